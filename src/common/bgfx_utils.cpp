@@ -16,10 +16,15 @@ namespace stl = tinystl;
 #include <bx/math.h>
 #include <bx/readerwriter.h>
 #include <bx/string.h>
+#include <bx/timer.h>
 #include "entry/entry.h"
-#include <meshoptimizer/src/meshoptimizer.h>
 
 #include "bgfx_utils.h"
+#include "gpu_ledger.h"
+#include "job_system.h"
+#include "mesh_decode.h"
+#include "png_r16.h"
+#include "tracking_allocator.h"
 
 #include <bimg/decode.h>
 
@@ -189,8 +194,9 @@ bgfx::TextureHandle loadTexture(bx::FileReaderI* _reader, const char* _filePath,
 
 			if (imageContainer->m_cubeMap)
 			{
-				handle = bgfx::createTextureCube(
-					  uint16_t(imageContainer->m_width)
+				handle = gpuCreateTextureCube(
+					  "texture"
+					, uint16_t(imageContainer->m_width)
 					, 1 < imageContainer->m_numMips
 					, imageContainer->m_numLayers
 					, bgfx::TextureFormat::Enum(imageContainer->m_format)
@@ -200,8 +206,9 @@ bgfx::TextureHandle loadTexture(bx::FileReaderI* _reader, const char* _filePath,
 			}
 			else if (1 < imageContainer->m_depth)
 			{
-				handle = bgfx::createTexture3D(
-					  uint16_t(imageContainer->m_width)
+				handle = gpuCreateTexture3D(
+					  "texture"
+					, uint16_t(imageContainer->m_width)
 					, uint16_t(imageContainer->m_height)
 					, uint16_t(imageContainer->m_depth)
 					, 1 < imageContainer->m_numMips
@@ -212,8 +219,9 @@ bgfx::TextureHandle loadTexture(bx::FileReaderI* _reader, const char* _filePath,
 			}
 			else if (bgfx::isTextureValid(0, false, imageContainer->m_numLayers, bgfx::TextureFormat::Enum(imageContainer->m_format), _flags) )
 			{
-				handle = bgfx::createTexture2D(
-					  uint16_t(imageContainer->m_width)
+				handle = gpuCreateTexture2D(
+					  "texture"
+					, uint16_t(imageContainer->m_width)
 					, uint16_t(imageContainer->m_height)
 					, 1 < imageContainer->m_numMips
 					, imageContainer->m_numLayers
@@ -254,10 +262,87 @@ bgfx::TextureHandle loadTexture(const char* _name, uint64_t _flags, uint8_t _ski
 
 bimg::ImageContainer* imageLoad(const char* _filePath, bgfx::TextureFormat::Enum _dstFormat)
 {
+	return imageLoad(entry::getFileReader(), _filePath, _dstFormat);
+}
+
+static float msSince(int64_t _start)
+{
+	return float(double(bx::getHPCounter() - _start)*1000.0/double(bx::getHPFrequency() ) );
+}
+
+bimg::ImageContainer* imageLoad(bx::FileReaderI* _reader, const char* _filePath, bgfx::TextureFormat::Enum _dstFormat, ImageLoadTimes* _times)
+{
+	bx::AllocatorI* allocator = entry::getAllocator();
+	ImageLoadTimes times = { 0.0f, 0.0f, 0.0f };
+
+	int64_t start = bx::getHPCounter();
 	uint32_t size = 0;
-	void* data = loadMem(entry::getFileReader(), entry::getAllocator(), _filePath, &size);
+	void* data = loadMem(_reader, allocator, _filePath, &size);
+	times.m_readMs = msSince(start);
+	start = bx::getHPCounter();
+
+	bimg::ImageContainer* imageContainer = NULL;
+
+	// 16-bit grayscale PNG heightmaps decode straight to R16, skipping
+	// bimg's decode to an intermediate format and conversion.
+	uint32_t width  = 0;
+	uint32_t height = 0;
+	if (bgfx::TextureFormat::R16 == _dstFormat
+	&&  pngR16Probe(data, size, &width, &height)
+	&&  width  <= UINT16_MAX
+	&&  height <= UINT16_MAX)
+	{
+		imageContainer = bimg::imageAlloc(
+			  allocator
+			, bimg::TextureFormat::R16
+			, uint16_t(width)
+			, uint16_t(height)
+			, 1
+			, 1
+			, false
+			, false
+			);
+
+		if (!pngR16Decode(allocator, data, size, (uint16_t*)imageContainer->m_data) )
+		{
+			DBG("Fast R16 PNG decode failed, falling back to bimg: %s.", _filePath);
+			bimg::imageFree(imageContainer);
+			imageContainer = NULL;
+		}
+	}
+
+	// Parsed and converted apart, as imageParse() would, to time both.
+	if (NULL == imageContainer)
+	{
+		imageContainer = bimg::imageParse(allocator, data, size);
+		times.m_decodeMs = msSince(start);
 
-	return bimg::imageParse(entry::getAllocator(), data, size, bimg::TextureFormat::Enum(_dstFormat) );
+		if (NULL != imageContainer
+		&&  bgfx::TextureFormat::Count != _dstFormat
+		&&  bimg::TextureFormat::Enum(_dstFormat) != imageContainer->m_format)
+		{
+			start = bx::getHPCounter();
+			bimg::ImageContainer* converted = bimg::imageConvert(allocator, bimg::TextureFormat::Enum(_dstFormat), *imageContainer);
+			bimg::imageFree(imageContainer);
+			imageContainer = converted;
+			times.m_convertMs = msSince(start);
+		}
+	}
+	else
+	{
+		times.m_decodeMs = msSince(start);
+	}
+
+	BX_FREE(allocator, data);
+
+	if (NULL != _times)
+	{
+		_times->m_readMs    += times.m_readMs;
+		_times->m_decodeMs  += times.m_decodeMs;
+		_times->m_convertMs += times.m_convertMs;
+	}
+
+	return imageContainer;
 }
 
 void calcTangents(void* _vertices, uint16_t _numVertices, bgfx::VertexLayout _layout, const uint16_t* _indices, uint32_t _numIndices)
@@ -378,6 +463,17 @@ namespace bgfx
 	int32_t read(bx::ReaderI* _reader, bgfx::VertexLayout& _layout, bx::Error* _err);
 }
 
+/// Where a compressed buffer of one group goes, once the whole file is
+/// read and decoded.
+struct MeshDecodeTarget
+{
+	const bgfx::Memory* m_mem;
+	uint32_t m_group;
+};
+
+typedef stl::vector<MeshDecode> MeshDecodeArray;
+typedef stl::vector<MeshDecodeTarget> MeshDecodeTargetArray;
+
 void Mesh::load(bx::ReaderSeekerI* _reader, bool _ramcopy)
 {
 	constexpr uint32_t kChunkVertexBuffer           = BX_MAKEFOURCC('V', 'B', ' ', 0x1);
@@ -389,7 +485,11 @@ void Mesh::load(bx::ReaderSeekerI* _reader, bool _ramcopy)
 	using namespace bx;
 	using namespace bgfx;
 
+	MEMORY_TAG_SCOPE("mesh");
+
 	Group group;
+	MeshDecodeArray decodes;
+	MeshDecodeTargetArray targets;
 
 	bx::AllocatorI* allocator = entry::getAllocator();
 
@@ -420,7 +520,7 @@ void Mesh::load(bx::ReaderSeekerI* _reader, bool _ramcopy)
 					bx::memCopy(group.m_vertices, mem->data, mem->size);
 				}
 
-				group.m_vbh = bgfx::createVertexBuffer(mem, m_layout);
+				group.m_vbh = gpuCreateVertexBuffer("mesh", mem, m_layout);
 			}
 				break;
 
@@ -438,23 +538,20 @@ void Mesh::load(bx::ReaderSeekerI* _reader, bool _ramcopy)
 
 				const bgfx::Memory* mem = bgfx::alloc(group.m_numVertices*stride);
 
-				uint32_t compressedSize;
-				bx::read(_reader, compressedSize, &err);
-
-				void* compressedVertices = BX_ALLOC(allocator, compressedSize);
-				bx::read(_reader, compressedVertices, compressedSize, &err);
-
-				meshopt_decodeVertexBuffer(mem->data, group.m_numVertices, stride, (uint8_t*)compressedVertices, compressedSize);
+				MeshDecode decode;
+				decode.m_dst    = mem->data;
+				decode.m_count  = group.m_numVertices;
+				decode.m_stride = stride;
+				decode.m_index  = false;
+				bx::read(_reader, decode.m_compressedSize, &err);
 
-				BX_FREE(allocator, compressedVertices);
+				void* compressed = BX_ALLOC(allocator, decode.m_compressedSize);
+				bx::read(_reader, compressed, decode.m_compressedSize, &err);
+				decode.m_compressed = compressed;
 
-				if (_ramcopy)
-				{
-					group.m_vertices = (uint8_t*)BX_ALLOC(allocator, group.m_numVertices*stride);
-					bx::memCopy(group.m_vertices, mem->data, mem->size);
-				}
-
-				group.m_vbh = bgfx::createVertexBuffer(mem, m_layout);
+				const MeshDecodeTarget target = { mem, uint32_t(m_groups.size() ) };
+				decodes.push_back(decode);
+				targets.push_back(target);
 			}
 				break;
 
@@ -471,7 +568,7 @@ void Mesh::load(bx::ReaderSeekerI* _reader, bool _ramcopy)
 					bx::memCopy(group.m_indices, mem->data, mem->size);
 				}
 
-				group.m_ibh = bgfx::createIndexBuffer(mem);
+				group.m_ibh = gpuCreateIndexBuffer("mesh", mem);
 			}
 				break;
 
@@ -481,24 +578,20 @@ void Mesh::load(bx::ReaderSeekerI* _reader, bool _ramcopy)
 
 				const bgfx::Memory* mem = bgfx::alloc(group.m_numIndices*2);
 
-				uint32_t compressedSize;
-				bx::read(_reader, compressedSize, &err);
-
-				void* compressedIndices = BX_ALLOC(allocator, compressedSize);
-
-				bx::read(_reader, compressedIndices, compressedSize, &err);
+				MeshDecode decode;
+				decode.m_dst    = mem->data;
+				decode.m_count  = group.m_numIndices;
+				decode.m_stride = 2;
+				decode.m_index  = true;
+				bx::read(_reader, decode.m_compressedSize, &err);
 
-				meshopt_decodeIndexBuffer(mem->data, group.m_numIndices, 2, (uint8_t*)compressedIndices, compressedSize);
+				void* compressed = BX_ALLOC(allocator, decode.m_compressedSize);
+				bx::read(_reader, compressed, decode.m_compressedSize, &err);
+				decode.m_compressed = compressed;
 
-				BX_FREE(allocator, compressedIndices);
-
-				if (_ramcopy)
-				{
-					group.m_indices = (uint16_t*)BX_ALLOC(allocator, group.m_numIndices*2);
-					bx::memCopy(group.m_indices, mem->data, mem->size);
-				}
-
-				group.m_ibh = bgfx::createIndexBuffer(mem);
+				const MeshDecodeTarget target = { mem, uint32_t(m_groups.size() ) };
+				decodes.push_back(decode);
+				targets.push_back(target);
 			}
 				break;
 
@@ -544,6 +637,55 @@ void Mesh::load(bx::ReaderSeekerI* _reader, bool _ramcopy)
 				break;
 		}
 	}
+
+	// Groups decode independently, one job each. Buffers are created here,
+	// on the calling thread, once their contents are final.
+	const uint32_t numDecodes = uint32_t(decodes.size() );
+	meshDecode(decodes.data(), numDecodes);
+
+	for (uint32_t ii = 0; ii < numDecodes; ++ii)
+	{
+		const MeshDecode& decode = decodes[ii];
+		const MeshDecodeTarget& target = targets[ii];
+		BX_FREE(allocator, const_cast<void*>(decode.m_compressed) );
+
+		if (target.m_group >= m_groups.size() )
+		{
+			// No primitive chunk followed, nothing keeps the buffer. Creating
+			// it still hands the memory back to bgfx.
+			if (decode.m_index)
+			{
+				bgfx::destroy(bgfx::createIndexBuffer(target.m_mem) );
+			}
+			else
+			{
+				bgfx::destroy(bgfx::createVertexBuffer(target.m_mem, m_layout) );
+			}
+			continue;
+		}
+
+		Group& dst = m_groups[target.m_group];
+		if (decode.m_index)
+		{
+			if (_ramcopy)
+			{
+				dst.m_indices = (uint16_t*)BX_ALLOC(allocator, target.m_mem->size);
+				bx::memCopy(dst.m_indices, target.m_mem->data, target.m_mem->size);
+			}
+
+			dst.m_ibh = gpuCreateIndexBuffer("mesh", target.m_mem);
+		}
+		else
+		{
+			if (_ramcopy)
+			{
+				dst.m_vertices = (uint8_t*)BX_ALLOC(allocator, target.m_mem->size);
+				bx::memCopy(dst.m_vertices, target.m_mem->data, target.m_mem->size);
+			}
+
+			dst.m_vbh = gpuCreateVertexBuffer("mesh", target.m_mem, m_layout);
+		}
+	}
 }
 
 void Mesh::unload()
@@ -553,11 +695,11 @@ void Mesh::unload()
 	for (GroupArray::const_iterator it = m_groups.begin(), itEnd = m_groups.end(); it != itEnd; ++it)
 	{
 		const Group& group = *it;
-		bgfx::destroy(group.m_vbh);
+		gpuDestroy(group.m_vbh);
 
 		if (bgfx::isValid(group.m_ibh) )
 		{
-			bgfx::destroy(group.m_ibh);
+			gpuDestroy(group.m_ibh);
 		}
 
 		if (NULL != group.m_vertices)
@@ -8,6 +8,7 @@
 
 #include <bx/bounds.h>
 #include <bx/pixelformat.h>
+#include <bx/readerwriter.h>
 #include <bx/string.h>
 #include <bgfx/bgfx.h>
 #include <bimg/bimg.h>
@@ -29,12 +30,27 @@ bgfx::ShaderHandle loadShader(const char* _name);
 ///
 bgfx::ProgramHandle loadProgram(const char* _vsName, const char* _fsName);
 
+/// Accounted in the GPU ledger, release with gpuDestroy().
 ///
 bgfx::TextureHandle loadTexture(const char* _name, uint64_t _flags = BGFX_TEXTURE_NONE|BGFX_SAMPLER_NONE, uint8_t _skip = 0, bgfx::TextureInfo* _info = NULL, bimg::Orientation::Enum* _orientation = NULL);
 
+/// Where imageLoad() spent its time, in milliseconds.
+///
+struct ImageLoadTimes
+{
+	float m_readMs;
+	float m_decodeMs;
+	float m_convertMs; //!< To the format asked for, 0 when decoded straight to it.
+};
+
 ///
 bimg::ImageContainer* imageLoad(const char* _filePath, bgfx::TextureFormat::Enum _dstFormat);
 
+/// Same as above with an explicit reader, for loads off the main thread.
+/// Pass bgfx::TextureFormat::Count to keep the decoded format. _times,
+/// when not NULL, is added to.
+bimg::ImageContainer* imageLoad(bx::FileReaderI* _reader, const char* _filePath, bgfx::TextureFormat::Enum _dstFormat, ImageLoadTimes* _times = NULL);
+
 ///
 void calcTangents(void* _vertices, uint16_t _numVertices, bgfx::VertexLayout _layout, const uint16_t* _indices, uint32_t _numIndices);
 
@@ -238,6 +238,25 @@ struct Camera
 			setKeyState(CAMERA_KEY_DOWN, false);
 		}
 
+		updateView();
+	}
+
+	void updateView()
+	{
+		const bx::Vec3 direction =
+		{
+			bx::cos(m_verticalAngle) * bx::sin(m_horizontalAngle),
+			bx::sin(m_verticalAngle),
+			bx::cos(m_verticalAngle) * bx::cos(m_horizontalAngle),
+		};
+
+		const bx::Vec3 right =
+		{
+			bx::sin(m_horizontalAngle - bx::kPiHalf),
+			0.0f,
+			bx::cos(m_horizontalAngle - bx::kPiHalf),
+		};
+
 		m_at = bx::add(m_eye, direction);
 		m_up = bx::cross(right, direction);
 	}
@@ -327,7 +346,22 @@ bx::Vec3 cameraGetAt()
 	return s_camera->m_at;
 }
 
+float cameraGetHorizontalAngle()
+{
+	return s_camera->m_horizontalAngle;
+}
+
+float cameraGetVerticalAngle()
+{
+	return s_camera->m_verticalAngle;
+}
+
 void cameraUpdate(float _deltaTime, const entry::MouseState& _mouseState, bool _reset)
 {
 	s_camera->update(_deltaTime, _mouseState, _reset);
 }
+
+void cameraUpdateView()
+{
+	s_camera->updateView();
+}
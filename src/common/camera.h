@@ -42,7 +42,17 @@ bx::Vec3 cameraGetPosition();
 ///
 bx::Vec3 cameraGetAt();
 
+///
+float cameraGetHorizontalAngle();
+
+///
+float cameraGetVerticalAngle();
+
 ///
 void cameraUpdate(float _deltaTime, const entry::MouseState& _mouseState, bool _reset = false);
 
+/// Updates the view from the position and angles alone, no input is read.
+///
+void cameraUpdateView();
+
 #endif // CAMERA_H_HEADER_GUARD
@@ -0,0 +1,147 @@
+#include "camera_path.h"
+#include "camera.h"
+
+#include <bx/file.h>
+
+namespace
+{
+	constexpr uint32_t kMagic   = BX_MAKEFOURCC('C', 'P', 'T', 'H');
+	constexpr uint32_t kVersion = 1;
+
+	struct Header
+	{
+		uint32_t m_magic;
+		uint32_t m_version;
+		uint32_t m_frameSize;
+		uint32_t m_numFrames;
+	};
+
+	static_assert(sizeof(CameraFrame) == 24, "");
+
+} // namespace
+
+CameraPath::CameraPath(bx::AllocatorI* _allocator)
+	: m_allocator(_allocator)
+	, m_frames(NULL)
+	, m_numFrames(0)
+	, m_capacity(0)
+{
+}
+
+CameraPath::~CameraPath()
+{
+	BX_FREE(m_allocator, m_frames);
+}
+
+void CameraPath::clear()
+{
+	m_numFrames = 0;
+}
+
+void CameraPath::push(const CameraFrame& _frame)
+{
+	if (m_numFrames == m_capacity)
+	{
+		m_capacity = bx::max<uint32_t>(m_capacity*2, 1024);
+		m_frames   = (CameraFrame*)BX_REALLOC(m_allocator, m_frames, m_capacity*sizeof(CameraFrame) );
+	}
+
+	m_frames[m_numFrames++] = _frame;
+}
+
+float CameraPath::getDuration() const
+{
+	float duration = 0.0f;
+	for (uint32_t ii = 0; ii < m_numFrames; ++ii)
+	{
+		duration += m_frames[ii].m_deltaTime;
+	}
+
+	return duration;
+}
+
+bool CameraPath::save(const char* _filePath) const
+{
+	bx::FileWriter writer;
+	bx::Error err;
+	if (!bx::open(&writer, _filePath, false, &err) )
+	{
+		return false;
+	}
+
+	Header header;
+	header.m_magic     = kMagic;
+	header.m_version   = kVersion;
+	header.m_frameSize = sizeof(CameraFrame);
+	header.m_numFrames = m_numFrames;
+	bx::write(&writer, &header, int32_t(sizeof(header) ), &err);
+	bx::write(&writer, m_frames, int32_t(m_numFrames*sizeof(CameraFrame) ), &err);
+	bx::close(&writer);
+
+	return err.isOk();
+}
+
+bool CameraPath::load(const char* _filePath)
+{
+	clear();
+
+	bx::FileReader reader;
+	if (!bx::open(&reader, _filePath) )
+	{
+		return false;
+	}
+
+	Header header;
+	bx::Error err;
+	const bool valid = true
+		&& int32_t(sizeof(header) ) == bx::read(&reader, &header, int32_t(sizeof(header) ), &err)
+		&& kMagic   == header.m_magic
+		&& kVersion == header.m_version
+		&& sizeof(CameraFrame) == header.m_frameSize
+		;
+
+	// The frame count comes from the file, it must not ask for more frames
+	// than follow the header, nor more bytes than one read takes.
+	const uint64_t size = uint64_t(header.m_numFrames)*sizeof(CameraFrame);
+	const int64_t  remaining = bx::getSize(&reader) - int64_t(sizeof(header) );
+
+	if (valid
+	&&  0 < header.m_numFrames
+	&&  int64_t(size) <= remaining
+	&&  INT32_MAX >= size)
+	{
+		m_capacity = bx::max(m_capacity, header.m_numFrames);
+		m_frames   = (CameraFrame*)BX_REALLOC(m_allocator, m_frames, m_capacity*sizeof(CameraFrame) );
+
+		if (int32_t(size) == bx::read(&reader, m_frames, int32_t(size), &err)
+		&&  err.isOk() )
+		{
+			m_numFrames = header.m_numFrames;
+		}
+	}
+
+	bx::close(&reader);
+	return 0 < m_numFrames;
+}
+
+CameraFrame cameraCaptureFrame(float _deltaTime)
+{
+	const bx::Vec3 pos = cameraGetPosition();
+
+	CameraFrame frame;
+	frame.m_pos[0] = pos.x;
+	frame.m_pos[1] = pos.y;
+	frame.m_pos[2] = pos.z;
+	frame.m_horizontalAngle = cameraGetHorizontalAngle();
+	frame.m_verticalAngle   = cameraGetVerticalAngle();
+	frame.m_deltaTime       = _deltaTime;
+	return frame;
+}
+
+void cameraApplyFrame(const CameraFrame& _frame)
+{
+	cameraSetPosition({ _frame.m_pos[0], _frame.m_pos[1], _frame.m_pos[2] });
+	cameraSetHorizontalAngle(_frame.m_horizontalAngle);
+	cameraSetVerticalAngle(_frame.m_verticalAngle);
+	cameraUpdateView();
+}
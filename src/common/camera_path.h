@@ -0,0 +1,67 @@
+#ifndef CAMERA_PATH_H_HEADER_GUARD
+#define CAMERA_PATH_H_HEADER_GUARD
+
+#include <bx/allocator.h>
+
+/// One frame of a camera flight, the camera as it was after the frame's
+/// update and the frame time it was updated with.
+///
+struct CameraFrame
+{
+	float m_pos[3];
+	float m_horizontalAngle;
+	float m_verticalAngle;
+	float m_deltaTime;
+};
+
+/// Camera flight recorded frame by frame, for replaying the same path
+/// through two builds. The file is a small header followed by the frames
+/// as they are in memory, 24 bytes each, little endian.
+///
+class CameraPath
+{
+public:
+	///
+	CameraPath(bx::AllocatorI* _allocator);
+
+	///
+	~CameraPath();
+
+	///
+	void clear();
+
+	///
+	void push(const CameraFrame& _frame);
+
+	///
+	uint32_t getNumFrames() const { return m_numFrames; }
+
+	///
+	const CameraFrame& getFrame(uint32_t _index) const { return m_frames[_index]; }
+
+	/// Sum of the frame times.
+	float getDuration() const;
+
+	///
+	bool save(const char* _filePath) const;
+
+	/// Replaces the frames, false when the file holds none.
+	bool load(const char* _filePath);
+
+private:
+	bx::AllocatorI* m_allocator;
+	CameraFrame* m_frames;
+	uint32_t m_numFrames;
+	uint32_t m_capacity;
+};
+
+/// The camera now, as updated with _deltaTime.
+///
+CameraFrame cameraCaptureFrame(float _deltaTime);
+
+/// Puts the camera where _frame has it and updates its view from there
+/// without input, so neither mouse nor keys steer it.
+///
+void cameraApplyFrame(const CameraFrame& _frame);
+
+#endif // CAMERA_PATH_H_HEADER_GUARD
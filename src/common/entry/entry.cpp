@@ -17,6 +17,7 @@
 #include "entry_p.h"
 #include "cmd.h"
 #include "input.h"
+#include "../tracking_allocator.h"
 
 #include "heightmap/heightmap_app.h"
 namespace entry
@@ -69,17 +70,38 @@ namespace entry
 	}
 
 #if ENTRY_CONFIG_IMPLEMENT_DEFAULT_ALLOCATOR
+	static TrackingAllocator* createTrackingAllocator()
+	{
+		static bx::DefaultAllocator s_system;
+		static TrackingAllocator s_tracking(&s_system);
+		return &s_tracking;
+	}
+
 	bx::AllocatorI* getDefaultAllocator()
 	{
-BX_PRAGMA_DIAGNOSTIC_PUSH();
-BX_PRAGMA_DIAGNOSTIC_IGNORED_MSVC(4459); // warning C4459: declaration of 's_allocator' hides global declaration
-BX_PRAGMA_DIAGNOSTIC_IGNORED_CLANG_GCC("-Wshadow");
-		static bx::DefaultAllocator s_allocator;
-		return &s_allocator;
-BX_PRAGMA_DIAGNOSTIC_POP();
+		return createTrackingAllocator();
+	}
+
+	TrackingAllocator* getTrackingAllocator()
+	{
+		return createTrackingAllocator();
+	}
+#else
+	TrackingAllocator* getTrackingAllocator()
+	{
+		return NULL;
 	}
 #endif // ENTRY_CONFIG_IMPLEMENT_DEFAULT_ALLOCATOR
 
+	uint32_t getNumAllocations()
+	{
+		const TrackingAllocator* allocator = getTrackingAllocator();
+		return NULL != allocator
+			? uint32_t(allocator->getTotal().m_allocations)
+			: 0
+			;
+	}
+
 	static const char* s_keyName[] =
 	{
 		"None",
@@ -998,6 +1020,16 @@ restart:
 		return s_fileWriter;
 	}
 
+	bx::FileReaderI* createFileReader()
+	{
+		return BX_NEW(g_allocator, FileReader);
+	}
+
+	void destroyFileReader(bx::FileReaderI* _reader)
+	{
+		BX_DELETE(g_allocator, _reader);
+	}
+
 	bx::AllocatorI* getAllocator()
 	{
 		if (NULL == g_allocator)
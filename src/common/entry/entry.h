@@ -12,6 +12,7 @@
 #include <bx/string.h>
 
 namespace bx { struct FileReaderI; struct FileWriterI; struct AllocatorI; }
+class TrackingAllocator;
 
 #define ENTRY_WINDOW_FLAG_NONE         UINT32_C(0x00000000)
 #define ENTRY_WINDOW_FLAG_ASPECT_RATIO UINT32_C(0x00000001)
@@ -250,9 +251,23 @@ namespace entry
     ///
     bx::FileWriterI* getFileWriter();
 
+    /// A reader that resolves paths like getFileReader() does, for a thread
+    /// other than the main thread. Free it with destroyFileReader().
+    bx::FileReaderI* createFileReader();
+
+    ///
+    void destroyFileReader(bx::FileReaderI* _reader);
+
     ///
     bx::AllocatorI*  getAllocator();
 
+    /// The default allocator, NULL when the application provides its own.
+    TrackingAllocator* getTrackingAllocator();
+
+    /// Allocations and reallocations made through the default allocator so
+    /// far, 0 when the application provides its own.
+    uint32_t getNumAllocations();
+
     ///
     WindowHandle createWindow(int32_t _x, int32_t _y, uint32_t _width, uint32_t _height, uint32_t _flags = ENTRY_WINDOW_FLAG_NONE, const char* _title = "");
 
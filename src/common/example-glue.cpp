@@ -7,60 +7,148 @@
 #include "entry/entry.h"
 #include "entry/cmd.h"
 #include "entry/dialog.h"
+#include "rolling_stats.h"
+#include <bx/file.h>
 #include <bx/string.h>
 #include <bx/timer.h>
 #include <bx/math.h>
 
-struct SampleData
+static constexpr uint32_t kPlotSamples  = 100;
+static constexpr uint32_t kMaxViewTimes = 16;
+
+struct ViewTimes
 {
-	static constexpr uint32_t kNumSamples = 100;
+	bgfx::ViewId m_view;
+	char         m_name[64];
+	RollingStats m_cpu;
+	RollingStats m_gpu;
+};
 
-	SampleData()
+static RollingStats s_frameTime;
+static RollingStats s_submitTime;
+static RollingStats s_gpuTime;
+static ViewTimes    s_viewTimes[kMaxViewTimes];
+static uint32_t     s_numViewTimes = 0;
+static int32_t      s_statsWindow  = 300;
+
+static void pushFrameStats(const bgfx::Stats* _stats)
+{
+	const double toMsCpu = 1000.0/double(_stats->cpuTimerFreq);
+	s_frameTime.push(float(double(_stats->cpuTimeFrame)*toMsCpu) );
+	s_submitTime.push(float(double(_stats->cpuTimeEnd - _stats->cpuTimeBegin)*toMsCpu) );
+
+	// Renderers without timer queries report no GPU frequency.
+	const bool hasGpuTimer = 0 != _stats->gpuTimerFreq;
+	const double toMsGpu = hasGpuTimer ? 1000.0/double(_stats->gpuTimerFreq) : 0.0;
+	if (hasGpuTimer)
 	{
-		reset();
+		s_gpuTime.push(float(double(_stats->gpuTimeEnd - _stats->gpuTimeBegin)*toMsGpu) );
 	}
 
-	void reset()
+	for (uint16_t ii = 0; ii < _stats->numViews; ++ii)
 	{
-		m_offset = 0;
-		bx::memSet(m_values, 0, sizeof(m_values) );
+		const bgfx::ViewStats& viewStats = _stats->viewStats[ii];
 
-		m_min = 0.0f;
-		m_max = 0.0f;
-		m_avg = 0.0f;
-	}
+		uint32_t slot = 0;
+		while (slot < s_numViewTimes
+		&&     s_viewTimes[slot].m_view != viewStats.view)
+		{
+			++slot;
+		}
 
-	void pushSample(float value)
-	{
-		m_values[m_offset] = value;
-		m_offset = (m_offset+1) % kNumSamples;
+		if (slot == s_numViewTimes)
+		{
+			if (kMaxViewTimes == s_numViewTimes)
+			{
+				continue;
+			}
 
-		float min = bx::max<float>();
-		float max = bx::min<float>();
-		float avg = 0.0f;
+			ViewTimes& times = s_viewTimes[s_numViewTimes++];
+			times.m_view = viewStats.view;
+			times.m_cpu.reset();
+			times.m_gpu.reset();
+			times.m_cpu.setWindow(uint32_t(s_statsWindow) );
+			times.m_gpu.setWindow(uint32_t(s_statsWindow) );
+		}
 
-		for (uint32_t ii = 0; ii < kNumSamples; ++ii)
+		ViewTimes& times = s_viewTimes[slot];
+		bx::strCopy(times.m_name, BX_COUNTOF(times.m_name), viewStats.name);
+		times.m_cpu.push(float(double(viewStats.cpuTimeEnd - viewStats.cpuTimeBegin)*toMsCpu) );
+		if (hasGpuTimer)
 		{
-			const float val = m_values[ii];
-			min  = bx::min(min, val);
-			max  = bx::max(max, val);
-			avg += val;
+			times.m_gpu.push(float(double(viewStats.gpuTimeEnd - viewStats.gpuTimeBegin)*toMsGpu) );
 		}
+	}
+}
 
-		m_min = min;
-		m_max = max;
-		m_avg = avg / kNumSamples;
+static void setStatsWindow(uint32_t _window)
+{
+	s_frameTime.setWindow(_window);
+	s_submitTime.setWindow(_window);
+	s_gpuTime.setWindow(_window);
+	for (uint32_t ii = 0; ii < s_numViewTimes; ++ii)
+	{
+		s_viewTimes[ii].m_cpu.setWindow(_window);
+		s_viewTimes[ii].m_gpu.setWindow(_window);
 	}
+}
 
-	int32_t m_offset;
-	float m_values[kNumSamples];
+static float getPlotSample(void* _data, int32_t _idx)
+{
+	const RollingStats* stats = (const RollingStats*)_data;
+	return stats->getSample(kPlotSamples - 1 - uint32_t(_idx) );
+}
 
-	float m_min;
-	float m_max;
-	float m_avg;
-};
+static void writeString(bx::WriterI* _writer, const char* _str, bx::Error* _err)
+{
+	bx::write(_writer, _str, bx::strLen(_str), _err);
+}
 
-static SampleData s_frameTime;
+bool writeFrameStats(const char* _filePath)
+{
+	bx::FileWriter writer;
+	bx::Error err;
+	if (!bx::open(&writer, _filePath, false, &err) )
+	{
+		return false;
+	}
+
+	writeString(&writer, "{\n\t\"frame\": ", &err);
+	s_frameTime.writeJson(&writer, &err);
+	writeString(&writer, ",\n\t\"submit\": ", &err);
+	s_submitTime.writeJson(&writer, &err);
+	writeString(&writer, ",\n\t\"gpu\": ", &err);
+	s_gpuTime.writeJson(&writer, &err);
+	writeString(&writer, ",\n\t\"views\": [", &err);
+
+	for (uint32_t ii = 0; ii < s_numViewTimes; ++ii)
+	{
+		const ViewTimes& times = s_viewTimes[ii];
+
+		char name[BX_COUNTOF(times.m_name)];
+		bx::strCopy(name, BX_COUNTOF(name), times.m_name);
+		for (char* ch = name; '\0' != *ch; ++ch)
+		{
+			*ch = '\\' == *ch || '"' == *ch ? '/' : *ch;
+		}
+
+		char temp[128];
+		bx::snprintf(temp, BX_COUNTOF(temp), "%s\n\t\t{ \"view\": %u, \"name\": \"%s\", \"cpu\": "
+			, 0 == ii ? "" : ","
+			, times.m_view
+			, name
+			);
+		writeString(&writer, temp, &err);
+		times.m_cpu.writeJson(&writer, &err);
+		writeString(&writer, ", \"gpu\": ", &err);
+		times.m_gpu.writeJson(&writer, &err);
+		writeString(&writer, " }", &err);
+	}
+
+	writeString(&writer, "\n\t]\n}\n", &err);
+	bx::close(&writer);
+	return err.isOk();
+}
 
 static bool bar(float _width, float _maxWidth, float _height, const ImVec4& _color)
 {
@@ -293,27 +381,27 @@ void showExampleDialog(entry::AppI* _app, const char* _errorText)
 #endif // 0
 
 	const bgfx::Stats* stats = bgfx::getStats();
-	const double toMsCpu = 1000.0/stats->cpuTimerFreq;
-	const double toMsGpu = 1000.0/stats->gpuTimerFreq;
-	const double frameMs = double(stats->cpuTimeFrame)*toMsCpu;
+	pushFrameStats(stats);
 
-	s_frameTime.pushSample(float(frameMs) );
+	const RollingStats::Summary frame = s_frameTime.getSummary();
+	const RollingStats::Summary gpu   = s_gpuTime.getSummary();
 
 	char frameTextOverlay[256];
 	bx::snprintf(frameTextOverlay, BX_COUNTOF(frameTextOverlay), "%s%.3fms, %s%.3fms\nAvg: %.3fms, %.1f FPS"
 		, ICON_FA_ARROW_DOWN
-		, s_frameTime.m_min
+		, frame.m_min
 		, ICON_FA_ARROW_UP
-		, s_frameTime.m_max
-		, s_frameTime.m_avg
-		, 1000.0f/s_frameTime.m_avg
+		, frame.m_max
+		, frame.m_mean
+		, 0.0f < frame.m_mean ? 1000.0f/frame.m_mean : 0.0f
 		);
 
 	ImGui::PushStyleColor(ImGuiCol_PlotHistogram, ImColor(0.0f, 0.5f, 0.15f, 1.0f).Value);
 	ImGui::PlotHistogram("Frame"
-		, s_frameTime.m_values
-		, SampleData::kNumSamples
-		, s_frameTime.m_offset
+		, getPlotSample
+		, &s_frameTime
+		, int32_t(kPlotSamples)
+		, 0
 		, frameTextOverlay
 		, 0.0f
 		, 60.0f
@@ -321,12 +409,24 @@ void showExampleDialog(entry::AppI* _app, const char* _errorText)
 		);
 	ImGui::PopStyleColor();
 
+	ImGui::Text("Frame p50 %0.3f, p95 %0.3f, p99 %0.3f"
+		, frame.m_p50
+		, frame.m_p95
+		, frame.m_p99
+		);
+
 	ImGui::Text("Submit CPU %0.3f, GPU %0.3f (L: %d)"
-		, double(stats->cpuTimeEnd - stats->cpuTimeBegin)*toMsCpu
-		, double(stats->gpuTimeEnd - stats->gpuTimeBegin)*toMsGpu
+		, s_submitTime.getSample(0)
+		, s_gpuTime.getSample(0)
 		, stats->maxGpuLatency
 		);
 
+	ImGui::Text("GPU p50 %0.3f, p95 %0.3f, p99 %0.3f"
+		, gpu.m_p50
+		, gpu.m_p95
+		, gpu.m_p99
+		);
+
 	if (-INT64_MAX != stats->gpuMemoryUsed)
 	{
 		char tmp0[64];
@@ -347,6 +447,16 @@ void showExampleDialog(entry::AppI* _app, const char* _errorText)
 
 		if (ImGui::Begin(ICON_FA_BAR_CHART " Stats", &s_showStats) )
 		{
+			if (ImGui::SliderInt("Window", &s_statsWindow, int32_t(kPlotSamples), int32_t(RollingStats::kCapacity) ) )
+			{
+				setStatsWindow(uint32_t(s_statsWindow) );
+			}
+
+			if (ImGui::Button("Write frame_stats.json") )
+			{
+				writeFrameStats("frame_stats.json");
+			}
+
 			if (ImGui::CollapsingHeader(ICON_FA_PUZZLE_PIECE " Resources") )
 			{
 				const bgfx::Caps* caps = bgfx::getCaps();
@@ -445,22 +555,36 @@ void showExampleDialog(entry::AppI* _app, const char* _errorText)
 
 									ImGui::SameLine(64.0f);
 
+									const ViewTimes* times = NULL;
+									for (uint32_t ii = 0; ii < s_numViewTimes; ++ii)
+									{
+										times = s_viewTimes[ii].m_view == viewStats.view ? &s_viewTimes[ii] : times;
+									}
+
 									if (bar(cpuWidth, maxWidth, itemHeight, cpuColor) )
 									{
-										ImGui::SetTooltip("View %d \"%s\", CPU: %f [ms]"
+										const RollingStats::Summary cpu = NULL != times ? times->m_cpu.getSummary() : RollingStats::Summary();
+										ImGui::SetTooltip("View %d \"%s\", CPU: %f [ms]\np50 %f, p95 %f, p99 %f [ms]"
 											, pos
 											, viewStats.name
 											, cpuTimeElapsed
+											, cpu.m_p50
+											, cpu.m_p95
+											, cpu.m_p99
 											);
 									}
 
 									ImGui::SameLine();
 									if (bar(gpuWidth, maxWidth, itemHeight, gpuColor) )
 									{
-										ImGui::SetTooltip("View: %d \"%s\", GPU: %f [ms]"
+										const RollingStats::Summary gpu = NULL != times ? times->m_gpu.getSummary() : RollingStats::Summary();
+										ImGui::SetTooltip("View: %d \"%s\", GPU: %f [ms]\np50 %f, p95 %f, p99 %f [ms]"
 											, pos
 											, viewStats.name
 											, gpuTimeElapsed
+											, gpu.m_p50
+											, gpu.m_p95
+											, gpu.m_p99
 											);
 									}
 								}
@@ -0,0 +1,28 @@
+#ifndef FORMAT_WRITER_H_HEADER_GUARD
+#define FORMAT_WRITER_H_HEADER_GUARD
+
+#include <bx/readerwriter.h>
+#include <bx/string.h>
+
+#include <stdarg.h>
+
+/// Formats into _writer like bx::writePrintf(), but reports write errors
+/// to _err, so a full disk fails the file being written. Output past 511
+/// characters is cut off.
+///
+inline void writef(bx::WriterI* _writer, bx::Error* _err, const char* _format, ...)
+{
+	char temp[512];
+
+	va_list argList;
+	va_start(argList, _format);
+	const int32_t len = bx::vsnprintf(temp, sizeof(temp), _format, argList);
+	va_end(argList);
+
+	if (0 < len)
+	{
+		bx::write(_writer, temp, bx::min(len, int32_t(sizeof(temp) ) - 1), _err);
+	}
+}
+
+#endif // FORMAT_WRITER_H_HEADER_GUARD
@@ -0,0 +1,274 @@
+#include "frame_allocator.h"
+#include "entry/entry.h"
+
+#include <bx/cpu.h>
+#include <bx/math.h>
+#include <bx/mutex.h>
+#include <bx/uint32_t.h>
+
+namespace
+{
+	constexpr uint32_t kMaxSlabs = 64;
+	constexpr size_t   kMinAlign = 16;
+
+	// In front of every allocation, for realloc() to know what to copy.
+	struct Header
+	{
+		size_t m_size;
+		size_t m_pad;
+	};
+
+	// In front of every overflow block, chaining it for the next reset.
+	struct Overflow
+	{
+		Overflow* m_next;
+		size_t    m_pad;
+	};
+
+	struct Slab
+	{
+		uint8_t*  m_data;
+		uint32_t  m_size;
+		uint32_t  m_used;
+		uint32_t  m_overflowBytes;
+		Overflow* m_overflow;
+	};
+
+	inline uintptr_t alignUp(uintptr_t _value, size_t _align)
+	{
+		return (_value + _align - 1) & ~uintptr_t(_align - 1);
+	}
+
+	struct FrameArena : public bx::AllocatorI
+	{
+		FrameArena(bx::AllocatorI* _backing, uint32_t _slabSize)
+			: m_backing(_backing)
+			, m_slabSize(_slabSize)
+			, m_numSlabs(0)
+			, m_allocations(0)
+			, m_overflows(0)
+			, m_bytes(0)
+		{
+			bx::memSet(m_slabs, 0, sizeof(m_slabs) );
+			bx::memSet(&m_shared, 0, sizeof(m_shared) );
+			bx::memSet(&m_last, 0, sizeof(m_last) );
+		}
+
+		virtual ~FrameArena()
+		{
+			release();
+			for (uint32_t ii = 0; ii < m_numSlabs; ++ii)
+			{
+				BX_FREE(m_backing, m_slabs[ii].m_data);
+			}
+		}
+
+		virtual void* realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line) override
+		{
+			BX_UNUSED(_file, _line);
+
+			// Freed at the next reset.
+			if (0 == _size)
+			{
+				return NULL;
+			}
+
+			void* ptr = alloc(_size, bx::max(_align, kMinAlign) );
+			if (NULL != _ptr)
+			{
+				const Header* header = (const Header*)_ptr - 1;
+				bx::memCopy(ptr, _ptr, bx::min(header->m_size, _size) );
+			}
+
+			return ptr;
+		}
+
+		void* alloc(size_t _size, size_t _align)
+		{
+			bx::atomicFetchAndAdd<uint32_t>(&m_allocations, 1);
+			bx::atomicFetchAndAdd<uint32_t>(&m_bytes, uint32_t(_size) );
+
+			Slab* slab = getThreadSlab();
+			if (NULL != slab)
+			{
+				const uintptr_t base = uintptr_t(slab->m_data);
+				const uintptr_t ptr  = alignUp(base + slab->m_used + sizeof(Header), _align);
+				if (ptr + _size <= base + slab->m_size)
+				{
+					slab->m_used = uint32_t(ptr + _size - base);
+					((Header*)ptr - 1)->m_size = _size;
+					return (void*)ptr;
+				}
+
+				return overflow(*slab, _size, _align);
+			}
+
+			bx::MutexScope lock(m_sharedMutex);
+			return overflow(m_shared, _size, _align);
+		}
+
+		void* overflow(Slab& _slab, size_t _size, size_t _align)
+		{
+			bx::atomicFetchAndAdd<uint32_t>(&m_overflows, 1);
+
+			const size_t total = sizeof(Overflow) + sizeof(Header) + _align + _size;
+			Overflow* block = (Overflow*)BX_ALLOC(m_backing, total);
+			block->m_next = _slab.m_overflow;
+			_slab.m_overflow = block;
+			_slab.m_overflowBytes += uint32_t(total);
+
+			const uintptr_t ptr = alignUp(uintptr_t(block + 1) + sizeof(Header), _align);
+			((Header*)ptr - 1)->m_size = _size;
+			return (void*)ptr;
+		}
+
+		// Slabs are handed out on a thread's first allocation and kept by
+		// index. The generation tells a slab from a previous init apart.
+		Slab* getThreadSlab()
+		{
+			static thread_local uint32_t t_slab       = UINT32_MAX;
+			static thread_local uint32_t t_generation = 0;
+
+			if (t_generation != s_generation)
+			{
+				t_generation = s_generation;
+				t_slab = bx::atomicFetchAndAdd<uint32_t>(&m_numSlabs, 1);
+				if (t_slab < kMaxSlabs)
+				{
+					m_slabs[t_slab].m_data = (uint8_t*)BX_ALLOC(m_backing, m_slabSize);
+					m_slabs[t_slab].m_size = m_slabSize;
+				}
+			}
+
+			return t_slab < kMaxSlabs ? &m_slabs[t_slab] : NULL;
+		}
+
+		void releaseOverflow(Slab& _slab)
+		{
+			for (Overflow* block = _slab.m_overflow; NULL != block;)
+			{
+				Overflow* next = block->m_next;
+				BX_FREE(m_backing, block);
+				block = next;
+			}
+
+			_slab.m_overflow = NULL;
+		}
+
+		void release()
+		{
+			const uint32_t numSlabs = bx::min(m_numSlabs, kMaxSlabs);
+			for (uint32_t ii = 0; ii < numSlabs; ++ii)
+			{
+				Slab& slab = m_slabs[ii];
+				releaseOverflow(slab);
+
+				// Grow to what the frame needed, next frame stays in the slab.
+				if (0 != slab.m_overflowBytes)
+				{
+					const uint32_t size = bx::uint32_nextpow2(slab.m_used + slab.m_overflowBytes);
+					BX_FREE(m_backing, slab.m_data);
+					slab.m_data = (uint8_t*)BX_ALLOC(m_backing, size);
+					slab.m_size = size;
+				}
+
+				slab.m_used = 0;
+				slab.m_overflowBytes = 0;
+			}
+
+			releaseOverflow(m_shared);
+			m_shared.m_overflowBytes = 0;
+		}
+
+		void reset()
+		{
+			release();
+
+			m_last.m_allocations = m_allocations;
+			m_last.m_overflows   = m_overflows;
+			m_last.m_bytes       = m_bytes;
+			m_last.m_numSlabs    = bx::min(m_numSlabs, kMaxSlabs);
+			m_last.m_capacity    = 0;
+			for (uint32_t ii = 0; ii < m_last.m_numSlabs; ++ii)
+			{
+				m_last.m_capacity += m_slabs[ii].m_size;
+			}
+
+			m_allocations = 0;
+			m_overflows   = 0;
+			m_bytes       = 0;
+		}
+
+		bx::AllocatorI* m_backing;
+		uint32_t m_slabSize;
+
+		Slab     m_slabs[kMaxSlabs];
+		uint32_t m_numSlabs;
+
+		// Threads past kMaxSlabs share this one, every block overflows.
+		bx::Mutex m_sharedMutex;
+		Slab      m_shared;
+
+		uint32_t m_allocations;
+		uint32_t m_overflows;
+		uint32_t m_bytes;
+		FrameAllocatorStats m_last;
+
+		static uint32_t s_generation;
+	};
+
+	uint32_t FrameArena::s_generation = 0;
+
+	static FrameArena* s_frameArena = NULL;
+
+} // namespace
+
+void frameAllocatorInit(bx::AllocatorI* _backing, uint32_t _slabSize)
+{
+	if (NULL != s_frameArena)
+	{
+		return;
+	}
+
+	++FrameArena::s_generation;
+	s_frameArena = BX_NEW(_backing, FrameArena)(_backing, _slabSize);
+}
+
+void frameAllocatorShutdown()
+{
+	if (NULL == s_frameArena)
+	{
+		return;
+	}
+
+	bx::AllocatorI* backing = s_frameArena->m_backing;
+	BX_DELETE(backing, s_frameArena);
+	s_frameArena = NULL;
+}
+
+bx::AllocatorI* getFrameAllocator()
+{
+	return NULL != s_frameArena
+		? s_frameArena
+		: entry::getAllocator()
+		;
+}
+
+void frameAllocatorReset()
+{
+	if (NULL != s_frameArena)
+	{
+		s_frameArena->reset();
+	}
+}
+
+FrameAllocatorStats frameAllocatorGetStats()
+{
+	if (NULL != s_frameArena)
+	{
+		return s_frameArena->m_last;
+	}
+
+	FrameAllocatorStats stats = {};
+	return stats;
+}
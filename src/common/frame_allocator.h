@@ -0,0 +1,47 @@
+#ifndef FRAME_ALLOCATOR_H_HEADER_GUARD
+#define FRAME_ALLOCATOR_H_HEADER_GUARD
+
+#include <bx/allocator.h>
+
+/// Bump allocator for memory that does not outlive the frame. Every thread
+/// allocating from it gets its own slab, so allocation takes no lock and
+/// frees are no-ops. Requests that do not fit a slab fall back to the
+/// backing allocator. Those blocks are also released at the next reset,
+/// and the slab grows to fit them from then on.
+///
+/// frameAllocatorReset() must run between frames, after bgfx::frame(),
+/// while no other thread allocates from the arena. Memory passed to bgfx
+/// by reference must not come from here.
+
+///
+struct FrameAllocatorStats
+{
+	uint32_t m_allocations; //!< Allocations served last frame.
+	uint32_t m_overflows;   //!< Of which fell back to the backing allocator.
+	uint32_t m_bytes;       //!< Bytes requested last frame.
+	uint32_t m_capacity;    //!< Bytes across all slabs.
+	uint32_t m_numSlabs;    //!< Threads that allocated so far.
+};
+
+/// @param[in] _backing Slabs and overflow blocks come from here.
+/// @param[in] _slabSize Initial size of each thread's slab.
+///
+void frameAllocatorInit(bx::AllocatorI* _backing, uint32_t _slabSize = 256<<10);
+
+///
+void frameAllocatorShutdown();
+
+/// Returns the frame arena, or entry::getAllocator() before
+/// frameAllocatorInit(), so callers may free what they allocate either way.
+///
+bx::AllocatorI* getFrameAllocator();
+
+/// Releases everything allocated since the last reset.
+///
+void frameAllocatorReset();
+
+/// Counts of the frame before the last reset.
+///
+FrameAllocatorStats frameAllocatorGetStats();
+
+#endif // FRAME_ALLOCATOR_H_HEADER_GUARD
@@ -0,0 +1,279 @@
+#include "gpu_ledger.h"
+
+#include <bx/string.h>
+
+#include <stdio.h>
+
+namespace
+{
+	constexpr uint32_t kMaxHandles = 4096;
+	constexpr uint32_t kMaxOwners  = 64;
+
+	// bgfx keeps one indirect draw in 32 bytes.
+	constexpr uint32_t kIndirectStride = 32;
+
+	struct Entry
+	{
+		uint32_t m_bytes;
+		uint16_t m_owner; // Index + 1, 0 when not live.
+	};
+
+	struct Ledger
+	{
+		Entry          m_entries[GpuResource::Count][kMaxHandles];
+		GpuLedgerStats m_owners[kMaxOwners];
+		GpuLedgerStats m_total;
+		uint32_t       m_numOwners;
+	};
+
+	static Ledger s_ledger;
+
+	static const char* s_typeName[] =
+	{
+		"texture",
+		"vertex buffer",
+		"index buffer",
+		"dynamic index buffer",
+		"indirect buffer",
+	};
+	static_assert(GpuResource::Count == BX_COUNTOF(s_typeName), "");
+
+	uint16_t findOwner(const char* _owner)
+	{
+		for (uint32_t ii = 0; ii < s_ledger.m_numOwners; ++ii)
+		{
+			const char* name = s_ledger.m_owners[ii].m_name;
+			if (name == _owner
+			||  0 == bx::strCmp(name, _owner) )
+			{
+				return uint16_t(ii + 1);
+			}
+		}
+
+		if (s_ledger.m_numOwners == kMaxOwners)
+		{
+			return 0;
+		}
+
+		GpuLedgerStats& owner = s_ledger.m_owners[s_ledger.m_numOwners++];
+		bx::memSet(&owner, 0, sizeof(owner) );
+		owner.m_name = _owner;
+		return uint16_t(s_ledger.m_numOwners);
+	}
+
+	void account(GpuLedgerStats& _stats, GpuResource::Enum _type, int64_t _bytes, int32_t _handles)
+	{
+		_stats.m_bytes += _bytes;
+		_stats.m_peak   = bx::max(_stats.m_peak, _stats.m_bytes);
+		_stats.m_handles[_type] += _handles;
+	}
+
+	void remove(GpuResource::Enum _type, uint16_t _idx)
+	{
+		if (_idx >= kMaxHandles)
+		{
+			return;
+		}
+
+		Entry& entry = s_ledger.m_entries[_type][_idx];
+		if (0 != entry.m_owner)
+		{
+			account(s_ledger.m_owners[entry.m_owner - 1], _type, -int64_t(entry.m_bytes), -1);
+			account(s_ledger.m_total, _type, -int64_t(entry.m_bytes), -1);
+			entry.m_owner = 0;
+		}
+	}
+
+	void add(GpuResource::Enum _type, uint16_t _idx, const char* _owner, uint32_t _bytes)
+	{
+		if (_idx >= kMaxHandles)
+		{
+			return;
+		}
+
+		// Still live: destroyed behind the ledger's back, its index reused.
+		remove(_type, _idx);
+
+		const uint16_t owner = findOwner(_owner);
+		if (0 == owner)
+		{
+			return;
+		}
+
+		Entry& entry = s_ledger.m_entries[_type][_idx];
+		entry.m_bytes = _bytes;
+		entry.m_owner = owner;
+		account(s_ledger.m_owners[owner - 1], _type, _bytes, 1);
+		account(s_ledger.m_total, _type, _bytes, 1);
+	}
+
+	uint32_t textureSize(uint16_t _width, uint16_t _height, uint16_t _depth, bool _cubeMap, bool _hasMips, uint16_t _numLayers, bgfx::TextureFormat::Enum _format)
+	{
+		bgfx::TextureInfo info;
+		bgfx::calcTextureSize(info, _width, _height, _depth, _cubeMap, _hasMips, _numLayers, _format);
+		return info.storageSize;
+	}
+
+} // namespace
+
+bgfx::TextureHandle gpuCreateTexture2D(const char* _owner, uint16_t _width, uint16_t _height, bool _hasMips, uint16_t _numLayers, bgfx::TextureFormat::Enum _format, uint64_t _flags, const bgfx::Memory* _mem)
+{
+	bgfx::TextureHandle handle = bgfx::createTexture2D(_width, _height, _hasMips, _numLayers, _format, _flags, _mem);
+	if (bgfx::isValid(handle) )
+	{
+		add(GpuResource::Texture, handle.idx, _owner, textureSize(_width, _height, 1, false, _hasMips, _numLayers, _format) );
+	}
+
+	return handle;
+}
+
+bgfx::TextureHandle gpuCreateTexture3D(const char* _owner, uint16_t _width, uint16_t _height, uint16_t _depth, bool _hasMips, bgfx::TextureFormat::Enum _format, uint64_t _flags, const bgfx::Memory* _mem)
+{
+	bgfx::TextureHandle handle = bgfx::createTexture3D(_width, _height, _depth, _hasMips, _format, _flags, _mem);
+	if (bgfx::isValid(handle) )
+	{
+		add(GpuResource::Texture, handle.idx, _owner, textureSize(_width, _height, _depth, false, _hasMips, 1, _format) );
+	}
+
+	return handle;
+}
+
+bgfx::TextureHandle gpuCreateTextureCube(const char* _owner, uint16_t _size, bool _hasMips, uint16_t _numLayers, bgfx::TextureFormat::Enum _format, uint64_t _flags, const bgfx::Memory* _mem)
+{
+	bgfx::TextureHandle handle = bgfx::createTextureCube(_size, _hasMips, _numLayers, _format, _flags, _mem);
+	if (bgfx::isValid(handle) )
+	{
+		add(GpuResource::Texture, handle.idx, _owner, textureSize(_size, _size, 1, true, _hasMips, _numLayers, _format) );
+	}
+
+	return handle;
+}
+
+bgfx::VertexBufferHandle gpuCreateVertexBuffer(const char* _owner, const bgfx::Memory* _mem, const bgfx::VertexLayout& _layout, uint16_t _flags)
+{
+	const uint32_t size = _mem->size;
+	bgfx::VertexBufferHandle handle = bgfx::createVertexBuffer(_mem, _layout, _flags);
+	if (bgfx::isValid(handle) )
+	{
+		add(GpuResource::VertexBuffer, handle.idx, _owner, size);
+	}
+
+	return handle;
+}
+
+bgfx::IndexBufferHandle gpuCreateIndexBuffer(const char* _owner, const bgfx::Memory* _mem, uint16_t _flags)
+{
+	const uint32_t size = _mem->size;
+	bgfx::IndexBufferHandle handle = bgfx::createIndexBuffer(_mem, _flags);
+	if (bgfx::isValid(handle) )
+	{
+		add(GpuResource::IndexBuffer, handle.idx, _owner, size);
+	}
+
+	return handle;
+}
+
+bgfx::DynamicIndexBufferHandle gpuCreateDynamicIndexBuffer(const char* _owner, uint32_t _num, uint16_t _flags)
+{
+	const uint32_t indexSize = 0 != (_flags & BGFX_BUFFER_INDEX32) ? 4 : 2;
+	bgfx::DynamicIndexBufferHandle handle = bgfx::createDynamicIndexBuffer(_num, _flags);
+	if (bgfx::isValid(handle) )
+	{
+		add(GpuResource::DynamicIndexBuffer, handle.idx, _owner, _num*indexSize);
+	}
+
+	return handle;
+}
+
+bgfx::DynamicIndexBufferHandle gpuCreateDynamicIndexBuffer(const char* _owner, const bgfx::Memory* _mem, uint16_t _flags)
+{
+	const uint32_t size = _mem->size;
+	bgfx::DynamicIndexBufferHandle handle = bgfx::createDynamicIndexBuffer(_mem, _flags);
+	if (bgfx::isValid(handle) )
+	{
+		add(GpuResource::DynamicIndexBuffer, handle.idx, _owner, size);
+	}
+
+	return handle;
+}
+
+bgfx::IndirectBufferHandle gpuCreateIndirectBuffer(const char* _owner, uint32_t _num)
+{
+	bgfx::IndirectBufferHandle handle = bgfx::createIndirectBuffer(_num);
+	if (bgfx::isValid(handle) )
+	{
+		add(GpuResource::IndirectBuffer, handle.idx, _owner, _num*kIndirectStride);
+	}
+
+	return handle;
+}
+
+void gpuDestroy(bgfx::TextureHandle _handle)
+{
+	remove(GpuResource::Texture, _handle.idx);
+	bgfx::destroy(_handle);
+}
+
+void gpuDestroy(bgfx::VertexBufferHandle _handle)
+{
+	remove(GpuResource::VertexBuffer, _handle.idx);
+	bgfx::destroy(_handle);
+}
+
+void gpuDestroy(bgfx::IndexBufferHandle _handle)
+{
+	remove(GpuResource::IndexBuffer, _handle.idx);
+	bgfx::destroy(_handle);
+}
+
+void gpuDestroy(bgfx::DynamicIndexBufferHandle _handle)
+{
+	remove(GpuResource::DynamicIndexBuffer, _handle.idx);
+	bgfx::destroy(_handle);
+}
+
+void gpuDestroy(bgfx::IndirectBufferHandle _handle)
+{
+	remove(GpuResource::IndirectBuffer, _handle.idx);
+	bgfx::destroy(_handle);
+}
+
+GpuLedgerStats gpuLedgerGetTotal()
+{
+	return s_ledger.m_total;
+}
+
+uint32_t gpuLedgerGetNumOwners()
+{
+	return s_ledger.m_numOwners;
+}
+
+GpuLedgerStats gpuLedgerGetOwner(uint32_t _index)
+{
+	return s_ledger.m_owners[_index];
+}
+
+uint32_t gpuLedgerReportLeaks()
+{
+	uint32_t numLeaks = 0;
+
+	for (uint32_t type = 0; type < GpuResource::Count; ++type)
+	{
+		for (uint32_t idx = 0; idx < kMaxHandles; ++idx)
+		{
+			const Entry& entry = s_ledger.m_entries[type][idx];
+			if (0 != entry.m_owner)
+			{
+				printf("GPU leak: %s %u of %s, %u bytes\n"
+					, s_typeName[type]
+					, idx
+					, s_ledger.m_owners[entry.m_owner - 1].m_name
+					, entry.m_bytes
+					);
+				++numLeaks;
+			}
+		}
+	}
+
+	return numLeaks;
+}
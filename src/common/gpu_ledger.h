@@ -0,0 +1,94 @@
+#ifndef GPU_LEDGER_H_HEADER_GUARD
+#define GPU_LEDGER_H_HEADER_GUARD
+
+#include <bgfx/bgfx.h>
+
+/// Accounts the GPU memory behind textures and buffers created through the
+/// functions below, per handle and per owner. Sizes are what bgfx computes
+/// for the resource (bgfx::calcTextureSize(), element counts times their
+/// size), not what the driver ends up allocating.
+///
+/// Create and destroy through here, on the API thread. Freeing a handle with
+/// bgfx::destroy() is not supported: the ledger cannot see it, so the handle
+/// stays accounted, and is reported as a leak, until bgfx hands its index
+/// out again.
+///
+/// Owners are kept by pointer, pass string literals.
+
+///
+struct GpuResource
+{
+	enum Enum
+	{
+		Texture,
+		VertexBuffer,
+		IndexBuffer,
+		DynamicIndexBuffer,
+		IndirectBuffer,
+
+		Count
+	};
+};
+
+///
+struct GpuLedgerStats
+{
+	const char* m_name;                        //!< Owner, NULL for the total.
+	uint64_t    m_bytes;                       //!< Bytes live now.
+	uint64_t    m_peak;                        //!< Most bytes live at once.
+	uint32_t    m_handles[GpuResource::Count]; //!< Live handles per resource type.
+};
+
+///
+bgfx::TextureHandle gpuCreateTexture2D(const char* _owner, uint16_t _width, uint16_t _height, bool _hasMips, uint16_t _numLayers, bgfx::TextureFormat::Enum _format, uint64_t _flags = BGFX_TEXTURE_NONE|BGFX_SAMPLER_NONE, const bgfx::Memory* _mem = NULL);
+
+///
+bgfx::TextureHandle gpuCreateTexture3D(const char* _owner, uint16_t _width, uint16_t _height, uint16_t _depth, bool _hasMips, bgfx::TextureFormat::Enum _format, uint64_t _flags = BGFX_TEXTURE_NONE|BGFX_SAMPLER_NONE, const bgfx::Memory* _mem = NULL);
+
+///
+bgfx::TextureHandle gpuCreateTextureCube(const char* _owner, uint16_t _size, bool _hasMips, uint16_t _numLayers, bgfx::TextureFormat::Enum _format, uint64_t _flags = BGFX_TEXTURE_NONE|BGFX_SAMPLER_NONE, const bgfx::Memory* _mem = NULL);
+
+///
+bgfx::VertexBufferHandle gpuCreateVertexBuffer(const char* _owner, const bgfx::Memory* _mem, const bgfx::VertexLayout& _layout, uint16_t _flags = BGFX_BUFFER_NONE);
+
+///
+bgfx::IndexBufferHandle gpuCreateIndexBuffer(const char* _owner, const bgfx::Memory* _mem, uint16_t _flags = BGFX_BUFFER_NONE);
+
+///
+bgfx::DynamicIndexBufferHandle gpuCreateDynamicIndexBuffer(const char* _owner, uint32_t _num, uint16_t _flags = BGFX_BUFFER_NONE);
+
+///
+bgfx::DynamicIndexBufferHandle gpuCreateDynamicIndexBuffer(const char* _owner, const bgfx::Memory* _mem, uint16_t _flags = BGFX_BUFFER_NONE);
+
+///
+bgfx::IndirectBufferHandle gpuCreateIndirectBuffer(const char* _owner, uint32_t _num);
+
+///
+void gpuDestroy(bgfx::TextureHandle _handle);
+
+///
+void gpuDestroy(bgfx::VertexBufferHandle _handle);
+
+///
+void gpuDestroy(bgfx::IndexBufferHandle _handle);
+
+///
+void gpuDestroy(bgfx::DynamicIndexBufferHandle _handle);
+
+///
+void gpuDestroy(bgfx::IndirectBufferHandle _handle);
+
+///
+GpuLedgerStats gpuLedgerGetTotal();
+
+///
+uint32_t gpuLedgerGetNumOwners();
+
+///
+GpuLedgerStats gpuLedgerGetOwner(uint32_t _index);
+
+/// Prints the handles still live per owner, returns how many there are.
+///
+uint32_t gpuLedgerReportLeaks();
+
+#endif // GPU_LEDGER_H_HEADER_GUARD
@@ -13,6 +13,7 @@
 
 #include "imgui.h"
 #include "../bgfx_utils.h"
+#include "../profiler.h"
 
 //#define USE_ENTRY 1
 
@@ -528,11 +529,13 @@ void imguiDestroy()
 
 void imguiBeginFrame(int32_t _mx, int32_t _my, uint8_t _button, int32_t _scroll, uint16_t _width, uint16_t _height, int _inputChar, bgfx::ViewId _viewId)
 {
+	PROFILER_SCOPE("imguiBeginFrame");
 	s_ctx.beginFrame(_mx, _my, _button, _scroll, _width, _height, _inputChar, _viewId);
 }
 
 void imguiEndFrame()
 {
+	PROFILER_SCOPE("imguiEndFrame");
 	s_ctx.endFrame();
 }
 
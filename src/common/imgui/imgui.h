@@ -36,6 +36,10 @@ void imguiEndFrame();
 namespace entry { class AppI; }
 void showExampleDialog(entry::AppI* _app, const char* _errorText = NULL);
 
+/// Writes the frame, submit, GPU and per view time statistics the example
+/// dialog keeps as JSON, false if the file cannot be written.
+bool writeFrameStats(const char* _filePath);
+
 namespace ImGui
 {
 #define IMGUI_FLAGS_NONE        UINT8_C(0x00)
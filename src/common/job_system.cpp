@@ -0,0 +1,505 @@
+#include "job_system.h"
+#include "entry/entry.h"
+#include "profiler.h"
+
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include <bx/math.h>
+#include <bx/mutex.h>
+#include <bx/os.h>
+#include <bx/semaphore.h>
+#include <bx/thread.h>
+
+#if BX_PLATFORM_WINDOWS
+#	ifndef NOMINMAX
+#		define NOMINMAX // bx::min() and bx::max() below.
+#	endif // NOMINMAX
+#	include <windows.h>
+#elif BX_PLATFORM_POSIX
+#	include <unistd.h>
+#endif // BX_PLATFORM_*
+
+namespace
+{
+	constexpr uint32_t kMaxThreads  = 32;
+	constexpr uint32_t kQueueSize   = 1024; // Power of two.
+	constexpr uint32_t kMinDeferred = 256;
+	constexpr uint32_t kNotWorker   = UINT32_MAX;
+
+	struct Job
+	{
+		JobFn       m_fn;
+		void*       m_userData;
+		JobCounter* m_counter;
+	};
+
+	// Jobs are coarse (a strip of rows, a whole image), so a locked ring
+	// buffer is cheap enough and keeps stealing obviously correct.
+	struct JobQueue
+	{
+		JobQueue()
+			: m_head(0)
+			, m_tail(0)
+		{
+		}
+
+		bool push(const Job& _job)
+		{
+			bx::MutexScope lock(m_mutex);
+			if (m_tail - m_head == kQueueSize)
+			{
+				return false;
+			}
+
+			m_jobs[m_tail & (kQueueSize - 1)] = _job;
+			++m_tail;
+			return true;
+		}
+
+		// Owner end, most recently pushed and still warm in cache.
+		bool popBack(Job& _job)
+		{
+			bx::MutexScope lock(m_mutex);
+			if (m_tail == m_head)
+			{
+				return false;
+			}
+
+			--m_tail;
+			_job = m_jobs[m_tail & (kQueueSize - 1)];
+			return true;
+		}
+
+		// Thief end, oldest and usually the largest remaining work.
+		bool popFront(Job& _job)
+		{
+			bx::MutexScope lock(m_mutex);
+			if (m_tail == m_head)
+			{
+				return false;
+			}
+
+			_job = m_jobs[m_head & (kQueueSize - 1)];
+			++m_head;
+			return true;
+		}
+
+		bx::Mutex m_mutex;
+		Job m_jobs[kQueueSize];
+		uint32_t m_head;
+		uint32_t m_tail;
+	};
+
+	struct Deferred
+	{
+		Job         m_job;
+		JobCounter* m_dependsOn;
+	};
+
+	struct JobSystem
+	{
+		JobSystem()
+			: m_numThreads(0)
+			, m_sleeping(0)
+			, m_quit(0)
+			, m_waiting(0)
+			, m_deferred(NULL)
+			, m_numDeferred(0)
+			, m_maxDeferred(0)
+			, m_executed(0)
+			, m_stolen(0)
+			, m_inline(0)
+		{
+		}
+
+		bx::Thread m_threads[kMaxThreads];
+		JobQueue   m_queues[kMaxThreads];
+		JobQueue   m_shared;
+		uint32_t   m_numThreads;
+
+		bx::Semaphore m_wake;
+		int32_t m_sleeping;
+		int32_t m_quit;
+
+		// Threads asleep in jobWait(), posted when a counter drains or a job
+		// is queued.
+		bx::Semaphore m_progress;
+		int32_t m_waiting;
+
+		// Grows as needed, a job is never turned away for want of room.
+		bx::Mutex m_deferredMutex;
+		Deferred* m_deferred;
+		uint32_t  m_numDeferred;
+		uint32_t  m_maxDeferred;
+
+		int32_t m_executed;
+		int32_t m_stolen;
+		int32_t m_inline;
+	};
+
+	static JobSystem* s_jobs = NULL;
+	static thread_local uint32_t t_worker = kNotWorker;
+
+	inline int32_t atomicLoad(int32_t* _ptr)
+	{
+		return bx::atomicFetchAndAdd<int32_t>(_ptr, 0);
+	}
+
+	bool popJob(uint32_t _self, Job& _job)
+	{
+		const uint32_t numThreads = s_jobs->m_numThreads;
+		if (_self < numThreads
+		&&  s_jobs->m_queues[_self].popBack(_job) )
+		{
+			return true;
+		}
+
+		if (s_jobs->m_shared.popFront(_job) )
+		{
+			return true;
+		}
+
+		const uint32_t first = _self < numThreads ? _self + 1 : 0;
+		for (uint32_t ii = 0; ii < numThreads; ++ii)
+		{
+			const uint32_t victim = (first + ii) % numThreads;
+			if (victim != _self
+			&&  s_jobs->m_queues[victim].popFront(_job) )
+			{
+				bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_stolen, 1);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void releaseDeferred(JobCounter* _counter);
+
+	void wakeWaiting()
+	{
+		const int32_t waiting = atomicLoad(&s_jobs->m_waiting);
+		if (0 < waiting)
+		{
+			s_jobs->m_progress.post(uint32_t(waiting) );
+		}
+	}
+
+	void finishJob(const Job& _job)
+	{
+		if (NULL != _job.m_counter
+		&&  0 == bx::atomicAddAndFetch<int32_t>(&_job.m_counter->m_value, -1)
+		&&  NULL != s_jobs)
+		{
+			releaseDeferred(_job.m_counter);
+			wakeWaiting();
+		}
+	}
+
+	void executeJob(const Job& _job)
+	{
+		_job.m_fn(_job.m_userData);
+		if (NULL != s_jobs)
+		{
+			bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_executed, 1);
+		}
+		finishJob(_job);
+	}
+
+	void submitJob(const Job& _job)
+	{
+		JobQueue& queue = t_worker < s_jobs->m_numThreads
+			? s_jobs->m_queues[t_worker]
+			: s_jobs->m_shared
+			;
+		if (!queue.push(_job) )
+		{
+			bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_inline, 1);
+			executeJob(_job);
+			return;
+		}
+
+		if (0 < atomicLoad(&s_jobs->m_sleeping) )
+		{
+			s_jobs->m_wake.post();
+		}
+
+		wakeWaiting();
+	}
+
+	// One at a time, submitting may run the job inline, and it may defer
+	// jobs of its own.
+	void releaseDeferred(JobCounter* _counter)
+	{
+		for (;;)
+		{
+			Job ready;
+			bool found = false;
+			{
+				bx::MutexScope lock(s_jobs->m_deferredMutex);
+				for (uint32_t ii = 0; ii < s_jobs->m_numDeferred; ++ii)
+				{
+					if (s_jobs->m_deferred[ii].m_dependsOn == _counter)
+					{
+						ready = s_jobs->m_deferred[ii].m_job;
+						s_jobs->m_deferred[ii] = s_jobs->m_deferred[--s_jobs->m_numDeferred];
+						found = true;
+						break;
+					}
+				}
+			}
+
+			if (!found)
+			{
+				break;
+			}
+
+			submitJob(ready);
+		}
+	}
+
+	int32_t workerFn(bx::Thread* _thread, void* _userData)
+	{
+		BX_UNUSED(_thread);
+		const uint32_t self = uint32_t(uintptr_t(_userData) );
+		t_worker = self;
+		profilerSetThreadName("job worker");
+
+		for (;;)
+		{
+			Job job;
+			if (popJob(self, job) )
+			{
+				executeJob(job);
+				continue;
+			}
+
+			// Announce the sleep before the last look, a job pushed after it
+			// sees the sleeper and posts.
+			bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_sleeping, 1);
+			if (popJob(self, job) )
+			{
+				bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_sleeping, -1);
+				executeJob(job);
+				continue;
+			}
+
+			if (0 != atomicLoad(&s_jobs->m_quit) )
+			{
+				bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_sleeping, -1);
+				break;
+			}
+
+			s_jobs->m_wake.wait();
+			bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_sleeping, -1);
+		}
+
+		t_worker = kNotWorker;
+		return 0;
+	}
+
+	struct ParallelFor
+	{
+		JobRangeFn m_fn;
+		void*      m_userData;
+		uint32_t   m_end;
+		uint32_t   m_grain;
+		uint32_t   m_next;
+	};
+
+	void parallelForJob(void* _userData)
+	{
+		ParallelFor& pf = *(ParallelFor*)_userData;
+		for (;;)
+		{
+			const uint32_t begin = bx::atomicFetchAndAdd<uint32_t>(&pf.m_next, pf.m_grain);
+			if (begin >= pf.m_end)
+			{
+				break;
+			}
+
+			pf.m_fn(begin, bx::min(pf.m_end - begin, pf.m_grain) + begin, pf.m_userData);
+		}
+	}
+
+} // namespace
+
+void jobInit(uint32_t _numThreads)
+{
+	if (NULL != s_jobs)
+	{
+		return;
+	}
+
+	if (0 == _numThreads)
+	{
+		_numThreads = bx::max(jobGetNumCores(), 2u) - 1;
+	}
+
+	s_jobs = BX_NEW(entry::getAllocator(), JobSystem);
+	s_jobs->m_numThreads = bx::min(_numThreads, kMaxThreads);
+	for (uint32_t ii = 0; ii < s_jobs->m_numThreads; ++ii)
+	{
+		s_jobs->m_threads[ii].init(workerFn, (void*)uintptr_t(ii), 0, "job worker");
+	}
+}
+
+void jobShutdown()
+{
+	if (NULL == s_jobs)
+	{
+		return;
+	}
+
+	bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_quit, 1);
+	s_jobs->m_wake.post(s_jobs->m_numThreads);
+	for (uint32_t ii = 0; ii < s_jobs->m_numThreads; ++ii)
+	{
+		s_jobs->m_threads[ii].shutdown();
+	}
+
+	// The workers quit with every queue empty, and a counter draining
+	// releases its jobs before that. A job still held back waits on a
+	// counter that nothing left can drain, running it would break the
+	// dependency it was queued with.
+	BX_ASSERT(0 == s_jobs->m_numDeferred
+		, "%u jobs still wait on a dependency at shutdown."
+		, s_jobs->m_numDeferred
+		);
+
+	if (NULL != s_jobs->m_deferred)
+	{
+		BX_FREE(entry::getAllocator(), s_jobs->m_deferred);
+	}
+
+	BX_DELETE(entry::getAllocator(), s_jobs);
+	s_jobs = NULL;
+}
+
+uint32_t jobGetNumThreads()
+{
+	return NULL != s_jobs ? s_jobs->m_numThreads : 0;
+}
+
+uint32_t jobGetNumCores()
+{
+#if BX_PLATFORM_WINDOWS
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return bx::max<uint32_t>(info.dwNumberOfProcessors, 1);
+#elif BX_PLATFORM_POSIX
+	return uint32_t(bx::max<long>(sysconf(_SC_NPROCESSORS_ONLN), 1) );
+#else
+	return 1;
+#endif // BX_PLATFORM_*
+}
+
+void jobRun(JobFn _fn, void* _userData, JobCounter* _counter, JobCounter* _dependsOn)
+{
+	if (NULL != _counter)
+	{
+		bx::atomicFetchAndAdd<int32_t>(&_counter->m_value, 1);
+	}
+
+	const Job job = { _fn, _userData, _counter };
+	if (NULL == s_jobs)
+	{
+		executeJob(job);
+		return;
+	}
+
+	if (NULL != _dependsOn)
+	{
+		bx::MutexScope lock(s_jobs->m_deferredMutex);
+		if (0 < atomicLoad(&_dependsOn->m_value) )
+		{
+			if (s_jobs->m_numDeferred == s_jobs->m_maxDeferred)
+			{
+				s_jobs->m_maxDeferred = bx::max(s_jobs->m_maxDeferred * 2, kMinDeferred);
+				s_jobs->m_deferred = (Deferred*)BX_REALLOC(entry::getAllocator()
+					, s_jobs->m_deferred
+					, s_jobs->m_maxDeferred * sizeof(Deferred)
+					);
+			}
+
+			Deferred& entry = s_jobs->m_deferred[s_jobs->m_numDeferred++];
+			entry.m_job = job;
+			entry.m_dependsOn = _dependsOn;
+			return;
+		}
+	}
+
+	submitJob(job);
+}
+
+void jobWait(JobCounter* _counter)
+{
+	while (0 < atomicLoad(&_counter->m_value) )
+	{
+		if (NULL == s_jobs)
+		{
+			bx::yield();
+			continue;
+		}
+
+		Job job;
+		if (popJob(t_worker, job) )
+		{
+			executeJob(job);
+			continue;
+		}
+
+		// Announce the wait before the last look, a counter draining or a
+		// job pushed after it sees the waiter and posts.
+		bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_waiting, 1);
+		const bool found = popJob(t_worker, job);
+		if (!found
+		&&  0 < atomicLoad(&_counter->m_value) )
+		{
+			s_jobs->m_progress.wait();
+		}
+		bx::atomicFetchAndAdd<int32_t>(&s_jobs->m_waiting, -1);
+
+		if (found)
+		{
+			executeJob(job);
+		}
+	}
+}
+
+void jobParallelFor(uint32_t _begin, uint32_t _end, uint32_t _grain, JobRangeFn _fn, void* _userData, uint32_t _maxThreads)
+{
+	if (_begin >= _end)
+	{
+		return;
+	}
+
+	_grain = bx::max(_grain, 1u);
+	const uint32_t numRanges  = (_end - _begin - 1) / _grain + 1;
+	const uint32_t maxHelpers = 0 != _maxThreads ? _maxThreads - 1 : UINT32_MAX;
+	const uint32_t numHelpers = bx::min(numRanges - 1, bx::min(jobGetNumThreads(), maxHelpers) );
+
+	ParallelFor pf = { _fn, _userData, _end, _grain, _begin };
+	JobCounter counter = { 0 };
+	for (uint32_t ii = 0; ii < numHelpers; ++ii)
+	{
+		jobRun(parallelForJob, &pf, &counter);
+	}
+
+	parallelForJob(&pf);
+	jobWait(&counter);
+}
+
+JobStats jobGetStats()
+{
+	JobStats stats = {};
+	if (NULL != s_jobs)
+	{
+		stats.m_numThreads = s_jobs->m_numThreads;
+		stats.m_executed   = uint32_t(atomicLoad(&s_jobs->m_executed) );
+		stats.m_stolen     = uint32_t(atomicLoad(&s_jobs->m_stolen) );
+		stats.m_inline     = uint32_t(atomicLoad(&s_jobs->m_inline) );
+	}
+
+	return stats;
+}
@@ -0,0 +1,87 @@
+#ifndef JOB_SYSTEM_H_HEADER_GUARD
+#define JOB_SYSTEM_H_HEADER_GUARD
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Work-stealing job scheduler. Every worker thread owns a queue, a ring
+/// buffer behind a mutex rather than a lock-free deque: it pushes and pops
+/// its own jobs at the back and steals from the front of the others when
+/// it runs dry. Threads that are not workers (the main thread, loader
+/// threads) push into a shared queue.
+///
+/// Jobs signal completion through a JobCounter. Waiting on a counter runs
+/// queued jobs on the waiting thread until the counter drains, so jobs may
+/// wait on jobs they spawned without tying up a worker. With nothing left
+/// to run, the waiting thread sleeps until a counter drains or a job is
+/// queued.
+///
+/// Before jobInit() or after jobShutdown() every job runs inline on the
+/// calling thread.
+
+///
+typedef void (*JobFn)(void* _userData);
+
+/// Called with a range of at most the grain size.
+typedef void (*JobRangeFn)(uint32_t _begin, uint32_t _end, void* _userData);
+
+/// Number of jobs not yet finished. Zero-initialize before the first use,
+/// and let it drain before reusing it as a dependency.
+struct JobCounter
+{
+	int32_t m_value;
+};
+
+///
+struct JobStats
+{
+	uint32_t m_numThreads; //!< Workers, without the threads helping in jobWait().
+	uint32_t m_executed;   //!< Jobs run since jobInit().
+	uint32_t m_stolen;     //!< Jobs a worker took from another's queue.
+	uint32_t m_inline;     //!< Jobs run inline because a queue was full.
+};
+
+/// Starts _numThreads workers, or one less than the number of cores when
+/// zero, leaving a core to the thread that waits.
+///
+void jobInit(uint32_t _numThreads = 0);
+
+/// Runs the jobs still queued and stops the workers. No job may still be
+/// held back on a dependency, its counter could never drain.
+///
+void jobShutdown();
+
+/// Returns the number of worker threads, 0 when not initialized.
+///
+uint32_t jobGetNumThreads();
+
+/// Returns the number of logical cores, at least 1.
+///
+uint32_t jobGetNumCores();
+
+/// Queues _fn(_userData).
+///
+/// @param[in] _fn Job function.
+/// @param[in] _userData Passed to _fn.
+/// @param[in] _counter Incremented now, decremented once _fn returns. May be NULL.
+/// @param[in] _dependsOn The job is held back until this counter drains. May be NULL.
+///
+void jobRun(JobFn _fn, void* _userData, JobCounter* _counter, JobCounter* _dependsOn = NULL);
+
+/// Returns once _counter reaches zero, running queued jobs meanwhile.
+///
+void jobWait(JobCounter* _counter);
+
+/// Splits [_begin, _end) into ranges of _grain items, runs them on the
+/// workers and the calling thread, and returns when all are done. Ranges
+/// are handed out in order, so the grain also bounds the imbalance.
+///
+/// @param[in] _maxThreads Threads to run on at most, the calling thread
+///   included. Zero for every worker.
+///
+void jobParallelFor(uint32_t _begin, uint32_t _end, uint32_t _grain, JobRangeFn _fn, void* _userData, uint32_t _maxThreads = 0);
+
+///
+JobStats jobGetStats();
+
+#endif // JOB_SYSTEM_H_HEADER_GUARD
@@ -0,0 +1,30 @@
+#include "mesh_decode.h"
+#include "job_system.h"
+
+#include <meshoptimizer/src/meshoptimizer.h>
+
+namespace
+{
+	void meshDecodeRange(uint32_t _begin, uint32_t _end, void* _userData)
+	{
+		const MeshDecode* decodes = (const MeshDecode*)_userData;
+		for (uint32_t ii = _begin; ii < _end; ++ii)
+		{
+			const MeshDecode& decode = decodes[ii];
+			if (decode.m_index)
+			{
+				meshopt_decodeIndexBuffer(decode.m_dst, decode.m_count, 2, (const uint8_t*)decode.m_compressed, decode.m_compressedSize);
+			}
+			else
+			{
+				meshopt_decodeVertexBuffer(decode.m_dst, decode.m_count, decode.m_stride, (const uint8_t*)decode.m_compressed, decode.m_compressedSize);
+			}
+		}
+	}
+
+} // namespace
+
+void meshDecode(const MeshDecode* _decodes, uint32_t _num)
+{
+	jobParallelFor(0, _num, 1, meshDecodeRange, const_cast<MeshDecode*>(_decodes) );
+}
@@ -0,0 +1,24 @@
+#ifndef MESH_DECODE_H_HEADER_GUARD
+#define MESH_DECODE_H_HEADER_GUARD
+
+#include <stdint.h>
+
+/// Compressed vertex or index buffer, as the VBC and IBC chunks of a mesh
+/// file hold it.
+///
+struct MeshDecode
+{
+	void*       m_dst;            //!< m_count * m_stride bytes.
+	const void* m_compressed;
+	uint32_t    m_compressedSize;
+	uint32_t    m_count;          //!< Vertices, or 16-bit indices.
+	uint16_t    m_stride;         //!< 2 for indices.
+	bool        m_index;
+};
+
+/// Decodes _num buffers, one job each, on the job workers and the calling
+/// thread. Returns when all are done.
+///
+void meshDecode(const MeshDecode* _decodes, uint32_t _num);
+
+#endif // MESH_DECODE_H_HEADER_GUARD
@@ -0,0 +1,350 @@
+// Client check of the metrics endpoint, no GPU or window needed:
+//
+//   metrics_check [--address unix:<path>|<port>]
+//
+// Without --address it serves snapshots of its own on a Unix socket and
+// scrapes them: label values that need escaping, a label too long for the
+// sample, more samples than one reply holds, and a path that isn't served.
+// With --address it scrapes a running server once instead, the app or
+// heightmap_bench started with --metrics, so a CI job can check a long
+// run:
+//
+//   heightmap_bench --frames 100000 --metrics unix:/tmp/hm.sock &
+//   metrics_check --address unix:/tmp/hm.sock
+//
+// Every reply must have the expected status and a Content-Length equal to
+// the body, and every line of the body must be a whole TYPE line or
+// sample with well-formed labels. Exits with 1 on the first reply that
+// fails.
+#include "metrics_server.h"
+
+#include <bx/commandline.h>
+#include <bx/string.h>
+#include <cstdio>
+#include <cstdlib>
+
+#if BX_PLATFORM_POSIX
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr int32_t kMaxReply = 80 << 10;
+
+    char s_reply[kMaxReply];
+
+    // What a reply held, once it passed the checks
+    struct Scrape {
+        const char* body;
+        int32_t bodySize;
+        uint32_t numTypes;
+        uint32_t numSamples;
+    };
+
+#if BX_PLATFORM_POSIX
+    int32_t connectTo(const char* address) {
+        if (bx::strCmp(address, "unix:", 5) == 0) {
+            sockaddr_un addr;
+            bx::memSet(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            bx::strCopy(addr.sun_path, sizeof(addr.sun_path), &address[5]);
+
+            const int32_t sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (sock >= 0 && ::connect(sock, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+                ::close(sock);
+                return -1;
+            }
+            return sock;
+        }
+
+        uint32_t port = 0;
+        if (!bx::fromString(&port, address) || port == 0 || port > UINT16_MAX) {
+            return -1;
+        }
+
+        sockaddr_in addr;
+        bx::memSet(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(uint16_t(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        const int32_t sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (sock >= 0 && ::connect(sock, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+            ::close(sock);
+            return -1;
+        }
+        return sock;
+    }
+
+    // Sends a GET for `path` and reads the reply until the server closes
+    // the connection. Returns its length, -1 when it failed or didn't fit.
+    int32_t fetch(const char* address, const char* path) {
+        const int32_t sock = connectTo(address);
+        if (sock < 0) {
+            printf("Failed to connect to %s\n", address);
+            return -1;
+        }
+
+        char request[256];
+        const int32_t requestSize = bx::snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\n\r\n", path);
+        if (::send(sock, request, size_t(requestSize), 0) != requestSize) {
+            ::close(sock);
+            return -1;
+        }
+
+        int32_t length = 0;
+        for (;;) {
+            const ssize_t num = ::recv(sock, &s_reply[length], size_t(kMaxReply - 1 - length), 0);
+            if (num <= 0) {
+                break;
+            }
+            length += int32_t(num);
+            if (length == kMaxReply - 1) {
+                printf("Reply to %s is over %d bytes\n", path, kMaxReply - 1);
+                ::close(sock);
+                return -1;
+            }
+        }
+        ::close(sock);
+
+        s_reply[length] = '\0';
+        return length;
+    }
+#endif // BX_PLATFORM_POSIX
+
+    bool isNameChar(char ch) {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9')
+            || ch == '_' || ch == ':';
+    }
+
+    const char* skipName(const char* ptr) {
+        while (isNameChar(*ptr)) {
+            ++ptr;
+        }
+        return ptr;
+    }
+
+    // name="value" pairs separated by commas, up to the closing brace.
+    // Returns where the brace is, nullptr when a pair is malformed.
+    const char* skipLabels(const char* ptr) {
+        for (;;) {
+            const char* end = skipName(ptr);
+            if (end == ptr || end[0] != '=' || end[1] != '"') {
+                return nullptr;
+            }
+
+            for (ptr = end + 2; *ptr != '"'; ++ptr) {
+                if (*ptr == '\0' || *ptr == '\n') {
+                    return nullptr;
+                }
+                if (*ptr == '\\') {
+                    ++ptr;
+                    if (*ptr != '\\' && *ptr != '"' && *ptr != 'n') {
+                        return nullptr;
+                    }
+                }
+            }
+
+            ++ptr;
+            if (*ptr == '}') {
+                return ptr;
+            }
+            if (*ptr != ',') {
+                return nullptr;
+            }
+            ++ptr;
+        }
+    }
+
+    // One line, up to and with its newline. Returns false if it is neither
+    // a TYPE line nor a sample.
+    bool checkLine(const char* line, Scrape& scrape) {
+        if (bx::strCmp(line, "# TYPE ", 7) == 0) {
+            const char* type = skipName(&line[7]);
+            if (type == &line[7] || *type != ' ') {
+                return false;
+            }
+            ++type;
+            if (bx::strCmp(type, "gauge\n", 6) != 0 && bx::strCmp(type, "counter\n", 8) != 0) {
+                return false;
+            }
+            ++scrape.numTypes;
+            return true;
+        }
+
+        const char* ptr = skipName(line);
+        if (ptr == line) {
+            return false;
+        }
+        if (*ptr == '{') {
+            ptr = skipLabels(ptr + 1);
+            if (ptr == nullptr) {
+                return false;
+            }
+            ++ptr;
+        }
+        if (*ptr != ' ') {
+            return false;
+        }
+
+        char* end = nullptr;
+        strtod(ptr + 1, &end);
+        if (end == ptr + 1 || *end != '\n') {
+            return false;
+        }
+        ++scrape.numSamples;
+        return true;
+    }
+
+    bool checkReply(const char* what, int32_t length, const char* status, Scrape& scrape) {
+        bx::memSet(&scrape, 0, sizeof(scrape));
+        if (length < 0) {
+            printf("%s: no reply\n", what);
+            return false;
+        }
+
+        char statusLine[64];
+        bx::snprintf(statusLine, sizeof(statusLine), "HTTP/1.0 %s\r\n", status);
+        if (bx::strCmp(s_reply, statusLine, bx::strLen(statusLine)) != 0) {
+            printf("%s: expected %s\n", what, status);
+            return false;
+        }
+
+        const bx::StringView headerEnd = bx::strFind(s_reply, "\r\n\r\n");
+        const bx::StringView contentLength = bx::strFind(s_reply, "Content-Length: ");
+        if (headerEnd.isEmpty() || contentLength.isEmpty() || contentLength.getPtr() > headerEnd.getPtr()) {
+            printf("%s: incomplete header\n", what);
+            return false;
+        }
+
+        scrape.body = headerEnd.getPtr() + 4;
+        scrape.bodySize = int32_t(&s_reply[length] - scrape.body);
+        uint32_t expected = 0;
+        bx::fromString(&expected, bx::StringView(contentLength.getPtr() + 16, headerEnd.getPtr()));
+        if (int32_t(expected) != scrape.bodySize) {
+            printf("%s: Content-Length %u, body %d bytes\n", what, expected, scrape.bodySize);
+            return false;
+        }
+
+        if (scrape.bodySize > 0 && scrape.body[scrape.bodySize - 1] != '\n') {
+            printf("%s: body ends in a partial line\n", what);
+            return false;
+        }
+
+        for (const char* line = scrape.body; *line != '\0'; line = bx::strFind(line, '\n').getPtr() + 1) {
+            if (!checkLine(line, scrape)) {
+                const char* end = bx::strFind(line, '\n').getPtr();
+                printf("%s: malformed line \"%.*s\"\n", what, int(end - line), line);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool expect(const char* what, bool ok) {
+        if (!ok) {
+            printf("%s: failed\n", what);
+        }
+        return ok;
+    }
+
+#if BX_PLATFORM_POSIX
+    bool checkScrape(const char* address) {
+        Scrape scrape;
+        if (!checkReply(address, fetch(address, "/metrics"), "200 OK", scrape)) {
+            return false;
+        }
+        printf("%s: %u samples of %u metrics, %d bytes\n", address, scrape.numSamples, scrape.numTypes, scrape.bodySize);
+        return true;
+    }
+
+    bool selfCheck() {
+        char address[64];
+        bx::snprintf(address, sizeof(address), "unix:/tmp/metrics_check_%d.sock", int(getpid()));
+        if (!metricsServerStart(address)) {
+            printf("Failed to serve metrics on %s\n", address);
+            return false;
+        }
+
+        bool ok = true;
+        Scrape scrape;
+
+        // Values with every escaped character, two samples of one metric
+        // under a single TYPE line
+        MetricsSnapshot* snapshot = metricsBeginPublish();
+        snapshot->add("check_escape", MetricType::Gauge, 1.0, "value", "a\"b\\c\nd");
+        snapshot->add("check_escape", MetricType::Gauge, 2.0, "value", "plain", "other", "x");
+        snapshot->add("check_counter", MetricType::Counter, 42.0);
+        metricsPublish();
+        ok = ok && checkReply("escapes", fetch(address, "/metrics"), "200 OK", scrape);
+        ok = ok && expect("escapes: counts", scrape.numTypes == 2 && scrape.numSamples == 3);
+        ok = ok && expect("escapes: value",
+            !bx::strFind(scrape.body, "check_escape{value=\"a\\\"b\\\\c\\nd\"} 1\n").isEmpty());
+
+        // A second label that doesn't fit the sample is left out whole
+        char longValue[200];
+        bx::memSet(longValue, 'v', sizeof(longValue) - 1);
+        longValue[sizeof(longValue) - 1] = '\0';
+        snapshot = metricsBeginPublish();
+        snapshot->add("check_long", MetricType::Gauge, 1.0, "first", "short", "second", longValue);
+        metricsPublish();
+        ok = ok && checkReply("long label", fetch(address, "/metrics"), "200 OK", scrape);
+        ok = ok && expect("long label: kept", !bx::strFind(scrape.body, "check_long{first=\"short\"} 1\n").isEmpty());
+
+        // Samples as long as they get are more text than a reply holds,
+        // whole lines up to the limit
+        char name[sizeof(MetricsSnapshot::Sample::m_name)];
+        char value[sizeof(MetricsSnapshot::Sample::m_labels) - 4];
+        bx::memSet(name, 'n', sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+        bx::memSet(value, 'v', sizeof(value) - 1);
+        value[sizeof(value) - 1] = '\0';
+        snapshot = metricsBeginPublish();
+        for (uint32_t ii = 0; ii < MetricsSnapshot::kMaxSamples; ++ii) {
+            char prefix[32];
+            const int32_t len = bx::snprintf(prefix, sizeof(prefix), "check_overflow_%04u_", ii);
+            bx::memCopy(name, prefix, size_t(len));
+            snapshot->add(name, MetricType::Counter, -1.23456789e+100, "l", value);
+        }
+        metricsPublish();
+        ok = ok && checkReply("overflow", fetch(address, "/metrics"), "200 OK", scrape);
+        ok = ok && expect("overflow: truncated",
+            scrape.numSamples > 0 && scrape.numSamples < MetricsSnapshot::kMaxSamples && scrape.numTypes == scrape.numSamples);
+
+        ok = ok && checkReply("not found", fetch(address, "/other"), "404 Not Found", scrape);
+        ok = ok && expect("not found: empty", scrape.bodySize == 0);
+
+        ok = ok && expect("scrape count", metricsGetNumScrapes() == 3);
+
+        metricsServerStop();
+        struct stat info;
+        ok = ok && expect("socket removed", ::stat(&address[5], &info) != 0);
+        return ok;
+    }
+#endif // BX_PLATFORM_POSIX
+} // namespace
+
+int main(int argc, const char* argv[]) {
+#if BX_PLATFORM_POSIX
+    bx::CommandLine cmdLine(argc, argv);
+    const char* address = cmdLine.findOption("address");
+    if (address != nullptr) {
+        return checkScrape(address) ? 0 : 1;
+    }
+
+    if (!selfCheck()) {
+        return 1;
+    }
+    printf("Metrics endpoint ok\n");
+    return 0;
+#else
+    BX_UNUSED(argc, argv);
+    printf("The metrics server needs BSD sockets\n");
+    return 1;
+#endif // BX_PLATFORM_POSIX
+}
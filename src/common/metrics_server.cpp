@@ -0,0 +1,459 @@
+#include "metrics_server.h"
+#include "entry/entry.h"
+#include "profiler.h"
+
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include <bx/string.h>
+#include <bx/thread.h>
+
+#if BX_PLATFORM_POSIX
+#	include <arpa/inet.h>
+#	include <netinet/in.h>
+#	include <poll.h>
+#	include <sys/socket.h>
+#	include <sys/stat.h>
+#	include <sys/time.h>
+#	include <sys/un.h>
+#	include <unistd.h>
+#endif // BX_PLATFORM_POSIX
+
+namespace
+{
+	constexpr uint32_t kFresh      = 4;      // Set in m_middle until the server takes it.
+	constexpr uint32_t kMaxText    = 64<<10;
+	constexpr uint32_t kMaxRequest = 1024;
+	constexpr int32_t  kPollMs     = 100;    // How long stopping may take.
+
+	const char* const s_typeName[MetricType::Count] =
+	{
+		"gauge",
+		"counter",
+	};
+
+	inline uint32_t atomicLoad(uint32_t* _ptr)
+	{
+		return bx::atomicFetchAndAdd<uint32_t>(_ptr, 0);
+	}
+
+	inline uint32_t atomicExchange(uint32_t* _ptr, uint32_t _value)
+	{
+		for (;;)
+		{
+			const uint32_t old = atomicLoad(_ptr);
+			if (old == bx::atomicCompareAndSwap<uint32_t>(_ptr, old, _value) )
+			{
+				return old;
+			}
+		}
+	}
+
+	// Appends _name="_value" with \, " and newlines escaped, or nothing when
+	// it doesn't fit whole. _pos must be below _size.
+	int32_t appendLabel(char* _dst, int32_t _size, int32_t _pos, const char* _name, const char* _value)
+	{
+		const int32_t start = _pos;
+		_pos += bx::snprintf(&_dst[_pos], _size - _pos, "%s%s=\"", 0 == start ? "" : ",", _name);
+
+		bool fits = _pos < _size;
+		for (const char* ch = _value; fits && '\0' != *ch; ++ch)
+		{
+			const bool escape = '\\' == *ch || '"' == *ch || '\n' == *ch;
+			fits = _pos + (escape ? 2 : 1) < _size;
+			if (!fits)
+			{
+				break;
+			}
+
+			if (escape)
+			{
+				_dst[_pos++] = '\\';
+				_dst[_pos++] = '\n' == *ch ? 'n' : *ch;
+			}
+			else
+			{
+				_dst[_pos++] = *ch;
+			}
+		}
+
+		// The closing quote and the terminator.
+		if (!fits
+		||  _pos + 1 >= _size)
+		{
+			_dst[start] = '\0';
+			return start;
+		}
+
+		_dst[_pos++] = '"';
+		_dst[_pos]   = '\0';
+		return _pos;
+	}
+
+	struct MetricsServer
+	{
+		MetricsSnapshot m_snapshots[3];
+		uint32_t m_middle;   // Index of the snapshot in between, | kFresh once published.
+		uint32_t m_back;     // Filled by the publishing thread.
+		uint32_t m_front;    // Formatted by the server thread.
+		uint32_t m_quit;
+		uint32_t m_scrapes;
+		int32_t  m_socket;
+		char     m_unixPath[108];
+		char     m_text[kMaxText];
+		bx::Thread m_thread;
+	};
+
+	static MetricsServer* s_metrics = NULL;
+
+#if BX_PLATFORM_POSIX
+	// Writes as many whole lines as fit, a sample that doesn't is dropped
+	// along with its TYPE line.
+	uint32_t formatSnapshot(const MetricsSnapshot& _snapshot, char* _text, uint32_t _size)
+	{
+		const int32_t size = int32_t(_size);
+		int32_t pos = 0;
+		const char* lastName = "";
+		for (uint32_t ii = 0; ii < _snapshot.m_numSamples; ++ii)
+		{
+			const MetricsSnapshot::Sample& sample = _snapshot.m_samples[ii];
+			const int32_t start = pos;
+			if (0 != bx::strCmp(lastName, sample.m_name) )
+			{
+				pos += bx::snprintf(&_text[pos], size - pos, "# TYPE %s %s\n", sample.m_name, s_typeName[sample.m_type]);
+			}
+
+			if (pos < size)
+			{
+				pos += '\0' == sample.m_labels[0]
+					? bx::snprintf(&_text[pos], size - pos, "%s %.10g\n", sample.m_name, sample.m_value)
+					: bx::snprintf(&_text[pos], size - pos, "%s{%s} %.10g\n", sample.m_name, sample.m_labels, sample.m_value)
+					;
+			}
+
+			if (pos >= size)
+			{
+				pos = start;
+				break;
+			}
+
+			lastName = sample.m_name;
+		}
+
+		_text[pos] = '\0';
+		return uint32_t(pos);
+	}
+
+	bool sendAll(int32_t _socket, const char* _data, uint32_t _size)
+	{
+#if defined(MSG_NOSIGNAL)
+		const int32_t flags = MSG_NOSIGNAL;
+#else
+		const int32_t flags = 0;
+#endif // defined(MSG_NOSIGNAL)
+
+		while (0 < _size)
+		{
+			const ssize_t sent = ::send(_socket, _data, _size, flags);
+			if (0 >= sent)
+			{
+				return false;
+			}
+
+			_data += sent;
+			_size -= uint32_t(sent);
+		}
+
+		return true;
+	}
+
+	void serveClient(int32_t _client)
+	{
+		// A client that connects and says nothing doesn't hold up the next.
+		timeval timeout = { 1, 0 };
+		::setsockopt(_client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+		::setsockopt(_client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout) );
+
+		char request[kMaxRequest];
+		int32_t length = 0;
+		while (length < int32_t(sizeof(request) ) - 1)
+		{
+			const ssize_t num = ::recv(_client, &request[length], sizeof(request) - 1 - length, 0);
+			if (0 >= num)
+			{
+				break;
+			}
+
+			length += int32_t(num);
+			request[length] = '\0';
+			if (!bx::strFind(request, "\r\n\r\n").isEmpty() )
+			{
+				break;
+			}
+		}
+		request[length] = '\0';
+
+		const bool metrics = 0 == bx::strCmp(request, "GET /metrics ", 13)
+			||               0 == bx::strCmp(request, "GET / ", 6)
+			;
+
+		char header[256];
+		if (!metrics)
+		{
+			const int32_t len = bx::snprintf(header, sizeof(header)
+				, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+				);
+			sendAll(_client, header, uint32_t(len) );
+			return;
+		}
+
+		// Takes the newest snapshot, or keeps formatting the last one when
+		// nothing was published since.
+		if (0 != (atomicLoad(&s_metrics->m_middle) & kFresh) )
+		{
+			s_metrics->m_front = atomicExchange(&s_metrics->m_middle, s_metrics->m_front) & ~kFresh;
+		}
+
+		const uint32_t size = formatSnapshot(s_metrics->m_snapshots[s_metrics->m_front], s_metrics->m_text, kMaxText);
+		const int32_t len = bx::snprintf(header, sizeof(header)
+			, "HTTP/1.0 200 OK\r\n"
+			  "Content-Type: text/plain; version=0.0.4\r\n"
+			  "Content-Length: %u\r\n"
+			  "Connection: close\r\n"
+			  "\r\n"
+			, size
+			);
+
+		if (sendAll(_client, header, uint32_t(len) ) )
+		{
+			sendAll(_client, s_metrics->m_text, size);
+		}
+
+		bx::atomicFetchAndAdd<uint32_t>(&s_metrics->m_scrapes, 1);
+	}
+
+	int32_t serverFn(bx::Thread* _thread, void* _userData)
+	{
+		BX_UNUSED(_thread, _userData);
+		profilerSetThreadName("metrics server");
+
+		while (0 == atomicLoad(&s_metrics->m_quit) )
+		{
+			pollfd pfd = { s_metrics->m_socket, POLLIN, 0 };
+			if (0 >= ::poll(&pfd, 1, kPollMs) )
+			{
+				continue;
+			}
+
+			const int32_t client = ::accept(s_metrics->m_socket, NULL, NULL);
+			if (0 > client)
+			{
+				continue;
+			}
+
+			serveClient(client);
+			::close(client);
+		}
+
+		return 0;
+	}
+
+	int32_t openSocket(const char* _address, char* _unixPath, int32_t _unixPathSize)
+	{
+		_unixPath[0] = '\0';
+
+		if (0 == bx::strCmp(_address, "unix:", 5) )
+		{
+			const char* path = &_address[5];
+			sockaddr_un addr;
+			bx::memSet(&addr, 0, sizeof(addr) );
+			addr.sun_family = AF_UNIX;
+			if ('\0' == *path
+			||  bx::strLen(path) >= int32_t(sizeof(addr.sun_path) ) )
+			{
+				return -1;
+			}
+			bx::strCopy(addr.sun_path, sizeof(addr.sun_path), path);
+
+			const int32_t sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			if (0 > sock)
+			{
+				return -1;
+			}
+
+			// Left behind by a process that didn't stop its server, anything
+			// but a socket there is left alone and fails the bind.
+			struct stat info;
+			if (0 == ::stat(path, &info)
+			&&  S_ISSOCK(info.st_mode) )
+			{
+				::unlink(path);
+			}
+			if (0 != ::bind(sock, (const sockaddr*)&addr, sizeof(addr) )
+			||  0 != ::listen(sock, 4) )
+			{
+				::close(sock);
+				return -1;
+			}
+
+			bx::strCopy(_unixPath, _unixPathSize, path);
+			return sock;
+		}
+
+		uint32_t port = 0;
+		if (!bx::fromString(&port, _address)
+		||  0 == port
+		||  UINT16_MAX < port)
+		{
+			return -1;
+		}
+
+		sockaddr_in addr;
+		bx::memSet(&addr, 0, sizeof(addr) );
+		addr.sin_family      = AF_INET;
+		addr.sin_port        = htons(uint16_t(port) );
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		const int32_t sock = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (0 > sock)
+		{
+			return -1;
+		}
+
+		const int32_t reuse = 1;
+		::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse) );
+		if (0 != ::bind(sock, (const sockaddr*)&addr, sizeof(addr) )
+		||  0 != ::listen(sock, 4) )
+		{
+			::close(sock);
+			return -1;
+		}
+
+		return sock;
+	}
+#endif // BX_PLATFORM_POSIX
+
+} // namespace
+
+void MetricsSnapshot::reset()
+{
+	m_numSamples = 0;
+}
+
+void MetricsSnapshot::add(
+	  const char* _name
+	, MetricType::Enum _type
+	, double _value
+	, const char* _label0
+	, const char* _value0
+	, const char* _label1
+	, const char* _value1
+	)
+{
+	if (kMaxSamples == m_numSamples)
+	{
+		return;
+	}
+
+	Sample& sample = m_samples[m_numSamples++];
+	bx::strCopy(sample.m_name, sizeof(sample.m_name), _name);
+	sample.m_type   = _type;
+	sample.m_value  = _value;
+	sample.m_labels[0] = '\0';
+
+	int32_t pos = 0;
+	if (NULL != _label0)
+	{
+		pos = appendLabel(sample.m_labels, sizeof(sample.m_labels), pos, _label0, _value0);
+		if (NULL != _label1)
+		{
+			appendLabel(sample.m_labels, sizeof(sample.m_labels), pos, _label1, _value1);
+		}
+	}
+}
+
+bool metricsServerStart(const char* _address)
+{
+#if BX_PLATFORM_POSIX
+	if (NULL != s_metrics)
+	{
+		return false;
+	}
+
+	char unixPath[108];
+	const int32_t sock = openSocket(_address, unixPath, sizeof(unixPath) );
+	if (0 > sock)
+	{
+		return false;
+	}
+
+	s_metrics = BX_NEW(entry::getAllocator(), MetricsServer);
+	s_metrics->m_snapshots[0].reset();
+	s_metrics->m_snapshots[1].reset();
+	s_metrics->m_snapshots[2].reset();
+	s_metrics->m_back    = 0;
+	s_metrics->m_middle  = 1;
+	s_metrics->m_front   = 2;
+	s_metrics->m_quit    = 0;
+	s_metrics->m_scrapes = 0;
+	s_metrics->m_socket  = sock;
+	bx::strCopy(s_metrics->m_unixPath, sizeof(s_metrics->m_unixPath), unixPath);
+	s_metrics->m_thread.init(serverFn, NULL, 0, "metrics server");
+	return true;
+#else
+	BX_UNUSED(_address);
+	return false;
+#endif // BX_PLATFORM_POSIX
+}
+
+void metricsServerStop()
+{
+#if BX_PLATFORM_POSIX
+	if (NULL == s_metrics)
+	{
+		return;
+	}
+
+	bx::atomicFetchAndAdd<uint32_t>(&s_metrics->m_quit, 1);
+	s_metrics->m_thread.shutdown();
+	::close(s_metrics->m_socket);
+	if ('\0' != s_metrics->m_unixPath[0])
+	{
+		::unlink(s_metrics->m_unixPath);
+	}
+
+	BX_DELETE(entry::getAllocator(), s_metrics);
+	s_metrics = NULL;
+#endif // BX_PLATFORM_POSIX
+}
+
+bool metricsServerIsRunning()
+{
+	return NULL != s_metrics;
+}
+
+MetricsSnapshot* metricsBeginPublish()
+{
+	if (NULL == s_metrics)
+	{
+		return NULL;
+	}
+
+	MetricsSnapshot* snapshot = &s_metrics->m_snapshots[s_metrics->m_back];
+	snapshot->reset();
+	return snapshot;
+}
+
+void metricsPublish()
+{
+	if (NULL == s_metrics)
+	{
+		return;
+	}
+
+	s_metrics->m_back = atomicExchange(&s_metrics->m_middle, s_metrics->m_back | kFresh) & ~kFresh;
+}
+
+uint32_t metricsGetNumScrapes()
+{
+	return NULL == s_metrics ? 0 : atomicLoad(&s_metrics->m_scrapes);
+}
@@ -0,0 +1,94 @@
+#ifndef METRICS_SERVER_H_HEADER_GUARD
+#define METRICS_SERVER_H_HEADER_GUARD
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Embedded metrics endpoint for dashboards. A thread serves the last
+/// published snapshot in the Prometheus text format over plain HTTP, on a
+/// Unix socket or a localhost port:
+///
+///     curl --unix-socket /tmp/heightmap.sock http://localhost/metrics
+///     curl http://127.0.0.1:9100/metrics
+///
+/// Snapshots go through three buffers. Publishing swaps the one just
+/// filled in with a compare-and-swap, a scrape takes the newest one the
+/// same way, so neither side ever waits on the other and a scrape never
+/// sees a snapshot half written.
+
+///
+struct MetricType
+{
+	enum Enum
+	{
+		Gauge,
+		Counter,
+
+		Count
+	};
+};
+
+/// Samples of one publish, served in the order they were added. Add the
+/// samples of a metric one after the other, its TYPE line is written once
+/// before the first.
+///
+struct MetricsSnapshot
+{
+	static constexpr uint32_t kMaxSamples = 256;
+
+	///
+	struct Sample
+	{
+		char             m_name[64];
+		char             m_labels[96]; //!< Without braces, empty for none.
+		double           m_value;
+		MetricType::Enum m_type;
+	};
+
+	///
+	void reset();
+
+	/// Adds a sample with up to two labels, ignored once full. Label values
+	/// are escaped, a NULL label name ends the labels.
+	///
+	void add(
+		  const char* _name
+		, MetricType::Enum _type
+		, double _value
+		, const char* _label0 = NULL
+		, const char* _value0 = NULL
+		, const char* _label1 = NULL
+		, const char* _value1 = NULL
+		);
+
+	Sample   m_samples[kMaxSamples];
+	uint32_t m_numSamples;
+};
+
+/// Starts serving on _address, "unix:<path>" for a Unix socket, replacing
+/// a stale one, or a port number, bound to 127.0.0.1 only. False when the
+/// address can't be bound, or on platforms without BSD sockets.
+///
+bool metricsServerStart(const char* _address);
+
+/// Stops the server, removing its Unix socket.
+///
+void metricsServerStop();
+
+///
+bool metricsServerIsRunning();
+
+/// Snapshot to fill for the next metricsPublish(), reset and owned by the
+/// caller until then. NULL when the server isn't running.
+///
+MetricsSnapshot* metricsBeginPublish();
+
+/// Hands the snapshot from metricsBeginPublish() to the server.
+///
+void metricsPublish();
+
+/// Scrapes of the metrics served so far.
+///
+uint32_t metricsGetNumScrapes();
+
+#endif // METRICS_SERVER_H_HEADER_GUARD
@@ -0,0 +1,290 @@
+#include "png_r16.h"
+
+#include <bx/endian.h>
+#include <bx/uint32_t.h>
+
+// tinfl of the miniz that bimg builds for tinyexr
+#include <miniz.h>
+
+namespace
+{
+	inline uint32_t readBe32(const uint8_t* _ptr)
+	{
+		return 0
+			| (uint32_t(_ptr[0])<<24)
+			| (uint32_t(_ptr[1])<<16)
+			| (uint32_t(_ptr[2])<< 8)
+			| (uint32_t(_ptr[3])<< 0)
+			;
+	}
+
+	static const uint8_t s_pngMagic[8] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+
+	constexpr uint32_t kChunkIHDR = BX_MAKEFOURCC('I', 'H', 'D', 'R');
+	constexpr uint32_t kChunkIDAT = BX_MAKEFOURCC('I', 'D', 'A', 'T');
+	constexpr uint32_t kChunkIEND = BX_MAKEFOURCC('I', 'E', 'N', 'D');
+
+	// Largest texture side bgfx takes, also the bound imageLoad applies.
+	constexpr uint32_t kMaxDimension = UINT16_MAX;
+
+	// Deflate never expands more than 1032:1, so an IDAT stream that
+	// would have to inflate further is truncated or lying about its size.
+	constexpr uint64_t kMaxInflateRatio = 1032;
+
+	inline uint32_t chunkType(const uint8_t* _ptr)
+	{
+		return BX_MAKEFOURCC(_ptr[0], _ptr[1], _ptr[2], _ptr[3]);
+	}
+
+	// Eight bytes at a time in a 64-bit register, bx::simd128_t has no byte
+	// lanes and no unaligned loads, and rows start anywhere.
+	inline uint64_t load64(const uint8_t* _ptr)
+	{
+		uint64_t value;
+		bx::memCopy(&value, _ptr, sizeof(value) );
+		return value;
+	}
+
+	inline void store64(uint8_t* _ptr, uint64_t _value)
+	{
+		bx::memCopy(_ptr, &_value, sizeof(_value) );
+	}
+
+	inline uint8_t paeth(uint8_t _a, uint8_t _b, uint8_t _c)
+	{
+		const int32_t pp = int32_t(_a) + int32_t(_b) - int32_t(_c);
+		const int32_t pa = pp > _a ? pp - _a : _a - pp;
+		const int32_t pb = pp > _b ? pp - _b : _b - pp;
+		const int32_t pc = pp > _c ? pp - _c : _c - pp;
+
+		if (pa <= pb && pa <= pc)
+		{
+			return _a;
+		}
+
+		return pb <= pc ? _b : _c;
+	}
+
+	// Reconstructs one scanline in place. Pixels are 2 bytes wide.
+	bool unfilterRow(uint8_t _filter, uint8_t* _row, const uint8_t* _prior, uint32_t _num)
+	{
+		constexpr uint32_t bpp = 2;
+
+		switch (_filter)
+		{
+		case 0:
+			break;
+
+		case 1:
+			for (uint32_t ii = bpp; ii < _num; ++ii)
+			{
+				_row[ii] = uint8_t(_row[ii] + _row[ii-bpp]);
+			}
+			break;
+
+		case 2:
+			{
+				// Bytewise add, the top bits are summed apart so no carry
+				// crosses into the next byte.
+				uint32_t ii = 0;
+				for (; ii + 8 <= _num; ii += 8)
+				{
+					const uint64_t cur = load64(&_row[ii]);
+					const uint64_t up  = load64(&_prior[ii]);
+					const uint64_t low = (cur & UINT64_C(0x7f7f7f7f7f7f7f7f) ) + (up & UINT64_C(0x7f7f7f7f7f7f7f7f) );
+					store64(&_row[ii], low ^ ( (cur ^ up) & UINT64_C(0x8080808080808080) ) );
+				}
+				for (; ii < _num; ++ii)
+				{
+					_row[ii] = uint8_t(_row[ii] + _prior[ii]);
+				}
+			}
+			break;
+
+		case 3:
+			for (uint32_t ii = 0; ii < _num; ++ii)
+			{
+				const uint32_t left = ii >= bpp ? _row[ii-bpp] : 0;
+				_row[ii] = uint8_t(_row[ii] + ( (left + _prior[ii]) >> 1) );
+			}
+			break;
+
+		case 4:
+			for (uint32_t ii = 0; ii < _num; ++ii)
+			{
+				const uint8_t left     = ii >= bpp ? _row[ii-bpp]   : 0;
+				const uint8_t upperLeft = ii >= bpp ? _prior[ii-bpp] : 0;
+				_row[ii] = uint8_t(_row[ii] + paeth(left, _prior[ii], upperLeft) );
+			}
+			break;
+
+		default:
+			return false;
+		}
+
+		return true;
+	}
+
+	// Big-endian samples to native R16.
+	void swapRow(uint16_t* _dst, const uint8_t* _src, uint32_t _width)
+	{
+		uint32_t ii = 0;
+#if BX_CPU_ENDIAN_LITTLE
+		for (; ii + 4 <= _width; ii += 4)
+		{
+			const uint64_t be = load64(&_src[ii*2]);
+			const uint64_t le = 0
+				| ( (be << 8) & UINT64_C(0xff00ff00ff00ff00) )
+				| ( (be >> 8) & UINT64_C(0x00ff00ff00ff00ff) )
+				;
+			store64( (uint8_t*)&_dst[ii], le);
+		}
+#endif // BX_CPU_ENDIAN_LITTLE
+		for (; ii < _width; ++ii)
+		{
+			_dst[ii] = uint16_t( (_src[ii*2] << 8) | _src[ii*2+1]);
+		}
+	}
+
+} // namespace
+
+bool pngR16Probe(const void* _data, uint32_t _size, uint32_t* _width, uint32_t* _height)
+{
+	const uint8_t* data = (const uint8_t*)_data;
+
+	// Signature, IHDR length and type, 13 bytes of IHDR.
+	if (NULL == data
+	||  _size < 8 + 8 + 13
+	||  0 != bx::memCmp(data, s_pngMagic, sizeof(s_pngMagic) )
+	||  13 != readBe32(&data[8])
+	||  kChunkIHDR != chunkType(&data[12]) )
+	{
+		return false;
+	}
+
+	const uint8_t* ihdr = &data[16];
+	const uint32_t width  = readBe32(&ihdr[0]);
+	const uint32_t height = readBe32(&ihdr[4]);
+	const uint8_t bitDepth    = ihdr[8];
+	const uint8_t colorType   = ihdr[9];
+	const uint8_t compression = ihdr[10];
+	const uint8_t filter      = ihdr[11];
+	const uint8_t interlace   = ihdr[12];
+
+	if (NULL != _width)
+	{
+		*_width = width;
+	}
+
+	if (NULL != _height)
+	{
+		*_height = height;
+	}
+
+	return 0 != width
+		&& 0 != height
+		&& kMaxDimension >= width
+		&& kMaxDimension >= height
+		&& 16 == bitDepth
+		&& 0  == colorType
+		&& 0  == compression
+		&& 0  == filter
+		&& 0  == interlace
+		;
+}
+
+bool pngR16Decode(bx::AllocatorI* _allocator, const void* _data, uint32_t _size, uint16_t* _dst)
+{
+	uint32_t width;
+	uint32_t height;
+	if (!pngR16Probe(_data, _size, &width, &height) )
+	{
+		return false;
+	}
+
+	const uint64_t stride   = uint64_t(width)*2;
+	const uint64_t rawSize  = (stride + 1)*height;
+
+	const uint8_t* data = (const uint8_t*)_data;
+
+	// Gather IDAT payloads, they form a single zlib stream.
+	uint64_t idatSize = 0;
+	for (uint32_t offset = 8; offset + 12 <= _size;)
+	{
+		const uint32_t length = readBe32(&data[offset]);
+		const uint32_t type   = chunkType(&data[offset+4]);
+		if (length > _size - offset - 12)
+		{
+			return false;
+		}
+
+		if (kChunkIDAT == type)
+		{
+			idatSize += length;
+		}
+		else if (kChunkIEND == type)
+		{
+			break;
+		}
+
+		offset += 12 + length;
+	}
+
+	// Both share one allocation, sized from header and chunk lengths that
+	// a crafted file controls.
+	if (rawSize > idatSize*kMaxInflateRatio
+	||  idatSize + rawSize > UINT32_MAX)
+	{
+		return false;
+	}
+
+	uint8_t* idat = (uint8_t*)BX_ALLOC(_allocator, uint32_t(idatSize + rawSize) );
+	uint8_t* raw  = idat + idatSize;
+
+	for (uint32_t offset = 8, pos = 0; offset + 12 <= _size;)
+	{
+		const uint32_t length = readBe32(&data[offset]);
+		const uint32_t type   = chunkType(&data[offset+4]);
+
+		if (kChunkIDAT == type)
+		{
+			bx::memCopy(&idat[pos], &data[offset+8], length);
+			pos += length;
+		}
+		else if (kChunkIEND == type)
+		{
+			break;
+		}
+
+		offset += 12 + length;
+	}
+
+	// The zlib header and Adler-32 are checked, and the stream must fill
+	// every scanline exactly.
+	const size_t inflated = tinfl_decompress_mem_to_mem(raw, size_t(rawSize), idat, size_t(idatSize), TINFL_FLAG_PARSE_ZLIB_HEADER);
+	bool ok = inflated == rawSize;
+
+	if (ok)
+	{
+		uint8_t* zero = (uint8_t*)BX_ALLOC(_allocator, uint32_t(stride) );
+		bx::memSet(zero, 0, uint32_t(stride) );
+
+		const uint8_t* prior = zero;
+		for (uint32_t yy = 0; ok && yy < height; ++yy)
+		{
+			uint8_t* line = &raw[yy*(stride + 1)];
+			uint8_t* row  = line + 1;
+
+			ok = unfilterRow(line[0], row, prior, uint32_t(stride) );
+			swapRow(&_dst[uint64_t(yy)*width], row, width);
+
+			prior = row;
+		}
+
+		BX_FREE(_allocator, zero);
+	}
+
+	BX_FREE(_allocator, idat);
+
+	return ok;
+}
@@ -0,0 +1,30 @@
+#ifndef PNG_R16_H_HEADER_GUARD
+#define PNG_R16_H_HEADER_GUARD
+
+#include <bx/allocator.h>
+
+/// Returns true if _data is a non-interlaced 16-bit grayscale PNG, the
+/// only layout handled by pngR16Decode, no larger than UINT16_MAX on
+/// either side.
+///
+/// @param[in] _data PNG file contents.
+/// @param[in] _size Size of _data in bytes.
+/// @param[out] _width Image width, may be NULL.
+/// @param[out] _height Image height, may be NULL.
+///
+bool pngR16Probe(const void* _data, uint32_t _size, uint32_t* _width, uint32_t* _height);
+
+/// Decodes a 16-bit grayscale PNG straight into native-endian R16 texels.
+/// Scanlines are inflated into one scratch buffer, unfiltered in place and
+/// byte-swapped into _dst row by row, with no intermediate RGBA format.
+///
+/// @param[in] _allocator Allocator for scratch memory.
+/// @param[in] _data PNG file contents.
+/// @param[in] _size Size of _data in bytes.
+/// @param[out] _dst Destination, width*height texels.
+///
+/// @returns False if the stream is not a supported or valid PNG.
+///
+bool pngR16Decode(bx::AllocatorI* _allocator, const void* _data, uint32_t _size, uint16_t* _dst);
+
+#endif // PNG_R16_H_HEADER_GUARD
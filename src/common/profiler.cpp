@@ -0,0 +1,248 @@
+#include "profiler.h"
+#include "format_writer.h"
+
+#include <bx/cpu.h>
+#include <bx/file.h>
+#include <bx/string.h>
+#include <bx/timer.h>
+#include <bx/uint32_t.h>
+
+#if BX_CPU_X86
+#	if BX_COMPILER_MSVC
+#		include <intrin.h>
+#	else
+#		include <x86intrin.h>
+#	endif // BX_COMPILER_MSVC
+#endif // BX_CPU_X86
+
+namespace
+{
+	constexpr uint32_t kMaxThreads    = 64;
+	constexpr uint32_t kCacheLineSize = 64;
+
+	struct Zone
+	{
+		const char* m_name;
+		int64_t     m_begin;
+		int64_t     m_end;
+	};
+
+	// One cache line each, so a thread bumping its m_head doesn't take the
+	// line away from the threads next to it.
+	struct ThreadRing
+	{
+		Zone*       m_zones;
+		const char* m_name;
+		uint32_t    m_head; // Zones recorded so far, the ring keeps the last ones.
+		uint8_t     m_pad[kCacheLineSize - 2*sizeof(void*) - sizeof(uint32_t)];
+	};
+
+	static_assert(sizeof(ThreadRing) == kCacheLineSize, "ThreadRing must fill a cache line.");
+
+	// Allocated aligned to a cache line, with the rings first.
+	struct Profiler
+	{
+		ThreadRing m_threads[kMaxThreads];
+		bx::AllocatorI* m_allocator;
+		uint32_t   m_numThreads;
+		uint32_t   m_mask;
+		int64_t    m_startTicks;
+		int64_t    m_startCounter;
+	};
+
+	// The cycle counter where there is one, it reads several times faster
+	// than bx::getHPCounter() and keeps zones cheap. Its rate is measured
+	// against bx::getHPCounter() when a trace is written.
+	inline int64_t getTicks()
+	{
+#if BX_CPU_X86
+		return int64_t(__rdtsc() );
+#elif BX_CPU_ARM && BX_ARCH_64BIT && !BX_COMPILER_MSVC
+		int64_t ticks;
+		__asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks) );
+		return ticks;
+#else
+		return bx::getHPCounter();
+#endif // BX_CPU_X86
+	}
+
+	static Profiler* s_profiler   = NULL;
+	static uint32_t  s_generation = 0;
+
+	// A thread takes a ring on its first zone. The generation tells a ring
+	// from a previous init apart.
+	ThreadRing* getThreadRing()
+	{
+		static thread_local uint32_t t_ring       = UINT32_MAX;
+		static thread_local uint32_t t_generation = 0;
+
+		Profiler* profiler = s_profiler;
+		if (NULL == profiler)
+		{
+			return NULL;
+		}
+
+		if (t_generation != s_generation)
+		{
+			t_generation = s_generation;
+			t_ring = bx::atomicFetchAndAdd<uint32_t>(&profiler->m_numThreads, 1);
+			if (t_ring < kMaxThreads)
+			{
+				ThreadRing& ring = profiler->m_threads[t_ring];
+				ring.m_zones = (Zone*)BX_ALLOC(profiler->m_allocator, (profiler->m_mask + 1)*sizeof(Zone) );
+			}
+		}
+
+		return t_ring < kMaxThreads ? &profiler->m_threads[t_ring] : NULL;
+	}
+
+} // namespace
+
+void profilerInit(bx::AllocatorI* _allocator, uint32_t _zonesPerThread)
+{
+	if (NULL != s_profiler)
+	{
+		return;
+	}
+
+	Profiler* profiler = (Profiler*)BX_ALIGNED_ALLOC(_allocator, sizeof(Profiler), kCacheLineSize);
+	bx::memSet(profiler, 0, sizeof(Profiler) );
+	profiler->m_allocator = _allocator;
+	profiler->m_mask      = bx::uint32_nextpow2(bx::max<uint32_t>(_zonesPerThread, 2) ) - 1;
+	profiler->m_startTicks   = getTicks();
+	profiler->m_startCounter = bx::getHPCounter();
+
+	++s_generation;
+	s_profiler = profiler;
+}
+
+void profilerShutdown()
+{
+	Profiler* profiler = s_profiler;
+	if (NULL == profiler)
+	{
+		return;
+	}
+
+	s_profiler = NULL;
+
+	const uint32_t numThreads = bx::min(profiler->m_numThreads, kMaxThreads);
+	for (uint32_t ii = 0; ii < numThreads; ++ii)
+	{
+		BX_FREE(profiler->m_allocator, profiler->m_threads[ii].m_zones);
+	}
+
+	bx::AllocatorI* allocator = profiler->m_allocator;
+	BX_ALIGNED_FREE(allocator, profiler, kCacheLineSize);
+}
+
+void profilerSetThreadName(const char* _name)
+{
+	ThreadRing* ring = getThreadRing();
+	if (NULL != ring)
+	{
+		ring->m_name = _name;
+	}
+}
+
+bool profilerWriteTrace(const char* _filePath)
+{
+	Profiler* profiler = s_profiler;
+	if (NULL == profiler)
+	{
+		return false;
+	}
+
+	bx::FileWriter writer;
+	bx::Error err;
+	if (!bx::open(&writer, _filePath, false, &err) )
+	{
+		return false;
+	}
+
+	const int64_t elapsedTicks   = getTicks() - profiler->m_startTicks;
+	const int64_t elapsedCounter = bx::getHPCounter() - profiler->m_startCounter;
+	const double  ticksPerSecond = 0 < elapsedCounter && 0 < elapsedTicks
+		? double(elapsedTicks) / double(elapsedCounter) * double(bx::getHPFrequency() )
+		: double(bx::getHPFrequency() )
+		;
+	const double toUs = 1.0e6 / ticksPerSecond;
+
+	const uint32_t size = profiler->m_mask + 1;
+	Zone* zones = (Zone*)BX_ALLOC(profiler->m_allocator, size*sizeof(Zone) );
+
+	writef(&writer, &err, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	bool first = true;
+	const uint32_t numThreads = bx::min(profiler->m_numThreads, kMaxThreads);
+	for (uint32_t tid = 0; tid < numThreads; ++tid)
+	{
+		ThreadRing& ring = profiler->m_threads[tid];
+
+		const uint32_t head = bx::atomicFetchAndAdd<uint32_t>(&ring.m_head, 0);
+		if (0 == head)
+		{
+			continue;
+		}
+
+		const uint32_t begin = head > size ? head - size : 0;
+		for (uint32_t ii = begin; ii < head; ++ii)
+		{
+			zones[ii - begin] = ring.m_zones[ii & profiler->m_mask];
+		}
+
+		// Zones recorded while copying may have overwritten the oldest ones.
+		const uint32_t last = bx::atomicFetchAndAdd<uint32_t>(&ring.m_head, 0);
+		const uint32_t valid = last + 1 > size ? bx::max(begin, last + 1 - size) : begin;
+
+		writef(&writer, &err
+			, "%s\t{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"args\": {\"name\": \"%s\"}}"
+			, first ? "" : ",\n"
+			, tid
+			, NULL != ring.m_name ? ring.m_name : "thread"
+			);
+		first = false;
+
+		for (uint32_t ii = valid; ii < head; ++ii)
+		{
+			const Zone& zone = zones[ii - begin];
+			writef(&writer, &err
+				, ",\n\t{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}"
+				, zone.m_name
+				, tid
+				, double(zone.m_begin - profiler->m_startTicks) * toUs
+				, double(zone.m_end - zone.m_begin) * toUs
+				);
+		}
+	}
+
+	writef(&writer, &err, "\n]}\n");
+	bx::close(&writer);
+
+	BX_FREE(profiler->m_allocator, zones);
+	return err.isOk();
+}
+
+ProfilerScope::ProfilerScope(const char* _name)
+	: m_name(_name)
+	, m_begin(getTicks() )
+{
+}
+
+ProfilerScope::~ProfilerScope()
+{
+	ThreadRing* ring = getThreadRing();
+	if (NULL == ring)
+	{
+		return;
+	}
+
+	const uint32_t head = ring->m_head;
+	Zone& zone = ring->m_zones[head & s_profiler->m_mask];
+	zone.m_name  = m_name;
+	zone.m_begin = m_begin;
+	zone.m_end   = getTicks();
+
+	// Publishes the zone to profilerWriteTrace().
+	bx::atomicFetchAndAdd<uint32_t>(&ring->m_head, 1);
+}
@@ -0,0 +1,45 @@
+#ifndef PROFILER_H_HEADER_GUARD
+#define PROFILER_H_HEADER_GUARD
+
+#include <bx/allocator.h>
+#include <bx/macros.h>
+
+/// Scoped-zone profiler. Every thread records into its own ring of
+/// completed zones, so a zone costs two timer reads and a store, no lock.
+/// Rings keep the most recent zones and overwrite the oldest. Zone names
+/// are kept by pointer, pass string literals.
+///
+/// Before profilerInit() and after profilerShutdown() zones record nothing.
+
+/// @param[in] _allocator Rings come from here.
+/// @param[in] _zonesPerThread Ring size, rounded up to a power of two.
+///
+void profilerInit(bx::AllocatorI* _allocator, uint32_t _zonesPerThread = 1<<15);
+
+///
+void profilerShutdown();
+
+/// Names the calling thread in traces. _name must outlive the profiler.
+///
+void profilerSetThreadName(const char* _name);
+
+/// Writes the zones still in the rings as Chrome trace event JSON, which
+/// chrome://tracing and ui.perfetto.dev open. Zones being recorded
+/// meanwhile may be missing, none come out torn.
+///
+bool profilerWriteTrace(const char* _filePath);
+
+///
+struct ProfilerScope
+{
+	ProfilerScope(const char* _name);
+	~ProfilerScope();
+
+	const char* m_name;
+	int64_t     m_begin;
+};
+
+///
+#define PROFILER_SCOPE(_name) ProfilerScope BX_CONCATENATE(profilerScope, __LINE__)(_name)
+
+#endif // PROFILER_H_HEADER_GUARD
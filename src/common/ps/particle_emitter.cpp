@@ -0,0 +1,970 @@
+/*
+ * Copyright 2011-2022 Branimir Karadzic. All rights reserved.
+ * License: https://github.com/bkaradzic/bgfx/blob/master/LICENSE
+ */
+
+#include "particle_emitter.h"
+#include "../job_system.h"
+
+#include <bx/easing.h>
+#include <bx/simd_t.h>
+
+void EmitterUniforms::reset()
+{
+	m_position[0] = 0.0f;
+	m_position[1] = 0.0f;
+	m_position[2] = 0.0f;
+
+	m_angle[0] = 0.0f;
+	m_angle[1] = 0.0f;
+	m_angle[2] = 0.0f;
+
+	m_particlesPerSecond = 0;
+
+	m_offsetStart[0] = 0.0f;
+	m_offsetStart[1] = 1.0f;
+	m_offsetEnd[0]   = 2.0f;
+	m_offsetEnd[1]   = 3.0f;
+
+	m_rgba[0] = 0x00ffffff;
+	m_rgba[1] = UINT32_MAX;
+	m_rgba[2] = UINT32_MAX;
+	m_rgba[3] = UINT32_MAX;
+	m_rgba[4] = 0x00ffffff;
+
+	m_blendStart[0] = 0.8f;
+	m_blendStart[1] = 1.0f;
+	m_blendEnd[0]   = 0.0f;
+	m_blendEnd[1]   = 0.2f;
+
+	m_scaleStart[0] = 0.1f;
+	m_scaleStart[1] = 0.2f;
+	m_scaleEnd[0]   = 0.3f;
+	m_scaleEnd[1]   = 0.4f;
+
+	m_lifeSpan[0]   = 1.0f;
+	m_lifeSpan[1]   = 2.0f;
+
+	m_gravityScale  = 0.0f;
+
+	m_easePos   = bx::Easing::Linear;
+	m_easeRgba  = bx::Easing::Linear;
+	m_easeBlend = bx::Easing::Linear;
+	m_easeScale = bx::Easing::Linear;
+}
+
+namespace ps
+{
+	namespace
+	{
+		// Particles eased or moved together, the scratch lives on the stack.
+		constexpr uint32_t kBatch = 256;
+
+		struct EaseMode
+		{
+			enum Enum
+			{
+				In,
+				Out,
+				InOut,
+				OutIn,
+			};
+		};
+
+		template<uint32_t PowerT>
+		inline float easeInPow(float _t)
+		{
+			float result = _t;
+			for (uint32_t ii = 1; ii < PowerT; ++ii)
+			{
+				result *= _t;
+			}
+
+			return result;
+		}
+
+		template<uint32_t PowerT>
+		inline float easeOutPow(float _t)
+		{
+			return 1.0f - easeInPow<PowerT>(1.0f - _t);
+		}
+
+		// Same shapes as bx::easeIn*, easeOut*, and their easeMix halves.
+		// Both halves are computed and selected, so the loops vectorize.
+		template<uint32_t PowerT>
+		void easePowBatch(EaseMode::Enum _mode, const float* _in, float* _out, uint32_t _num)
+		{
+			switch (_mode)
+			{
+			case EaseMode::In:
+				for (uint32_t ii = 0; ii < _num; ++ii)
+				{
+					_out[ii] = easeInPow<PowerT>(_in[ii]);
+				}
+				break;
+
+			case EaseMode::Out:
+				for (uint32_t ii = 0; ii < _num; ++ii)
+				{
+					_out[ii] = easeOutPow<PowerT>(_in[ii]);
+				}
+				break;
+
+			case EaseMode::InOut:
+				for (uint32_t ii = 0; ii < _num; ++ii)
+				{
+					const float tt = _in[ii];
+					const float lo = easeInPow<PowerT>(2.0f*tt)*0.5f;
+					const float hi = easeOutPow<PowerT>(2.0f*tt - 1.0f)*0.5f + 0.5f;
+					_out[ii] = tt < 0.5f ? lo : hi;
+				}
+				break;
+
+			case EaseMode::OutIn:
+				for (uint32_t ii = 0; ii < _num; ++ii)
+				{
+					const float tt = _in[ii];
+					const float lo = easeOutPow<PowerT>(2.0f*tt)*0.5f;
+					const float hi = easeInPow<PowerT>(2.0f*tt - 1.0f)*0.5f + 0.5f;
+					_out[ii] = tt < 0.5f ? lo : hi;
+				}
+				break;
+			}
+		}
+
+		inline void clampBatch(float* _values, uint32_t _num)
+		{
+			for (uint32_t ii = 0; ii < _num; ++ii)
+			{
+				_values[ii] = bx::clamp(_values[ii], 0.0f, 1.0f);
+			}
+		}
+
+		// Every destination is below every source still to come, so the moves
+		// don't depend on each other and each stream is done in one go.
+		void moveParticles(float* const* _stream, uint32_t* const* _rgba, const uint32_t* _dst, const uint32_t* _src, uint32_t _num)
+		{
+			for (uint32_t ii = 0; ii < ParticleStream::Count; ++ii)
+			{
+				if (ParticleStream::Life == ii)
+				{
+					continue;
+				}
+
+				float* stream = _stream[ii];
+				for (uint32_t jj = 0; jj < _num; ++jj)
+				{
+					stream[_dst[jj] ] = stream[_src[jj] ];
+				}
+			}
+
+			for (uint32_t ii = 0; ii < Emitter::kNumColors; ++ii)
+			{
+				uint32_t* rgba = _rgba[ii];
+				for (uint32_t jj = 0; jj < _num; ++jj)
+				{
+					rgba[_dst[jj] ] = rgba[_src[jj] ];
+				}
+			}
+		}
+
+		inline uint32_t lerpAbgr(uint32_t _start, uint32_t _end, float _tt)
+		{
+			uint32_t abgr = 0;
+			for (uint32_t shift = 0; shift < 32; shift += 8)
+			{
+				const float channel = bx::lerp(float( (_start>>shift)&0xff), float( (_end>>shift)&0xff), _tt);
+				abgr |= uint32_t(uint8_t(channel) ) << shift;
+			}
+
+			return abgr;
+		}
+
+		inline void writeVertex(ParticleVertex* _vertex, const bx::Vec3& _pos, uint32_t _abgr, float _u, float _v, float _blend)
+		{
+			bx::store(&_vertex->m_x, _pos);
+			_vertex->m_abgr  = _abgr;
+			_vertex->m_u     = _u;
+			_vertex->m_v     = _v;
+			_vertex->m_blend = _blend;
+			_vertex->m_angle = 0.0f;
+		}
+
+		inline bx::simd128_t lerp4(bx::simd128_t _a, bx::simd128_t _b, bx::simd128_t _t)
+		{
+			return bx::simd_add(_a, bx::simd_mul(bx::simd_sub(_b, _a), _t) );
+		}
+
+		// Integer part of values in [0, 256), as uint8_t() takes it. Adding
+		// 2^23 leaves the nearest integer in the low mantissa bits, one less
+		// is taken where that rounded up, so it doesn't matter how the
+		// platform's simd_ftoi() rounds.
+		inline bx::simd128_t truncByte4(bx::simd128_t _a)
+		{
+			const bx::simd128_t magic   = bx::simd_splat(8388608.0f);
+			const bx::simd128_t biased  = bx::simd_add(_a, magic);
+			const bx::simd128_t nearest = bx::simd_isub(biased, magic);
+			const bx::simd128_t up      = bx::simd_cmpgt(bx::simd_sub(biased, magic), _a);
+			return bx::simd_iadd(nearest, up);
+		}
+
+		// Channel by channel, as lerpAbgr() does for one particle.
+		inline bx::simd128_t lerpAbgr4(bx::simd128_t _start, bx::simd128_t _end, bx::simd128_t _tt)
+		{
+			const bx::simd128_t mask = bx::simd_isplat(0xff);
+			bx::simd128_t abgr = bx::simd_zero();
+			for (int32_t shift = 0; shift < 32; shift += 8)
+			{
+				const bx::simd128_t from = bx::simd_itof(bx::simd_and(bx::simd_srl(_start, shift), mask) );
+				const bx::simd128_t to   = bx::simd_itof(bx::simd_and(bx::simd_srl(_end,   shift), mask) );
+				const bx::simd128_t channel = truncByte4(lerp4(from, to, _tt) );
+				abgr = bx::simd_or(abgr, bx::simd_sll(bx::simd_and(channel, mask), shift) );
+			}
+
+			return abgr;
+		}
+
+		// One corner of four quads: (x, y, z, abgr) and (u, v, blend, 0)
+		// transposed into the four vertices.
+		inline void writeCorner4(ParticleVertex* _vertex, bx::simd128_t _x, bx::simd128_t _y, bx::simd128_t _z, bx::simd128_t _abgr, bx::simd128_t _uv, bx::simd128_t _blend)
+		{
+			const bx::simd128_t xy01 = bx::simd_shuf_xAyB(_x, _y);
+			const bx::simd128_t xy23 = bx::simd_shuf_zCwD(_x, _y);
+			const bx::simd128_t za01 = bx::simd_shuf_xAyB(_z, _abgr);
+			const bx::simd128_t za23 = bx::simd_shuf_zCwD(_z, _abgr);
+			const bx::simd128_t bz01 = bx::simd_shuf_xAyB(_blend, bx::simd_zero() );
+			const bx::simd128_t bz23 = bx::simd_shuf_zCwD(_blend, bx::simd_zero() );
+
+			bx::simd_st(&_vertex[ 0].m_x, bx::simd_shuf_xyAB(xy01, za01) );
+			bx::simd_st(&_vertex[ 0].m_u, bx::simd_shuf_xyAB(_uv,  bz01) );
+			bx::simd_st(&_vertex[ 4].m_x, bx::simd_shuf_zwCD(xy01, za01) );
+			bx::simd_st(&_vertex[ 4].m_u, bx::simd_shuf_zwCD(_uv,  bz01) );
+			bx::simd_st(&_vertex[ 8].m_x, bx::simd_shuf_xyAB(xy23, za23) );
+			bx::simd_st(&_vertex[ 8].m_u, bx::simd_shuf_xyAB(_uv,  bz23) );
+			bx::simd_st(&_vertex[12].m_x, bx::simd_shuf_zwCD(xy23, za23) );
+			bx::simd_st(&_vertex[12].m_u, bx::simd_shuf_zwCD(_uv,  bz23) );
+		}
+
+		inline float hmin(bx::simd128_t _a)
+		{
+			_a = bx::simd_min(_a, bx::simd_swiz_zwxy(_a) );
+			_a = bx::simd_min(_a, bx::simd_swiz_yxwz(_a) );
+			return bx::simd_x(_a);
+		}
+
+		inline float hmax(bx::simd128_t _a)
+		{
+			_a = bx::simd_max(_a, bx::simd_swiz_zwxy(_a) );
+			_a = bx::simd_max(_a, bx::simd_swiz_yxwz(_a) );
+			return bx::simd_x(_a);
+		}
+
+		// Transform and number of the particles spawned over _dt, the rest of
+		// the time carries over to the next update.
+		uint32_t beginSpawn(Emitter& _emitter, float _dt, float* _mtx, float* _timePerParticle)
+		{
+			const EmitterUniforms& uniforms = _emitter.m_uniforms;
+			bx::mtxSRT(_mtx
+				, 1.0f, 1.0f, 1.0f
+				, uniforms.m_angle[0],    uniforms.m_angle[1],    uniforms.m_angle[2]
+				, uniforms.m_position[0], uniforms.m_position[1], uniforms.m_position[2]
+				);
+
+			const float timePerParticle = 1.0f/uniforms.m_particlesPerSecond;
+			_emitter.m_dt += _dt;
+			const uint32_t numParticles = uint32_t(_emitter.m_dt / timePerParticle);
+			_emitter.m_dt -= numParticles * timePerParticle;
+
+			*_timePerParticle = timePerParticle;
+			return numParticles;
+		}
+
+		// Writes a new particle to slot _idx, _time into its life.
+		void spawnParticle(Emitter& _emitter, uint32_t _idx, const float* _mtx, float _time)
+		{
+			constexpr bx::Vec3 up = { 0.0f, 1.0f, 0.0f };
+
+			const EmitterUniforms& uniforms = _emitter.m_uniforms;
+			bx::RngMwc* rng = &_emitter.m_rng;
+			float* const* stream = _emitter.m_stream;
+
+			bx::Vec3 pos(bx::init::None);
+			switch (_emitter.m_shape)
+			{
+				default:
+				case EmitterShape::Sphere:
+					pos = bx::randUnitSphere(rng);
+					break;
+
+				case EmitterShape::Hemisphere:
+					pos = bx::randUnitHemisphere(rng, up);
+					break;
+
+				case EmitterShape::Circle:
+					pos = bx::randUnitCircle(rng);
+					break;
+
+				case EmitterShape::Disc:
+					{
+						const bx::Vec3 tmp = bx::randUnitCircle(rng);
+						pos = bx::mul(tmp, bx::frnd(rng) );
+					}
+					break;
+
+				case EmitterShape::Rect:
+					pos =
+					{
+						bx::frndh(rng),
+						0.0f,
+						bx::frndh(rng),
+					};
+					break;
+			}
+
+			bx::Vec3 dir(bx::init::None);
+			switch (_emitter.m_direction)
+			{
+				default:
+				case EmitterDirection::Up:
+					dir = up;
+					break;
+
+				case EmitterDirection::Outward:
+					dir = bx::normalize(pos);
+					break;
+			}
+
+			const float startOffset = bx::lerp(uniforms.m_offsetStart[0], uniforms.m_offsetStart[1], bx::frnd(rng) );
+			const bx::Vec3 start = bx::mul(pos, startOffset);
+
+			const float endOffset = bx::lerp(uniforms.m_offsetEnd[0], uniforms.m_offsetEnd[1], bx::frnd(rng) );
+			const bx::Vec3 tmp1 = bx::mul(dir, endOffset);
+			const bx::Vec3 end  = bx::add(tmp1, start);
+
+			const float lifeSpan = bx::lerp(uniforms.m_lifeSpan[0], uniforms.m_lifeSpan[1], bx::frnd(rng) );
+			stream[ParticleStream::Life][_idx]        = _time;
+			stream[ParticleStream::InvLifeSpan][_idx] = 1.0f/lifeSpan;
+
+			const bx::Vec3 gravity = { 0.0f, -9.81f * uniforms.m_gravityScale * bx::square(lifeSpan), 0.0f };
+
+			const bx::Vec3 start0 = bx::mul(start, _mtx);
+			const bx::Vec3 end0   = bx::mul(end,   _mtx);
+			const bx::Vec3 end1   = bx::add(end0, gravity);
+			stream[ParticleStream::StartX][_idx] = start0.x;
+			stream[ParticleStream::StartY][_idx] = start0.y;
+			stream[ParticleStream::StartZ][_idx] = start0.z;
+			stream[ParticleStream::End0X ][_idx] = end0.x;
+			stream[ParticleStream::End0Y ][_idx] = end0.y;
+			stream[ParticleStream::End0Z ][_idx] = end0.z;
+			stream[ParticleStream::End1X ][_idx] = end1.x;
+			stream[ParticleStream::End1Y ][_idx] = end1.y;
+			stream[ParticleStream::End1Z ][_idx] = end1.z;
+
+			for (uint32_t jj = 0; jj < Emitter::kNumColors; ++jj)
+			{
+				_emitter.m_rgba[jj][_idx] = uniforms.m_rgba[jj];
+			}
+
+			stream[ParticleStream::BlendStart][_idx] = bx::lerp(uniforms.m_blendStart[0], uniforms.m_blendStart[1], bx::frnd(rng) );
+			stream[ParticleStream::BlendEnd  ][_idx] = bx::lerp(uniforms.m_blendEnd[0],   uniforms.m_blendEnd[1],   bx::frnd(rng) );
+
+			stream[ParticleStream::ScaleStart][_idx] = bx::lerp(uniforms.m_scaleStart[0], uniforms.m_scaleStart[1], bx::frnd(rng) );
+			stream[ParticleStream::ScaleEnd  ][_idx] = bx::lerp(uniforms.m_scaleEnd[0],   uniforms.m_scaleEnd[1],   bx::frnd(rng) );
+		}
+
+		// Particles rendered by one job. A multiple of kBatch, so slices of
+		// one emitter ease the same batches as rendering it in one go.
+		constexpr uint32_t kRenderGrain = 4*kBatch;
+
+		struct UpdateContext
+		{
+			Emitter* const* m_emitters;
+			float           m_dt;
+		};
+
+		void updateRange(uint32_t _begin, uint32_t _end, void* _userData)
+		{
+			const UpdateContext& ctx = *(const UpdateContext*)_userData;
+
+			for (uint32_t ii = _begin; ii < _end; ++ii)
+			{
+				ctx.m_emitters[ii]->update(ctx.m_dt);
+			}
+		}
+
+		struct RenderSlice
+		{
+			uint32_t m_emitter;
+			uint32_t m_begin;
+			uint32_t m_end;
+			uint32_t m_first;
+			bx::Aabb m_aabb;
+		};
+
+		struct RenderContext
+		{
+			Emitter* const* m_emitters;
+			const float   (*m_uv)[4];
+			RenderSlice*    m_slices;
+			const float*    m_mtxView;
+			bx::Vec3        m_eye;
+			ParticleSort*   m_outSort;
+			ParticleVertex* m_outVertices;
+		};
+
+		void renderRange(uint32_t _begin, uint32_t _end, void* _userData)
+		{
+			const RenderContext& ctx = *(const RenderContext*)_userData;
+
+			for (uint32_t ii = _begin; ii < _end; ++ii)
+			{
+				RenderSlice& slice = ctx.m_slices[ii];
+				ctx.m_emitters[slice.m_emitter]->renderRange(
+					  ctx.m_uv[slice.m_emitter]
+					, ctx.m_mtxView
+					, ctx.m_eye
+					, slice.m_begin
+					, slice.m_end
+					, slice.m_first
+					, ctx.m_outSort
+					, ctx.m_outVertices
+					, slice.m_aabb
+					);
+			}
+		}
+
+	} // namespace
+
+	void easeBatch(bx::Easing::Enum _ease, const float* _in, float* _out, uint32_t _num)
+	{
+		switch (_ease)
+		{
+		case bx::Easing::Linear:
+			bx::memCopy(_out, _in, _num*sizeof(float) );
+			break;
+
+		case bx::Easing::Step:
+			for (uint32_t ii = 0; ii < _num; ++ii)
+			{
+				_out[ii] = _in[ii] < 0.5f ? 0.0f : 1.0f;
+			}
+			break;
+
+		case bx::Easing::SmoothStep:
+			for (uint32_t ii = 0; ii < _num; ++ii)
+			{
+				const float tt = _in[ii];
+				_out[ii] = tt*tt*(3.0f - 2.0f*tt);
+			}
+			break;
+
+		case bx::Easing::InQuad:     easePowBatch<2>(EaseMode::In,    _in, _out, _num); break;
+		case bx::Easing::OutQuad:    easePowBatch<2>(EaseMode::Out,   _in, _out, _num); break;
+		case bx::Easing::InOutQuad:  easePowBatch<2>(EaseMode::InOut, _in, _out, _num); break;
+		case bx::Easing::OutInQuad:  easePowBatch<2>(EaseMode::OutIn, _in, _out, _num); break;
+		case bx::Easing::InCubic:    easePowBatch<3>(EaseMode::In,    _in, _out, _num); break;
+		case bx::Easing::OutCubic:   easePowBatch<3>(EaseMode::Out,   _in, _out, _num); break;
+		case bx::Easing::InOutCubic: easePowBatch<3>(EaseMode::InOut, _in, _out, _num); break;
+		case bx::Easing::OutInCubic: easePowBatch<3>(EaseMode::OutIn, _in, _out, _num); break;
+		case bx::Easing::InQuart:    easePowBatch<4>(EaseMode::In,    _in, _out, _num); break;
+		case bx::Easing::OutQuart:   easePowBatch<4>(EaseMode::Out,   _in, _out, _num); break;
+		case bx::Easing::InOutQuart: easePowBatch<4>(EaseMode::InOut, _in, _out, _num); break;
+		case bx::Easing::OutInQuart: easePowBatch<4>(EaseMode::OutIn, _in, _out, _num); break;
+		case bx::Easing::InQuint:    easePowBatch<5>(EaseMode::In,    _in, _out, _num); break;
+		case bx::Easing::OutQuint:   easePowBatch<5>(EaseMode::Out,   _in, _out, _num); break;
+		case bx::Easing::InOutQuint: easePowBatch<5>(EaseMode::InOut, _in, _out, _num); break;
+		case bx::Easing::OutInQuint: easePowBatch<5>(EaseMode::OutIn, _in, _out, _num); break;
+
+		default:
+			{
+				// Sine, expo, circ, elastic, back and bounce keep bx's
+				// functions, still looked up once per batch.
+				const bx::EaseFn ease = bx::getEaseFunc(_ease);
+				for (uint32_t ii = 0; ii < _num; ++ii)
+				{
+					_out[ii] = ease(_in[ii]);
+				}
+			}
+			break;
+		}
+	}
+
+	void Emitter::create(EmitterShape::Enum _shape, EmitterDirection::Enum _direction, uint32_t _maxParticles, bx::AllocatorI* _allocator)
+	{
+		reset();
+
+		m_shape     = _shape;
+		m_direction = _direction;
+		m_max       = _maxParticles;
+		m_allocator = _allocator;
+
+		// All streams in one block, each padded to whole groups of four.
+		const uint32_t capacity = (m_max + 3) & ~3u;
+		const uint32_t numStreams = ParticleStream::Count + kNumColors;
+		m_data = BX_ALIGNED_ALLOC(m_allocator, size_t(capacity)*numStreams*sizeof(float), 16);
+
+		float* data = (float*)m_data;
+		for (uint32_t ii = 0; ii < ParticleStream::Count; ++ii)
+		{
+			m_stream[ii] = data;
+			data += capacity;
+		}
+
+		for (uint32_t ii = 0; ii < kNumColors; ++ii)
+		{
+			m_rgba[ii] = (uint32_t*)data;
+			data += capacity;
+		}
+	}
+
+	void Emitter::destroy()
+	{
+		BX_ALIGNED_FREE(m_allocator, m_data, 16);
+		m_data = NULL;
+	}
+
+	void Emitter::reset()
+	{
+		m_dt = 0.0f;
+		m_uniforms.reset();
+		m_num = 0;
+		bx::memSet(&m_aabb, 0, sizeof(bx::Aabb) );
+
+		m_rng.reset();
+	}
+
+	void Emitter::update(float _dt)
+	{
+		float* life = m_stream[ParticleStream::Life];
+		const float* invLifeSpan = m_stream[ParticleStream::InvLifeSpan];
+		uint32_t num = m_num;
+
+		uint32_t ii = 0;
+		const bx::simd128_t dt = bx::simd_splat(_dt);
+		for (; ii + 4 <= num; ii += 4)
+		{
+			bx::simd_st(&life[ii], bx::simd_add(bx::simd_ld(&life[ii]), bx::simd_mul(dt, bx::simd_ld(&invLifeSpan[ii]) ) ) );
+		}
+
+		for (; ii < num; ++ii)
+		{
+			life[ii] += _dt*invLifeSpan[ii];
+		}
+
+		// Particles spawned this update take the slots of the first expired
+		// ones, where the scan finds them, and the rest are appended. That
+		// saves moving a particle from the end into every slot that's
+		// written again right after, the steady state spawns about as many
+		// particles as expire.
+		float mtx[16];
+		float timePerParticle = 0.0f;
+		float time = 0.0f;
+		const uint32_t numSpawn = 0 < m_uniforms.m_particlesPerSecond
+			? beginSpawn(*this, _dt, mtx, &timePerParticle)
+			: 0
+			;
+		uint32_t numSpawned = 0;
+
+		// Other expired particles are replaced by the last one, which is
+		// then checked in turn. Whole groups of four still alive are skipped
+		// at once.
+		// Only life is moved while scanning, the moves are replayed on the
+		// other streams a batch at a time, one stream after the other.
+		uint32_t moveDst[kBatch];
+		uint32_t moveSrc[kBatch];
+		uint32_t numMoves = 0;
+
+		const bx::simd128_t one = bx::simd_splat(1.0f);
+
+		ii = 0;
+		while (ii < num)
+		{
+			if (0 == (ii & 3) )
+			{
+				while (ii + 4 <= num
+				&&     !bx::simd_test_any_xyzw(bx::simd_cmpgt(bx::simd_ld(&life[ii]), one) ) )
+				{
+					ii += 4;
+				}
+
+				if (ii == num)
+				{
+					break;
+				}
+			}
+
+			if (life[ii] > 1.0f)
+			{
+				if (numSpawned < numSpawn)
+				{
+					spawnParticle(*this, ii, mtx, time);
+					time += timePerParticle;
+					++numSpawned;
+					++ii;
+				}
+				else
+				{
+					--num;
+					life[ii] = life[num];
+
+					if (ii != num)
+					{
+						moveDst[numMoves] = ii;
+						moveSrc[numMoves] = num;
+						++numMoves;
+
+						if (kBatch == numMoves)
+						{
+							moveParticles(m_stream, m_rgba, moveDst, moveSrc, numMoves);
+							numMoves = 0;
+						}
+					}
+				}
+			}
+			else
+			{
+				++ii;
+			}
+		}
+
+		moveParticles(m_stream, m_rgba, moveDst, moveSrc, numMoves);
+
+		for (; numSpawned < numSpawn && num < m_max; ++numSpawned)
+		{
+			spawnParticle(*this, num, mtx, time);
+			time += timePerParticle;
+			++num;
+		}
+
+		m_num = num;
+	}
+
+	void Emitter::spawn(float _dt)
+	{
+		float mtx[16];
+		float timePerParticle;
+		const uint32_t numParticles = beginSpawn(*this, _dt, mtx, &timePerParticle);
+
+		float time = 0.0f;
+		for (uint32_t ii = 0
+			; ii < numParticles && m_num < m_max
+			; ++ii
+			)
+		{
+			spawnParticle(*this, m_num, mtx, time);
+			m_num++;
+
+			time += timePerParticle;
+		}
+	}
+
+	uint32_t Emitter::render(
+		  const float _uv[4]
+		, const float* _mtxView
+		, const bx::Vec3& _eye
+		, uint32_t _first
+		, uint32_t _max
+		, ParticleSort* _outSort
+		, ParticleVertex* _outVertices
+		)
+	{
+		const uint32_t num = _first < _max ? bx::min(m_num, _max - _first) : 0;
+
+		bx::Aabb aabb =
+		{
+			{  bx::kInfinity,  bx::kInfinity,  bx::kInfinity },
+			{ -bx::kInfinity, -bx::kInfinity, -bx::kInfinity },
+		};
+
+		renderRange(_uv, _mtxView, _eye, 0, num, _first, _outSort, _outVertices, aabb);
+		m_aabb = aabb;
+
+		return num;
+	}
+
+	void Emitter::renderRange(
+		  const float _uv[4]
+		, const float* _mtxView
+		, const bx::Vec3& _eye
+		, uint32_t _begin
+		, uint32_t _end
+		, uint32_t _first
+		, ParticleSort* _outSort
+		, ParticleVertex* _outVertices
+		, bx::Aabb& _aabb
+		) const
+	{
+		BX_ASSERT(0 == (_begin & 3), "Range must start on a group of four, not %d.", _begin);
+		BX_ASSERT(bx::isAligned(_outVertices, 16), "Vertices must be 16-byte aligned.");
+
+		const float* const* stream = m_stream;
+		const float* life       = stream[ParticleStream::Life];
+		const float* startX     = stream[ParticleStream::StartX];
+		const float* startY     = stream[ParticleStream::StartY];
+		const float* startZ     = stream[ParticleStream::StartZ];
+		const float* end0X      = stream[ParticleStream::End0X];
+		const float* end0Y      = stream[ParticleStream::End0Y];
+		const float* end0Z      = stream[ParticleStream::End0Z];
+		const float* end1X      = stream[ParticleStream::End1X];
+		const float* end1Y      = stream[ParticleStream::End1Y];
+		const float* end1Z      = stream[ParticleStream::End1Z];
+		const float* blendStart = stream[ParticleStream::BlendStart];
+		const float* blendEnd   = stream[ParticleStream::BlendEnd];
+		const float* scaleStart = stream[ParticleStream::ScaleStart];
+		const float* scaleEnd   = stream[ParticleStream::ScaleEnd];
+
+		// Local copy, the vertex stores could otherwise alias the members.
+		const uint32_t* rgba[kNumColors];
+		bx::memCopy(rgba, m_rgba, sizeof(rgba) );
+
+		bx::Aabb aabb = _aabb;
+
+		bx::simd128_t minX = bx::simd_splat( bx::kInfinity);
+		bx::simd128_t minY = minX;
+		bx::simd128_t minZ = minX;
+		bx::simd128_t maxX = bx::simd_splat(-bx::kInfinity);
+		bx::simd128_t maxY = maxX;
+		bx::simd128_t maxZ = maxX;
+
+		const bx::simd128_t eyeX = bx::simd_splat(_eye.x);
+		const bx::simd128_t eyeY = bx::simd_splat(_eye.y);
+		const bx::simd128_t eyeZ = bx::simd_splat(_eye.z);
+		const bx::simd128_t viewUX = bx::simd_splat(_mtxView[0]);
+		const bx::simd128_t viewUY = bx::simd_splat(_mtxView[4]);
+		const bx::simd128_t viewUZ = bx::simd_splat(_mtxView[8]);
+		const bx::simd128_t viewVX = bx::simd_splat(_mtxView[1]);
+		const bx::simd128_t viewVY = bx::simd_splat(_mtxView[5]);
+		const bx::simd128_t viewVZ = bx::simd_splat(_mtxView[9]);
+
+		// (u, v) of each corner twice, the lanes writeCorner4() picks.
+		const bx::simd128_t uv0 = bx::simd_ld(_uv[0], _uv[1], _uv[0], _uv[1]);
+		const bx::simd128_t uv1 = bx::simd_ld(_uv[2], _uv[1], _uv[2], _uv[1]);
+		const bx::simd128_t uv2 = bx::simd_ld(_uv[2], _uv[3], _uv[2], _uv[3]);
+		const bx::simd128_t uv3 = bx::simd_ld(_uv[0], _uv[3], _uv[0], _uv[3]);
+
+		BX_ALIGN_DECL(16, float) ttPos[kBatch];
+		BX_ALIGN_DECL(16, float) ttScale[kBatch];
+		BX_ALIGN_DECL(16, float) ttBlend[kBatch];
+		BX_ALIGN_DECL(16, float) ttRgba[kBatch];
+
+		for (uint32_t base = _begin; base < _end; base += kBatch)
+		{
+			const uint32_t count = bx::min(_end - base, kBatch);
+			easeBatch(m_uniforms.m_easePos,   &life[base], ttPos,   count);
+			easeBatch(m_uniforms.m_easeScale, &life[base], ttScale, count);
+			easeBatch(m_uniforms.m_easeBlend, &life[base], ttBlend, count);
+			easeBatch(m_uniforms.m_easeRgba,  &life[base], ttRgba,  count);
+			clampBatch(ttBlend, count);
+			clampBatch(ttRgba,  count);
+
+			uint32_t jj = 0;
+			for (; jj + 4 <= count; jj += 4)
+			{
+				const uint32_t ii = base + jj;
+				const uint32_t current = _first + ii - _begin;
+
+				const bx::simd128_t tt  = bx::simd_ld(&ttPos[jj]);
+				const bx::simd128_t e0X = bx::simd_ld(&end0X[ii]);
+				const bx::simd128_t e0Y = bx::simd_ld(&end0Y[ii]);
+				const bx::simd128_t e0Z = bx::simd_ld(&end0Z[ii]);
+				const bx::simd128_t posX = lerp4(lerp4(bx::simd_ld(&startX[ii]), e0X, tt), lerp4(e0X, bx::simd_ld(&end1X[ii]), tt), tt);
+				const bx::simd128_t posY = lerp4(lerp4(bx::simd_ld(&startY[ii]), e0Y, tt), lerp4(e0Y, bx::simd_ld(&end1Y[ii]), tt), tt);
+				const bx::simd128_t posZ = lerp4(lerp4(bx::simd_ld(&startZ[ii]), e0Z, tt), lerp4(e0Z, bx::simd_ld(&end1Z[ii]), tt), tt);
+
+				const bx::simd128_t dx = bx::simd_sub(eyeX, posX);
+				const bx::simd128_t dy = bx::simd_sub(eyeY, posY);
+				const bx::simd128_t dz = bx::simd_sub(eyeZ, posZ);
+				BX_ALIGN_DECL(16, float) dist[4];
+				bx::simd_st(dist, bx::simd_sqrt(bx::simd_add(bx::simd_add(bx::simd_mul(dx, dx), bx::simd_mul(dy, dy) ), bx::simd_mul(dz, dz) ) ) );
+				for (uint32_t kk = 0; kk < 4; ++kk)
+				{
+					ParticleSort& sort = _outSort[current + kk];
+					sort.dist = dist[kk];
+					sort.idx  = current + kk;
+				}
+
+				// Gradient key below the tint, the last key at the end. The
+				// key counts the thresholds reached, and every lane picks its
+				// pair of colors with masks instead of a gather.
+				const bx::simd128_t tt4 = bx::simd_mul(bx::simd_ld(&ttRgba[jj]), bx::simd_splat(4.0f) );
+				bx::simd128_t key       = bx::simd_zero();
+				bx::simd128_t rgbaStart = bx::simd_ld(&rgba[0][ii]);
+				bx::simd128_t rgbaEnd   = bx::simd_ld(&rgba[1][ii]);
+				for (uint32_t kk = 1; kk < kNumColors - 1; ++kk)
+				{
+					const bx::simd128_t mask = bx::simd_cmpge(tt4, bx::simd_splat(float(kk) ) );
+					key       = bx::simd_selb(mask, bx::simd_splat(float(kk) ), key);
+					rgbaStart = bx::simd_selb(mask, rgbaEnd, rgbaStart);
+					rgbaEnd   = bx::simd_selb(mask, bx::simd_ld(&rgba[kk+1][ii]), rgbaEnd);
+				}
+				const bx::simd128_t abgr = lerpAbgr4(rgbaStart, rgbaEnd, bx::simd_sub(tt4, key) );
+
+				const bx::simd128_t blend = lerp4(bx::simd_ld(&blendStart[ii]), bx::simd_ld(&blendEnd[ii]), bx::simd_ld(&ttBlend[jj]) );
+				const bx::simd128_t scale = lerp4(bx::simd_ld(&scaleStart[ii]), bx::simd_ld(&scaleEnd[ii]), bx::simd_ld(&ttScale[jj]) );
+
+				const bx::simd128_t uX = bx::simd_mul(viewUX, scale);
+				const bx::simd128_t uY = bx::simd_mul(viewUY, scale);
+				const bx::simd128_t uZ = bx::simd_mul(viewUZ, scale);
+				const bx::simd128_t vX = bx::simd_mul(viewVX, scale);
+				const bx::simd128_t vY = bx::simd_mul(viewVY, scale);
+				const bx::simd128_t vZ = bx::simd_mul(viewVZ, scale);
+
+				const bx::simd128_t lX = bx::simd_sub(posX, uX);
+				const bx::simd128_t lY = bx::simd_sub(posY, uY);
+				const bx::simd128_t lZ = bx::simd_sub(posZ, uZ);
+				const bx::simd128_t rX = bx::simd_add(posX, uX);
+				const bx::simd128_t rY = bx::simd_add(posY, uY);
+				const bx::simd128_t rZ = bx::simd_add(posZ, uZ);
+
+				const bx::simd128_t ulX = bx::simd_sub(lX, vX), ulY = bx::simd_sub(lY, vY), ulZ = bx::simd_sub(lZ, vZ);
+				const bx::simd128_t urX = bx::simd_sub(rX, vX), urY = bx::simd_sub(rY, vY), urZ = bx::simd_sub(rZ, vZ);
+				const bx::simd128_t brX = bx::simd_add(rX, vX), brY = bx::simd_add(rY, vY), brZ = bx::simd_add(rZ, vZ);
+				const bx::simd128_t blX = bx::simd_add(lX, vX), blY = bx::simd_add(lY, vY), blZ = bx::simd_add(lZ, vZ);
+
+				// Vertices of particle k are at k*4 + corner.
+				ParticleVertex* vertex = &_outVertices[current*4];
+				writeCorner4(vertex + 0, ulX, ulY, ulZ, abgr, uv0, blend);
+				writeCorner4(vertex + 1, urX, urY, urZ, abgr, uv1, blend);
+				writeCorner4(vertex + 2, brX, brY, brZ, abgr, uv2, blend);
+				writeCorner4(vertex + 3, blX, blY, blZ, abgr, uv3, blend);
+
+				minX = bx::simd_min(minX, bx::simd_min(bx::simd_min(ulX, urX), bx::simd_min(brX, blX) ) );
+				minY = bx::simd_min(minY, bx::simd_min(bx::simd_min(ulY, urY), bx::simd_min(brY, blY) ) );
+				minZ = bx::simd_min(minZ, bx::simd_min(bx::simd_min(ulZ, urZ), bx::simd_min(brZ, blZ) ) );
+				maxX = bx::simd_max(maxX, bx::simd_max(bx::simd_max(ulX, urX), bx::simd_max(brX, blX) ) );
+				maxY = bx::simd_max(maxY, bx::simd_max(bx::simd_max(ulY, urY), bx::simd_max(brY, blY) ) );
+				maxZ = bx::simd_max(maxZ, bx::simd_max(bx::simd_max(ulZ, urZ), bx::simd_max(brZ, blZ) ) );
+			}
+
+			for (; jj < count; ++jj)
+			{
+				const uint32_t ii = base + jj;
+				const uint32_t current = _first + ii - _begin;
+
+				const float tt = ttPos[jj];
+				const bx::Vec3 start = { startX[ii], startY[ii], startZ[ii] };
+				const bx::Vec3 end0  = { end0X[ii],  end0Y[ii],  end0Z[ii]  };
+				const bx::Vec3 end1  = { end1X[ii],  end1Y[ii],  end1Z[ii]  };
+				const bx::Vec3 p0  = bx::lerp(start, end0, tt);
+				const bx::Vec3 p1  = bx::lerp(end0,  end1, tt);
+				const bx::Vec3 pos = bx::lerp(p0, p1, tt);
+
+				ParticleSort& sort = _outSort[current];
+				sort.dist = bx::length(bx::sub(_eye, pos) );
+				sort.idx  = current;
+
+				const float tt4 = ttRgba[jj]*4.0f;
+				const uint32_t key = bx::min(uint32_t(tt4), 3u);
+				const uint32_t abgr = lerpAbgr(rgba[key][ii], rgba[key+1][ii], tt4 - float(key) );
+
+				const float blend = bx::lerp(blendStart[ii], blendEnd[ii], ttBlend[jj]);
+				const float scale = bx::lerp(scaleStart[ii], scaleEnd[ii], ttScale[jj]);
+
+				const bx::Vec3 udir = { _mtxView[0]*scale, _mtxView[4]*scale, _mtxView[8]*scale };
+				const bx::Vec3 vdir = { _mtxView[1]*scale, _mtxView[5]*scale, _mtxView[9]*scale };
+
+				ParticleVertex* vertex = &_outVertices[current*4];
+
+				const bx::Vec3 ul = bx::sub(bx::sub(pos, udir), vdir);
+				const bx::Vec3 ur = bx::sub(bx::add(pos, udir), vdir);
+				const bx::Vec3 br = bx::add(bx::add(pos, udir), vdir);
+				const bx::Vec3 bl = bx::add(bx::sub(pos, udir), vdir);
+				writeVertex(&vertex[0], ul, abgr, _uv[0], _uv[1], blend);
+				writeVertex(&vertex[1], ur, abgr, _uv[2], _uv[1], blend);
+				writeVertex(&vertex[2], br, abgr, _uv[2], _uv[3], blend);
+				writeVertex(&vertex[3], bl, abgr, _uv[0], _uv[3], blend);
+				aabbExpand(aabb, ul);
+				aabbExpand(aabb, ur);
+				aabbExpand(aabb, br);
+				aabbExpand(aabb, bl);
+			}
+		}
+
+		aabb.min = bx::min(aabb.min, bx::Vec3(hmin(minX), hmin(minY), hmin(minZ) ) );
+		aabb.max = bx::max(aabb.max, bx::Vec3(hmax(maxX), hmax(maxY), hmax(maxZ) ) );
+
+		_aabb = aabb;
+	}
+
+	void updateEmitters(Emitter* const* _emitters, uint32_t _num, float _dt)
+	{
+		UpdateContext ctx = { _emitters, _dt };
+		jobParallelFor(0, _num, 1, updateRange, &ctx);
+	}
+
+	uint32_t renderEmitters(
+		  Emitter* const* _emitters
+		, const float (*_uv)[4]
+		, uint32_t _num
+		, const float* _mtxView
+		, const bx::Vec3& _eye
+		, uint32_t _max
+		, ParticleSort* _outSort
+		, ParticleVertex* _outVertices
+		, bx::AllocatorI* _allocator
+		)
+	{
+		// Where every emitter starts in the buffer, in emitter order, so the
+		// output doesn't depend on which job finishes first.
+		uint32_t numSlices = 0;
+		uint32_t first = 0;
+		for (uint32_t ii = 0; ii < _num; ++ii)
+		{
+			const uint32_t num = bx::min(_emitters[ii]->m_num, _max - first);
+			numSlices += (num + kRenderGrain - 1)/kRenderGrain;
+			first     += num;
+		}
+
+		const bx::Aabb empty =
+		{
+			{  bx::kInfinity,  bx::kInfinity,  bx::kInfinity },
+			{ -bx::kInfinity, -bx::kInfinity, -bx::kInfinity },
+		};
+
+		for (uint32_t ii = 0; ii < _num; ++ii)
+		{
+			_emitters[ii]->m_aabb = empty;
+		}
+
+		if (0 == numSlices)
+		{
+			return 0;
+		}
+
+		RenderSlice* slices = (RenderSlice*)BX_ALLOC(_allocator, numSlices*sizeof(RenderSlice) );
+
+		RenderSlice* slice = slices;
+		first = 0;
+		for (uint32_t ii = 0; ii < _num; ++ii)
+		{
+			const uint32_t num = bx::min(_emitters[ii]->m_num, _max - first);
+			for (uint32_t begin = 0; begin < num; begin += kRenderGrain, ++slice)
+			{
+				slice->m_emitter = ii;
+				slice->m_begin   = begin;
+				slice->m_end     = bx::min(begin + kRenderGrain, num);
+				slice->m_first   = first + begin;
+				slice->m_aabb    = empty;
+			}
+
+			first += num;
+		}
+
+		RenderContext ctx = { _emitters, _uv, slices, _mtxView, _eye, _outSort, _outVertices };
+		jobParallelFor(0, numSlices, 1, renderRange, &ctx);
+
+		// Slices of an emitter merge in order, the bounds come out the same
+		// however the jobs ran.
+		for (uint32_t ii = 0; ii < numSlices; ++ii)
+		{
+			bx::Aabb& aabb = _emitters[slices[ii].m_emitter]->m_aabb;
+			aabb.min = bx::min(aabb.min, slices[ii].m_aabb.min);
+			aabb.max = bx::max(aabb.max, slices[ii].m_aabb.max);
+		}
+
+		BX_FREE(_allocator, slices);
+
+		return first;
+	}
+
+} // namespace ps
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2011-2022 Branimir Karadzic. All rights reserved.
+ * License: https://github.com/bkaradzic/bgfx/blob/master/LICENSE
+ */
+
+#ifndef PARTICLE_EMITTER_H_HEADER_GUARD
+#define PARTICLE_EMITTER_H_HEADER_GUARD
+
+#include "particle_system.h"
+
+namespace ps
+{
+	/// Vertex of a particle quad, as the particle shader reads it.
+	///
+	struct ParticleVertex
+	{
+		float m_x;
+		float m_y;
+		float m_z;
+		uint32_t m_abgr;
+		float m_u;
+		float m_v;
+		float m_blend;
+		float m_angle;
+	};
+
+	///
+	struct ParticleSort
+	{
+		float    dist;
+		uint32_t idx;
+	};
+
+	/// Particle streams of an emitter, one array each.
+	///
+	struct ParticleStream
+	{
+		enum Enum
+		{
+			Life,
+			InvLifeSpan,
+			StartX,
+			StartY,
+			StartZ,
+			End0X,
+			End0Y,
+			End0Z,
+			End1X,
+			End1Y,
+			End1Z,
+			BlendStart,
+			BlendEnd,
+			ScaleStart,
+			ScaleEnd,
+
+			Count
+		};
+	};
+
+	/// Particles are kept as a structure of arrays, every stream padded to
+	/// a multiple of four and 16-byte aligned, so update and render work
+	/// on four particles at a time. Easing runs over batches of particles
+	/// with one dispatch per batch instead of a call per particle.
+	///
+	struct Emitter
+	{
+		static constexpr uint32_t kNumColors = 5;
+
+		///
+		void create(EmitterShape::Enum _shape, EmitterDirection::Enum _direction, uint32_t _maxParticles, bx::AllocatorI* _allocator);
+
+		///
+		void destroy();
+
+		///
+		void reset();
+
+		/// Ages the particles, removes the expired ones and spawns new ones,
+		/// into the slots of expired ones first.
+		///
+		void update(float _dt);
+
+		///
+		void spawn(float _dt);
+
+		/// Writes the quads of up to _max - _first particles from vertex
+		/// _first*4 on, and their distance to _eye. Returns the number of
+		/// particles written. _outVertices must be 16-byte aligned.
+		///
+		uint32_t render(
+			  const float _uv[4]
+			, const float* _mtxView
+			, const bx::Vec3& _eye
+			, uint32_t _first
+			, uint32_t _max
+			, ParticleSort* _outSort
+			, ParticleVertex* _outVertices
+			);
+
+		/// Writes the quads of particles [_begin, _end) from vertex _first*4
+		/// on and grows _aabb by them, leaving m_aabb alone. _begin must be a
+		/// multiple of four. Ranges that don't overlap may be written from
+		/// different threads at once.
+		///
+		void renderRange(
+			  const float _uv[4]
+			, const float* _mtxView
+			, const bx::Vec3& _eye
+			, uint32_t _begin
+			, uint32_t _end
+			, uint32_t _first
+			, ParticleSort* _outSort
+			, ParticleVertex* _outVertices
+			, bx::Aabb& _aabb
+			) const;
+
+		EmitterShape::Enum     m_shape;
+		EmitterDirection::Enum m_direction;
+
+		float           m_dt;
+		bx::RngMwc      m_rng;
+		EmitterUniforms m_uniforms;
+
+		bx::Aabb m_aabb;
+
+		bx::AllocatorI* m_allocator;
+		void*     m_data;
+		float*    m_stream[ParticleStream::Count];
+		uint32_t* m_rgba[kNumColors];
+		uint32_t  m_num;
+		uint32_t  m_max;
+	};
+
+	/// Updates _num emitters, spread over the job workers. Each emitter has
+	/// its own random generator, so the result doesn't depend on which
+	/// thread ran it.
+	///
+	void updateEmitters(Emitter* const* _emitters, uint32_t _num, float _dt);
+
+	/// Renders _num emitters into one vertex buffer, spread over the job
+	/// workers. Every emitter's range of the buffer is reserved up front
+	/// from a prefix sum over the particle counts, then the ranges are
+	/// written in slices, so the output is the same as rendering the
+	/// emitters one after the other. Returns the number of particles
+	/// written, at most _max. _outVertices must be 16-byte aligned, as
+	/// transient vertex buffers are.
+	///
+	/// @param[in] _uv Sprite rectangle of each emitter.
+	/// @param[in] _allocator Slice list for this call only.
+	///
+	uint32_t renderEmitters(
+		  Emitter* const* _emitters
+		, const float (*_uv)[4]
+		, uint32_t _num
+		, const float* _mtxView
+		, const bx::Vec3& _eye
+		, uint32_t _max
+		, ParticleSort* _outSort
+		, ParticleVertex* _outVertices
+		, bx::AllocatorI* _allocator
+		);
+
+	/// Eases _num values in one pass, the same as calling the easing
+	/// function of _ease on each.
+	///
+	void easeBatch(bx::Easing::Enum _ease, const float* _in, float* _out, uint32_t _num);
+
+} // namespace ps
+
+#endif // PARTICLE_EMITTER_H_HEADER_GUARD
@@ -0,0 +1,863 @@
+// Micro-benchmarks of the particle emitter, no GPU involved:
+//
+//   particle_microbench [--counts 1000,10000,100000,250000]
+//       [--sort-counts 1000,10000,100000,1000000] [--threads 1,2,4]
+//       [--warmup N] [--reps N] [--filter name] [--json out.json]
+//
+// Every kernel runs --warmup times unmeasured, then --reps times measured,
+// as in terrain_microbench. Each emitter is first run for two simulated
+// seconds at 60 Hz so its population is at the steady state of --counts
+// particles, with spawns balancing the expired ones.
+//
+//   particle_update_aos  update() of the array of structs reference
+//   particle_update_soa  ps::Emitter::update()
+//   particle_render_aos  render() of the reference into a vertex array
+//   particle_render_soa  ps::Emitter::render() into the same array
+//   particle_sort_qsort  qsort() of --sort-counts distances, as render()
+//                        sorted before the radix sort
+//   particle_sort_radix  ps::sortBackToFront() of the same, per --threads
+//   particle_frame_serial
+//                        update() and render() of --counts particles over
+//                        kNumFrameEmitters emitters, one after the other
+//   particle_frame_jobs  ps::updateEmitters() and ps::renderEmitters() of
+//                        the same, per --threads
+//
+// The reference is the emitter as it was before the particle streams:
+// one struct per particle and an easing call per particle and curve. The
+// speedup of each kernel is the reference's p50 over the streams' p50,
+// and of the sorts qsort's p50 over the radix sort's. Both sorts time a
+// copy of the unsorted distances as well, since sorting works in place.
+// The frame's speedup is the serial loop's p50 over the jobs' p50.
+//
+// Both emitters write the same 128 bytes of vertices per particle, which
+// bounds the render speedup once the streams' math is out of the way, and
+// both spawn with the same per-particle code, which bounds the update
+// speedup. At 100k particles that leaves about 2x for render and 1.5x
+// for update.
+//
+// Threads count the calling thread, --threads 1 runs without job workers.
+//
+// Before anything is timed, both emitters run from the same random state
+// until just before the first particle expires, while their particles
+// still line up index for index. Their vertices and sort keys must then
+// match within rounding, the tool fails otherwise. The frame's emitters
+// are then stepped and rendered both serially and on the job workers, per
+// --threads, and the vertices, sort keys and bounds must be the same to
+// the bit. Every radix sort is checked as well, for distances that never
+// grow and ties kept in their original order.
+//
+// The frame's speedup only means something for thread counts up to the
+// number of cores, which is printed and written to the JSON.
+#include "../job_system.h"
+#include "../tool_support.h"
+#include "particle_emitter.h"
+#include "particle_sort.h"
+
+#include <bx/allocator.h>
+#include <bx/commandline.h>
+#include <bx/file.h>
+#include <bx/math.h>
+#include <bx/string.h>
+#include <bx/timer.h>
+#include <entry/entry.h>
+#include <cstdio>
+
+namespace {
+    constexpr uint32_t kMaxList = 16;
+    constexpr uint32_t kMaxResults = 256;
+    constexpr float kDt = 1.0f / 60.0f;
+    constexpr uint32_t kSettleFrames = 120;
+    constexpr uint32_t kNumFrameEmitters = 16;
+    // Below the shortest life span of setupUniforms(), nothing expires
+    constexpr uint32_t kCheckFrames = 50;
+    constexpr float kCheckTolerance = 1.0e-4f;
+
+    struct Options {
+        uint32_t warmup;
+        uint32_t reps;
+        const char* filter;
+        uint32_t cores;
+    };
+
+    struct Result {
+        const char* name;
+        uint32_t count;
+        uint32_t threads;
+        uint64_t items;     // per repetition
+        float mean;         // milliseconds
+        float p50;
+        float p90;
+        float p99;
+        float min;
+        float max;
+    };
+
+    Result s_results[kMaxResults];
+    uint32_t s_numResults = 0;
+
+    // Results of the measured work end up here so none of it is optimized out
+    volatile uint32_t s_sink = 0;
+
+    struct Random {
+        uint32_t state;
+        uint32_t next() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+    };
+
+    // The emitter before the particle streams, kept as the baseline
+    namespace aos {
+        struct Particle {
+            bx::Vec3 start;
+            bx::Vec3 end[2];
+            float blendStart;
+            float blendEnd;
+            float scaleStart;
+            float scaleEnd;
+
+            uint32_t rgba[5];
+
+            float life;
+            float lifeSpan;
+        };
+
+        inline uint32_t toAbgr(float rr, float gg, float bb, float aa) {
+            return 0
+                | (uint8_t(rr * 255.0f) << 0)
+                | (uint8_t(gg * 255.0f) << 8)
+                | (uint8_t(bb * 255.0f) << 16)
+                | (uint8_t(aa * 255.0f) << 24)
+                ;
+        }
+
+        struct Emitter {
+            void create(EmitterShape::Enum shape, EmitterDirection::Enum direction, uint32_t maxParticles) {
+                reset();
+                m_shape = shape;
+                m_direction = direction;
+                m_max = maxParticles;
+                m_particles = (Particle*)BX_ALLOC(entry::getAllocator(), m_max * sizeof(Particle));
+            }
+
+            void destroy() {
+                BX_FREE(entry::getAllocator(), m_particles);
+                m_particles = nullptr;
+            }
+
+            void reset() {
+                m_dt = 0.0f;
+                m_uniforms.reset();
+                m_num = 0;
+                m_rng.reset();
+            }
+
+            void update(float dt) {
+                uint32_t num = m_num;
+                for (uint32_t i = 0; i < num; ++i) {
+                    Particle& particle = m_particles[i];
+                    particle.life += dt * 1.0f / particle.lifeSpan;
+
+                    if (particle.life > 1.0f) {
+                        if (i != num - 1) {
+                            bx::memCopy(&particle, &m_particles[num - 1], sizeof(Particle));
+                            --i;
+                        }
+                        --num;
+                    }
+                }
+                m_num = num;
+
+                if (0 < m_uniforms.m_particlesPerSecond) {
+                    spawn(dt);
+                }
+            }
+
+            void spawn(float dt) {
+                float mtx[16];
+                bx::mtxSRT(mtx
+                    , 1.0f, 1.0f, 1.0f
+                    , m_uniforms.m_angle[0], m_uniforms.m_angle[1], m_uniforms.m_angle[2]
+                    , m_uniforms.m_position[0], m_uniforms.m_position[1], m_uniforms.m_position[2]
+                    );
+
+                const float timePerParticle = 1.0f / m_uniforms.m_particlesPerSecond;
+                m_dt += dt;
+                const uint32_t numParticles = uint32_t(m_dt / timePerParticle);
+                m_dt -= numParticles * timePerParticle;
+
+                constexpr bx::Vec3 up = { 0.0f, 1.0f, 0.0f };
+
+                float time = 0.0f;
+                for (uint32_t i = 0; i < numParticles && m_num < m_max; ++i) {
+                    Particle& particle = m_particles[m_num];
+                    m_num++;
+
+                    bx::Vec3 pos(bx::init::None);
+                    switch (m_shape) {
+                    default:
+                    case EmitterShape::Sphere:
+                        pos = bx::randUnitSphere(&m_rng);
+                        break;
+                    case EmitterShape::Hemisphere:
+                        pos = bx::randUnitHemisphere(&m_rng, up);
+                        break;
+                    case EmitterShape::Circle:
+                        pos = bx::randUnitCircle(&m_rng);
+                        break;
+                    case EmitterShape::Disc:
+                        pos = bx::mul(bx::randUnitCircle(&m_rng), bx::frnd(&m_rng));
+                        break;
+                    case EmitterShape::Rect:
+                        pos = { bx::frndh(&m_rng), 0.0f, bx::frndh(&m_rng) };
+                        break;
+                    }
+
+                    const bx::Vec3 dir = m_direction == EmitterDirection::Outward ? bx::normalize(pos) : up;
+
+                    const float startOffset = bx::lerp(m_uniforms.m_offsetStart[0], m_uniforms.m_offsetStart[1], bx::frnd(&m_rng));
+                    const bx::Vec3 start = bx::mul(pos, startOffset);
+
+                    const float endOffset = bx::lerp(m_uniforms.m_offsetEnd[0], m_uniforms.m_offsetEnd[1], bx::frnd(&m_rng));
+                    const bx::Vec3 end = bx::add(bx::mul(dir, endOffset), start);
+
+                    particle.life = time;
+                    particle.lifeSpan = bx::lerp(m_uniforms.m_lifeSpan[0], m_uniforms.m_lifeSpan[1], bx::frnd(&m_rng));
+
+                    const bx::Vec3 gravity = { 0.0f, -9.81f * m_uniforms.m_gravityScale * bx::square(particle.lifeSpan), 0.0f };
+
+                    particle.start = bx::mul(start, mtx);
+                    particle.end[0] = bx::mul(end, mtx);
+                    particle.end[1] = bx::add(particle.end[0], gravity);
+
+                    bx::memCopy(particle.rgba, m_uniforms.m_rgba, sizeof(particle.rgba));
+
+                    particle.blendStart = bx::lerp(m_uniforms.m_blendStart[0], m_uniforms.m_blendStart[1], bx::frnd(&m_rng));
+                    particle.blendEnd = bx::lerp(m_uniforms.m_blendEnd[0], m_uniforms.m_blendEnd[1], bx::frnd(&m_rng));
+
+                    particle.scaleStart = bx::lerp(m_uniforms.m_scaleStart[0], m_uniforms.m_scaleStart[1], bx::frnd(&m_rng));
+                    particle.scaleEnd = bx::lerp(m_uniforms.m_scaleEnd[0], m_uniforms.m_scaleEnd[1], bx::frnd(&m_rng));
+
+                    time += timePerParticle;
+                }
+            }
+
+            uint32_t render(const float uv[4], const float* mtxView, const bx::Vec3& eye,
+                    ps::ParticleSort* outSort, ps::ParticleVertex* outVertices) {
+                bx::EaseFn easeRgba = bx::getEaseFunc(m_uniforms.m_easeRgba);
+                bx::EaseFn easePos = bx::getEaseFunc(m_uniforms.m_easePos);
+                bx::EaseFn easeBlend = bx::getEaseFunc(m_uniforms.m_easeBlend);
+                bx::EaseFn easeScale = bx::getEaseFunc(m_uniforms.m_easeScale);
+
+                bx::Aabb aabb = {
+                    {  bx::kInfinity,  bx::kInfinity,  bx::kInfinity },
+                    { -bx::kInfinity, -bx::kInfinity, -bx::kInfinity },
+                };
+
+                for (uint32_t i = 0; i < m_num; ++i) {
+                    const Particle& particle = m_particles[i];
+
+                    const float ttPos = easePos(particle.life);
+                    const float ttScale = easeScale(particle.life);
+                    const float ttBlend = bx::clamp(easeBlend(particle.life), 0.0f, 1.0f);
+                    const float ttRgba = bx::clamp(easeRgba(particle.life), 0.0f, 1.0f);
+
+                    const bx::Vec3 p0 = bx::lerp(particle.start, particle.end[0], ttPos);
+                    const bx::Vec3 p1 = bx::lerp(particle.end[0], particle.end[1], ttPos);
+                    const bx::Vec3 pos = bx::lerp(p0, p1, ttPos);
+
+                    outSort[i].dist = bx::length(bx::sub(eye, pos));
+                    outSort[i].idx = i;
+
+                    // Clamped, the original read one color past the end at 1
+                    const uint32_t idx = bx::min(uint32_t(ttRgba * 4), 3u);
+                    const float ttmod = ttRgba * 4 - float(idx);
+                    const uint8_t* rgbaStart = (const uint8_t*)&particle.rgba[idx];
+                    const uint8_t* rgbaEnd = (const uint8_t*)&particle.rgba[idx + 1];
+                    const uint32_t abgr = toAbgr(
+                          bx::lerp(rgbaStart[0], rgbaEnd[0], ttmod) / 255.0f
+                        , bx::lerp(rgbaStart[1], rgbaEnd[1], ttmod) / 255.0f
+                        , bx::lerp(rgbaStart[2], rgbaEnd[2], ttmod) / 255.0f
+                        , bx::lerp(rgbaStart[3], rgbaEnd[3], ttmod) / 255.0f
+                        );
+
+                    const float blend = bx::lerp(particle.blendStart, particle.blendEnd, ttBlend);
+                    const float scale = bx::lerp(particle.scaleStart, particle.scaleEnd, ttScale);
+
+                    const bx::Vec3 udir = { mtxView[0] * scale, mtxView[4] * scale, mtxView[8] * scale };
+                    const bx::Vec3 vdir = { mtxView[1] * scale, mtxView[5] * scale, mtxView[9] * scale };
+
+                    const bx::Vec3 corners[4] = {
+                        bx::sub(bx::sub(pos, udir), vdir),
+                        bx::sub(bx::add(pos, udir), vdir),
+                        bx::add(bx::add(pos, udir), vdir),
+                        bx::add(bx::sub(pos, udir), vdir),
+                    };
+                    const float us[4] = { uv[0], uv[2], uv[2], uv[0] };
+                    const float vs[4] = { uv[1], uv[1], uv[3], uv[3] };
+                    ps::ParticleVertex* vertex = &outVertices[i * 4];
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        bx::store(&vertex[c].m_x, corners[c]);
+                        aabbExpand(aabb, corners[c]);
+                        vertex[c].m_abgr = abgr;
+                        vertex[c].m_u = us[c];
+                        vertex[c].m_v = vs[c];
+                        vertex[c].m_blend = blend;
+                        vertex[c].m_angle = 0.0f;
+                    }
+                }
+                m_aabb = aabb;
+                return m_num;
+            }
+
+            EmitterShape::Enum m_shape;
+            EmitterDirection::Enum m_direction;
+            float m_dt;
+            bx::RngMwc m_rng;
+            EmitterUniforms m_uniforms;
+            bx::Aabb m_aabb;
+            Particle* m_particles;
+            uint32_t m_num;
+            uint32_t m_max;
+        };
+    } // namespace aos
+
+    bool isEnabled(const Options& options, const char* name) {
+        return options.filter == nullptr || !bx::strFind(name, options.filter).isEmpty();
+    }
+
+    // Returns the result, nullptr when the table is full
+    template<typename Fn>
+    const Result* measure(const Options& options, const char* name, uint32_t count, uint32_t threads, uint64_t items, Fn&& fn) {
+        for (uint32_t i = 0; i < options.warmup; ++i) {
+            fn();
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        float* samples = (float*)BX_ALLOC(allocator, options.reps * sizeof(float));
+        const double toMs = 1000.0 / double(bx::getHPFrequency());
+        double sum = 0.0;
+        for (uint32_t i = 0; i < options.reps; ++i) {
+            const int64_t start = bx::getHPCounter();
+            fn();
+            samples[i] = float(double(bx::getHPCounter() - start) * toMs);
+            sum += samples[i];
+        }
+        sortFloats(samples, options.reps);
+        Result result;
+        result.name = name;
+        result.count = count;
+        result.threads = threads;
+        result.items = items;
+        result.mean = float(sum / options.reps);
+        result.p50 = nearestRank(samples, options.reps, 0.50f);
+        result.p90 = nearestRank(samples, options.reps, 0.90f);
+        result.p99 = nearestRank(samples, options.reps, 0.99f);
+        result.min = samples[0];
+        result.max = samples[options.reps - 1];
+        BX_FREE(allocator, samples);
+
+        printf("%-20s %8u %3u thr %10.3f ms p50 %10.3f ms p99 %9.3f Mitems/s\n", name, count, threads,
+            result.p50, result.p99, result.p50 > 0.0f ? double(items) / (double(result.p50) * 1000.0) : 0.0);
+        if (s_numResults == kMaxResults) {
+            return nullptr;
+        }
+        s_results[s_numResults] = result;
+        return &s_results[s_numResults++];
+    }
+
+    void printSpeedup(const char* name, uint32_t count, uint32_t threads, const Result* reference, const Result* result) {
+        if (reference != nullptr && result != nullptr && result->p50 > 0.0f) {
+            printf("%-20s %8u %3u thr %10.2fx\n", name, count, threads, reference->p50 / result->p50);
+        }
+    }
+
+    void setThreads(uint32_t threads) {
+        jobShutdown();
+        if (threads > 1) {
+            jobInit(threads - 1);
+        }
+    }
+
+    // Non-linear curves on purpose, easing is a large part of render()
+    void setupUniforms(EmitterUniforms& uniforms, uint32_t count) {
+        uniforms.reset();
+        uniforms.m_particlesPerSecond = uint32_t(float(count) / bx::lerp(uniforms.m_lifeSpan[0], uniforms.m_lifeSpan[1], 0.5f));
+        uniforms.m_gravityScale = 0.2f;
+        uniforms.m_rgba[1] = 0xff3080ffu;
+        uniforms.m_rgba[2] = 0xff40c0ffu;
+        uniforms.m_rgba[3] = 0xc0808080u;
+        uniforms.m_easePos = bx::Easing::OutQuad;
+        uniforms.m_easeRgba = bx::Easing::InCubic;
+        uniforms.m_easeBlend = bx::Easing::InOutQuad;
+        uniforms.m_easeScale = bx::Easing::OutCubic;
+    }
+
+    bool nearlyEqual(float a, float b) {
+        return bx::abs(a - b) <= kCheckTolerance * bx::max(1.0f, bx::max(bx::abs(a), bx::abs(b)));
+    }
+
+    // Colors are rounded from floats on both sides, a step apart at most
+    bool nearlyEqualAbgr(uint32_t a, uint32_t b) {
+        for (uint32_t shift = 0; shift < 32; shift += 8) {
+            const int32_t ca = int32_t((a >> shift) & 0xff);
+            const int32_t cb = int32_t((b >> shift) & 0xff);
+            if (bx::abs(ca - cb) > 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns false and prints the first difference when the streams don't
+    // render what the reference does
+    bool checkEmitter(uint32_t count) {
+        bx::AllocatorI* allocator = entry::getAllocator();
+
+        aos::Emitter reference;
+        reference.create(EmitterShape::Sphere, EmitterDirection::Outward, count);
+        setupUniforms(reference.m_uniforms, count);
+
+        ps::Emitter streams;
+        streams.create(EmitterShape::Sphere, EmitterDirection::Outward, count, allocator);
+        setupUniforms(streams.m_uniforms, count);
+
+        for (uint32_t i = 0; i < kCheckFrames; ++i) {
+            reference.update(kDt);
+            streams.update(kDt);
+        }
+
+        ps::ParticleSort* aosSort = (ps::ParticleSort*)BX_ALLOC(allocator, size_t(count) * sizeof(ps::ParticleSort));
+        ps::ParticleSort* soaSort = (ps::ParticleSort*)BX_ALLOC(allocator, size_t(count) * sizeof(ps::ParticleSort));
+        ps::ParticleVertex* aosVertices = (ps::ParticleVertex*)BX_ALIGNED_ALLOC(allocator, size_t(count) * 4 * sizeof(ps::ParticleVertex), 16);
+        ps::ParticleVertex* soaVertices = (ps::ParticleVertex*)BX_ALIGNED_ALLOC(allocator, size_t(count) * 4 * sizeof(ps::ParticleVertex), 16);
+
+        float view[16];
+        bx::mtxLookAt(view, bx::Vec3(0.0f, 2.0f, -8.0f), bx::Vec3(0.0f, 0.0f, 0.0f));
+        const bx::Vec3 eye = { 0.0f, 2.0f, -8.0f };
+        const float uv[4] = { 0.0f, 0.0f, 0.25f, 0.25f };
+
+        const uint32_t aosNum = reference.render(uv, view, eye, aosSort, aosVertices);
+        const uint32_t soaNum = streams.render(uv, view, eye, 0, count, soaSort, soaVertices);
+
+        bool ok = aosNum == soaNum && aosNum > 0;
+        if (!ok) {
+            printf("particle_check       %8u: %u particles, the reference has %u\n", count, soaNum, aosNum);
+        }
+
+        for (uint32_t i = 0; ok && i < aosNum; ++i) {
+            ok = aosSort[i].idx == soaSort[i].idx && nearlyEqual(aosSort[i].dist, soaSort[i].dist);
+            if (!ok) {
+                printf("particle_check       %8u: sort key %u is (%u, %f), the reference's (%u, %f)\n", count, i,
+                    soaSort[i].idx, soaSort[i].dist, aosSort[i].idx, aosSort[i].dist);
+            }
+        }
+
+        for (uint32_t i = 0; ok && i < aosNum * 4; ++i) {
+            const ps::ParticleVertex& a = aosVertices[i];
+            const ps::ParticleVertex& b = soaVertices[i];
+            ok = nearlyEqual(a.m_x, b.m_x)
+                && nearlyEqual(a.m_y, b.m_y)
+                && nearlyEqual(a.m_z, b.m_z)
+                && nearlyEqualAbgr(a.m_abgr, b.m_abgr)
+                && a.m_u == b.m_u
+                && a.m_v == b.m_v
+                && nearlyEqual(a.m_blend, b.m_blend)
+                && a.m_angle == b.m_angle;
+            if (!ok) {
+                printf("particle_check       %8u: vertex %u is (%f, %f, %f, %08x, %f), the reference's (%f, %f, %f, %08x, %f)\n",
+                    count, i, b.m_x, b.m_y, b.m_z, b.m_abgr, b.m_blend, a.m_x, a.m_y, a.m_z, a.m_abgr, a.m_blend);
+            }
+        }
+
+        BX_ALIGNED_FREE(allocator, soaVertices, 16);
+        BX_ALIGNED_FREE(allocator, aosVertices, 16);
+        BX_FREE(allocator, soaSort);
+        BX_FREE(allocator, aosSort);
+
+        streams.destroy();
+        reference.destroy();
+
+        if (ok) {
+            printf("particle_check       %8u: %u particles match\n", count, aosNum);
+        }
+        return ok;
+    }
+
+    void benchEmitter(const Options& options, uint32_t count) {
+        const bool update = isEnabled(options, "particle_update");
+        const bool render = isEnabled(options, "particle_render");
+        if (!update && !render) {
+            return;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+
+        aos::Emitter reference;
+        reference.create(EmitterShape::Sphere, EmitterDirection::Outward, count);
+        setupUniforms(reference.m_uniforms, count);
+
+        ps::Emitter streams;
+        streams.create(EmitterShape::Sphere, EmitterDirection::Outward, count, allocator);
+        setupUniforms(streams.m_uniforms, count);
+
+        for (uint32_t i = 0; i < kSettleFrames; ++i) {
+            reference.update(kDt);
+            streams.update(kDt);
+        }
+
+        if (update) {
+            const Result* aosResult = measure(options, "particle_update_aos", count, 1, count, [&]() {
+                reference.update(kDt);
+                s_sink += reference.m_num;
+            });
+            const Result* soaResult = measure(options, "particle_update_soa", count, 1, count, [&]() {
+                streams.update(kDt);
+                s_sink += streams.m_num;
+            });
+            printSpeedup("particle_update", count, 1, aosResult, soaResult);
+        }
+
+        if (render) {
+            ps::ParticleSort* sort = (ps::ParticleSort*)BX_ALLOC(allocator, size_t(count) * sizeof(ps::ParticleSort));
+            ps::ParticleVertex* vertices = (ps::ParticleVertex*)BX_ALIGNED_ALLOC(allocator, size_t(count) * 4 * sizeof(ps::ParticleVertex), 16);
+
+            float view[16];
+            bx::mtxLookAt(view, bx::Vec3(0.0f, 2.0f, -8.0f), bx::Vec3(0.0f, 0.0f, 0.0f));
+            const bx::Vec3 eye = { 0.0f, 2.0f, -8.0f };
+            const float uv[4] = { 0.0f, 0.0f, 0.25f, 0.25f };
+
+            const Result* aosResult = measure(options, "particle_render_aos", count, 1, reference.m_num, [&]() {
+                s_sink += reference.render(uv, view, eye, sort, vertices);
+            });
+            const Result* soaResult = measure(options, "particle_render_soa", count, 1, streams.m_num, [&]() {
+                s_sink += streams.render(uv, view, eye, 0, count, sort, vertices);
+            });
+            printSpeedup("particle_render", count, 1, aosResult, soaResult);
+
+            BX_ALIGNED_FREE(allocator, vertices, 16);
+            BX_FREE(allocator, sort);
+        }
+
+        streams.destroy();
+        reference.destroy();
+    }
+
+    // The comparator render() passed to qsort()
+    int32_t compareBackToFront(const void* lhs, const void* rhs) {
+        const ps::ParticleSort& a = *(const ps::ParticleSort*)lhs;
+        const ps::ParticleSort& b = *(const ps::ParticleSort*)rhs;
+        return a.dist > b.dist ? -1 : 1;
+    }
+
+    // Returns false and prints the first particle out of place. The input
+    // is indexed in order, so ties keep theirs when the indices grow.
+    bool checkBackToFront(const ps::ParticleSort* unsorted, const ps::ParticleSort* sorted, uint32_t count, uint32_t threads) {
+        for (uint32_t i = 0; i < count; ++i) {
+            const ps::ParticleSort& cur = sorted[i];
+            bool ok = cur.idx < count && cur.dist == unsorted[cur.idx].dist;
+            if (ok && i > 0) {
+                const ps::ParticleSort& prev = sorted[i - 1];
+                ok = prev.dist > cur.dist || (prev.dist == cur.dist && prev.idx < cur.idx);
+            }
+            if (!ok) {
+                printf("particle_sort_radix  %8u %3u thr: particle %u (%u, %f) is out of order\n", count, threads, i, cur.idx, cur.dist);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns false when a radix sort came out wrong
+    bool benchSort(const Options& options, uint32_t count, const uint32_t* threads, uint32_t numThreads) {
+        if (!isEnabled(options, "particle_sort")) {
+            return true;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        ps::ParticleSort* unsorted = (ps::ParticleSort*)BX_ALLOC(allocator, size_t(count) * sizeof(ps::ParticleSort));
+        ps::ParticleSort* sorted = (ps::ParticleSort*)BX_ALLOC(allocator, size_t(count) * sizeof(ps::ParticleSort));
+
+        // Distances of a cloud a few units across, seen from eight units away,
+        // in 4096 steps so every count has ties
+        Random random = { 0x9e3779b9u + count };
+        for (uint32_t i = 0; i < count; ++i) {
+            unsorted[i].dist = 5.0f + 6.0f * float(random.next() >> 20) / 4096.0f;
+            unsorted[i].idx = i;
+        }
+
+        bool ok = true;
+
+        const Result* qsortResult = nullptr;
+        if (isEnabled(options, "particle_sort_qsort")) {
+            qsortResult = measure(options, "particle_sort_qsort", count, 1, count, [&]() {
+                bx::memCopy(sorted, unsorted, size_t(count) * sizeof(ps::ParticleSort));
+                qsort(sorted, count, sizeof(ps::ParticleSort), compareBackToFront);
+                s_sink += sorted[0].idx;
+            });
+        }
+
+        if (isEnabled(options, "particle_sort_radix")) {
+            ps::SortScratch scratch;
+            scratch.init(allocator);
+            for (uint32_t t = 0; t < numThreads; ++t) {
+                setThreads(threads[t]);
+                const Result* radixResult = measure(options, "particle_sort_radix", count, threads[t], count, [&]() {
+                    bx::memCopy(sorted, unsorted, size_t(count) * sizeof(ps::ParticleSort));
+                    ps::sortBackToFront(sorted, count, scratch, true);
+                    s_sink += sorted[0].idx;
+                });
+                printSpeedup("particle_sort", count, threads[t], qsortResult, radixResult);
+
+                // The last repetition's output
+                ok = ok && checkBackToFront(unsorted, sorted, count, threads[t]);
+            }
+            setThreads(1);
+            scratch.shutdown();
+        }
+
+        BX_FREE(allocator, sorted);
+        BX_FREE(allocator, unsorted);
+        return ok;
+    }
+
+    // Returns the particles the emitters hold at most
+    uint32_t createFrameEmitters(uint32_t count, ps::Emitter* emitters, ps::Emitter** list, float (*uvs)[4]) {
+        uint32_t max = 0;
+        for (uint32_t i = 0; i < kNumFrameEmitters; ++i) {
+            // Uneven sizes from 1/32 to 3/32 of the count, about the count in all
+            const uint32_t num = count * (1 + i % 3) / (2 * kNumFrameEmitters) + 1;
+            emitters[i].create(EmitterShape::Sphere, EmitterDirection::Outward, num, entry::getAllocator());
+            setupUniforms(emitters[i].m_uniforms, num);
+            emitters[i].m_uniforms.m_position[0] = float(i) - float(kNumFrameEmitters / 2);
+            list[i] = &emitters[i];
+            max += num;
+
+            uvs[i][0] = float(i % 4) * 0.25f;
+            uvs[i][1] = float(i / 4) * 0.25f;
+            uvs[i][2] = uvs[i][0] + 0.25f;
+            uvs[i][3] = uvs[i][1] + 0.25f;
+        }
+        return max;
+    }
+
+    // Returns false and prints where the jobs' frame differs from the
+    // serial one. Both sets of emitters start from the same random state,
+    // and are stepped past the first expiries before rendering.
+    bool checkFrame(uint32_t count, uint32_t threads) {
+        bx::AllocatorI* allocator = entry::getAllocator();
+
+        ps::Emitter serial[kNumFrameEmitters];
+        ps::Emitter jobs[kNumFrameEmitters];
+        ps::Emitter* serialList[kNumFrameEmitters];
+        ps::Emitter* jobsList[kNumFrameEmitters];
+        float uvs[kNumFrameEmitters][4];
+        const uint32_t max = createFrameEmitters(count, serial, serialList, uvs);
+        createFrameEmitters(count, jobs, jobsList, uvs);
+
+        setThreads(threads);
+        for (uint32_t frame = 0; frame < kSettleFrames; ++frame) {
+            for (uint32_t i = 0; i < kNumFrameEmitters; ++i) {
+                serial[i].update(kDt);
+            }
+            ps::updateEmitters(jobsList, kNumFrameEmitters, kDt);
+        }
+
+        const size_t sortSize = size_t(max) * sizeof(ps::ParticleSort);
+        const size_t vertexSize = size_t(max) * 4 * sizeof(ps::ParticleVertex);
+        ps::ParticleSort* serialSort = (ps::ParticleSort*)BX_ALLOC(allocator, sortSize);
+        ps::ParticleSort* jobsSort = (ps::ParticleSort*)BX_ALLOC(allocator, sortSize);
+        ps::ParticleVertex* serialVertices = (ps::ParticleVertex*)BX_ALIGNED_ALLOC(allocator, vertexSize, 16);
+        ps::ParticleVertex* jobsVertices = (ps::ParticleVertex*)BX_ALIGNED_ALLOC(allocator, vertexSize, 16);
+
+        // Whatever isn't written compares equal too
+        bx::memSet(serialSort, 0xcd, sortSize);
+        bx::memSet(jobsSort, 0xcd, sortSize);
+        bx::memSet(serialVertices, 0xcd, vertexSize);
+        bx::memSet(jobsVertices, 0xcd, vertexSize);
+
+        float view[16];
+        bx::mtxLookAt(view, bx::Vec3(0.0f, 2.0f, -16.0f), bx::Vec3(0.0f, 0.0f, 0.0f));
+        const bx::Vec3 eye = { 0.0f, 2.0f, -16.0f };
+
+        uint32_t serialNum = 0;
+        for (uint32_t i = 0; i < kNumFrameEmitters; ++i) {
+            serialNum += serial[i].render(uvs[i], view, eye, serialNum, max, serialSort, serialVertices);
+        }
+        const uint32_t jobsNum = ps::renderEmitters(jobsList, uvs, kNumFrameEmitters, view, eye, max, jobsSort, jobsVertices, allocator);
+        setThreads(1);
+
+        const char* what = nullptr;
+        if (serialNum != jobsNum) {
+            what = "particle count";
+        } else if (0 != bx::memCmp(serialVertices, jobsVertices, vertexSize)) {
+            what = "vertices";
+        } else if (0 != bx::memCmp(serialSort, jobsSort, sortSize)) {
+            what = "sort keys";
+        }
+        for (uint32_t i = 0; what == nullptr && i < kNumFrameEmitters; ++i) {
+            if (serial[i].m_num != jobs[i].m_num
+            ||  0 != bx::memCmp(&serial[i].m_aabb, &jobs[i].m_aabb, sizeof(bx::Aabb))) {
+                what = "emitter bounds";
+            }
+        }
+
+        BX_ALIGNED_FREE(allocator, jobsVertices, 16);
+        BX_ALIGNED_FREE(allocator, serialVertices, 16);
+        BX_FREE(allocator, jobsSort);
+        BX_FREE(allocator, serialSort);
+
+        for (uint32_t i = 0; i < kNumFrameEmitters; ++i) {
+            jobs[i].destroy();
+            serial[i].destroy();
+        }
+
+        if (what != nullptr) {
+            printf("particle_check       %8u %3u thr: the jobs' %s differ from the serial frame's\n", count, threads, what);
+            return false;
+        }
+        printf("particle_check       %8u %3u thr: %u particles, the jobs' frame matches\n", count, threads, jobsNum);
+        return true;
+    }
+
+    // A frame of several emitters, as ParticleSystem::update() and render()
+    // run them. Both variants step the same emitters, which stay at the
+    // steady state.
+    void benchFrame(const Options& options, uint32_t count, const uint32_t* threads, uint32_t numThreads) {
+        if (!isEnabled(options, "particle_frame")) {
+            return;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+
+        ps::Emitter emitters[kNumFrameEmitters];
+        ps::Emitter* list[kNumFrameEmitters];
+        float uvs[kNumFrameEmitters][4];
+        const uint32_t max = createFrameEmitters(count, emitters, list, uvs);
+        for (uint32_t i = 0; i < kNumFrameEmitters; ++i) {
+            for (uint32_t frame = 0; frame < kSettleFrames; ++frame) {
+                emitters[i].update(kDt);
+            }
+        }
+
+        ps::ParticleSort* sort = (ps::ParticleSort*)BX_ALLOC(allocator, size_t(max) * sizeof(ps::ParticleSort));
+        ps::ParticleVertex* vertices = (ps::ParticleVertex*)BX_ALIGNED_ALLOC(allocator, size_t(max) * 4 * sizeof(ps::ParticleVertex), 16);
+
+        float view[16];
+        bx::mtxLookAt(view, bx::Vec3(0.0f, 2.0f, -16.0f), bx::Vec3(0.0f, 0.0f, 0.0f));
+        const bx::Vec3 eye = { 0.0f, 2.0f, -16.0f };
+
+        const Result* serialResult = nullptr;
+        if (isEnabled(options, "particle_frame_serial")) {
+            serialResult = measure(options, "particle_frame_serial", count, 1, count, [&]() {
+                uint32_t pos = 0;
+                for (uint32_t i = 0; i < kNumFrameEmitters; ++i) {
+                    emitters[i].update(kDt);
+                }
+                for (uint32_t i = 0; i < kNumFrameEmitters; ++i) {
+                    pos += emitters[i].render(uvs[i], view, eye, pos, max, sort, vertices);
+                }
+                s_sink += pos;
+            });
+        }
+
+        if (isEnabled(options, "particle_frame_jobs")) {
+            for (uint32_t t = 0; t < numThreads; ++t) {
+                setThreads(threads[t]);
+                const Result* jobsResult = measure(options, "particle_frame_jobs", count, threads[t], count, [&]() {
+                    ps::updateEmitters(list, kNumFrameEmitters, kDt);
+                    s_sink += ps::renderEmitters(list, uvs, kNumFrameEmitters, view, eye, max, sort, vertices, allocator);
+                });
+                printSpeedup("particle_frame", count, threads[t], serialResult, jobsResult);
+            }
+            setThreads(1);
+        }
+
+        BX_ALIGNED_FREE(allocator, vertices, 16);
+        BX_FREE(allocator, sort);
+
+        for (uint32_t i = 0; i < kNumFrameEmitters; ++i) {
+            emitters[i].destroy();
+        }
+    }
+
+    bool writeJson(const char* path, const Options& options) {
+        bx::FileWriter writer;
+        bx::Error err;
+        if (!bx::open(&writer, path, false, &err)) {
+            return false;
+        }
+
+        bx::writePrintf(&writer, "{\n  \"warmup\": %u,\n  \"reps\": %u,\n  \"cores\": %u,\n  \"results\": [\n",
+            options.warmup, options.reps, options.cores);
+        for (uint32_t i = 0; i < s_numResults; ++i) {
+            const Result& result = s_results[i];
+            bx::writePrintf(&writer
+                , "    { \"name\": \"%s\", \"count\": %u, \"threads\": %u, \"items\": %llu"
+                  ", \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f"
+                  ", \"min_ms\": %.4f, \"max_ms\": %.4f }%s\n"
+                , result.name, result.count, result.threads, (unsigned long long)result.items
+                , result.mean, result.p50, result.p90, result.p99, result.min, result.max
+                , i + 1 < s_numResults ? "," : "");
+        }
+        bx::writePrintf(&writer, "  ]\n}\n");
+
+        bx::close(&writer);
+        return err.isOk();
+    }
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    bx::CommandLine cmdLine(argc, argv);
+
+    Options options;
+    options.warmup = uintOption(cmdLine, "warmup", 3);
+    options.reps = uintOption(cmdLine, "reps", 20);
+    if (options.reps == 0) {
+        printf("--reps must be at least 1\n");
+        return 1;
+    }
+    options.filter = cmdLine.findOption("filter");
+    options.cores = jobGetNumCores();
+    printf("%u cores\n", options.cores);
+
+    uint32_t counts[kMaxList];
+    uint32_t sortCounts[kMaxList];
+    uint32_t threads[kMaxList];
+    const uint32_t numCounts = parseUintList(cmdLine.findOption("counts", "1000,10000,100000,250000"), counts, kMaxList);
+    const uint32_t numSortCounts = parseUintList(cmdLine.findOption("sort-counts", "1000,10000,100000,1000000"), sortCounts, kMaxList);
+    const uint32_t numThreads = parseUintList(cmdLine.findOption("threads", "1,2,4"), threads, kMaxList);
+    for (uint32_t i = 0; i < numCounts; ++i) {
+        if (!checkEmitter(counts[i])) {
+            return 1;
+        }
+        for (uint32_t t = 0; t < numThreads; ++t) {
+            if (!checkFrame(counts[i], threads[t])) {
+                return 1;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < numCounts; ++i) {
+        benchEmitter(options, counts[i]);
+    }
+    for (uint32_t i = 0; i < numCounts; ++i) {
+        benchFrame(options, counts[i], threads, numThreads);
+    }
+    for (uint32_t i = 0; i < numSortCounts; ++i) {
+        if (!benchSort(options, sortCounts[i], threads, numThreads)) {
+            jobShutdown();
+            return 1;
+        }
+    }
+    jobShutdown();
+
+    const char* json = cmdLine.findOption("json", "particle_microbench.json");
+    if (!writeJson(json, options)) {
+        printf("Failed to write %s\n", json);
+        return 1;
+    }
+    printf("%u results written to %s\n", s_numResults, json);
+    return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2011-2022 Branimir Karadzic. All rights reserved.
+ * License: https://github.com/bkaradzic/bgfx/blob/master/LICENSE
+ */
+
+#include "particle_sort.h"
+#include "../job_system.h"
+
+#include <bx/math.h>
+
+namespace ps
+{
+	namespace
+	{
+		// Three passes of 11, 11 and 10 bits cover the 32-bit keys.
+		constexpr uint32_t kRadixBits   = 11;
+		constexpr uint32_t kNumBuckets  = 1u << kRadixBits;
+		constexpr uint32_t kNumPasses   = 3;
+
+		// Below this an insertion sort beats clearing the histograms.
+		constexpr uint32_t kInsertionSortMax = 64;
+
+		// Below this the workers cost more than they save. Chunks are at
+		// least kParallelGrain particles, and there are at most kMaxChunks
+		// of them so the histograms stay small.
+		constexpr uint32_t kParallelMin   = 64<<10;
+		constexpr uint32_t kParallelGrain = 16<<10;
+		constexpr uint32_t kMaxChunks     = 64;
+
+		// Keys ascend as distances descend: the float bits are flipped to
+		// order as unsigned integers, then inverted.
+		inline uint32_t sortKey(float _dist)
+		{
+			const uint32_t bits = bx::floatToBits(_dist);
+			const uint32_t mask = uint32_t(int32_t(bits) >> 31) | UINT32_C(0x80000000);
+			return ~(bits ^ mask);
+		}
+
+		inline uint32_t sortDigit(uint32_t _key, uint32_t _pass)
+		{
+			return (_key >> (_pass*kRadixBits) ) & (kNumBuckets-1);
+		}
+
+		void insertionSort(ParticleSort* _data, uint32_t _num)
+		{
+			for (uint32_t ii = 1; ii < _num; ++ii)
+			{
+				const ParticleSort item = _data[ii];
+				const uint32_t key = sortKey(item.dist);
+
+				uint32_t jj = ii;
+				for (; 0 < jj && sortKey(_data[jj-1].dist) > key; --jj)
+				{
+					_data[jj] = _data[jj-1];
+				}
+
+				_data[jj] = item;
+			}
+		}
+
+		struct RadixContext
+		{
+			const ParticleSort* m_src;
+			ParticleSort*       m_dst;
+			uint32_t*           m_counts; //!< [chunk][pass][bucket], offsets once a pass starts.
+			uint32_t            m_grain;
+			uint32_t            m_pass;
+			uint32_t            m_numCounted; //!< Passes counted from m_pass on.
+		};
+
+		inline uint32_t* chunkCounts(const RadixContext& _ctx, uint32_t _begin, uint32_t _pass)
+		{
+			return &_ctx.m_counts[(_begin/_ctx.m_grain*kNumPasses + _pass)*kNumBuckets];
+		}
+
+		void countRange(uint32_t _begin, uint32_t _end, void* _userData)
+		{
+			const RadixContext& ctx = *(const RadixContext*)_userData;
+			uint32_t* counts = chunkCounts(ctx, _begin, ctx.m_pass);
+			bx::memSet(counts, 0, ctx.m_numCounted*kNumBuckets*sizeof(uint32_t) );
+
+			for (uint32_t ii = _begin; ii < _end; ++ii)
+			{
+				const uint32_t key = sortKey(ctx.m_src[ii].dist);
+				for (uint32_t pass = 0; pass < ctx.m_numCounted; ++pass)
+				{
+					++counts[pass*kNumBuckets + sortDigit(key, ctx.m_pass + pass)];
+				}
+			}
+		}
+
+		void scatterRange(uint32_t _begin, uint32_t _end, void* _userData)
+		{
+			const RadixContext& ctx = *(const RadixContext*)_userData;
+			uint32_t* offsets = chunkCounts(ctx, _begin, ctx.m_pass);
+
+			for (uint32_t ii = _begin; ii < _end; ++ii)
+			{
+				const ParticleSort& item = ctx.m_src[ii];
+				ctx.m_dst[offsets[sortDigit(sortKey(item.dist), ctx.m_pass)]++] = item;
+			}
+		}
+
+		void radixSort(ParticleSort* _data, ParticleSort* _temp, uint32_t* _counts, uint32_t _num, uint32_t _grain, bool _parallel)
+		{
+			const uint32_t numChunks = (_num + _grain - 1)/_grain;
+			RadixContext ctx = { _data, _temp, _counts, _grain, 0, kNumPasses };
+
+			// A single chunk holds the same keys whatever their order, so
+			// every pass is counted in one read.
+			if (!_parallel)
+			{
+				countRange(0, _num, &ctx);
+			}
+
+			for (uint32_t pass = 0; pass < kNumPasses; ++pass)
+			{
+				ctx.m_pass = pass;
+
+				// Chunks hold other particles after every pass, they are
+				// counted again.
+				if (_parallel)
+				{
+					ctx.m_numCounted = 1;
+					jobParallelFor(0, _num, _grain, countRange, &ctx);
+				}
+
+				// A pass where every key has the same digit would only copy,
+				// which is common for the high bits of nearby distances.
+				const uint32_t first = sortDigit(sortKey(ctx.m_src[0].dist), pass);
+				uint32_t numFirst = 0;
+				for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+				{
+					numFirst += ctx.m_counts[(chunk*kNumPasses + pass)*kNumBuckets + first];
+				}
+
+				if (numFirst == _num)
+				{
+					continue;
+				}
+
+				// Offsets by digit, then by chunk, keep equal keys in order.
+				uint32_t offset = 0;
+				for (uint32_t bucket = 0; bucket < kNumBuckets; ++bucket)
+				{
+					for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+					{
+						uint32_t& count = ctx.m_counts[(chunk*kNumPasses + pass)*kNumBuckets + bucket];
+						const uint32_t num = count;
+						count   = offset;
+						offset += num;
+					}
+				}
+
+				if (_parallel)
+				{
+					jobParallelFor(0, _num, _grain, scatterRange, &ctx);
+				}
+				else
+				{
+					scatterRange(0, _num, &ctx);
+				}
+
+				ParticleSort* src = ctx.m_dst;
+				ctx.m_dst = const_cast<ParticleSort*>(ctx.m_src);
+				ctx.m_src = src;
+			}
+
+			if (ctx.m_src != _data)
+			{
+				bx::memCopy(_data, ctx.m_src, _num*sizeof(ParticleSort) );
+			}
+		}
+
+	} // namespace
+
+	void SortScratch::init(bx::AllocatorI* _allocator)
+	{
+		m_allocator = _allocator;
+		m_data = NULL;
+		m_size = 0;
+	}
+
+	void SortScratch::shutdown()
+	{
+		if (NULL != m_data)
+		{
+			BX_ALIGNED_FREE(m_allocator, m_data, 16);
+		}
+
+		m_data = NULL;
+		m_size = 0;
+	}
+
+	void* SortScratch::reserve(uint32_t _size)
+	{
+		if (_size > m_size)
+		{
+			if (NULL != m_data)
+			{
+				BX_ALIGNED_FREE(m_allocator, m_data, 16);
+			}
+
+			// Some headroom, so counts creeping up don't reallocate every frame.
+			m_size = bx::max(_size, m_size + m_size/2);
+			m_data = BX_ALIGNED_ALLOC(m_allocator, m_size, 16);
+		}
+
+		return m_data;
+	}
+
+	void sortBackToFront(ParticleSort* _data, uint32_t _num, SortScratch& _scratch, bool _parallel)
+	{
+		if (_num <= kInsertionSortMax)
+		{
+			insertionSort(_data, _num);
+			return;
+		}
+
+		_parallel = _parallel
+			&& kParallelMin <= _num
+			&& 0 < jobGetNumThreads()
+			;
+
+		const uint32_t grain = _parallel
+			? bx::max(kParallelGrain, (_num + kMaxChunks - 1)/kMaxChunks)
+			: _num
+			;
+		const uint32_t numChunks = (_num + grain - 1)/grain;
+
+		const uint32_t tempSize = (_num*uint32_t(sizeof(ParticleSort) ) + 15) & ~15u;
+		uint8_t* scratch = (uint8_t*)_scratch.reserve(tempSize + numChunks*kNumPasses*kNumBuckets*uint32_t(sizeof(uint32_t) ) );
+
+		radixSort(_data, (ParticleSort*)scratch, (uint32_t*)(scratch + tempSize), _num, grain, _parallel);
+	}
+
+} // namespace ps
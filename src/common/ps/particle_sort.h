@@ -0,0 +1,45 @@
+/*
+ * Copyright 2011-2022 Branimir Karadzic. All rights reserved.
+ * License: https://github.com/bkaradzic/bgfx/blob/master/LICENSE
+ */
+
+#ifndef PARTICLE_SORT_H_HEADER_GUARD
+#define PARTICLE_SORT_H_HEADER_GUARD
+
+#include "particle_emitter.h"
+
+namespace ps
+{
+	/// Scratch memory of sortBackToFront(), kept between frames so sorting
+	/// stops allocating once it has grown to the largest count.
+	///
+	struct SortScratch
+	{
+		///
+		void init(bx::AllocatorI* _allocator);
+
+		///
+		void shutdown();
+
+		/// Returns at least _size bytes, 16-byte aligned. The contents are
+		/// not kept when it grows.
+		///
+		void* reserve(uint32_t _size);
+
+		bx::AllocatorI* m_allocator;
+		void*    m_data;
+		uint32_t m_size;
+	};
+
+	/// Sorts _num particles back to front, the farthest first. Particles at
+	/// the same distance keep their order.
+	///
+	/// Small counts use an insertion sort, larger ones an LSD radix sort on
+	/// the distance bits. With _parallel, counts large enough to be worth it
+	/// split the histograms and scatters over the job workers.
+	///
+	void sortBackToFront(ParticleSort* _data, uint32_t _num, SortScratch& _scratch, bool _parallel);
+
+} // namespace ps
+
+#endif // PARTICLE_SORT_H_HEADER_GUARD
@@ -0,0 +1,187 @@
+#include "rolling_stats.h"
+#include "format_writer.h"
+
+#include <bx/math.h>
+#include <bx/string.h>
+#include <bx/uint32_t.h>
+
+namespace
+{
+	constexpr uint32_t kSubCount = 1<<RollingStats::kSubBits;
+
+	inline uint32_t toUs(float _ms)
+	{
+		const float us = _ms*1000.0f + 0.5f;
+		return us <= 0.0f ? 0 : us >= 4294967295.0f ? UINT32_MAX : uint32_t(us);
+	}
+
+	// Exact below kSubCount, then kSubCount buckets per power of two.
+	inline uint32_t bucketOf(uint32_t _us)
+	{
+		if (_us < kSubCount)
+		{
+			return _us;
+		}
+
+		const uint32_t msb   = 31 - bx::uint32_cntlz(_us);
+		const uint32_t shift = msb - RollingStats::kSubBits;
+		return ( (shift + 1) << RollingStats::kSubBits) + ( (_us >> shift) & (kSubCount - 1) );
+	}
+
+	inline double bucketLower(uint32_t _bucket)
+	{
+		if (_bucket < kSubCount)
+		{
+			return double(_bucket);
+		}
+
+		const uint32_t shift = (_bucket >> RollingStats::kSubBits) - 1;
+		return double(uint64_t( (_bucket & (kSubCount - 1) ) + kSubCount) << shift);
+	}
+
+	// Middle of the bucket in milliseconds, exact for the linear buckets.
+	inline float bucketMs(uint32_t _bucket)
+	{
+		const double lower = bucketLower(_bucket);
+		const double width = _bucket < kSubCount ? 0.0 : bucketLower(_bucket + 1) - lower;
+		return float( (lower + width*0.5)/1000.0);
+	}
+
+} // namespace
+
+RollingStats::RollingStats(uint32_t _window)
+	: m_window(bx::clamp<uint32_t>(_window, 1, kCapacity) )
+{
+	reset();
+}
+
+void RollingStats::reset()
+{
+	bx::memSet(m_ring,    0, sizeof(m_ring) );
+	bx::memSet(m_buckets, 0, sizeof(m_buckets) );
+	m_sum       = 0;
+	m_head      = 0;
+	m_numPushed = 0;
+	m_count     = 0;
+}
+
+void RollingStats::setWindow(uint32_t _window)
+{
+	m_window = bx::clamp<uint32_t>(_window, 1, kCapacity);
+	m_count  = bx::min(m_numPushed, m_window);
+
+	bx::memSet(m_buckets, 0, sizeof(m_buckets) );
+	m_sum = 0;
+	for (uint32_t ii = 0; ii < m_count; ++ii)
+	{
+		const uint32_t us = m_ring[(m_head + kCapacity - 1 - ii) & (kCapacity - 1)];
+		++m_buckets[bucketOf(us)];
+		m_sum += us;
+	}
+}
+
+void RollingStats::push(float _ms)
+{
+	// The sample leaving the window is still in the ring, which is at
+	// least as long.
+	if (m_count == m_window)
+	{
+		const uint32_t oldest = m_ring[(m_head + kCapacity - m_window) & (kCapacity - 1)];
+		--m_buckets[bucketOf(oldest)];
+		m_sum -= oldest;
+	}
+	else
+	{
+		++m_count;
+	}
+
+	const uint32_t us = toUs(_ms);
+	m_ring[m_head] = us;
+	m_head = (m_head + 1) & (kCapacity - 1);
+	m_numPushed = bx::min(m_numPushed + 1, kCapacity);
+
+	++m_buckets[bucketOf(us)];
+	m_sum += us;
+}
+
+float RollingStats::getSample(uint32_t _age) const
+{
+	if (_age >= m_numPushed)
+	{
+		return 0.0f;
+	}
+
+	return float(m_ring[(m_head + kCapacity - 1 - _age) & (kCapacity - 1)])/1000.0f;
+}
+
+RollingStats::Summary RollingStats::getSummary() const
+{
+	Summary summary;
+	bx::memSet(&summary, 0, sizeof(summary) );
+	summary.m_count = m_count;
+	if (0 == m_count)
+	{
+		return summary;
+	}
+
+	summary.m_mean = float(double(m_sum)/double(m_count)/1000.0);
+
+	// Nearest rank.
+	const uint32_t rank50 = bx::max<uint32_t>(1, (m_count*50 + 99)/100);
+	const uint32_t rank95 = bx::max<uint32_t>(1, (m_count*95 + 99)/100);
+	const uint32_t rank99 = bx::max<uint32_t>(1, (m_count*99 + 99)/100);
+
+	uint32_t seen = 0;
+	for (uint32_t ii = 0; ii < kNumBuckets && seen < m_count; ++ii)
+	{
+		const uint32_t count = m_buckets[ii];
+		if (0 == count)
+		{
+			continue;
+		}
+
+		const float ms = bucketMs(ii);
+		if (0 == seen)
+		{
+			summary.m_min = ms;
+		}
+
+		const uint32_t before = seen;
+		seen += count;
+		summary.m_p50 = before < rank50 && seen >= rank50 ? ms : summary.m_p50;
+		summary.m_p95 = before < rank95 && seen >= rank95 ? ms : summary.m_p95;
+		summary.m_p99 = before < rank99 && seen >= rank99 ? ms : summary.m_p99;
+		summary.m_max = ms;
+	}
+
+	return summary;
+}
+
+void RollingStats::writeJson(bx::WriterI* _writer, bx::Error* _err) const
+{
+	const Summary summary = getSummary();
+	writef(_writer, _err
+		, "{ \"window\": %u, \"count\": %u, \"mean\": %.4f, \"min\": %.4f, \"max\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"histogram\": ["
+		, m_window
+		, summary.m_count
+		, summary.m_mean
+		, summary.m_min
+		, summary.m_max
+		, summary.m_p50
+		, summary.m_p95
+		, summary.m_p99
+		);
+
+	// [lower bound in ms, samples]
+	bool first = true;
+	for (uint32_t ii = 0; ii < kNumBuckets; ++ii)
+	{
+		if (0 != m_buckets[ii])
+		{
+			writef(_writer, _err, "%s[%.3f, %u]", first ? "" : ", ", bucketLower(ii)/1000.0, m_buckets[ii]);
+			first = false;
+		}
+	}
+
+	writef(_writer, _err, "] }");
+}
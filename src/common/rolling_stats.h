@@ -0,0 +1,69 @@
+#ifndef ROLLING_STATS_H_HEADER_GUARD
+#define ROLLING_STATS_H_HEADER_GUARD
+
+#include <bx/readerwriter.h>
+
+/// Statistics over the last samples pushed, with percentiles, for frame
+/// times. Samples are in milliseconds and kept to the microsecond in a ring
+/// buffer. A log-linear histogram of the samples in the window, 32 buckets
+/// per power of two, follows every push in O(1). Percentiles, minimum and
+/// maximum come from it to within 1.6%, the mean is exact.
+///
+/// A summary walks the fixed histogram and costs the same at any window.
+///
+class RollingStats
+{
+public:
+	static constexpr uint32_t kCapacity   = 1024;
+	static constexpr uint32_t kSubBits    = 5;
+	static constexpr uint32_t kNumBuckets = (32 - kSubBits + 1) << kSubBits;
+
+	///
+	struct Summary
+	{
+		uint32_t m_count; //!< Samples in the window.
+		float m_min;
+		float m_max;
+		float m_mean;
+		float m_p50;
+		float m_p95;
+		float m_p99;
+	};
+
+	/// @param[in] _window Samples the statistics cover, at most kCapacity.
+	///
+	RollingStats(uint32_t _window = 300);
+
+	///
+	void reset();
+
+	/// Rebuilds the histogram over the last _window samples still in the
+	/// ring, O(_window).
+	void setWindow(uint32_t _window);
+
+	///
+	uint32_t getWindow() const { return m_window; }
+
+	///
+	void push(float _ms);
+
+	/// Sample _age pushes ago, 0 is the latest, 0.0f when there is none.
+	float getSample(uint32_t _age) const;
+
+	///
+	Summary getSummary() const;
+
+	/// Window, summary and the non-empty buckets as a JSON object.
+	void writeJson(bx::WriterI* _writer, bx::Error* _err) const;
+
+private:
+	uint32_t m_ring[kCapacity];      // Microseconds.
+	uint16_t m_buckets[kNumBuckets];
+	uint64_t m_sum;                  // Of the window, microseconds.
+	uint32_t m_head;
+	uint32_t m_numPushed;            // Up to kCapacity.
+	uint32_t m_count;                // In the window.
+	uint32_t m_window;
+};
+
+#endif // ROLLING_STATS_H_HEADER_GUARD
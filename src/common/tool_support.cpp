@@ -0,0 +1,52 @@
+#include "tool_support.h"
+
+#include <bx/allocator.h>
+#include <bx/string.h>
+#include <entry/entry.h>
+
+namespace entry
+{
+	// The code these tools share with the app allocates through entry,
+	// which they don't link.
+	bx::AllocatorI* getAllocator()
+	{
+		static bx::DefaultAllocator s_allocator;
+		return &s_allocator;
+	}
+
+} // namespace entry
+
+uint32_t parseUintList(const char* _str, uint32_t* _values, uint32_t _max)
+{
+	uint32_t num = 0;
+	while (NULL != _str && '\0' != *_str && num < _max)
+	{
+		const bx::StringView comma = bx::strFind(_str, ',');
+		const char* end = comma.isEmpty() ? _str + bx::strLen(_str) : comma.getPtr();
+
+		uint32_t value;
+		if (bx::fromString(&value, bx::StringView(_str, int32_t(end - _str) ) )
+		&&  0 < value)
+		{
+			_values[num++] = value;
+		}
+
+		_str = comma.isEmpty() ? NULL : comma.getPtr() + 1;
+	}
+
+	return num;
+}
+
+uint32_t uintOption(const bx::CommandLine& _cmdLine, const char* _name, uint32_t _default)
+{
+	uint32_t value;
+	const char* str = _cmdLine.findOption(_name);
+	return NULL != str && bx::fromString(&value, str) ? value : _default;
+}
+
+float floatOption(const bx::CommandLine& _cmdLine, const char* _name, float _default)
+{
+	float value;
+	const char* str = _cmdLine.findOption(_name);
+	return NULL != str && bx::fromString(&value, str) ? value : _default;
+}
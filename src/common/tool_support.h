@@ -0,0 +1,51 @@
+#ifndef TOOL_SUPPORT_H_HEADER_GUARD
+#define TOOL_SUPPORT_H_HEADER_GUARD
+
+#include <bx/commandline.h>
+#include <bx/math.h>
+#include <bx/sort.h>
+
+/// Helpers shared by the benchmarks and command line tools.
+///
+/// The inline ones may be used anywhere. The rest live in tool_support.cpp,
+/// which also defines entry::getAllocator() for tools that don't link
+/// entry, and must only be built into those.
+
+/// Orders floats ascending, for bx::quickSort().
+///
+inline int32_t compareFloat(const void* _lhs, const void* _rhs)
+{
+	const float a = *(const float*)_lhs;
+	const float b = *(const float*)_rhs;
+	return a < b ? -1 : a > b ? 1 : 0;
+}
+
+///
+inline void sortFloats(float* _values, uint32_t _num)
+{
+	bx::quickSort(_values, _num, sizeof(float), compareFloat);
+}
+
+/// Nearest-rank percentile of _num sorted values, _p in (0, 1]. _num must
+/// not be zero.
+///
+inline float nearestRank(const float* _sorted, uint32_t _num, float _p)
+{
+	const uint32_t index = uint32_t(bx::ceil(_p*float(_num) ) ) - 1;
+	return _sorted[bx::min(index, _num - 1)];
+}
+
+/// Parses a comma separated list of positive integers, skipping anything
+/// else. Returns the number of values written, at most _max.
+///
+uint32_t parseUintList(const char* _str, uint32_t* _values, uint32_t _max);
+
+/// Value of --_name, _default when missing or not a number.
+///
+uint32_t uintOption(const bx::CommandLine& _cmdLine, const char* _name, uint32_t _default);
+
+/// Value of --_name, _default when missing or not a number.
+///
+float floatOption(const bx::CommandLine& _cmdLine, const char* _name, float _default);
+
+#endif // TOOL_SUPPORT_H_HEADER_GUARD
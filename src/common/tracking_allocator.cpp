@@ -0,0 +1,407 @@
+#include "tracking_allocator.h"
+#include "format_writer.h"
+
+#include <bx/cpu.h>
+#include <bx/file.h>
+#include <bx/string.h>
+
+namespace
+{
+	// In front of every allocation, for the free to know what to account.
+	struct Header
+	{
+		uint64_t m_size;
+		uint16_t m_tag;
+		uint16_t m_offset; // From the backing allocation to the user pointer.
+		uint32_t m_site;   // Index + 1, 0 when not tracked.
+	};
+
+	static_assert(16 == sizeof(Header), "Header must keep user pointers 16-byte aligned.");
+
+	constexpr uint32_t kTagCacheSize = 64;
+
+	struct TagCacheEntry
+	{
+		const void* m_key;
+		const void* m_owner;
+		uint16_t    m_tag;
+	};
+
+	static thread_local const char*   t_scope = NULL;
+	static thread_local TagCacheEntry t_tagCache[kTagCacheSize];
+
+	static const char s_other[] = "other";
+
+	inline uintptr_t alignUp(uintptr_t _value, size_t _align)
+	{
+		return (_value + _align - 1) & ~uintptr_t(_align - 1);
+	}
+
+	inline uint32_t hashPtr(const void* _ptr)
+	{
+		const uintptr_t value = uintptr_t(_ptr);
+		return uint32_t( (value >> 4) ^ (value >> 12) );
+	}
+
+	// "a/b/heightmap/x.cpp" -> "heightmap", "bgfx/src/bgfx.cpp" -> "bgfx".
+	void tagFromFile(char* _out, int32_t _max, const char* _file)
+	{
+		// Last three separators, the one before the file name first.
+		const char* sep[3] = { NULL, NULL, NULL };
+		for (const char* ch = _file; '\0' != *ch; ++ch)
+		{
+			if ('/' == *ch || '\\' == *ch)
+			{
+				sep[2] = sep[1];
+				sep[1] = sep[0];
+				sep[0] = ch;
+			}
+		}
+
+		if (NULL == sep[0])
+		{
+			bx::strCopy(_out, _max, s_other);
+			return;
+		}
+
+		const char* end   = sep[0];
+		const char* begin = NULL != sep[1] ? sep[1] + 1 : _file;
+		if (NULL != sep[1]
+		&&  3 == end - begin
+		&&  0 == bx::strCmp(begin, "src", 3) )
+		{
+			end   = sep[1];
+			begin = NULL != sep[2] ? sep[2] + 1 : _file;
+		}
+
+		bx::strCopy(_out, _max, bx::StringView(begin, int32_t(end - begin) ) );
+	}
+
+	void writeCounters(bx::WriterI* _writer, bx::Error* _err, const MemoryCounters& _counters)
+	{
+		writef(_writer, _err
+			, "\"current\": %lld, \"peak\": %lld, \"count\": %lld, \"allocations\": %llu"
+			, (long long)_counters.m_current
+			, (long long)_counters.m_peak
+			, (long long)_counters.m_count
+			, (unsigned long long)_counters.m_allocations
+			);
+	}
+
+} // namespace
+
+TrackingAllocator::TrackingAllocator(bx::AllocatorI* _backing)
+	: m_backing(_backing)
+	, m_numTags(1)
+	, m_sites(NULL)
+	, m_numSites(0)
+	, m_trackSites(false)
+{
+	bx::memSet(m_tagNames, 0, sizeof(m_tagNames) );
+	bx::memSet(m_tags, 0, sizeof(m_tags) );
+	bx::memSet(&m_total, 0, sizeof(m_total) );
+	bx::strCopy(m_tagNames[0], sizeof(m_tagNames[0]), s_other);
+}
+
+TrackingAllocator::~TrackingAllocator()
+{
+	if (NULL != m_sites)
+	{
+		m_backing->realloc(m_sites, 0, 0, NULL, 0);
+	}
+}
+
+void* TrackingAllocator::realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line)
+{
+	// Copied out, the backing allocator may move or free it.
+	Header prev;
+	uint8_t* prevRaw = NULL;
+	if (NULL != _ptr)
+	{
+		prev    = *( (const Header*)_ptr - 1);
+		prevRaw = (uint8_t*)_ptr - prev.m_offset;
+	}
+
+	// Room for the old offset as well, so the backing allocator can grow or
+	// shrink the block in place without cutting off the data.
+	const size_t align = bx::max(_align, sizeof(Header) );
+	const size_t front = bx::max<size_t>(sizeof(Header) + align - 1, NULL != prevRaw ? prev.m_offset : 0);
+
+	uint8_t* raw = NULL;
+	if (0 != _size)
+	{
+		raw = (uint8_t*)m_backing->realloc(prevRaw, front + _size, 0, _file, _line);
+		if (NULL == raw)
+		{
+			return NULL;
+		}
+	}
+	else if (NULL != prevRaw)
+	{
+		m_backing->realloc(prevRaw, 0, 0, _file, _line);
+	}
+
+	if (NULL != prevRaw)
+	{
+		const int64_t size = int64_t(prev.m_size);
+		remove(m_total, size);
+		remove(m_tags[prev.m_tag], size);
+		if (0 != prev.m_site)
+		{
+			remove(m_sites[prev.m_site - 1].m_counters, size);
+		}
+	}
+
+	if (NULL == raw)
+	{
+		return NULL;
+	}
+
+	void* ptr = (void*)alignUp(uintptr_t(raw) + sizeof(Header), align);
+
+	// The block may have moved to an address aligned differently.
+	if (NULL != prevRaw
+	&&  uint16_t( (uint8_t*)ptr - raw) != prev.m_offset)
+	{
+		bx::memMove(ptr, raw + prev.m_offset, size_t(bx::min<uint64_t>(prev.m_size, _size) ) );
+	}
+
+	const char* key = NULL != t_scope ? t_scope : _file;
+	const uint16_t tag = NULL != key ? findTag(key, NULL == t_scope) : 0;
+
+	Header* header = (Header*)ptr - 1;
+	header->m_size   = _size;
+	header->m_tag    = tag;
+	header->m_offset = uint16_t( (uint8_t*)ptr - raw);
+	header->m_site   = m_trackSites && NULL != _file ? findSite(_file, _line, tag) : 0;
+
+	add(m_total, int64_t(_size) );
+	add(m_tags[tag], int64_t(_size) );
+	if (0 != header->m_site)
+	{
+		add(m_sites[header->m_site - 1].m_counters, int64_t(_size) );
+	}
+
+	return ptr;
+}
+
+// Tags are looked up by the pointer of the scope name or file literal, so
+// a thread resolves each call site once and hits its cache from then on.
+uint16_t TrackingAllocator::findTag(const char* _key, bool _isFile)
+{
+	TagCacheEntry& entry = t_tagCache[hashPtr(_key) % kTagCacheSize];
+	if (entry.m_key == _key
+	&&  entry.m_owner == this)
+	{
+		return entry.m_tag;
+	}
+
+	char name[sizeof(m_tagNames[0])];
+	if (_isFile)
+	{
+		tagFromFile(name, sizeof(name), _key);
+	}
+	else
+	{
+		bx::strCopy(name, sizeof(name), _key);
+	}
+
+	uint16_t tag = 0;
+	{
+		bx::MutexScope lock(m_tagMutex);
+
+		for (tag = 0; tag < m_numTags && 0 != bx::strCmp(m_tagNames[tag], name); ++tag)
+		{
+		}
+
+		if (tag == m_numTags)
+		{
+			if (m_numTags < kMaxTags)
+			{
+				bx::strCopy(m_tagNames[tag], sizeof(m_tagNames[tag]), name);
+				++m_numTags;
+			}
+			else
+			{
+				tag = 0;
+			}
+		}
+	}
+
+	entry.m_key   = _key;
+	entry.m_owner = this;
+	entry.m_tag   = tag;
+	return tag;
+}
+
+uint32_t TrackingAllocator::findSite(const char* _file, uint32_t _line, uint16_t _tag)
+{
+	// Only finding a site takes the lock, the table never moves once made.
+	bx::MutexScope lock(m_siteMutex);
+
+	if (NULL == m_sites)
+	{
+		m_sites = (Site*)m_backing->realloc(NULL, kMaxSites*sizeof(Site), 0, __FILE__, __LINE__);
+		bx::memSet(m_sites, 0, kMaxSites*sizeof(Site) );
+	}
+
+	// Same file pointer, same site. Scoped tags split a site further.
+	const uint32_t hash = hashPtr(_file) ^ (_line * 0x9e3779b1u) ^ _tag;
+	for (uint32_t ii = 0; ii < kMaxSites; ++ii)
+	{
+		const uint32_t index = (hash + ii) % kMaxSites;
+		Site& site = m_sites[index];
+
+		if (NULL == site.m_file)
+		{
+			if (m_numSites >= kMaxSites/2)
+			{
+				return 0;
+			}
+
+			site.m_file = _file;
+			site.m_line = _line;
+			site.m_tag  = _tag;
+			++m_numSites;
+			return index + 1;
+		}
+
+		if (site.m_file == _file
+		&&  site.m_line == _line
+		&&  site.m_tag  == _tag)
+		{
+			return index + 1;
+		}
+	}
+
+	return 0;
+}
+
+void TrackingAllocator::add(Counters& _counters, int64_t _size)
+{
+	const int64_t current = bx::atomicAddAndFetch<int64_t>(&_counters.m_current, _size);
+	bx::atomicFetchAndAdd<int64_t>(&_counters.m_count, 1);
+	bx::atomicFetchAndAdd<uint64_t>(&_counters.m_allocations, 1);
+
+	for (int64_t peak = _counters.m_peak; current > peak;)
+	{
+		const int64_t prev = bx::atomicCompareAndSwap<int64_t>(&_counters.m_peak, peak, current);
+		if (prev == peak)
+		{
+			break;
+		}
+
+		peak = prev;
+	}
+}
+
+void TrackingAllocator::remove(Counters& _counters, int64_t _size)
+{
+	bx::atomicFetchAndAdd<int64_t>(&_counters.m_current, -_size);
+	bx::atomicFetchAndAdd<int64_t>(&_counters.m_count, -1);
+}
+
+MemoryCounters TrackingAllocator::load(const Counters& _counters)
+{
+	MemoryCounters result;
+	result.m_current     = _counters.m_current;
+	result.m_peak        = _counters.m_peak;
+	result.m_count       = _counters.m_count;
+	result.m_allocations = _counters.m_allocations;
+	return result;
+}
+
+MemoryCounters TrackingAllocator::getTotal() const
+{
+	return load(m_total);
+}
+
+uint16_t TrackingAllocator::getNumTags() const
+{
+	bx::MutexScope lock(m_tagMutex);
+	return m_numTags;
+}
+
+MemoryTagStats TrackingAllocator::getTag(uint16_t _index) const
+{
+	MemoryTagStats stats;
+	stats.m_name     = m_tagNames[_index];
+	stats.m_counters = load(m_tags[_index]);
+	return stats;
+}
+
+void TrackingAllocator::writeJson(bx::WriterI* _writer, bx::Error* _err) const
+{
+	writef(_writer, _err, "{\n\t\"total\": { ");
+	writeCounters(_writer, _err, getTotal() );
+	writef(_writer, _err, " },\n\t\"tags\": [");
+
+	const uint16_t numTags = getNumTags();
+	for (uint16_t ii = 0; ii < numTags; ++ii)
+	{
+		const MemoryTagStats tag = getTag(ii);
+		writef(_writer, _err, "%s\n\t\t{ \"name\": \"%s\", ", 0 == ii ? "" : ",", tag.m_name);
+		writeCounters(_writer, _err, tag.m_counters);
+		writef(_writer, _err, " }");
+	}
+
+	writef(_writer, _err, "\n\t],\n\t\"sites\": [");
+
+	{
+		bx::MutexScope lock(m_siteMutex);
+
+		bool first = true;
+		for (uint32_t ii = 0; NULL != m_sites && ii < kMaxSites; ++ii)
+		{
+			const Site& site = m_sites[ii];
+			if (NULL == site.m_file)
+			{
+				continue;
+			}
+
+			char file[256];
+			bx::strCopy(file, sizeof(file), site.m_file);
+			for (char* ch = file; '\0' != *ch; ++ch)
+			{
+				*ch = '\\' == *ch || '"' == *ch ? '/' : *ch;
+			}
+
+			writef(_writer, _err, "%s\n\t\t{ \"file\": \"%s\", \"line\": %u, \"tag\": \"%s\", "
+				, first ? "" : ","
+				, file
+				, site.m_line
+				, m_tagNames[site.m_tag]
+				);
+			writeCounters(_writer, _err, load(site.m_counters) );
+			writef(_writer, _err, " }");
+			first = false;
+		}
+	}
+
+	writef(_writer, _err, "\n\t]\n}\n");
+}
+
+bool TrackingAllocator::writeJson(const char* _filePath) const
+{
+	bx::FileWriter writer;
+	bx::Error err;
+	if (!bx::open(&writer, _filePath, false, &err) )
+	{
+		return false;
+	}
+
+	writeJson(&writer, &err);
+	bx::close(&writer);
+	return err.isOk();
+}
+
+MemoryTagScope::MemoryTagScope(const char* _name)
+	: m_prev(t_scope)
+{
+	t_scope = _name;
+}
+
+MemoryTagScope::~MemoryTagScope()
+{
+	t_scope = m_prev;
+}
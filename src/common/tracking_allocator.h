@@ -0,0 +1,121 @@
+#ifndef TRACKING_ALLOCATOR_H_HEADER_GUARD
+#define TRACKING_ALLOCATOR_H_HEADER_GUARD
+
+#include <bx/allocator.h>
+#include <bx/macros.h>
+#include <bx/mutex.h>
+#include <bx/readerwriter.h>
+
+///
+struct MemoryCounters
+{
+	int64_t  m_current;     //!< Bytes live now.
+	int64_t  m_peak;        //!< Most bytes live at once.
+	int64_t  m_count;       //!< Allocations live now.
+	uint64_t m_allocations; //!< Allocations made so far.
+};
+
+///
+struct MemoryTagStats
+{
+	const char*    m_name;
+	MemoryCounters m_counters;
+};
+
+/// Allocator wrapper that accounts every allocation to a tag. The tag is
+/// the innermost MEMORY_TAG_SCOPE on the allocating thread or, outside of
+/// one, the directory of the file BX_ALLOC was called from ("heightmap",
+/// "imgui", "bgfx", ...). Allocations without a file, as BX_ALLOC makes
+/// them unless BX_CONFIG_ALLOCATOR_DEBUG is set (Debug builds, or the
+/// OMNI_ALLOCATOR_SITES CMake option), go to "other". Counters are updated
+/// with atomics only.
+///
+/// Site tracking additionally keeps counters per file and line, behind a
+/// lock, for sizing containers.
+///
+class TrackingAllocator : public bx::AllocatorI
+{
+public:
+	static constexpr uint16_t kMaxTags  = 64;
+	static constexpr uint32_t kMaxSites = 4096;
+
+	///
+	TrackingAllocator(bx::AllocatorI* _backing);
+
+	///
+	virtual ~TrackingAllocator();
+
+	///
+	virtual void* realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line) override;
+
+	/// Per file and line counters, off by default. Allocations made while
+	/// it was off are not attributed to a site when freed.
+	void setTrackSites(bool _enabled) { m_trackSites = _enabled; }
+
+	///
+	MemoryCounters getTotal() const;
+
+	///
+	uint16_t getNumTags() const;
+
+	///
+	MemoryTagStats getTag(uint16_t _index) const;
+
+	/// Writes totals, tags and, when tracked, the sites as JSON.
+	void writeJson(bx::WriterI* _writer, bx::Error* _err) const;
+
+	/// Same as above into a file, false if it cannot be written.
+	bool writeJson(const char* _filePath) const;
+
+private:
+	struct Counters
+	{
+		int64_t  m_current;
+		int64_t  m_peak;
+		int64_t  m_count;
+		uint64_t m_allocations;
+	};
+
+	struct Site
+	{
+		const char* m_file;
+		uint32_t    m_line;
+		uint16_t    m_tag;
+		Counters    m_counters;
+	};
+
+	uint16_t findTag(const char* _key, bool _isFile);
+	uint32_t findSite(const char* _file, uint32_t _line, uint16_t _tag);
+	static void add(Counters& _counters, int64_t _size);
+	static void remove(Counters& _counters, int64_t _size);
+	static MemoryCounters load(const Counters& _counters);
+
+	bx::AllocatorI* m_backing;
+
+	mutable bx::Mutex m_tagMutex;
+	char     m_tagNames[kMaxTags][32];
+	Counters m_tags[kMaxTags];
+	uint16_t m_numTags;
+	Counters m_total;
+
+	mutable bx::Mutex m_siteMutex;
+	Site*    m_sites;
+	uint32_t m_numSites;
+	bool     m_trackSites;
+};
+
+/// Accounts the allocations of the calling thread to _name while in scope.
+/// _name must outlive the scope, a string literal usually.
+///
+struct MemoryTagScope
+{
+	MemoryTagScope(const char* _name);
+	~MemoryTagScope();
+
+	const char* m_prev;
+};
+
+///
+#define MEMORY_TAG_SCOPE(_name) MemoryTagScope BX_CONCATENATE(memoryTagScope, __LINE__)(_name)
+
+#endif // TRACKING_ALLOCATOR_H_HEADER_GUARD
@@ -0,0 +1,380 @@
+#include "bake_cache.h"
+
+#include <bimg/decode.h>
+#include <bx/hash.h>
+#include <bx/string.h>
+#include <entry/entry.h>
+#include <cstdio>
+#include <ctime>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if BX_PLATFORM_WINDOWS
+#include <direct.h>
+#endif
+
+namespace {
+    constexpr uint32_t kMagic = BX_MAKEFOURCC('H', 'B', 'A', 'K');
+
+    uint32_t hashString(const char* str) {
+        return bx::hash<bx::HashMurmur2A>(str, (uint32_t)bx::strLen(str));
+    }
+
+    // Payloads larger than one read or write are moved in pieces
+    constexpr uint32_t kMaxChunk = 1u << 30;
+
+    // A payload must fit in one allocation wherever the cache is read
+    constexpr uint64_t kMaxPayload = uint64_t(SIZE_MAX);
+
+    bool statSource(const char* path, uint64_t& size, uint64_t& mtime) {
+        // bx::stat() has the size in 64 bits on every platform, but no
+        // modification time, that one still comes from the CRT
+        bx::FileInfo info;
+        if (!bx::stat(path, info) || info.type != bx::FileInfo::Type::Regular) {
+            return false;
+        }
+        size = info.size;
+
+#if BX_PLATFORM_WINDOWS
+        struct __stat64 st;
+        if (_stat64(path, &st) != 0) {
+            return false;
+        }
+#else
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            return false;
+        }
+#endif
+        mtime = uint64_t(st.st_mtime);
+        return true;
+    }
+
+    bool readPayload(bx::FileReader& reader, void* data, uint64_t size) {
+        bx::Error err;
+        uint8_t* dst = (uint8_t*)data;
+        while (size > 0) {
+            const int32_t bytes = int32_t(bx::min<uint64_t>(size, kMaxChunk));
+            if (bx::read(&reader, dst, bytes, &err) != bytes) {
+                return false;
+            }
+            dst += bytes;
+            size -= bytes;
+        }
+        return true;
+    }
+
+    void writePayload(bx::FileWriter& writer, const void* data, uint64_t size, bx::Error* err) {
+        const uint8_t* src = (const uint8_t*)data;
+        while (size > 0 && err->isOk()) {
+            const int32_t bytes = int32_t(bx::min<uint64_t>(size, kMaxChunk));
+            bx::write(&writer, src, bytes, err);
+            src += bytes;
+            size -= bytes;
+        }
+    }
+
+    bool hashSource(const char* path, uint64_t size, uint32_t& hash) {
+        bx::FileReader reader;
+        if (!bx::open(&reader, path)) {
+            return false;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        const uint32_t chunkSize = 1 << 20;
+        uint8_t* chunk = (uint8_t*)BX_ALLOC(allocator, chunkSize);
+
+        bx::HashMurmur2A murmur;
+        murmur.begin();
+        bx::Error err;
+        uint64_t remaining = size;
+        while (remaining > 0 && err.isOk()) {
+            const int32_t bytes = (int32_t)bx::min<uint64_t>(remaining, chunkSize);
+            if (bx::read(&reader, chunk, bytes, &err) != bytes) {
+                break;
+            }
+            murmur.add(chunk, bytes);
+            remaining -= bytes;
+        }
+        hash = murmur.end();
+
+        BX_FREE(allocator, chunk);
+        bx::close(&reader);
+        return remaining == 0;
+    }
+} // namespace
+
+BakeCache::BakeCache()
+    : m_enabled(false)
+{
+    m_dir[0] = '\0';
+}
+
+bool BakeCache::init(const char* dir) {
+    bx::strCopy(m_dir, sizeof(m_dir), dir);
+
+#if BX_PLATFORM_WINDOWS
+    _mkdir(dir);
+#else
+    mkdir(dir, 0755);
+#endif
+
+    bx::FileInfo info;
+    m_enabled = bx::stat(dir, info) && info.type == bx::FileInfo::Type::Directory;
+    if (!m_enabled) {
+        printf("Bake cache disabled, cannot create %s\n", dir);
+    }
+    return m_enabled;
+}
+
+bimg::ImageContainer* BakeCache::loadImage(const char* sourcePath, const char* kind, SourceKey& key) const {
+    bx::FileReader reader;
+    Header header;
+    if (!open(reader, sourcePath, kind, header, key)) {
+        return nullptr;
+    }
+
+    bimg::ImageContainer* image = bimg::imageAlloc(
+        entry::getAllocator(),
+        bimg::TextureFormat::Enum(header.format),
+        uint16_t(header.width),
+        uint16_t(header.height),
+        uint16_t(header.depth),
+        header.numLayers,
+        header.cubeMap != 0,
+        header.numMips > 1
+    );
+
+    // The payload goes straight into the final allocation, no decode
+    if (!image
+        || image->m_size != header.payloadSize
+        || image->m_numMips != header.numMips
+        || !readPayload(reader, image->m_data, image->m_size)) {
+        if (image) {
+            bimg::imageFree(image);
+        }
+        image = nullptr;
+    }
+
+    bx::close(&reader);
+    return image;
+}
+
+bool BakeCache::storeImage(const char* sourcePath, const char* kind, const SourceKey& key, const bimg::ImageContainer* image) const {
+    if (!image) {
+        return false;
+    }
+
+    Header header;
+    header.format = uint32_t(image->m_format);
+    header.width = image->m_width;
+    header.height = image->m_height;
+    header.depth = image->m_depth;
+    header.numLayers = image->m_numLayers;
+    header.numMips = image->m_numMips;
+    header.cubeMap = image->m_cubeMap ? 1 : 0;
+    header.payloadSize = image->m_size;
+    return store(sourcePath, kind, key, header, image->m_data);
+}
+
+bimg::ImageContainer* BakeCache::loadKtx(const char* sourcePath, const char* kind, SourceKey& key) const {
+    bx::FileReader reader;
+    Header header;
+    if (!open(reader, sourcePath, kind, header, key)) {
+        return nullptr;
+    }
+    bx::close(&reader);
+
+    char path[512];
+    artifactPath(sourcePath, kind, "ktx", path, sizeof(path));
+    if (!bx::open(&reader, path)) {
+        return nullptr;
+    }
+
+    // bimg parses at most 4 GiB
+    const int64_t fileSize = bx::getSize(&reader);
+    if (fileSize <= 0 || fileSize > int64_t(UINT32_MAX)) {
+        bx::close(&reader);
+        return nullptr;
+    }
+
+    bx::AllocatorI* allocator = entry::getAllocator();
+    const uint32_t size = uint32_t(fileSize);
+    void* data = BX_ALLOC(allocator, size);
+    bimg::ImageContainer* image = nullptr;
+    if (readPayload(reader, data, size)) {
+        image = bimg::imageParse(allocator, data, size);
+    }
+    bx::close(&reader);
+    BX_FREE(allocator, data);
+
+    if (image && (uint32_t(image->m_format) != header.format
+        || image->m_width != header.width
+        || image->m_height != header.height
+        || image->m_numMips != header.numMips)) {
+        bimg::imageFree(image);
+        image = nullptr;
+    }
+    return image;
+}
+
+bool BakeCache::storeKtx(const char* sourcePath, const char* kind, const SourceKey& key, const bimg::ImageContainer* image) const {
+    if (!m_enabled || !key.valid || !image) {
+        return false;
+    }
+
+    char path[512];
+    char tmpPath[520];
+    artifactPath(sourcePath, kind, "ktx", path, sizeof(path));
+    bx::snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    bx::FileWriter writer;
+    bx::Error err;
+    if (!bx::open(&writer, tmpPath, false, &err)) {
+        return false;
+    }
+    bimg::imageWriteKtx(&writer, *const_cast<bimg::ImageContainer*>(image), image->m_data, image->m_size, &err);
+    bx::close(&writer);
+
+    remove(path);
+    if (!err.isOk() || rename(tmpPath, path) != 0) {
+        remove(tmpPath);
+        return false;
+    }
+
+    // The sidecar is written last, a KTX without one is never trusted
+    Header header;
+    header.format = uint32_t(image->m_format);
+    header.width = image->m_width;
+    header.height = image->m_height;
+    header.depth = image->m_depth;
+    header.numLayers = image->m_numLayers;
+    header.numMips = image->m_numMips;
+    header.cubeMap = image->m_cubeMap ? 1 : 0;
+    header.payloadSize = 0;
+    return store(sourcePath, kind, key, header, nullptr);
+}
+
+float* BakeCache::loadSlopeMap(const char* sourcePath, uint32_t width, uint32_t height, SourceKey& key) const {
+    bx::FileReader reader;
+    Header header;
+    if (!open(reader, sourcePath, "smap", header, key)) {
+        return nullptr;
+    }
+
+    const uint64_t size = uint64_t(width) * height * 2 * sizeof(float);
+    float* slopeMap = nullptr;
+    if (header.width == width && header.height == height && header.payloadSize == size && size <= kMaxPayload) {
+        slopeMap = (float*)BX_ALLOC(entry::getAllocator(), size_t(size));
+        if (!readPayload(reader, slopeMap, size)) {
+            BX_FREE(entry::getAllocator(), slopeMap);
+            slopeMap = nullptr;
+        }
+    }
+
+    bx::close(&reader);
+    return slopeMap;
+}
+
+bool BakeCache::storeSlopeMap(const char* sourcePath, uint32_t width, uint32_t height, const SourceKey& key, const float* slopeMap) const {
+    Header header;
+    header.format = uint32_t(bimg::TextureFormat::RG32F);
+    header.width = width;
+    header.height = height;
+    header.depth = 1;
+    header.numLayers = 1;
+    header.numMips = 1;
+    header.cubeMap = 0;
+    header.payloadSize = uint64_t(width) * height * 2 * sizeof(float);
+    return store(sourcePath, "smap", key, header, slopeMap);
+}
+
+void BakeCache::artifactPath(const char* sourcePath, const char* kind, const char* ext, char* out, int32_t outSize) const {
+    // Keep the file name readable, the path hash tells same-named sources apart
+    const char* name = sourcePath;
+    for (const char* ptr = sourcePath; *ptr != '\0'; ++ptr) {
+        if (*ptr == '/' || *ptr == '\\') {
+            name = ptr + 1;
+        }
+    }
+    bx::snprintf(out, outSize, "%s%s-%08x.%s.%s", m_dir, name, hashString(sourcePath), kind, ext);
+}
+
+bool BakeCache::open(bx::FileReader& reader, const char* sourcePath, const char* kind, Header& header, SourceKey& key) const {
+    key.valid = false;
+    if (!m_enabled || !statSource(sourcePath, key.size, key.mtime)) {
+        return false;
+    }
+
+    char path[512];
+    artifactPath(sourcePath, kind, "bake", path, sizeof(path));
+    bx::Error err;
+    bool opened = bx::open(&reader, path);
+    bool valid = opened
+        && bx::read(&reader, &header, int32_t(sizeof(header)), &err) == int32_t(sizeof(header))
+        && header.magic == kMagic
+        && header.version == VERSION
+        && header.kindHash == hashString(kind)
+        && header.sourceSize == key.size;
+
+    // A touched but unchanged source (fresh checkout, copy) is still valid.
+    // An mtime in the same second as the bake may hide a later edit.
+    bool hashed = false;
+    if (valid && (header.sourceMtime != key.mtime || header.bakeTime <= key.mtime + 1)) {
+        hashed = hashSource(sourcePath, key.size, key.hash);
+        valid = hashed && key.hash == header.sourceHash;
+    } else if (valid) {
+        key.hash = header.sourceHash;
+        hashed = true;
+    }
+
+    // The store after a miss describes the source as it was before the
+    // decode, a later edit then fails the next lookup
+    if (!valid && !hashed) {
+        hashed = hashSource(sourcePath, key.size, key.hash);
+    }
+    key.valid = hashed;
+
+    if (opened && !valid) {
+        bx::close(&reader);
+    }
+    return valid;
+}
+
+bool BakeCache::store(const char* sourcePath, const char* kind, const SourceKey& key, Header& header, const void* payload) const {
+    if (!m_enabled || !key.valid || header.payloadSize > kMaxPayload || (header.payloadSize > 0 && !payload)) {
+        return false;
+    }
+
+    header.magic = kMagic;
+    header.version = VERSION;
+    header.kindHash = hashString(kind);
+    header.bakeTime = uint64_t(time(nullptr));
+    header.sourceSize = key.size;
+    header.sourceMtime = key.mtime;
+    header.sourceHash = key.hash;
+    header.reserved = 0;
+
+    char path[512];
+    char tmpPath[520];
+    artifactPath(sourcePath, kind, "bake", path, sizeof(path));
+    bx::snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    // Write aside and rename, a crash mid-write must not leave a valid header
+    bx::FileWriter writer;
+    bx::Error err;
+    if (!bx::open(&writer, tmpPath, false, &err)) {
+        return false;
+    }
+    bx::write(&writer, &header, int32_t(sizeof(header)), &err);
+    writePayload(writer, payload, header.payloadSize, &err);
+    bx::close(&writer);
+
+    if (!err.isOk()) {
+        remove(tmpPath);
+        return false;
+    }
+
+    remove(path);
+    return rename(tmpPath, path) == 0;
+}
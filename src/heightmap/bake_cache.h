@@ -0,0 +1,82 @@
+#pragma once
+
+#include <bimg/bimg.h>
+#include <bx/file.h>
+#include <cstdint>
+
+// Persistent cache of artifacts baked from source images (decoded R16
+// heights, slope maps, diffuse images), one file per source and kind.
+//
+// An artifact records the size, mtime and content hash of its source. It
+// is used as is when size and mtime match, after rehashing the source when
+// only the mtime differs or the source changed within a second of the bake
+// (mtime resolution), and rebuilt otherwise. Bumping VERSION invalidates
+// every existing artifact.
+//
+// Methods are const and keep no per-call state, so the main thread and the
+// catalog worker can use the same instance.
+class BakeCache {
+public:
+    static constexpr uint32_t VERSION = 2;
+
+    // The source as a load saw it. A store after a miss passes it back, so
+    // the artifact describes the bytes that were decoded, and the source
+    // is not read again to hash it.
+    struct SourceKey {
+        uint64_t size;
+        uint64_t mtime;
+        uint32_t hash;
+        bool valid;     // false if the source could not be read
+    };
+
+    BakeCache();
+
+    // Creates `dir` if needed. The cache stays disabled when it cannot.
+    bool init(const char* dir);
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+
+    // Returns nullptr if there is no valid artifact of `kind` for
+    // `sourcePath`, and fills `key` either way. The container is allocated
+    // with entry::getAllocator().
+    bimg::ImageContainer* loadImage(const char* sourcePath, const char* kind, SourceKey& key) const;
+    bool storeImage(const char* sourcePath, const char* kind, const SourceKey& key, const bimg::ImageContainer* image) const;
+
+    // Artifacts other tools read too are written as plain KTX files, with
+    // the header in a sidecar .bake file next to them.
+    bimg::ImageContainer* loadKtx(const char* sourcePath, const char* kind, SourceKey& key) const;
+    bool storeKtx(const char* sourcePath, const char* kind, const SourceKey& key, const bimg::ImageContainer* image) const;
+
+    // Slope maps are stored as w * h RG32F texels.
+    float* loadSlopeMap(const char* sourcePath, uint32_t width, uint32_t height, SourceKey& key) const;
+    bool storeSlopeMap(const char* sourcePath, uint32_t width, uint32_t height, const SourceKey& key, const float* slopeMap) const;
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t kindHash;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        uint16_t numLayers;
+        uint8_t numMips;
+        uint8_t cubeMap;
+        uint64_t sourceSize;
+        uint64_t sourceMtime;
+        uint64_t bakeTime;
+        uint64_t payloadSize;
+        uint32_t sourceHash;
+        uint32_t reserved;
+    };
+
+    void artifactPath(const char* sourcePath, const char* kind, const char* ext, char* out, int32_t outSize) const;
+    // Leaves `reader` positioned at the payload on success. Hashes the
+    // source on a miss, for the store that follows.
+    bool open(bx::FileReader& reader, const char* sourcePath, const char* kind, Header& header, SourceKey& key) const;
+    bool store(const char* sourcePath, const char* kind, const SourceKey& key, Header& header, const void* payload) const;
+
+    char m_dir[256];
+    bool m_enabled;
+};
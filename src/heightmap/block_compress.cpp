@@ -0,0 +1,163 @@
+#include "block_compress.h"
+#include "../common/job_system.h"
+
+#include <bimg/decode.h>
+#include <bimg/encode.h>
+#include <bx/math.h>
+#include <bx/timer.h>
+
+namespace bcenc {
+    namespace {
+        // 16 block rows per strip keeps strips small enough to balance the
+        // tail mips while amortizing the per-call encoder setup.
+        constexpr uint32_t kStripBlockRows = 16;
+
+        struct Strip {
+            const uint8_t* src;
+            uint8_t* dst;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        struct EncodeContext {
+            bx::AllocatorI* allocator;
+            bimg::TextureFormat::Enum format;
+            const Strip* strips;
+        };
+
+        void encodeStrips(uint32_t begin, uint32_t end, void* userData) {
+            const EncodeContext& ctx = *static_cast<const EncodeContext*>(userData);
+            for (uint32_t index = begin; index < end; ++index) {
+                const Strip& strip = ctx.strips[index];
+                bx::Error err;
+                bimg::imageEncodeFromRgba8(ctx.allocator, strip.dst, strip.src,
+                    strip.width, strip.height, 1, ctx.format, bimg::Quality::Default, &err);
+            }
+        }
+    } // namespace
+
+    bimg::ImageContainer* compress(bx::AllocatorI* allocator, const bimg::ImageContainer& image,
+        bimg::TextureFormat::Enum format, uint32_t numThreads, Stats* stats) {
+        BX_ASSERT(format == bimg::TextureFormat::BC1 || format == bimg::TextureFormat::BC7,
+            "Unsupported block format %d", format);
+
+        bimg::ImageContainer* rgba = bimg::imageConvert(allocator, bimg::TextureFormat::RGBA8, image, false);
+        if (!rgba) {
+            return nullptr;
+        }
+
+        const int64_t startTime = bx::getHPCounter();
+
+        // RGBA8 mip chain, each level box filtered from the previous one
+        bimg::ImageContainer* mips = bimg::imageAlloc(allocator, bimg::TextureFormat::RGBA8,
+            uint16_t(rgba->m_width), uint16_t(rgba->m_height), 1, 1, false, true);
+        bimg::ImageContainer* output = bimg::imageAlloc(allocator, format,
+            uint16_t(rgba->m_width), uint16_t(rgba->m_height), 1, 1, false, true);
+
+        bimg::ImageMip top;
+        bimg::imageGetRawData(*mips, 0, 0, mips->m_data, mips->m_size, top);
+        bx::memCopy(const_cast<uint8_t*>(top.m_data), rgba->m_data, top.m_size);
+
+        for (uint8_t lod = 1; lod < mips->m_numMips; ++lod) {
+            bimg::ImageMip src;
+            bimg::ImageMip dst;
+            bimg::imageGetRawData(*mips, 0, lod - 1, mips->m_data, mips->m_size, src);
+            bimg::imageGetRawData(*mips, 0, lod, mips->m_data, mips->m_size, dst);
+            if (src.m_width >= 2 && src.m_height >= 2) {
+                bimg::imageRgba8Downsample2x2(const_cast<uint8_t*>(dst.m_data),
+                    src.m_width, src.m_height, 1, src.m_width * 4, dst.m_width * 4, src.m_data);
+                continue;
+            }
+
+            // The 2x2 filter skips 1-texel wide or tall levels, point sample those
+            const uint32_t* srcTexels = (const uint32_t*)src.m_data;
+            uint32_t* dstTexels = (uint32_t*)dst.m_data;
+            for (uint32_t y = 0; y < dst.m_height; ++y) {
+                for (uint32_t x = 0; x < dst.m_width; ++x) {
+                    const uint32_t sx = bx::min(x * 2, src.m_width - 1);
+                    const uint32_t sy = bx::min(y * 2, src.m_height - 1);
+                    dstTexels[y * dst.m_width + x] = srcTexels[sy * src.m_width + sx];
+                }
+            }
+        }
+
+        // Strips of whole block rows are independent, encode them all at once
+        const bimg::ImageBlockInfo& blockInfo = bimg::getBlockInfo(format);
+        const uint32_t blockBytes = blockInfo.blockSize;
+        const uint32_t stripRows = kStripBlockRows * 4;
+
+        uint32_t numStrips = 0;
+        uint32_t texels = 0;
+        for (uint8_t lod = 0; lod < mips->m_numMips; ++lod) {
+            bimg::ImageMip src;
+            bimg::imageGetRawData(*mips, 0, lod, mips->m_data, mips->m_size, src);
+            numStrips += (src.m_height + stripRows - 1) / stripRows;
+            texels += src.m_width * src.m_height;
+        }
+
+        Strip* strips = (Strip*)BX_ALLOC(allocator, numStrips * sizeof(Strip));
+        uint32_t strip = 0;
+        for (uint8_t lod = 0; lod < mips->m_numMips; ++lod) {
+            bimg::ImageMip src;
+            bimg::ImageMip dst;
+            bimg::imageGetRawData(*mips, 0, lod, mips->m_data, mips->m_size, src);
+            bimg::imageGetRawData(*output, 0, lod, output->m_data, output->m_size, dst);
+
+            const uint32_t blocksX = bx::max<uint32_t>(1, (src.m_width + 3) / 4);
+            for (uint32_t y = 0; y < src.m_height; y += stripRows) {
+                strips[strip].src = src.m_data + y * src.m_width * 4;
+                strips[strip].dst = const_cast<uint8_t*>(dst.m_data) + (y / 4) * blocksX * blockBytes;
+                strips[strip].width = src.m_width;
+                strips[strip].height = bx::min(stripRows, src.m_height - y);
+                ++strip;
+            }
+        }
+
+        // The calling thread encodes too, alongside the job workers
+        EncodeContext ctx = { allocator, format, strips };
+        const uint32_t maxThreads = numThreads == 0 ? jobGetNumThreads() + 1 : numThreads;
+        numThreads = bx::max(1u, bx::min(maxThreads, bx::min(jobGetNumThreads() + 1, numStrips)));
+        jobParallelFor(0, numStrips, 1, encodeStrips, &ctx, numThreads);
+
+        const int64_t endTime = bx::getHPCounter();
+
+        if (stats) {
+            const double seconds = double(endTime - startTime) / double(bx::getHPFrequency());
+            stats->encodeMs = float(seconds * 1000.0);
+            stats->megatexelsPerSecond = float(double(texels) / 1.0e6 / bx::max(seconds, 1.0e-9));
+            stats->texels = texels;
+            stats->numMips = mips->m_numMips;
+            stats->numThreads = numThreads;
+
+            // Decoded top level against the source
+            const uint32_t topTexels = rgba->m_width * rgba->m_height;
+            uint8_t* decoded = (uint8_t*)BX_ALLOC(allocator, topTexels * 4);
+            bimg::imageDecodeToRgba8(allocator, decoded, output->m_data,
+                rgba->m_width, rgba->m_height, rgba->m_width * 4, format);
+            stats->psnr = psnrRgba8((const uint8_t*)rgba->m_data, decoded, topTexels);
+            BX_FREE(allocator, decoded);
+        }
+
+        BX_FREE(allocator, strips);
+        bimg::imageFree(mips);
+        bimg::imageFree(rgba);
+        return output;
+    }
+
+    float psnrRgba8(const uint8_t* a, const uint8_t* b, uint32_t numTexels) {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < numTexels; ++i) {
+            for (uint32_t c = 0; c < 3; ++c) {
+                const int32_t d = int32_t(a[i * 4 + c]) - int32_t(b[i * 4 + c]);
+                sum += uint64_t(d * d);
+            }
+        }
+
+        if (sum == 0) {
+            return bx::kFloatInfinity;
+        }
+
+        const double mse = double(sum) / (double(numTexels) * 3.0);
+        return 10.0f * bx::log2(float(255.0 * 255.0 / mse)) / bx::log2(10.0f);
+    }
+} // namespace bcenc
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <bimg/bimg.h>
+#include <bx/allocator.h>
+#include <cstdint>
+
+// CPU block compression of diffuse images. Builds the full RGBA8 mip chain
+// and encodes every level in strips of block rows spread over the job
+// system.
+namespace bcenc {
+    struct Stats {
+        float encodeMs;
+        float megatexelsPerSecond;
+        float psnr;
+        uint32_t texels;
+        uint32_t numMips;
+        uint32_t numThreads;
+    };
+
+    // Returns an image of `format` (BC1 or BC7) with a full mip chain, or
+    // nullptr if `image` cannot be converted to RGBA8. Encodes on at most
+    // `numThreads` threads, the calling one and job workers, or on every
+    // worker when 0. `stats` (optional) receives encode throughput over all
+    // levels, the threads it ran on, and the PSNR of the top level.
+    bimg::ImageContainer* compress(bx::AllocatorI* allocator, const bimg::ImageContainer& image,
+        bimg::TextureFormat::Enum format, uint32_t numThreads, Stats* stats);
+
+    // PSNR in dB over the RGB channels of two RGBA8 buffers, infinite for
+    // identical input.
+    float psnrRgba8(const uint8_t* a, const uint8_t* b, uint32_t numTexels);
+} // namespace bcenc
@@ -0,0 +1,154 @@
+#include "camera_predictor.h"
+
+#include <bx/math.h>
+
+namespace {
+    // Long enough to smooth out jitter, short enough to follow a turn
+    constexpr float kHistorySeconds = 0.5f;
+    // Turns rarely last longer, the direction stops turning after this
+    constexpr float kMaxTurnSeconds = 0.5f;
+
+    void normalize(float* v) {
+        const float length = bx::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length > 1e-6f) {
+            v[0] /= length;
+            v[1] /= length;
+            v[2] /= length;
+        }
+    }
+} // namespace
+
+CameraPredictor::CameraPredictor()
+    : m_head(0)
+    , m_count(0)
+{
+}
+
+void CameraPredictor::reset() {
+    m_head = 0;
+    m_count = 0;
+}
+
+void CameraPredictor::addSample(float time, const float* position, const float* at) {
+    if (m_count > 0 && time <= getSample(0).time) {
+        if (time < getSample(0).time) {
+            reset();
+        } else {
+            return;
+        }
+    }
+
+    Sample& sample = m_samples[m_head];
+    sample.time = time;
+    for (uint32_t i = 0; i < 3; ++i) {
+        sample.position[i] = position[i];
+        sample.direction[i] = at[i] - position[i];
+    }
+    normalize(sample.direction);
+
+    m_head = (m_head + 1) % MAX_SAMPLES;
+    if (m_count < MAX_SAMPLES) {
+        ++m_count;
+    }
+}
+
+const CameraPredictor::Sample& CameraPredictor::getSample(uint32_t age) const {
+    return m_samples[(m_head + MAX_SAMPLES - 1 - age) % MAX_SAMPLES];
+}
+
+void CameraPredictor::fit(float* velocity, float* turnRate) const {
+    for (uint32_t i = 0; i < 3; ++i) {
+        velocity[i] = 0.0f;
+        turnRate[i] = 0.0f;
+    }
+    if (m_count == 0) {
+        return;
+    }
+
+    const float newest = getSample(0).time;
+    uint32_t num = 0;
+    float meanTime = 0.0f;
+    while (num < m_count && newest - getSample(num).time <= kHistorySeconds) {
+        meanTime += getSample(num).time;
+        ++num;
+    }
+    if (num < 2) {
+        return;
+    }
+    meanTime /= float(num);
+
+    float meanPosition[3] = { 0.0f, 0.0f, 0.0f };
+    float meanDirection[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t s = 0; s < num; ++s) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            meanPosition[i] += getSample(s).position[i] / float(num);
+            meanDirection[i] += getSample(s).direction[i] / float(num);
+        }
+    }
+
+    float timeVariance = 0.0f;
+    for (uint32_t s = 0; s < num; ++s) {
+        const Sample& sample = getSample(s);
+        const float dt = sample.time - meanTime;
+        timeVariance += dt * dt;
+        for (uint32_t i = 0; i < 3; ++i) {
+            velocity[i] += dt * (sample.position[i] - meanPosition[i]);
+            turnRate[i] += dt * (sample.direction[i] - meanDirection[i]);
+        }
+    }
+    if (timeVariance < 1e-8f) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            velocity[i] = 0.0f;
+            turnRate[i] = 0.0f;
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < 3; ++i) {
+        velocity[i] /= timeVariance;
+        turnRate[i] /= timeVariance;
+    }
+}
+
+void CameraPredictor::extrapolate(const float* velocity, const float* turnRate, float ahead, Forecast& forecast) const {
+    // From the newest sample rather than the fitted line, the prediction
+    // starts where the camera is
+    const Sample& last = getSample(0);
+    const float turnTime = bx::min(ahead, kMaxTurnSeconds);
+    forecast.ahead = ahead;
+    for (uint32_t i = 0; i < 3; ++i) {
+        forecast.position[i] = last.position[i] + velocity[i] * ahead;
+        forecast.direction[i] = last.direction[i] + turnRate[i] * turnTime;
+    }
+    normalize(forecast.direction);
+}
+
+bool CameraPredictor::predict(float ahead, Forecast& forecast) const {
+    if (m_count == 0) {
+        return false;
+    }
+
+    float velocity[3];
+    float turnRate[3];
+    fit(velocity, turnRate);
+    extrapolate(velocity, turnRate, ahead, forecast);
+    return true;
+}
+
+uint32_t CameraPredictor::forecast(float horizon, uint32_t count, Forecast* forecasts) const {
+    if (m_count == 0 || count == 0 || horizon <= 0.0f) {
+        return 0;
+    }
+
+    float velocity[3];
+    float turnRate[3];
+    fit(velocity, turnRate);
+    for (uint32_t i = 0; i < count; ++i) {
+        extrapolate(velocity, turnRate, horizon * float(i + 1) / float(count), forecasts[i]);
+    }
+    return count;
+}
+
+void CameraPredictor::getVelocity(float* velocity) const {
+    float turnRate[3];
+    fit(velocity, turnRate);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+// Extrapolates the camera a little into the future from its recent
+// positions and view targets, as cameraGetPosition() and cameraGetAt()
+// return them, so streamed data can be requested before it is on screen.
+// Velocities are least squares fits over the last moments of history, which
+// averages out frame time jitter and single jerky mouse moves. Works in
+// whatever space the samples are given in.
+class CameraPredictor {
+public:
+    static constexpr uint32_t MAX_SAMPLES = 64;
+
+    struct Forecast {
+        float ahead;            // seconds after the last sample
+        float position[3];
+        float direction[3];     // unit view direction
+    };
+
+    CameraPredictor();
+
+    void reset();
+    // `time` in seconds; a sample older than the last one restarts the history
+    void addSample(float time, const float* position, const float* at);
+    uint32_t getNumSamples() const { return m_count; }
+
+    // Camera `ahead` seconds after the last sample, false without samples
+    bool predict(float ahead, Forecast& forecast) const;
+    // `count` forecasts evenly spaced up to `horizon` seconds ahead
+    uint32_t forecast(float horizon, uint32_t count, Forecast* forecasts) const;
+
+    // Units per second
+    void getVelocity(float* velocity) const;
+
+private:
+    struct Sample {
+        float time;
+        float position[3];
+        float direction[3];
+    };
+
+    const Sample& getSample(uint32_t age) const;
+    // Least squares slopes of position and direction over the history window
+    void fit(float* velocity, float* turnRate) const;
+    void extrapolate(const float* velocity, const float* turnRate, float ahead, Forecast& forecast) const;
+
+    Sample m_samples[MAX_SAMPLES];
+    uint32_t m_head;    // next write
+    uint32_t m_count;
+};
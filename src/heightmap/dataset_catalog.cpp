@@ -0,0 +1,784 @@
+#include "dataset_catalog.h"
+#include "slope_map.h"
+#include "block_compress.h"
+#include "vt_pyramid.h"
+#include "../common/bgfx_utils.h"
+#include "../common/job_system.h"
+#include "../common/profiler.h"
+#include "../common/tracking_allocator.h"
+
+#include <bx/string.h>
+#include <bx/timer.h>
+#include <entry/entry.h>
+#include <cstdio>
+
+#if BX_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+namespace {
+    float msSince(int64_t start) {
+        return float(double(bx::getHPCounter() - start) * 1000.0 / double(bx::getHPFrequency()));
+    }
+
+    void addImageTimes(DatasetCatalog::LoadTimes& times, const ImageLoadTimes& image) {
+        times.ioMs += image.m_readMs;
+        times.decodeMs += image.m_decodeMs;
+        times.convertMs += image.m_convertMs;
+    }
+
+    const char* skipSpace(const char* ptr, const char* end) {
+        while (ptr < end && (*ptr == ' ' || *ptr == '\t')) {
+            ++ptr;
+        }
+        return ptr;
+    }
+
+    const char* nextToken(const char* ptr, const char* end, char* token, int32_t tokenSize) {
+        ptr = skipSpace(ptr, end);
+        const char* begin = ptr;
+        while (ptr < end && *ptr != ' ' && *ptr != '\t') {
+            ++ptr;
+        }
+        bx::strCopy(token, tokenSize, bx::StringView(begin, int32_t(ptr - begin)));
+        return ptr;
+    }
+
+    bool fileExists(const char* path) {
+        bx::FileReader reader;
+        if (bx::open(&reader, path)) {
+            bx::close(&reader);
+            return true;
+        }
+        return false;
+    }
+
+    // "<source without extension>.vtp"
+    void pyramidPath(const char* source, char* path, int32_t size) {
+        bx::strCopy(path, size, source);
+        char* ext = path + bx::strLen(path);
+        for (char* ptr = path; *ptr != '\0'; ++ptr) {
+            if (*ptr == '.') {
+                ext = ptr;
+            } else if (*ptr == '/' || *ptr == '\\') {
+                ext = path + bx::strLen(path);
+            }
+        }
+        bx::strCopy(ext, int32_t(size - (ext - path)), ".vtp");
+    }
+} // namespace
+
+DatasetCatalog::DatasetCatalog()
+    : m_count(0)
+    , m_pending(-1)
+    , m_inFlight(-1)
+    , m_syncIndex(-1)
+    , m_activeHeightmap(-1)
+    , m_activeDiffuse(-1)
+    , m_waiting(false)
+    , m_quit(false)
+    , m_cacheSlopeMaps(true)
+    , m_budgetBytes(DEFAULT_BUDGET_BYTES)
+    , m_residentBytes(0)
+    , m_useCounter(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_prefetches(0)
+    , m_evictions(0)
+    , m_bakeHits(0)
+    , m_bakeMisses(0)
+    , m_diffuseFormat(bimg::TextureFormat::BC1)
+{
+    bx::memSet(&m_encodeStats, 0, sizeof(m_encodeStats));
+    bx::memSet(&m_syncLoadTimes, 0, sizeof(m_syncLoadTimes));
+    bx::memSet(m_datasets, 0, sizeof(m_datasets));
+}
+
+DatasetCatalog::~DatasetCatalog() {
+    shutdown();
+}
+
+void DatasetCatalog::init(uint64_t budgetBytes) {
+    m_budgetBytes = budgetBytes;
+    m_quit = false;
+    m_bake.init("cache/");
+    m_thread.init(workerFn, this, 0, "dataset prefetch");
+}
+
+void DatasetCatalog::shutdown() {
+    if (m_thread.isRunning()) {
+        {
+            bx::MutexScope lock(m_mutex);
+            m_quit = true;
+        }
+        m_requestSem.post();
+        m_thread.shutdown();
+    }
+
+    for (int i = 0; i < m_count; ++i) {
+        evict(i);
+    }
+    m_count = 0;
+    m_pending = -1;
+    m_activeHeightmap = -1;
+    m_activeDiffuse = -1;
+}
+
+int DatasetCatalog::loadManifest(const char* path) {
+    uint32_t size = 0;
+    char* data = (char*)load(path, &size);
+    if (!data) {
+        return 0;
+    }
+
+    int added = 0;
+    const char* ptr = data;
+    const char* end = data + size;
+    while (ptr < end) {
+        const char* eol = ptr;
+        while (eol < end && *eol != '\n' && *eol != '\r') {
+            ++eol;
+        }
+
+        const char* line = skipSpace(ptr, eol);
+        if (line < eol && *line != '#') {
+            char name[64];
+            char heightmap[256];
+            char diffuse[256];
+            line = nextToken(line, eol, name, sizeof(name));
+            line = nextToken(line, eol, heightmap, sizeof(heightmap));
+            nextToken(line, eol, diffuse, sizeof(diffuse));
+
+            if (heightmap[0] != '\0' && addDataset(name, heightmap, diffuse) >= 0) {
+                ++added;
+            } else {
+                printf("Ignoring dataset manifest line in %s\n", path);
+            }
+        }
+
+        ptr = eol + 1;
+    }
+
+    unload(data);
+    return added;
+}
+
+int DatasetCatalog::scanDirectory(const char* dir) {
+    static const char suffix[] = "_16bit.png";
+    static const char* diffuseExtensions[] = { ".jpg", ".png" };
+
+    char names[MAX_DATASETS][64];
+    int count = 0;
+
+#if BX_PLATFORM_WINDOWS
+    char pattern[256];
+    bx::snprintf(pattern, sizeof(pattern), "%s*%s", dir, suffix);
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileA(pattern, &findData);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            bx::StringView fileName(findData.cFileName);
+#else
+    DIR* find = opendir(dir);
+    if (find) {
+        while (struct dirent* item = readdir(find)) {
+            bx::StringView fileName(item->d_name);
+#endif
+            const int32_t stemLen = fileName.getLength() - int32_t(sizeof(suffix) - 1);
+            if (stemLen > 0
+            &&  count < MAX_DATASETS
+            &&  bx::strCmp(bx::StringView(fileName.getPtr() + stemLen), suffix) == 0) {
+                bx::strCopy(names[count], sizeof(names[count]), bx::StringView(fileName.getPtr(), stemLen));
+                ++count;
+            }
+#if BX_PLATFORM_WINDOWS
+        } while (FindNextFileA(find, &findData));
+        FindClose(find);
+    }
+#else
+        }
+        closedir(find);
+    }
+#endif
+
+    // Directory order is arbitrary, keep the catalog stable across runs
+    for (int i = 1; i < count; ++i) {
+        for (int j = i; j > 0 && bx::strCmp(names[j - 1], names[j]) > 0; --j) {
+            char tmp[64];
+            bx::strCopy(tmp, sizeof(tmp), names[j]);
+            bx::strCopy(names[j], sizeof(names[j]), names[j - 1]);
+            bx::strCopy(names[j - 1], sizeof(names[j - 1]), tmp);
+        }
+    }
+
+    int added = 0;
+    for (int i = 0; i < count; ++i) {
+        char heightmap[256];
+        char diffuse[256];
+        bx::snprintf(heightmap, sizeof(heightmap), "%s%s%s", dir, names[i], suffix);
+
+        diffuse[0] = '\0';
+        for (const char* ext : diffuseExtensions) {
+            char candidate[256];
+            bx::snprintf(candidate, sizeof(candidate), "%s%s%s", dir, names[i], ext);
+            if (fileExists(candidate)) {
+                bx::strCopy(diffuse, sizeof(diffuse), candidate);
+                break;
+            }
+        }
+
+        if (addDataset(names[i], heightmap, diffuse) >= 0) {
+            ++added;
+        }
+    }
+
+    return added;
+}
+
+int DatasetCatalog::addDataset(const char* name, const char* heightmapPath, const char* diffusePath) {
+    if (m_count >= MAX_DATASETS) {
+        printf("Dataset catalog is full, dropping %s\n", name);
+        return -1;
+    }
+
+    Entry& entry = m_datasets[m_count];
+    bx::memSet(&entry, 0, sizeof(entry));
+    bx::strCopy(entry.info.name, sizeof(entry.info.name), name);
+    bx::strCopy(entry.info.heightmapPath, sizeof(entry.info.heightmapPath), heightmapPath);
+    bx::strCopy(entry.info.diffusePath, sizeof(entry.info.diffusePath), diffusePath);
+    return m_count++;
+}
+
+const bimg::ImageContainer* DatasetCatalog::acquireHeightmap(int index) {
+    if (index < 0 || index >= m_count) {
+        return nullptr;
+    }
+
+    bool hit;
+    {
+        bx::MutexScope lock(m_mutex);
+        hit = m_datasets[index].heightmapLoaded;
+    }
+
+    if (hit) {
+        ++m_hits;
+    } else {
+        ++m_misses;
+        loadSync(index, m_cacheSlopeMaps);
+    }
+    touch(index);
+    return m_datasets[index].heightmap;
+}
+
+const bimg::ImageContainer* DatasetCatalog::acquireDiffuse(int index) {
+    if (index < 0 || index >= m_count) {
+        return nullptr;
+    }
+
+    bool hit;
+    {
+        bx::MutexScope lock(m_mutex);
+        hit = m_datasets[index].diffuseLoaded;
+    }
+
+    if (hit) {
+        ++m_hits;
+    } else {
+        ++m_misses;
+        loadSync(index, m_cacheSlopeMaps);
+    }
+    touch(index);
+    return m_datasets[index].diffuse;
+}
+
+const float* DatasetCatalog::acquireSlopeMap(int index) {
+    if (index < 0 || index >= m_count) {
+        return nullptr;
+    }
+
+    const Entry& entry = m_datasets[index];
+    bool hit;
+    {
+        bx::MutexScope lock(m_mutex);
+        hit = entry.slopeMap || (entry.heightmapLoaded && !entry.heightmap);
+    }
+
+    if (hit) {
+        ++m_hits;
+    } else {
+        ++m_misses;
+        loadSync(index, true);
+    }
+    touch(index);
+    return entry.slopeMap;
+}
+
+bool DatasetCatalog::isResident(int index) const {
+    if (index < 0 || index >= m_count) {
+        return false;
+    }
+
+    bx::MutexScope lock(m_mutex);
+    return m_datasets[index].heightmapLoaded && m_datasets[index].diffuseLoaded;
+}
+
+bool DatasetCatalog::isBaked(int index) const {
+    if (index < 0 || index >= m_count) {
+        return false;
+    }
+
+    bx::MutexScope lock(m_mutex);
+    return m_datasets[index].baked;
+}
+
+void DatasetCatalog::setActive(int heightmapIndex, int diffuseIndex) {
+    bx::MutexScope lock(m_mutex);
+    m_activeHeightmap = heightmapIndex;
+    m_activeDiffuse = diffuseIndex;
+}
+
+void DatasetCatalog::prefetch(int index) {
+    if (index < 0 || index >= m_count || !m_thread.isRunning()) {
+        return;
+    }
+
+    {
+        bx::MutexScope lock(m_mutex);
+        const Entry& entry = m_datasets[index];
+        if (index == m_inFlight || index == m_syncIndex
+        ||  (entry.heightmapLoaded && entry.diffuseLoaded
+            && (entry.slopeMap || !m_cacheSlopeMaps || !entry.heightmap))) {
+            return;
+        }
+        m_pending = index;
+    }
+    m_requestSem.post();
+
+    trim();
+}
+
+bool DatasetCatalog::isIdle() const {
+    bx::MutexScope lock(m_mutex);
+    return m_pending < 0 && m_inFlight < 0;
+}
+
+int DatasetCatalog::bakeAll() {
+    int baked = 0;
+    for (int i = 0; i < m_count; ++i) {
+        loadSync(i, true);
+
+        bx::MutexScope lock(m_mutex);
+        if (m_datasets[i].heightmap) {
+            ++baked;
+        }
+        if (i != m_activeHeightmap && i != m_activeDiffuse && i != m_inFlight) {
+            evict(i);
+        }
+    }
+    return baked;
+}
+
+int DatasetCatalog::buildVirtualTextures() {
+    MEMORY_TAG_SCOPE("virtual texture");
+    int built = 0;
+    for (int i = 0; i < m_count * 2; ++i) {
+        // Diffuse images become RGBA8 pyramids, heightmaps R16 ones
+        const DatasetInfo& info = m_datasets[i / 2].info;
+        const bool heightmap = (i & 1) == 1;
+        const char* source = heightmap ? info.heightmapPath : info.diffusePath;
+        if (source[0] == '\0' || vt::isPyramidPath(source)) {
+            continue;
+        }
+
+        char path[256];
+        pyramidPath(source, path, sizeof(path));
+
+        bimg::ImageContainer* image = imageLoad(entry::getFileReader(), source,
+            heightmap ? bgfx::TextureFormat::R16 : bgfx::TextureFormat::RGBA8);
+        if (!image) {
+            printf("Failed to load %s: %s\n", heightmap ? "heightmap" : "diffuse texture", source);
+            continue;
+        }
+
+        const vt::Format::Enum format = heightmap ? vt::Format::R16 : vt::Format::RGBA8;
+        if (vt::buildPyramid(image->m_data, image->m_width, image->m_height, format, path)) {
+            printf("Built tile pyramid %s (%ux%u)\n", path, image->m_width, image->m_height);
+            ++built;
+        }
+        bimg::imageFree(image);
+    }
+    return built;
+}
+
+DatasetCatalog::Stats DatasetCatalog::getStats() const {
+    bx::MutexScope lock(m_mutex);
+    Stats stats;
+    stats.residentBytes = m_residentBytes;
+    stats.budgetBytes = m_budgetBytes;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.prefetches = m_prefetches;
+    stats.evictions = m_evictions;
+    stats.bakeHits = m_bakeHits;
+    stats.bakeMisses = m_bakeMisses;
+    stats.encode = m_encodeStats;
+    return stats;
+}
+
+DatasetCatalog::LoadTimes DatasetCatalog::takeLoadTimes() {
+    const LoadTimes times = m_syncLoadTimes;
+    bx::memSet(&m_syncLoadTimes, 0, sizeof(m_syncLoadTimes));
+    return times;
+}
+
+int32_t DatasetCatalog::workerFn(bx::Thread* self, void* userData) {
+    BX_UNUSED(self);
+    return static_cast<DatasetCatalog*>(userData)->worker();
+}
+
+int32_t DatasetCatalog::worker() {
+    profilerSetThreadName("catalog");
+    bx::FileReaderI* reader = entry::createFileReader();
+    for (;;) {
+        m_requestSem.wait();
+
+        Job job;
+        {
+            bx::MutexScope lock(m_mutex);
+            if (m_quit) {
+                break;
+            }
+            if (m_pending < 0 || !prepareJob(m_pending, m_cacheSlopeMaps, job)) {
+                m_pending = -1;
+                continue;
+            }
+            m_inFlight = m_pending;
+            m_pending = -1;
+        }
+
+        runJob(reader, job);
+
+        bx::MutexScope lock(m_mutex);
+        commitJob(job);
+        ++m_prefetches;
+        m_inFlight = -1;
+        if (m_waiting) {
+            m_waiting = false;
+            m_doneSem.post();
+        }
+    }
+
+    entry::destroyFileReader(reader);
+    return 0;
+}
+
+bool DatasetCatalog::prepareJob(int index, bool slopeMap, Job& job) const {
+    const Entry& entry = m_datasets[index];
+    job.index = index;
+    job.heightmap = !entry.heightmapLoaded;
+    job.diffuse = !entry.diffuseLoaded;
+    job.slopeMap = slopeMap && !entry.slopeMap;
+    job.residentHeightmap = entry.heightmap;
+    job.decodedHeightmap = nullptr;
+    job.decodedDiffuse = nullptr;
+    job.decodedSlopeMap = nullptr;
+    job.bakeHits = 0;
+    job.bakeMisses = 0;
+    job.diffuseFormat = m_diffuseFormat;
+    job.encoded = false;
+    bx::memSet(&job.times, 0, sizeof(job.times));
+    return job.heightmap || job.diffuse || (job.slopeMap && entry.heightmap);
+}
+
+void DatasetCatalog::loadHeightmapTask(void* userData) {
+    MEMORY_TAG_SCOPE("heightmap image");
+    PROFILER_SCOPE("decode heightmap");
+    Task& task = *static_cast<Task*>(userData);
+    Job& job = *task.job;
+    const DatasetInfo& info = task.catalog->m_datasets[job.index].info;
+
+    int64_t start = bx::getHPCounter();
+    BakeCache::SourceKey key;
+    job.decodedHeightmap = task.catalog->m_bake.loadImage(info.heightmapPath, "r16", key);
+    task.times.ioMs += msSince(start);
+    if (job.decodedHeightmap) {
+        ++task.bakeHits;
+        return;
+    }
+
+    ++task.bakeMisses;
+    ImageLoadTimes imageTimes = { 0.0f, 0.0f, 0.0f };
+    job.decodedHeightmap = imageLoad(task.reader, info.heightmapPath, bgfx::TextureFormat::R16, &imageTimes);
+    addImageTimes(task.times, imageTimes);
+    if (job.decodedHeightmap) {
+        start = bx::getHPCounter();
+        task.catalog->m_bake.storeImage(info.heightmapPath, "r16", key, job.decodedHeightmap);
+        task.times.ioMs += msSince(start);
+    } else {
+        printf("Failed to load heightmap: %s\n", info.heightmapPath);
+    }
+}
+
+void DatasetCatalog::loadSlopeMapTask(void* userData) {
+    MEMORY_TAG_SCOPE("slope map");
+    PROFILER_SCOPE("slope map");
+    Task& task = *static_cast<Task*>(userData);
+    Job& job = *task.job;
+    const DatasetInfo& info = task.catalog->m_datasets[job.index].info;
+
+    const bimg::ImageContainer* heightmap = job.heightmap ? job.decodedHeightmap : job.residentHeightmap;
+    if (!heightmap || heightmap->m_width == 0 || heightmap->m_height == 0) {
+        return;
+    }
+
+    const int w = int(heightmap->m_width);
+    const int h = int(heightmap->m_height);
+    int64_t start = bx::getHPCounter();
+    BakeCache::SourceKey key;
+    job.decodedSlopeMap = task.catalog->m_bake.loadSlopeMap(info.heightmapPath, w, h, key);
+    task.times.ioMs += msSince(start);
+    if (job.decodedSlopeMap) {
+        ++task.bakeHits;
+    } else {
+        ++task.bakeMisses;
+        start = bx::getHPCounter();
+        job.decodedSlopeMap = (float*)BX_ALLOC(entry::getAllocator(), size_t(w) * h * 2 * sizeof(float));
+        smap::generate((const uint16_t*)heightmap->m_data, w, h, job.decodedSlopeMap);
+        task.times.smapMs += msSince(start);
+
+        start = bx::getHPCounter();
+        task.catalog->m_bake.storeSlopeMap(info.heightmapPath, w, h, key, job.decodedSlopeMap);
+        task.times.ioMs += msSince(start);
+    }
+}
+
+void DatasetCatalog::runJob(bx::FileReaderI* reader, Job& job) const {
+    PROFILER_SCOPE("DatasetCatalog::runJob");
+    const DatasetInfo& info = m_datasets[job.index].info;
+
+    // The heightmap, then its slope map, load on the job workers while
+    // this thread does the diffuse image. Tile pyramids are streamed by
+    // the renderer, never decoded whole.
+    Task heightmapTask = { this, &job, nullptr, 0, 0 };
+    Task slopeMapTask = { this, &job, nullptr, 0, 0 };
+    JobCounter heightmapDone = { 0 };
+    JobCounter slopeMapDone = { 0 };
+    if (job.heightmap && !vt::isPyramidPath(info.heightmapPath)) {
+        // Any thread may run the task, so it cannot borrow this one's reader
+        heightmapTask.reader = entry::createFileReader();
+        jobRun(loadHeightmapTask, &heightmapTask, &heightmapDone);
+    }
+    if (job.slopeMap) {
+        jobRun(loadSlopeMapTask, &slopeMapTask, &slopeMapDone, &heightmapDone);
+    }
+
+    if (job.diffuse && info.diffusePath[0] != '\0' && !vt::isPyramidPath(info.diffusePath)) {
+        MEMORY_TAG_SCOPE("diffuse image");
+        PROFILER_SCOPE("decode diffuse");
+        const bool compressed = job.diffuseFormat != bimg::TextureFormat::Count;
+        const char* kind = !compressed ? "diffuse"
+            : job.diffuseFormat == bimg::TextureFormat::BC7 ? "bc7" : "bc1";
+
+        int64_t start = bx::getHPCounter();
+        BakeCache::SourceKey key;
+        job.decodedDiffuse = compressed
+            ? m_bake.loadKtx(info.diffusePath, kind, key)
+            : m_bake.loadImage(info.diffusePath, kind, key);
+        job.times.ioMs += msSince(start);
+        if (job.decodedDiffuse) {
+            ++job.bakeHits;
+        } else {
+            ++job.bakeMisses;
+            ImageLoadTimes imageTimes = { 0.0f, 0.0f, 0.0f };
+            job.decodedDiffuse = imageLoad(reader, info.diffusePath, bgfx::TextureFormat::Count, &imageTimes);
+            addImageTimes(job.times, imageTimes);
+            start = bx::getHPCounter();
+            if (!job.decodedDiffuse) {
+                printf("Failed to load diffuse texture: %s\n", info.diffusePath);
+            } else if (compressed) {
+                bimg::ImageContainer* blocks = bcenc::compress(entry::getAllocator(), *job.decodedDiffuse,
+                    job.diffuseFormat, 0, &job.encodeStats);
+                job.times.convertMs += msSince(start);
+                start = bx::getHPCounter();
+                if (blocks) {
+                    printf("%s encode: %ux%u, %u mips, %.2f Mtexel/s on %u threads (%.1f ms), PSNR %.2f dB\n",
+                        kind, blocks->m_width, blocks->m_height, job.encodeStats.numMips,
+                        job.encodeStats.megatexelsPerSecond, job.encodeStats.numThreads,
+                        job.encodeStats.encodeMs, job.encodeStats.psnr);
+                    bimg::imageFree(job.decodedDiffuse);
+                    job.decodedDiffuse = blocks;
+                    job.encoded = true;
+                    m_bake.storeKtx(info.diffusePath, kind, key, blocks);
+                }
+            } else {
+                m_bake.storeImage(info.diffusePath, kind, key, job.decodedDiffuse);
+            }
+            job.times.ioMs += msSince(start);
+        }
+    }
+
+    jobWait(&slopeMapDone);
+    jobWait(&heightmapDone);
+    if (heightmapTask.reader) {
+        entry::destroyFileReader(heightmapTask.reader);
+    }
+    job.bakeHits += heightmapTask.bakeHits + slopeMapTask.bakeHits;
+    job.bakeMisses += heightmapTask.bakeMisses + slopeMapTask.bakeMisses;
+    const Task* tasks[] = { &heightmapTask, &slopeMapTask };
+    for (const Task* task : tasks) {
+        job.times.ioMs += task->times.ioMs;
+        job.times.decodeMs += task->times.decodeMs;
+        job.times.convertMs += task->times.convertMs;
+        job.times.smapMs += task->times.smapMs;
+    }
+}
+
+void DatasetCatalog::commitJob(Job& job) {
+    Entry& entry = m_datasets[job.index];
+    // A job that filled in part of the entry, a slope map after the images
+    // say, cannot tell how the rest was loaded
+    if (job.bakeMisses > 0) {
+        entry.baked = false;
+    } else if (job.heightmap && job.diffuse) {
+        entry.baked = true;
+    }
+    m_bakeHits += job.bakeHits;
+    m_bakeMisses += job.bakeMisses;
+    if (job.encoded) {
+        m_encodeStats = job.encodeStats;
+    }
+
+    if (job.heightmap) {
+        entry.heightmap = job.decodedHeightmap;
+        entry.heightmapLoaded = true;
+        if (entry.heightmap) {
+            entry.bytes += entry.heightmap->m_size;
+        }
+    }
+
+    if (job.diffuse) {
+        entry.diffuse = job.decodedDiffuse;
+        entry.diffuseLoaded = true;
+        if (entry.diffuse) {
+            entry.bytes += entry.diffuse->m_size;
+        }
+    }
+
+    if (job.decodedSlopeMap) {
+        entry.slopeMap = job.decodedSlopeMap;
+        entry.bytes += uint64_t(entry.heightmap->m_width) * entry.heightmap->m_height * 2 * sizeof(float);
+    }
+
+    m_residentBytes = 0;
+    for (int i = 0; i < m_count; ++i) {
+        m_residentBytes += m_datasets[i].bytes;
+    }
+
+    // Prefetches commit on the catalog thread, so the budget is enforced
+    // here rather than on the main thread's next call. The new data counts
+    // as the most recently used and is never the one evicted.
+    entry.lastUse = ++m_useCounter;
+    evictOverBudget(job.index);
+}
+
+void DatasetCatalog::loadSync(int index, bool slopeMap) {
+    waitInFlight(index);
+
+    Job job;
+    {
+        bx::MutexScope lock(m_mutex);
+        if (!prepareJob(index, slopeMap, job)) {
+            return;
+        }
+        // runJob() reads the resident heightmap without the lock, so a
+        // prefetch committing meanwhile must not evict it
+        m_syncIndex = index;
+    }
+
+    runJob(entry::getFileReader(), job);
+    m_syncLoadTimes.ioMs += job.times.ioMs;
+    m_syncLoadTimes.decodeMs += job.times.decodeMs;
+    m_syncLoadTimes.convertMs += job.times.convertMs;
+    m_syncLoadTimes.smapMs += job.times.smapMs;
+
+    bx::MutexScope lock(m_mutex);
+    commitJob(job);
+    m_syncIndex = -1;
+}
+
+void DatasetCatalog::waitInFlight(int index) {
+    bool wait = false;
+    {
+        bx::MutexScope lock(m_mutex);
+        if (m_pending == index) {
+            m_pending = -1;
+        }
+        if (m_inFlight == index) {
+            m_waiting = true;
+            wait = true;
+        }
+    }
+
+    if (wait) {
+        m_doneSem.wait();
+    }
+}
+
+void DatasetCatalog::touch(int index) {
+    bx::MutexScope lock(m_mutex);
+    m_datasets[index].lastUse = ++m_useCounter;
+}
+
+void DatasetCatalog::evict(int index) {
+    Entry& entry = m_datasets[index];
+    if (entry.heightmap) {
+        bimg::imageFree(entry.heightmap);
+    }
+    if (entry.diffuse) {
+        bimg::imageFree(entry.diffuse);
+    }
+    if (entry.slopeMap) {
+        BX_FREE(entry::getAllocator(), entry.slopeMap);
+    }
+
+    m_residentBytes -= entry.bytes;
+    entry.heightmap = nullptr;
+    entry.diffuse = nullptr;
+    entry.slopeMap = nullptr;
+    entry.bytes = 0;
+    entry.heightmapLoaded = false;
+    entry.diffuseLoaded = false;
+    entry.baked = false;
+}
+
+void DatasetCatalog::trim() {
+    bx::MutexScope lock(m_mutex);
+    evictOverBudget(-1);
+}
+
+void DatasetCatalog::evictOverBudget(int keep) {
+    // Either thread may evict, but never the datasets passed to setActive(),
+    // so pointers the main thread got for those stay valid
+    while (m_residentBytes > m_budgetBytes) {
+        int victim = -1;
+        for (int i = 0; i < m_count; ++i) {
+            const Entry& entry = m_datasets[i];
+            if (entry.bytes == 0 || i == keep || i == m_activeHeightmap || i == m_activeDiffuse
+            ||  i == m_inFlight || i == m_syncIndex) {
+                continue;
+            }
+            if (victim < 0 || entry.lastUse < m_datasets[victim].lastUse) {
+                victim = i;
+            }
+        }
+
+        if (victim < 0) {
+            break;
+        }
+
+        evict(victim);
+        ++m_evictions;
+    }
+}
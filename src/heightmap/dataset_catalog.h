@@ -0,0 +1,195 @@
+#pragma once
+
+#include "bake_cache.h"
+#include "block_compress.h"
+
+#include <bimg/bimg.h>
+#include <bx/file.h>
+#include <bx/mutex.h>
+#include <bx/semaphore.h>
+#include <bx/thread.h>
+
+struct DatasetInfo {
+    char name[64];
+    char heightmapPath[256];
+    char diffusePath[256];
+};
+
+// List of heightmap/diffuse datasets with a byte-budgeted LRU of decoded
+// images and a background thread that prefetches the next likely dataset.
+// All public methods are called from the main thread.
+class DatasetCatalog {
+public:
+    static constexpr int MAX_DATASETS = 64;
+    static constexpr uint64_t DEFAULT_BUDGET_BYTES = UINT64_C(512) << 20;
+
+    struct Stats {
+        uint64_t residentBytes;
+        uint64_t budgetBytes;
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t prefetches;
+        uint32_t evictions;
+        uint32_t bakeHits;
+        uint32_t bakeMisses;
+        bcenc::Stats encode;    // last diffuse encode
+    };
+
+    // Thread time of the loads, in milliseconds. Decoding and slope maps
+    // run on job workers alongside the diffuse image.
+    struct LoadTimes {
+        float ioMs;             // source images and bake cache files
+        float decodeMs;
+        float convertMs;        // to R16, and diffuse block compression
+        float smapMs;
+    };
+
+    DatasetCatalog();
+    ~DatasetCatalog();
+
+    void init(uint64_t budgetBytes = DEFAULT_BUDGET_BYTES);
+    void shutdown();
+
+    // One dataset per line: "name heightmap-path diffuse-path", '#' starts
+    // a comment. Returns the number of datasets added.
+    int loadManifest(const char* path);
+
+    // Pairs every "<stem>_16bit.png" in `dir` with "<stem>.jpg" or
+    // "<stem>.png". Returns the number of datasets added.
+    int scanDirectory(const char* dir);
+
+    int addDataset(const char* name, const char* heightmapPath, const char* diffusePath);
+
+    int getCount() const { return m_count; }
+    const DatasetInfo& get(int index) const { return m_datasets[index].info; }
+
+    // Decoded data for a dataset, loading it synchronously on a miss. Any
+    // call, and any prefetch finishing in the background, may evict
+    // datasets other than those passed to setActive(), so pin a dataset
+    // before acquiring its data.
+    const bimg::ImageContainer* acquireHeightmap(int index);
+    const bimg::ImageContainer* acquireDiffuse(int index);
+    const float* acquireSlopeMap(int index);
+
+    void setActive(int heightmapIndex, int diffuseIndex);
+    void setCacheSlopeMaps(bool enabled) { m_cacheSlopeMaps = enabled; }
+    void setBakeCacheEnabled(bool enabled) { m_bake.setEnabled(enabled); }
+    // BC1 or BC7 encodes diffuse images with mips, Count keeps them as decoded.
+    void setDiffuseFormat(bimg::TextureFormat::Enum format) { m_diffuseFormat = format; }
+
+    // True if the heightmap and diffuse image are decoded in memory.
+    bool isResident(int index) const;
+    // True if the last load of the dataset came from the bake cache alone.
+    bool isBaked(int index) const;
+
+    // Queues a background load; a newer request replaces a pending one.
+    void prefetch(int index);
+    // True when no background load is queued or running.
+    bool isIdle() const;
+
+    // Builds every bake cache artifact up front, e.g. for an offline bake.
+    // Returns the number of datasets whose heightmap loaded.
+    int bakeAll();
+
+    // Writes a tile pyramid next to every diffuse image and heightmap,
+    // "<image without extension>.vtp". Point a manifest at it to stream
+    // the image instead. Returns the number of pyramids written.
+    int buildVirtualTextures();
+
+    Stats getStats() const;
+
+    // Time of the synchronous loads since the last call. Data a prefetch
+    // made resident is not in it.
+    LoadTimes takeLoadTimes();
+
+private:
+    struct Entry {
+        DatasetInfo info;
+        bimg::ImageContainer* heightmap;
+        bimg::ImageContainer* diffuse;
+        float* slopeMap;
+        uint64_t bytes;
+        uint64_t lastUse;
+        bool heightmapLoaded;
+        bool diffuseLoaded;
+        bool baked;
+    };
+
+    // What a load still has to produce for one entry, and the results.
+    struct Job {
+        int index;
+        bool heightmap;
+        bool diffuse;
+        bool slopeMap;
+        const bimg::ImageContainer* residentHeightmap;
+        bimg::ImageContainer* decodedHeightmap;
+        bimg::ImageContainer* decodedDiffuse;
+        float* decodedSlopeMap;
+        uint32_t bakeHits;
+        uint32_t bakeMisses;
+        bimg::TextureFormat::Enum diffuseFormat;
+        bcenc::Stats encodeStats;
+        bool encoded;
+        LoadTimes times;
+    };
+
+    // Part of a Job handed to the job system, with its own bake counts
+    // and times. The reader is only set for the heightmap.
+    struct Task {
+        const DatasetCatalog* catalog;
+        Job* job;
+        bx::FileReaderI* reader;
+        uint32_t bakeHits;
+        uint32_t bakeMisses;
+        LoadTimes times;
+    };
+
+    static int32_t workerFn(bx::Thread* self, void* userData);
+    int32_t worker();
+
+    bool prepareJob(int index, bool slopeMap, Job& job) const;
+    void runJob(bx::FileReaderI* reader, Job& job) const;
+    static void loadHeightmapTask(void* userData);
+    static void loadSlopeMapTask(void* userData);
+    void commitJob(Job& job);
+    void loadSync(int index, bool slopeMap);
+    void waitInFlight(int index);
+    void touch(int index);
+    void evict(int index);
+    void trim();
+    // Evicts the least recently used datasets until the budget holds, never
+    // `keep` or a pinned one. Call with m_mutex held.
+    void evictOverBudget(int keep);
+
+    Entry m_datasets[MAX_DATASETS];
+    int m_count;
+    BakeCache m_bake;
+
+    bx::Thread m_thread;
+    mutable bx::Mutex m_mutex;
+    bx::Semaphore m_requestSem;
+    bx::Semaphore m_doneSem;
+
+    int m_pending;
+    int m_inFlight;
+    // Dataset loadSync() is loading on the main thread, pinned like m_inFlight
+    int m_syncIndex;
+    int m_activeHeightmap;
+    int m_activeDiffuse;
+    bool m_waiting;
+    bool m_quit;
+    bool m_cacheSlopeMaps;
+
+    uint64_t m_budgetBytes;
+    uint64_t m_residentBytes;
+    uint64_t m_useCounter;
+    uint32_t m_hits;
+    uint32_t m_misses;
+    uint32_t m_prefetches;
+    uint32_t m_evictions;
+    uint32_t m_bakeHits;
+    uint32_t m_bakeMisses;
+    bimg::TextureFormat::Enum m_diffuseFormat;
+    bcenc::Stats m_encodeStats;
+    LoadTimes m_syncLoadTimes;
+};
@@ -0,0 +1,100 @@
+#include "dmap_stream.h"
+
+#include <bx/math.h>
+#include <cstdio>
+
+DmapStream::DmapStream()
+    : m_selected(0)
+    , m_prefetched(0)
+{
+}
+
+DmapStream::~DmapStream() {
+    shutdown();
+}
+
+bool DmapStream::init(const char* path, uint32_t budgetMB) {
+    shutdown();
+
+    vt::PyramidReader reader;
+    if (!reader.open(path)) {
+        printf("Failed to open heightmap pyramid: %s\n", path);
+        return false;
+    }
+    const vt::PyramidInfo info = reader.getInfo();
+    reader.close();
+    if (info.format != vt::Format::R16) {
+        printf("Heightmap pyramid %s is not R16\n", path);
+        return false;
+    }
+
+    // As square as the budget allows, within the texture size limit and
+    // the byte per axis of the indirection entries
+    const uint32_t maxSlots = bx::min<uint32_t>(256, bgfx::getCaps()->limits.maxTextureSize / vt::kTileStride);
+    const uint32_t numSlots = bx::max<uint32_t>(uint32_t((uint64_t(budgetMB) << 20) / info.tileBytes()), 1);
+    const uint32_t slotsX = bx::clamp<uint32_t>(uint32_t(bx::ceil(bx::sqrt(float(numSlots)))), 1, maxSlots);
+    const uint32_t slotsY = bx::clamp<uint32_t>(numSlots / slotsX, 1, maxSlots);
+
+    if (!m_cache.init(path, slotsX, slotsY, "dmap cache")) {
+        return false;
+    }
+    m_selector.init(slotsX * slotsY);
+    m_planner.init(slotsX * slotsY);
+    m_selected = 0;
+    m_prefetched = 0;
+
+    printf("Streaming heightmap %s: %ux%u, %u levels, %u cache slots (%.1f MB)\n",
+        path, info.width, info.height, info.numLevels, slotsX * slotsY,
+        double(uint64_t(slotsX) * slotsY * info.tileBytes()) / (1024.0 * 1024.0));
+    return true;
+}
+
+void DmapStream::shutdown() {
+    m_cache.shutdown();
+    m_selector.shutdown();
+    m_planner.shutdown();
+    m_selected = 0;
+    m_prefetched = 0;
+}
+
+void DmapStream::update(const float* camera, const CameraPredictor::Forecast* forecasts, uint32_t numForecasts,
+    const vt::TerrainView& view, uint32_t frame) {
+    if (!isValid()) {
+        return;
+    }
+
+    const vt::PyramidInfo& info = m_cache.getInfo();
+    m_selected = m_selector.select(info, vt::terrainSelectParams(info, view, camera));
+    m_cache.setWanted(m_selector.getTiles(), m_selected, frame);
+
+    m_prefetched = m_planner.plan(info, view, forecasts, numForecasts,
+        m_selector.getTiles(), m_selected, m_cache.getPrefetchCapacity());
+    m_cache.setPrefetch(m_planner.getTiles(), m_prefetched);
+    m_cache.update();
+}
+
+void DmapStream::getShaderParams(float* params) const {
+    bx::memSet(params, 0, 8 * sizeof(float));
+    if (!isValid()) {
+        return;
+    }
+
+    const vt::PyramidInfo& info = m_cache.getInfo();
+    const float virtualSize = float(info.tiles * vt::kTileSize);
+    params[0] = 1.0f;
+    params[1] = float(info.tiles);
+    params[2] = float(info.width);
+    params[3] = float(info.height);
+    params[4] = float(info.width) / virtualSize;
+    params[5] = float(info.height) / virtualSize;
+    params[6] = float(m_cache.getSlotsX());
+    params[7] = float(m_cache.getSlotsY());
+}
+
+DmapStream::Stats DmapStream::getStats() const {
+    Stats stats;
+    stats.cache = m_cache.getStats();
+    stats.selected = m_selected;
+    stats.prefetched = m_prefetched;
+    return stats;
+}
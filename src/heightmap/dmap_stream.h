@@ -0,0 +1,50 @@
+#pragma once
+
+#include "vt_cache.h"
+#include "vt_prefetch.h"
+
+// Streams an R16 tile pyramid as the displacement map, for heightmaps past
+// the 16384 texel texture limit or too large to keep resident. Tiles are
+// wanted by camera distance (see vt::DistanceSelector) within a fixed
+// memory budget and loaded asynchronously; until a tile arrives the
+// shaders fall back to the finest resident ancestor, see dmap_stream.sh.
+// Tiles the forecast cameras will want are prefetched into the slots the
+// current ones leave free.
+class DmapStream {
+public:
+    static constexpr uint32_t DEFAULT_BUDGET_MB = 64;
+
+    struct Stats {
+        vt::TileCache::Stats cache;
+        uint32_t selected;      // tiles wanted by the last update, without ancestors
+        uint32_t prefetched;    // tiles the forecasts want on top of those
+    };
+
+    DmapStream();
+    ~DmapStream();
+
+    // `budgetMB` sizes the physical cache
+    bool init(const char* path, uint32_t budgetMB);
+    void shutdown();
+    bool isValid() const { return m_cache.isValid(); }
+
+    const vt::PyramidInfo& getInfo() const { return m_cache.getInfo(); }
+
+    // `camera` and `forecasts` are in terrain space, see vt::TerrainView
+    void update(const float* camera, const CameraPredictor::Forecast* forecasts, uint32_t numForecasts,
+        const vt::TerrainView& view, uint32_t frame);
+
+    // u_dmapStreamParams, all zero when not streaming
+    void getShaderParams(float* params) const;
+    bgfx::TextureHandle getIndirection() const { return m_cache.getIndirection(); }
+    bgfx::TextureHandle getCache() const { return m_cache.getCache(); }
+
+    Stats getStats() const;
+
+private:
+    vt::TileCache m_cache;
+    vt::DistanceSelector m_selector;
+    vt::PrefetchPlanner m_planner;
+    uint32_t m_selected;
+    uint32_t m_prefetched;
+};
@@ -1,9 +1,21 @@
 #pragma once
 #include "heightmap/heightmap_renderer.h"
+#include "heightmap/param_sweep.h"
 #include "common/common.h"
 #include "common/camera.h"
+#include "common/camera_path.h"
+#include "common/entry/cmd.h"
 #include "common/imgui/imgui.h"
 #include "common/bgfx_utils.h"
+#include "common/frame_allocator.h"
+#include "common/gpu_ledger.h"
+#include "common/job_system.h"
+#include "common/metrics_server.h"
+#include "common/profiler.h"
+#include "common/rolling_stats.h"
+#include "common/tracking_allocator.h"
+
+#include <bx/commandline.h>
 
 class ExampleHeightmap : public entry::AppI {
 public:
@@ -18,6 +30,12 @@ public:
         m_debug = BGFX_DEBUG_NONE;
         m_reset = BGFX_RESET_NONE;
 
+        // Zones are recorded from the start, the trace is written on request
+        bx::CommandLine cmdLine(argc, argv);
+        profilerInit(entry::getAllocator());
+        profilerSetThreadName("main");
+        m_tracePath = cmdLine.findOption("trace");
+
         // Initialize bgfx
         bgfx::Init init;
         init.type = args.m_type;
@@ -27,11 +45,10 @@ public:
         init.resolution.reset = m_reset;
         init.platformData.nwh = entry::getNativeWindowHandle(entry::kDefaultWindowHandle);
         init.platformData.ndt = entry::getNativeDisplayHandle();
-        
+        init.allocator = entry::getAllocator();
+
         bgfx::init(init);
         bgfx::setDebug(m_debug);
-        bgfx::setViewClear(0, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x303030ff, 1.0f, 0);
-        bgfx::setViewClear(1, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x303030ff, 1.0f, 0);
 
         // Initialize subsystems
         imguiCreate();
@@ -39,28 +56,186 @@ public:
         cameraSetPosition({0.0f, 0.9f, -1.3f});
         cameraSetVerticalAngle(0);
 
+        // Camera flights: a replay drives the camera and the frame times
+        // from the file, a recording is written on exit
+        m_cameraPath = BX_NEW(entry::getAllocator(), CameraPath)(entry::getAllocator());
+        m_recordPath = cmdLine.findOption("record-camera");
+        m_recording = m_recordPath != nullptr;
+        if (m_recordPath == nullptr) {
+            m_recordPath = "camera.path";
+        }
+        m_replay = BX_NEW(entry::getAllocator(), CameraPath)(entry::getAllocator());
+        m_replayFrame = 0;
+        m_replayStart = 0;
+        const char* replayPath = cmdLine.findOption("replay-camera");
+        if (replayPath != nullptr && !m_replay->load(replayPath)) {
+            printf("No camera path in %s\n", replayPath);
+        }
+
+        // Job workers for the CPU loaders, one fewer than the cores by default
+        uint32_t numJobThreads = 0;
+        const char* jobs = cmdLine.findOption("jobs");
+        if (jobs != nullptr) {
+            bx::fromString(&numJobThreads, jobs);
+        }
+        jobInit(numJobThreads);
+        frameAllocatorInit(entry::getAllocator());
+
+        // Memory accounting: per call site on request, JSON written on exit
+        TrackingAllocator* tracking = entry::getTrackingAllocator();
+        if (tracking != nullptr) {
+            tracking->setTrackSites(cmdLine.hasArg("mem-sites"));
+        }
+        m_memJsonPath = cmdLine.findOption("mem-json");
+        m_frameStatsPath = cmdLine.findOption("frame-stats");
+
+        // Prometheus endpoint, --metrics unix:<path> or --metrics <port>
+        m_metricsAddress = cmdLine.findOption("metrics");
+        if (m_metricsAddress != nullptr && !metricsServerStart(m_metricsAddress)) {
+            printf("Failed to serve metrics on %s\n", m_metricsAddress);
+        }
+
+        // Leak check: reload every frame, then fail if the GPU ledger grew
+        m_reloadChecks = 0;
+        m_reloadBaseline = gpuLedgerGetTotal();
+        m_exitCode = 0;
+        const char* reloadChecks = cmdLine.findOption("check-reloads");
+        if (reloadChecks != nullptr) {
+            bx::fromString(&m_reloadChecks, reloadChecks);
+            m_reloadChecks = bx::max<uint32_t>(m_reloadChecks, 2);
+        }
+
+        // Sort check: sort the culled keys, check that many frames of the
+        // GPU sort against the CPU reference, then fail on any mismatch
+        m_sortChecks = 0;
+        const char* sortChecks = cmdLine.findOption("check-sort");
+        if (sortChecks != nullptr) {
+            bx::fromString(&m_sortChecks, sortChecks);
+            m_sortChecks = bx::max<uint32_t>(m_sortChecks, 1);
+            m_heightmapRenderer.setSortCulledKeys(true);
+            m_heightmapRenderer.setSortCheck(true);
+        }
+
         // Initialize heightmap renderer
+        const char* diffuse = cmdLine.findOption("diffuse");
+        if (diffuse != nullptr) {
+            m_heightmapRenderer.setDiffuseFormat(
+                0 == bx::strCmpI(diffuse, "bc7") ? bimg::TextureFormat::BC7 :
+                0 == bx::strCmpI(diffuse, "bc1") ? bimg::TextureFormat::BC1 :
+                bimg::TextureFormat::Count);
+        }
+        uint32_t dmapBudget;
+        const char* budget = cmdLine.findOption("dmap-budget");
+        if (budget != nullptr && bx::fromString(&dmapBudget, budget)) {
+            m_heightmapRenderer.setDmapStreamBudget(dmapBudget);
+        }
+        float prefetchSeconds;
+        const char* prefetch = cmdLine.findOption("prefetch");
+        if (prefetch != nullptr && bx::fromString(&prefetchSeconds, prefetch)) {
+            m_heightmapRenderer.setPrefetchHorizon(prefetchSeconds);
+        }
+        // Every load lands in a CSV for heightmap_load_compare, next to the
+        // bake cache; --load-history "" turns it off
+        m_heightmapRenderer.setLoadHistoryPath(cmdLine.findOption("load-history", "cache/load_history.csv"));
         m_heightmapRenderer.init(m_width, m_height);
+
+        // Settings sweep, through the console like "sweep pixel=1,2,4 cull=0,1"
+        // typed there: every combination runs --sweep-warmup frames to settle
+        // and --sweep-frames measured ones, the table goes to --sweep-out
+        m_sweepWarmup = 30;
+        m_sweepFrames = 120;
+        const char* value = cmdLine.findOption("sweep-warmup");
+        if (value != nullptr) {
+            bx::fromString(&m_sweepWarmup, value);
+        }
+        value = cmdLine.findOption("sweep-frames");
+        if (value != nullptr) {
+            bx::fromString(&m_sweepFrames, value);
+        }
+        m_sweepPath = cmdLine.findOption("sweep-out", "sweep.csv");
+        cmdAdd("sweep", cmdSweep, this);
+        const char* sweep = cmdLine.findOption("sweep");
+        m_sweepExit = sweep != nullptr;
+        if (sweep != nullptr) {
+            cmdExec("sweep %s", sweep);
+        }
+
+        // Offline bake: fill the bake cache for every dataset and quit
+        m_bakeOnly = cmdLine.hasArg("bake-all");
+        if (m_bakeOnly) {
+            int baked = m_heightmapRenderer.bakeAllDatasets();
+            printf("Baked %d of %d datasets\n", baked, m_heightmapRenderer.getDatasetCount());
+        }
+
+        // Offline build of the tile pyramids for streaming
+        if (cmdLine.hasArg("build-vt")) {
+            m_bakeOnly = true;
+            int built = m_heightmapRenderer.buildVirtualTextures();
+            printf("Built %d tile pyramids\n", built);
+        }
         
         m_timeOffset = bx::getHPCounter();
+        m_frameAllocations = 0;
+        m_lastNumAllocations = entry::getNumAllocations();
     }
 
     int shutdown() override {
+        if (m_tracePath != nullptr && !profilerWriteTrace(m_tracePath)) {
+            printf("Failed to write %s\n", m_tracePath);
+        }
+        if (m_frameStatsPath != nullptr && !writeFrameStats(m_frameStatsPath)) {
+            printf("Failed to write %s\n", m_frameStatsPath);
+        }
+
+        cmdRemove("sweep");
+        metricsServerStop();
         m_heightmapRenderer.shutdown();
+        const uint32_t numLeaks = gpuLedgerReportLeaks();
+        if (numLeaks > 0) {
+            printf("%u GPU resources still live after shutdown\n", numLeaks);
+        }
+        jobShutdown();
+        frameAllocatorShutdown();
+        if (m_recording) {
+            saveCameraPath();
+        }
+        BX_DELETE(entry::getAllocator(), m_cameraPath);
+        BX_DELETE(entry::getAllocator(), m_replay);
         cameraDestroy();
         imguiDestroy();
         bgfx::shutdown();
-        return 0;
+
+        // Written last, what is still current here leaked
+        TrackingAllocator* tracking = entry::getTrackingAllocator();
+        if (tracking != nullptr && m_memJsonPath != nullptr && !tracking->writeJson(m_memJsonPath)) {
+            printf("Failed to write %s\n", m_memJsonPath);
+        }
+        profilerShutdown();
+        return m_exitCode;
     }
 
     bool update() override {
+        if (m_bakeOnly) {
+            return false;
+        }
+
         if (!entry::processEvents(m_width, m_height, m_debug, m_reset, &m_mouseState)) {
+            PROFILER_SCOPE("frame");
             int64_t now = bx::getHPCounter();
             static int64_t last = now;
             const int64_t frameTime = now - last;
             last = now;
             const double freq = double(bx::getHPFrequency());
-            const float deltaTime = float(frameTime / freq);
+            float deltaTime = float(frameTime / freq);
+
+            // A replay steps by the recorded frame times, not by the clock
+            const bool replaying = m_replayFrame < m_replay->getNumFrames();
+            if (replaying) {
+                if (m_replayFrame == 0) {
+                    m_replayStart = now;
+                }
+                deltaTime = m_replay->getFrame(m_replayFrame).m_deltaTime;
+            }
 
             // Begin ImGui frame
             imguiBeginFrame(
@@ -75,19 +250,175 @@ public:
             renderUI();
 
             // Update camera
-            cameraUpdate(deltaTime * 0.01f, m_mouseState);
+            if (replaying) {
+                cameraApplyFrame(m_replay->getFrame(m_replayFrame));
+            } else {
+                cameraUpdate(deltaTime * 0.01f, m_mouseState);
+            }
+            if (m_recording) {
+                m_cameraPath->push(cameraCaptureFrame(deltaTime));
+            }
 
             // Update heightmap renderer
             m_heightmapRenderer.update(deltaTime, m_mouseState);
 
             imguiEndFrame();
-            bgfx::frame(false);
+            {
+                PROFILER_SCOPE("bgfx::frame");
+                m_heightmapRenderer.setFrameNumber(bgfx::frame(false));
+            }
+
+            // Transient memory of the frame just submitted is no longer used
+            frameAllocatorReset();
+            const uint32_t numAllocations = entry::getNumAllocations();
+            m_frameAllocations = numAllocations - m_lastNumAllocations;
+            m_lastNumAllocations = numAllocations;
+            m_frameTimes.push(float(frameTime * 1000.0 / freq));
+            publishMetrics();
+
+            if (m_sweep.isRunning() && updateSweep(float(frameTime * 1000.0 / freq)) && m_sweepExit) {
+                return false;
+            }
+            if (replaying && ++m_replayFrame == m_replay->getNumFrames()) {
+                const double seconds = double(bx::getHPCounter() - m_replayStart) / freq;
+                printf("Replayed %u frames, %.1f s of flight, in %.2f s: %.3f ms per frame\n",
+                    m_replayFrame, m_replay->getDuration(), seconds, seconds * 1000.0 / m_replayFrame);
+                return false;
+            }
+            if (m_reloadChecks > 0) {
+                return checkReloads();
+            }
+            if (m_sortChecks > 0) {
+                return checkSort();
+            }
             return true;
         }
         return false;
     }
 
 private:
+    // sweep <axis>=<values> ..., see ParamSweep
+    static int cmdSweep(CmdContext* /*context*/, void* userData, int argc, char const* const* argv) {
+        ExampleHeightmap* app = (ExampleHeightmap*)userData;
+        ParamSweep& sweep = app->m_sweep;
+        sweep.clear();
+        for (int i = 1; i < argc; ++i) {
+            if (!sweep.parse(argv[i])) {
+                printf("Bad sweep axis in %s\n", argv[i]);
+                sweep.clear();
+                return 1;
+            }
+        }
+        if (!sweep.start(app->m_sweepWarmup, app->m_sweepFrames)) {
+            return 1;
+        }
+        printf("Sweeping %u combinations\n", sweep.getNumCombinations());
+        return 0;
+    }
+
+    // True once the sweep is done and its table written
+    bool updateSweep(float frameMs) {
+        const bgfx::Stats* stats = bgfx::getStats();
+        const double gpuMs = stats->gpuTimerFreq > 0
+            ? double(stats->gpuTimeEnd - stats->gpuTimeBegin) * 1000.0 / double(stats->gpuTimerFreq)
+            : 0.0;
+        if (!m_sweep.frame(frameMs, float(gpuMs), m_heightmapRenderer.isLoading())) {
+            return false;
+        }
+
+        if (m_sweep.write(m_sweepPath)) {
+            printf("Sweep of %u combinations written to %s\n", m_sweep.getNumCombinations(), m_sweepPath);
+        } else {
+            printf("Failed to write %s\n", m_sweepPath);
+        }
+        return true;
+    }
+
+    // Swapped in for the server once filled, a scrape never waits on it
+    void publishMetrics() {
+        MetricsSnapshot* snapshot = metricsBeginPublish();
+        if (snapshot == nullptr) {
+            return;
+        }
+
+        const RollingStats::Summary frame = m_frameTimes.getSummary();
+        snapshot->add("heightmap_frame_time_ms", MetricType::Gauge, frame.m_p50, "quantile", "0.5");
+        snapshot->add("heightmap_frame_time_ms", MetricType::Gauge, frame.m_p95, "quantile", "0.95");
+        snapshot->add("heightmap_frame_time_ms", MetricType::Gauge, frame.m_p99, "quantile", "0.99");
+        snapshot->add("heightmap_frame_time_ms", MetricType::Gauge, frame.m_max, "quantile", "1");
+        snapshot->add("heightmap_frame_time_mean_ms", MetricType::Gauge, frame.m_mean);
+        snapshot->add("heightmap_frame_heap_allocations", MetricType::Gauge, m_frameAllocations);
+
+        TrackingAllocator* tracking = entry::getTrackingAllocator();
+        if (tracking != nullptr) {
+            const MemoryCounters total = tracking->getTotal();
+            snapshot->add("heightmap_heap_bytes", MetricType::Gauge, double(total.m_current));
+            snapshot->add("heightmap_heap_allocations_total", MetricType::Counter, double(total.m_allocations));
+        }
+
+        m_heightmapRenderer.publishMetrics(*snapshot);
+        metricsPublish();
+    }
+
+    void saveCameraPath() {
+        if (m_cameraPath->save(m_recordPath)) {
+            printf("Recorded %u camera frames to %s\n", m_cameraPath->getNumFrames(), m_recordPath);
+        } else {
+            printf("Failed to write %s\n", m_recordPath);
+        }
+    }
+
+    // The first reload is the baseline, every later one must give back
+    // exactly what it takes. Only gpuDestroy() takes a handle out of the
+    // ledger: one freed with plain bgfx::destroy() stays accounted and shows
+    // up here as a leak, so free everything created through the ledger with
+    // gpuDestroy().
+    bool checkReloads() {
+        const uint32_t reloads = m_heightmapRenderer.getGpuReloadDelta().reloads;
+        const GpuLedgerStats total = gpuLedgerGetTotal();
+        if (reloads == 1) {
+            m_reloadBaseline = total;
+        }
+        if (reloads < m_reloadChecks) {
+            m_heightmapRenderer.reloadTextures();
+            return true;
+        }
+
+        uint32_t handlesBefore = 0;
+        uint32_t handlesAfter = 0;
+        for (uint32_t i = 0; i < GpuResource::Count; ++i) {
+            handlesBefore += m_reloadBaseline.m_handles[i];
+            handlesAfter += total.m_handles[i];
+        }
+        const bool grew = total.m_bytes > m_reloadBaseline.m_bytes || handlesAfter > handlesBefore;
+        printf("Reload check: %u reloads, GPU %llu -> %llu bytes, %u -> %u handles: %s\n",
+            reloads, (unsigned long long)m_reloadBaseline.m_bytes, (unsigned long long)total.m_bytes,
+            handlesBefore, handlesAfter, grew ? "leaked" : "ok");
+        m_exitCode = grew ? 1 : 0;
+        return false;
+    }
+
+    // Frames with more keys than the check image holds are skipped, a run
+    // where every check was skipped verified nothing and fails
+    bool checkSort() {
+        if (!m_heightmapRenderer.getSortCheck()) {
+            printf("Sort check: not supported by this renderer\n");
+            m_exitCode = 1;
+            return false;
+        }
+
+        const HeightmapRenderer::SortCheckStats stats = m_heightmapRenderer.getSortCheckStats();
+        if (stats.passed + stats.failed + stats.skipped < m_sortChecks) {
+            return true;
+        }
+
+        const bool ok = stats.failed == 0 && stats.passed > 0;
+        printf("Sort check: %u passed, %u failed, %u skipped: %s\n",
+            stats.passed, stats.failed, stats.skipped, ok ? "ok" : "failed");
+        m_exitCode = ok ? 0 : 1;
+        return false;
+    }
+
     void renderUI() {
         ImGui::SetNextWindowPos(ImVec2(m_width - m_width / 5.0f - 10.0f, 10.0f), ImGuiCond_FirstUseEver);
         ImGui::SetNextWindowSize(ImVec2(m_width / 5.0f, m_height / 3.0f), ImGuiCond_FirstUseEver);
@@ -95,7 +426,8 @@ private:
         ImGui::Begin("Settings", nullptr, 0);
         
         // Performance stats
-        ImGui::Text("Loading time: %.2f ms", m_heightmapRenderer.getLoadTime());
+        ImGui::Text("Loading time: %.2f ms (%s)", m_heightmapRenderer.getLoadTime(),
+            HeightmapRenderer::getLoadKindName(m_heightmapRenderer.getLoadKind()));
         if (m_heightmapRenderer.getCpuSmapTime() > 0.0f) {
             ImGui::Text("CPU SMap: %.2f ms", m_heightmapRenderer.getCpuSmapTime());
         }
@@ -103,12 +435,229 @@ private:
             ImGui::Text("GPU SMap: %.2f ms", m_heightmapRenderer.getGpuSmapTime());
         }
 
+        // Datasets
+        int selected = m_heightmapRenderer.getSelectedHeightmap();
+        for (int i = 0; i < m_heightmapRenderer.getDatasetCount(); ++i) {
+            if (ImGui::RadioButton(m_heightmapRenderer.getDatasetName(i), selected == i) && selected != i) {
+                m_heightmapRenderer.loadHeightmap(i);
+            }
+        }
+
+        DatasetCatalog::Stats cache = m_heightmapRenderer.getDatasetCacheStats();
+        ImGui::Text("Cache: %.1f / %.0f MB, %u hits, %u misses",
+            double(cache.residentBytes) / (1024.0 * 1024.0),
+            double(cache.budgetBytes) / (1024.0 * 1024.0),
+            cache.hits, cache.misses);
+        ImGui::Text("Bake cache: %u hits, %u misses", cache.bakeHits, cache.bakeMisses);
+        if (cache.encode.texels > 0) {
+            ImGui::Text("Diffuse encode: %.1f Mtexel/s, PSNR %.1f dB",
+                cache.encode.megatexelsPerSecond, cache.encode.psnr);
+        }
+        FrameAllocatorStats frameStats = frameAllocatorGetStats();
+        ImGui::Text("Heap allocations: %u per frame, frame arena %u (%u overflowed)",
+            m_frameAllocations, frameStats.m_allocations, frameStats.m_overflows);
+        GpuLedgerStats gpu = gpuLedgerGetTotal();
+        HeightmapRenderer::GpuReloadDelta reload = m_heightmapRenderer.getGpuReloadDelta();
+        ImGui::Text("GPU: %.1f MB, last reload %+.1f KB, %+d handles",
+            double(gpu.m_bytes) / (1024.0 * 1024.0), double(reload.bytes) / 1024.0, reload.handles);
+        JobStats jobStats = jobGetStats();
+        ImGui::Text("Jobs: %u workers, %u run, %u stolen",
+            jobStats.m_numThreads, jobStats.m_executed, jobStats.m_stolen);
+        if (metricsServerIsRunning()) {
+            ImGui::Text("Metrics: %s, %u scrapes", m_metricsAddress, metricsGetNumScrapes());
+        }
+        if (m_heightmapRenderer.isVirtualTextureActive()) {
+            vt::VirtualTexture::Stats vtStats = m_heightmapRenderer.getVirtualTextureStats();
+            ImGui::Text("VT tiles: %u / %u resident, %u loading, %u missing",
+                vtStats.cache.residency.resident, vtStats.cache.residency.numSlots,
+                vtStats.cache.residency.loading, vtStats.cache.residency.missing);
+            ImGui::Text("VT: %u uploads, %u evictions, %u dropped",
+                vtStats.cache.uploads, vtStats.cache.residency.evicted, vtStats.cache.residency.dropped);
+            ImGui::Text("VT prefetch: %u planned, %u requested, %u cancelled",
+                vtStats.prefetched, vtStats.cache.residency.prefetchRequests, vtStats.cache.cancelled);
+        }
+        if (m_heightmapRenderer.isDmapStreamActive()) {
+            DmapStream::Stats dmapStats = m_heightmapRenderer.getDmapStreamStats();
+            ImGui::Text("DMap tiles: %u / %u resident, %u loading, %u missing",
+                dmapStats.cache.residency.resident, dmapStats.cache.residency.numSlots,
+                dmapStats.cache.residency.loading, dmapStats.cache.residency.missing);
+            ImGui::Text("DMap: %.1f MB loaded, %u evictions, %u dropped",
+                double(dmapStats.cache.bytesLoaded) / (1024.0 * 1024.0),
+                dmapStats.cache.residency.evicted, dmapStats.cache.residency.dropped);
+            ImGui::Text("DMap prefetch: %u planned, %u requested, %u cancelled",
+                dmapStats.prefetched, dmapStats.cache.residency.prefetchRequests, dmapStats.cache.cancelled);
+        }
+        renderLoadUI();
+        renderPassUI();
+        renderMemoryUI();
+        if (ImGui::Button("Write trace.json")) {
+            profilerWriteTrace("trace.json");
+        }
+        if (!m_recording && ImGui::Button("Record camera")) {
+            m_cameraPath->clear();
+            m_recording = true;
+        } else if (m_recording && ImGui::Button("Stop recording")) {
+            m_recording = false;
+            saveCameraPath();
+        }
+        if (m_recording) {
+            ImGui::SameLine();
+            ImGui::Text("%u frames to %s", m_cameraPath->getNumFrames(), m_recordPath);
+        }
+        if (m_sweep.isRunning()) {
+            ImGui::Text("Sweep: %u / %u", m_sweep.getCurrent() + 1, m_sweep.getNumCombinations());
+        }
+
         // Controls will be moved to HeightmapRenderer's UI method
         // For now, just show basic info
         
         ImGui::End();
     }
 
+    void renderLoadUI() {
+        if (!ImGui::CollapsingHeader("Load history")) {
+            return;
+        }
+
+        // Newest first, phases in ms
+        const LoadHistory& history = m_heightmapRenderer.getLoadHistory();
+        if (ImGui::BeginTable("load_history", 3 + types::LOAD_PHASE_COUNT)) {
+            ImGui::TableSetupColumn("Dataset");
+            ImGui::TableSetupColumn("Kind");
+            ImGui::TableSetupColumn("Total");
+            for (int i = 0; i < types::LOAD_PHASE_COUNT; ++i) {
+                ImGui::TableSetupColumn(loadhistory::getPhaseName(i));
+            }
+            ImGui::TableHeadersRow();
+            for (uint32_t i = history.getCount(); i-- > 0; ) {
+                const LoadTimeRecord& record = history.get(i);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(record.heightmapName);
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(loadhistory::getKindName(record.kind));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", record.loadTimeMs);
+                for (int j = 0; j < types::LOAD_PHASE_COUNT; ++j) {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f", record.phaseMs[j]);
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    void renderPassUI() {
+        if (!ImGui::CollapsingHeader("Terrain passes")) {
+            return;
+        }
+
+        HeightmapRenderer::FrameStats stats = m_heightmapRenderer.getFrameStats();
+        if (stats.countersValid) {
+            ImGui::Text("Keys: %u, %u after culling", stats.keys, stats.culledKeys);
+            ImGui::Text("Instances: %u, %.2f M triangles", stats.instances, double(stats.triangles) / 1e6);
+            ImGui::Text("Counters %u frames old", stats.latency);
+            ImGui::Text("Max key depth: %d", m_heightmapRenderer.getMaxKeyDepth());
+        } else {
+            ImGui::TextUnformatted("Counters: no readback");
+        }
+        const HeightmapRenderer::SortCheckStats sortCheck = m_heightmapRenderer.getSortCheckStats();
+        if (sortCheck.passed + sortCheck.failed + sortCheck.skipped > 0) {
+            ImGui::Text("Sort checks: %u passed, %u failed, %u skipped",
+                sortCheck.passed, sortCheck.failed, sortCheck.skipped);
+        }
+
+        if (!stats.passTimes) {
+            ImGui::TextUnformatted("Enable the profiler for pass times");
+            return;
+        }
+        if (ImGui::BeginTable("terrain_passes", 3)) {
+            ImGui::TableSetupColumn("Pass");
+            ImGui::TableSetupColumn("CPU ms");
+            ImGui::TableSetupColumn("GPU ms");
+            ImGui::TableHeadersRow();
+            for (int i = 0; i < types::VIEW_COUNT; ++i) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(HeightmapRenderer::getViewName(i));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", stats.cpuMs[i]);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", stats.gpuMs[i]);
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    void renderMemoryUI() {
+        if (!ImGui::CollapsingHeader("Memory")) {
+            return;
+        }
+
+        const double toMB = 1.0 / (1024.0 * 1024.0);
+        if (ImGui::BeginTable("gpu_owners", 4)) {
+            ImGui::TableSetupColumn("GPU");
+            ImGui::TableSetupColumn("MB");
+            ImGui::TableSetupColumn("Peak");
+            ImGui::TableSetupColumn("Handles");
+            ImGui::TableHeadersRow();
+            for (uint32_t i = 0; i < gpuLedgerGetNumOwners(); ++i) {
+                GpuLedgerStats owner = gpuLedgerGetOwner(i);
+                uint32_t handles = 0;
+                for (uint32_t type = 0; type < GpuResource::Count; ++type) {
+                    handles += owner.m_handles[type];
+                }
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(owner.m_name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", double(owner.m_bytes) * toMB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", double(owner.m_peak) * toMB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", handles);
+            }
+            ImGui::EndTable();
+        }
+
+        TrackingAllocator* tracking = entry::getTrackingAllocator();
+        if (tracking == nullptr) {
+            return;
+        }
+
+        MemoryCounters total = tracking->getTotal();
+        ImGui::Text("Heap: %.1f MB, peak %.1f MB, %lld blocks",
+            double(total.m_current) * toMB, double(total.m_peak) * toMB, (long long)total.m_count);
+
+        if (ImGui::BeginTable("memory_tags", 4)) {
+            ImGui::TableSetupColumn("Tag");
+            ImGui::TableSetupColumn("MB");
+            ImGui::TableSetupColumn("Peak");
+            ImGui::TableSetupColumn("Blocks");
+            ImGui::TableHeadersRow();
+            for (uint16_t i = 0; i < tracking->getNumTags(); ++i) {
+                MemoryTagStats tag = tracking->getTag(i);
+                if (tag.m_counters.m_peak == 0) {
+                    continue;
+                }
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(tag.m_name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", double(tag.m_counters.m_current) * toMB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", double(tag.m_counters.m_peak) * toMB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%lld", (long long)tag.m_counters.m_count);
+            }
+            ImGui::EndTable();
+        }
+
+        if (ImGui::Button("Write memory.json")) {
+            tracking->writeJson("memory.json");
+        }
+    }
+
     HeightmapRenderer m_heightmapRenderer;
     uint32_t m_width;
     uint32_t m_height;
@@ -116,4 +665,27 @@ private:
     uint32_t m_reset;
     entry::MouseState m_mouseState;
     int64_t m_timeOffset;
+    uint32_t m_frameAllocations;
+    uint32_t m_lastNumAllocations;
+    const char* m_memJsonPath;
+    const char* m_tracePath;
+    const char* m_frameStatsPath;
+    const char* m_metricsAddress;
+    RollingStats m_frameTimes;
+    CameraPath* m_cameraPath;
+    const char* m_recordPath;
+    bool m_recording;
+    CameraPath* m_replay;
+    uint32_t m_replayFrame;
+    int64_t m_replayStart;
+    ParamSweep m_sweep;
+    const char* m_sweepPath;
+    uint32_t m_sweepWarmup;
+    uint32_t m_sweepFrames;
+    bool m_sweepExit;
+    uint32_t m_reloadChecks;
+    GpuLedgerStats m_reloadBaseline;
+    uint32_t m_sortChecks;
+    int m_exitCode;
+    bool m_bakeOnly;
 };
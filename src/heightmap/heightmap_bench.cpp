@@ -0,0 +1,430 @@
+// Headless benchmark of the renderer's CPU side, no GPU or window needed:
+//
+//   heightmap_bench [--frames N] [--warmup N] [--reloads N] [--dataset i]
+//       [--jobs N] [--camera flight.path] [--json out.json]
+//       [--trace trace.json] [--metrics unix:<path>|<port>]
+//       [--load-history loads.csv]
+//
+// bgfx runs the Noop renderer under the noop entry, so every command is
+// recorded and submitted but none is executed. init() loads the first
+// dataset, then dataset --dataset is loaded --reloads times, then
+// --warmup and --frames frames are drawn with the camera orbiting the
+// terrain at a fixed 60 Hz step, or along a flight recorded by the app's
+// --record-camera, looped, at its recorded steps. The same arguments fly
+// the same path, so runs of two builds compare.
+//
+// The JSON holds every load (time to set up, to the first frame, the
+// slope map and the renderer's load phases), the CPU time of the measured
+// frames as percentiles and the heap allocations they made, and the GPU
+// ledger. Frame times are what the renderer's update() and bgfx::frame()
+// take on this thread, with the Noop render thread doing nothing behind
+// them.
+//
+// --metrics serves the renderer's metrics while the bench runs, the same
+// as the app does, so a CI job can scrape a long run and check the reply:
+//
+//   heightmap_bench --frames 100000 --metrics unix:/tmp/hm.sock &
+//   metrics_check --address unix:/tmp/hm.sock
+//
+// --load-history appends the loads to a history file as the app does, for
+// heightmap_load_compare to check against a baseline run.
+#include "heightmap_renderer.h"
+#include "../common/camera.h"
+#include "../common/camera_path.h"
+#include "../common/format_writer.h"
+#include "../common/frame_allocator.h"
+#include "../common/gpu_ledger.h"
+#include "../common/job_system.h"
+#include "../common/metrics_server.h"
+#include "../common/profiler.h"
+#include "../common/tool_support.h"
+#include "../common/tracking_allocator.h"
+
+#include <bx/commandline.h>
+#include <bx/file.h>
+#include <bx/math.h>
+#include <bx/string.h>
+#include <bx/timer.h>
+#include <cstdio>
+
+namespace {
+    constexpr float kFrameTime = 1.0f / 60.0f;
+    constexpr uint32_t kMaxLoads = 64;
+
+    struct LoadRecord {
+        bool reload;
+        int kind;               // types::LOAD_*
+        float setupMs;          // init(), or the update() swapping textures
+        float firstFrameMs;     // the first frame drawn with them
+        float loadMs;           // as the renderer reports it
+        float cpuSmapMs;
+        float gpuSmapMs;
+        float phaseMs[types::LOAD_PHASE_COUNT];
+        uint32_t allocations;
+        HeightmapRenderer::GpuReloadDelta gpu;
+    };
+
+    struct Percentiles {
+        float mean;
+        float p50;
+        float p90;
+        float p95;
+        float p99;
+        float max;
+    };
+
+    // Nearest rank, over a sorted copy
+    Percentiles computePercentiles(const float* samples, uint32_t count, float* sorted) {
+        Percentiles result = {};
+        if (count == 0) {
+            return result;
+        }
+
+        double sum = 0.0;
+        for (uint32_t i = 0; i < count; ++i) {
+            sorted[i] = samples[i];
+            sum += samples[i];
+        }
+        sortFloats(sorted, count);
+
+        result.mean = float(sum / count);
+        result.p50 = nearestRank(sorted, count, 0.50f);
+        result.p90 = nearestRank(sorted, count, 0.90f);
+        result.p95 = nearestRank(sorted, count, 0.95f);
+        result.p99 = nearestRank(sorted, count, 0.99f);
+        result.max = sorted[count - 1];
+        return result;
+    }
+
+    void writePercentiles(bx::WriterI* writer, bx::Error* err, const char* name, const Percentiles& p) {
+        writef(writer, err
+            , "    \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n"
+            , name, p.mean, p.p50, p.p90, p.p95, p.p99, p.max);
+    }
+
+    float toMs(int64_t ticks) {
+        return float(double(ticks) * 1000.0 / double(bx::getHPFrequency()));
+    }
+} // namespace
+
+class HeightmapBench : public entry::AppI {
+public:
+    HeightmapBench()
+        : entry::AppI("heightmap_bench", "Headless CPU benchmark of the heightmap renderer.", "") {}
+
+    void init(int32_t argc, const char* const* argv, uint32_t width, uint32_t height) override {
+        bx::CommandLine cmdLine(argc, argv);
+        profilerInit(entry::getAllocator());
+        profilerSetThreadName("main");
+        m_tracePath = cmdLine.findOption("trace");
+        m_jsonPath = cmdLine.findOption("json", "heightmap_bench.json");
+        m_exitCode = 0;
+        m_flight = BX_NEW(entry::getAllocator(), CameraPath)(entry::getAllocator());
+        const char* flightPath = cmdLine.findOption("camera");
+        if (flightPath != nullptr && !m_flight->load(flightPath)) {
+            printf("No camera path in %s\n", flightPath);
+            m_exitCode = 1;
+        }
+
+        m_numFrames = 600;
+        m_numWarmup = 60;
+        m_numReloads = 3;
+        m_dataset = 0;
+        uint32_t numJobThreads = 0;
+        const char* value;
+        if ((value = cmdLine.findOption("frames")) != nullptr) {
+            bx::fromString(&m_numFrames, value);
+        }
+        if ((value = cmdLine.findOption("warmup")) != nullptr) {
+            bx::fromString(&m_numWarmup, value);
+        }
+        if ((value = cmdLine.findOption("reloads")) != nullptr) {
+            bx::fromString(&m_numReloads, value);
+            m_numReloads = bx::min(m_numReloads, kMaxLoads - 1);
+        }
+        if ((value = cmdLine.findOption("dataset")) != nullptr) {
+            bx::fromString(&m_dataset, value);
+        }
+        if ((value = cmdLine.findOption("jobs")) != nullptr) {
+            bx::fromString(&numJobThreads, value);
+        }
+        if ((value = cmdLine.findOption("metrics")) != nullptr && !metricsServerStart(value)) {
+            printf("Failed to serve metrics on %s\n", value);
+            m_exitCode = 1;
+        }
+        m_heightmapRenderer.setLoadHistoryPath(cmdLine.findOption("load-history"));
+
+        m_width = width;
+        m_height = height;
+
+        bgfx::Init init;
+        init.type = bgfx::RendererType::Noop;
+        init.resolution.width = m_width;
+        init.resolution.height = m_height;
+        init.resolution.reset = BGFX_RESET_NONE;
+        init.allocator = entry::getAllocator();
+        bgfx::init(init);
+
+        cameraCreate();
+        jobInit(numJobThreads);
+        frameAllocatorInit(entry::getAllocator());
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        m_frameMs = (float*)BX_ALLOC(allocator, bx::max(m_numFrames, 1u) * sizeof(float));
+        m_updateMs = (float*)BX_ALLOC(allocator, bx::max(m_numFrames, 1u) * sizeof(float));
+        m_allocations = (float*)BX_ALLOC(allocator, bx::max(m_numFrames, 1u) * sizeof(float));
+
+        m_numLoads = 0;
+        m_loadStep = 0;
+        m_frame = 0;
+        m_time = 0.0f;
+        m_step = 0;
+        bx::memSet(m_loads, 0, sizeof(m_loads));
+
+        setCamera(0.0f);
+        const uint32_t allocationsBefore = entry::getNumAllocations();
+        const int64_t start = bx::getHPCounter();
+        if (!m_heightmapRenderer.init(m_width, m_height)) {
+            printf("Failed to initialize the renderer\n");
+            m_exitCode = 1;
+        }
+        m_loads[0].setupMs = toMs(bx::getHPCounter() - start);
+        m_loads[0].allocations = entry::getNumAllocations() - allocationsBefore;
+
+        if (m_dataset < 0 || m_dataset >= m_heightmapRenderer.getDatasetCount()) {
+            printf("No dataset %d, %d available\n", m_dataset, m_heightmapRenderer.getDatasetCount());
+            m_exitCode = 1;
+        }
+    }
+
+    int shutdown() override {
+        if (m_exitCode == 0) {
+            printResults();
+            if (!writeJson(m_jsonPath)) {
+                printf("Failed to write %s\n", m_jsonPath);
+                m_exitCode = 1;
+            }
+        }
+        if (m_tracePath != nullptr && !profilerWriteTrace(m_tracePath)) {
+            printf("Failed to write %s\n", m_tracePath);
+        }
+
+        metricsServerStop();
+        m_heightmapRenderer.shutdown();
+        gpuLedgerReportLeaks();
+        jobShutdown();
+        frameAllocatorShutdown();
+        BX_DELETE(entry::getAllocator(), m_flight);
+        cameraDestroy();
+        bgfx::shutdown();
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        BX_FREE(allocator, m_frameMs);
+        BX_FREE(allocator, m_updateMs);
+        BX_FREE(allocator, m_allocations);
+        profilerShutdown();
+        return m_exitCode;
+    }
+
+    bool update() override {
+        if (m_exitCode != 0) {
+            return false;
+        }
+
+        // The load from init() only needs its first frame, a reload also
+        // needs the update() that swaps the textures in
+        if (m_numLoads <= m_numReloads) {
+            LoadRecord& load = m_loads[m_numLoads];
+            const bool reload = m_numLoads > 0;
+            if (reload && m_loadStep == 0) {
+                load.reload = true;
+                m_heightmapRenderer.loadHeightmap(m_dataset);
+            }
+
+            const uint32_t allocationsBefore = entry::getNumAllocations();
+            float updateMs;
+            const float ms = runFrame(updateMs);
+            load.allocations += entry::getNumAllocations() - allocationsBefore;
+            if (reload && m_loadStep == 0) {
+                load.setupMs = ms;
+                m_loadStep = 1;
+                return true;
+            }
+
+            load.firstFrameMs = ms;
+            load.loadMs = m_heightmapRenderer.getLoadTime();
+            load.kind = m_heightmapRenderer.getLoadKind();
+            load.cpuSmapMs = m_heightmapRenderer.getCpuSmapTime();
+            load.gpuSmapMs = m_heightmapRenderer.getGpuSmapTime();
+            bx::memCopy(load.phaseMs, m_heightmapRenderer.getLoadPhases(), sizeof(load.phaseMs));
+            load.gpu = m_heightmapRenderer.getGpuReloadDelta();
+            m_loadStep = 0;
+            ++m_numLoads;
+            return true;
+        }
+
+        if (m_frame < m_numWarmup + m_numFrames) {
+            const uint32_t allocationsBefore = entry::getNumAllocations();
+            float updateMs;
+            const float ms = runFrame(updateMs);
+            if (m_frame >= m_numWarmup) {
+                const uint32_t i = m_frame - m_numWarmup;
+                m_frameMs[i] = ms;
+                m_updateMs[i] = updateMs;
+                m_allocations[i] = float(entry::getNumAllocations() - allocationsBefore);
+            }
+            ++m_frame;
+            return true;
+        }
+
+        return false;
+    }
+
+private:
+    // One revolution every 20 s around the terrain, dipping low and
+    // climbing back every 7 s, always looking at the centre
+    void setCamera(float time) {
+        const float angle = bx::kPi2 * time / 20.0f;
+        const float height = 0.6f + 0.35f * bx::sin(bx::kPi2 * time / 7.0f);
+        const bx::Vec3 eye = { 1.3f * bx::sin(angle), height, -1.3f * bx::cos(angle) };
+        const bx::Vec3 dir = bx::normalize(bx::neg(eye));
+        cameraSetPosition(eye);
+        cameraSetHorizontalAngle(bx::atan2(dir.x, dir.z));
+        cameraSetVerticalAngle(bx::asin(dir.y));
+        cameraUpdateView();
+    }
+
+    // Fewer than asked for when the entry asked to quit early
+    uint32_t getNumMeasured() const {
+        return m_frame > m_numWarmup ? m_frame - m_numWarmup : 0;
+    }
+
+    float runFrame(float& updateMs) {
+        PROFILER_SCOPE("frame");
+        const int64_t start = bx::getHPCounter();
+        float deltaTime = kFrameTime;
+        if (m_flight->getNumFrames() > 0) {
+            const CameraFrame& frame = m_flight->getFrame(m_step % m_flight->getNumFrames());
+            cameraApplyFrame(frame);
+            deltaTime = frame.m_deltaTime;
+        } else {
+            setCamera(m_time);
+        }
+        m_heightmapRenderer.update(deltaTime, m_mouseState);
+        const int64_t updated = bx::getHPCounter();
+        m_heightmapRenderer.setFrameNumber(bgfx::frame(false));
+        frameAllocatorReset();
+        const int64_t end = bx::getHPCounter();
+
+        m_time += deltaTime;
+        ++m_step;
+        updateMs = toMs(updated - start);
+
+        MetricsSnapshot* snapshot = metricsBeginPublish();
+        if (snapshot != nullptr) {
+            snapshot->add("heightmap_bench_frame_ms", MetricType::Gauge, toMs(end - start));
+            snapshot->add("heightmap_bench_frames_total", MetricType::Counter, m_step);
+            m_heightmapRenderer.publishMetrics(*snapshot);
+            metricsPublish();
+        }
+        return toMs(end - start);
+    }
+
+    void printResults() const {
+        for (uint32_t i = 0; i < m_numLoads; ++i) {
+            const LoadRecord& load = m_loads[i];
+            printf("%-7s %-8s setup %8.2f ms, first frame %8.2f ms, load %8.2f ms, %u allocations\n",
+                load.reload ? "reload" : "init", HeightmapRenderer::getLoadKindName(load.kind),
+                load.setupMs, load.firstFrameMs, load.loadMs, load.allocations);
+        }
+
+        float* sorted = (float*)BX_ALLOC(entry::getAllocator(), bx::max(m_numFrames, 1u) * sizeof(float));
+        const Percentiles frame = computePercentiles(m_frameMs, getNumMeasured(), sorted);
+        const Percentiles allocations = computePercentiles(m_allocations, getNumMeasured(), sorted);
+        BX_FREE(entry::getAllocator(), sorted);
+        printf("%u frames: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms, %.1f allocations per frame\n",
+            getNumMeasured(), frame.p50, frame.p95, frame.p99, frame.max, allocations.mean);
+    }
+
+    bool writeJson(const char* path) const {
+        bx::FileWriter writer;
+        bx::Error err;
+        if (!bx::open(&writer, path, false, &err)) {
+            return false;
+        }
+
+        writef(&writer, &err, "{\n  \"width\": %u,\n  \"height\": %u,\n  \"frame_time_s\": %.6f,\n",
+            m_width, m_height, kFrameTime);
+        writef(&writer, &err, "  \"job_threads\": %u,\n  \"loads\": [\n", jobGetNumThreads());
+        for (uint32_t i = 0; i < m_numLoads; ++i) {
+            const LoadRecord& load = m_loads[i];
+            writef(&writer, &err
+                , "    { \"phase\": \"%s\", \"kind\": \"%s\", \"setup_ms\": %.3f, \"first_frame_ms\": %.3f"
+                  ", \"load_ms\": %.3f, \"cpu_smap_ms\": %.3f, \"gpu_smap_ms\": %.3f, \"allocations\": %u"
+                  ", \"gpu_delta_bytes\": %lld, \"gpu_delta_handles\": %d, \"phases_ms\": {"
+                , load.reload ? "reload" : "init", HeightmapRenderer::getLoadKindName(load.kind)
+                , load.setupMs, load.firstFrameMs, load.loadMs, load.cpuSmapMs, load.gpuSmapMs
+                , load.allocations, load.reload ? (long long)load.gpu.bytes : 0ll
+                , load.reload ? load.gpu.handles : 0);
+            for (int j = 0; j < types::LOAD_PHASE_COUNT; ++j) {
+                writef(&writer, &err, "%s \"%s\": %.3f", j > 0 ? "," : "",
+                    loadhistory::getPhaseName(j), load.phaseMs[j]);
+            }
+            writef(&writer, &err, " } }%s\n", i + 1 < m_numLoads ? "," : "");
+        }
+
+        float* sorted = (float*)BX_ALLOC(entry::getAllocator(), bx::max(m_numFrames, 1u) * sizeof(float));
+        writef(&writer, &err, "  ],\n  \"frames\": {\n    \"warmup\": %u,\n    \"count\": %u,\n",
+            m_numWarmup, getNumMeasured());
+        writePercentiles(&writer, &err, "cpu_ms", computePercentiles(m_frameMs, getNumMeasured(), sorted));
+        writePercentiles(&writer, &err, "update_ms", computePercentiles(m_updateMs, getNumMeasured(), sorted));
+        const Percentiles allocations = computePercentiles(m_allocations, getNumMeasured(), sorted);
+        writef(&writer, &err, "    \"allocations\": { \"mean\": %.2f, \"p99\": %.0f, \"max\": %.0f }\n  },\n",
+            allocations.mean, allocations.p99, allocations.max);
+        BX_FREE(entry::getAllocator(), sorted);
+
+        const TrackingAllocator* tracking = entry::getTrackingAllocator();
+        if (tracking != nullptr) {
+            const MemoryCounters total = tracking->getTotal();
+            writef(&writer, &err
+                , "  \"heap\": { \"current\": %lld, \"peak\": %lld, \"count\": %lld, \"allocations\": %llu },\n"
+                , (long long)total.m_current, (long long)total.m_peak, (long long)total.m_count
+                , (unsigned long long)total.m_allocations);
+        }
+
+        const GpuLedgerStats gpu = gpuLedgerGetTotal();
+        writef(&writer, &err, "  \"gpu\": { \"bytes\": %llu, \"peak\": %llu }\n}\n",
+            (unsigned long long)gpu.m_bytes, (unsigned long long)gpu.m_peak);
+
+        bx::close(&writer);
+        return err.isOk();
+    }
+
+    HeightmapRenderer m_heightmapRenderer;
+    entry::MouseState m_mouseState;
+    const char* m_jsonPath;
+    const char* m_tracePath;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_numFrames;
+    uint32_t m_numWarmup;
+    uint32_t m_numReloads;
+    int32_t m_dataset;
+
+    LoadRecord m_loads[kMaxLoads];
+    uint32_t m_numLoads;
+    uint32_t m_loadStep;
+
+    // Measured frames, after the warmup
+    float* m_frameMs;
+    float* m_updateMs;
+    float* m_allocations;
+    uint32_t m_frame;
+    float m_time;
+    CameraPath* m_flight;
+    uint32_t m_step;            // Frames run, loads included
+    int m_exitCode;
+};
+
+// The entry runs the first app registered, this one
+static HeightmapBench s_bench;
@@ -1,13 +1,118 @@
 #include "heightmap_renderer.h"
 #include "patch_tables.h"
+#include "leb_sort.h"
 #include "types.h"
 #include "../common/bgfx_utils.h"
 #include "../common/camera.h"
+#include "../common/entry/cmd.h"
+#include "../common/gpu_ledger.h"
 #include "../common/imgui/imgui.h"
+#include "../common/metrics_server.h"
+#include "../common/profiler.h"
 
 #include <bx/math.h>
+#include <bx/string.h>
 #include <bx/timer.h>
 #include <cstdio>
+#include <ctime>
+
+namespace {
+    // Indexed by types::VIEW_*, the VT views name themselves the same way
+    const char* const kViewNames[types::VIEW_COUNT] = {
+        "terrain lod",
+        "terrain update draw",
+        "terrain sort",
+        "terrain render",
+        "vt feedback",
+        "vt readback",
+        "terrain counters",
+        "terrain counter readback",
+        "terrain smap",
+    };
+
+    float msSince(int64_t start) {
+        return float(double(bx::getHPCounter() - start) * 1000.0 / double(bx::getHPFrequency()));
+    }
+
+    uint32_t countHandles(const GpuLedgerStats& stats) {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < GpuResource::Count; ++i) {
+            count += stats.m_handles[i];
+        }
+        return count;
+    }
+
+    bool parseSwitch(const char* value, bool& enabled) {
+        if (0 == bx::strCmpI(value, "on") || 0 == bx::strCmp(value, "1") || 0 == bx::strCmpI(value, "true")) {
+            enabled = true;
+            return true;
+        }
+        if (0 == bx::strCmpI(value, "off") || 0 == bx::strCmp(value, "0") || 0 == bx::strCmpI(value, "false")) {
+            enabled = false;
+            return true;
+        }
+        return false;
+    }
+
+    const char* const kTerrainUsage =
+        "Usage: terrain subdivision <level> | pixel <length> | subtexel <levels>\n"
+        "             | cull <on|off> | freeze <on|off> | sort <on|off>\n"
+        "             | sortcheck <on|off> | dataset <index>\n";
+
+    // Prints the usage for a setting or value it doesn't know
+    int cmdTerrain(CmdContext* /*context*/, void* userData, int argc, char const* const* argv) {
+        HeightmapRenderer* renderer = (HeightmapRenderer*)userData;
+        if (argc != 3) {
+            printf("%s", kTerrainUsage);
+            return 1;
+        }
+
+        const char* setting = argv[1];
+        const char* value = argv[2];
+        int32_t number;
+        float length;
+        bool enabled;
+        if (0 == bx::strCmp(setting, "subdivision") && bx::fromString(&number, value) && number >= 0) {
+            renderer->setGpuSubdivision(number);
+            return 0;
+        }
+        if (0 == bx::strCmp(setting, "pixel") && bx::fromString(&length, value) && length > 0.0f) {
+            renderer->setPrimitivePixelLength(length);
+            return 0;
+        }
+        // Negative levels lift the texel density bound
+        if (0 == bx::strCmp(setting, "subtexel") && bx::fromString(&number, value)) {
+            renderer->setMaxSubTexelLevels(number);
+            return 0;
+        }
+        if (0 == bx::strCmp(setting, "cull") && parseSwitch(value, enabled)) {
+            renderer->setCulling(enabled);
+            return 0;
+        }
+        if (0 == bx::strCmp(setting, "freeze") && parseSwitch(value, enabled)) {
+            renderer->setFreeze(enabled);
+            return 0;
+        }
+        if (0 == bx::strCmp(setting, "sort") && parseSwitch(value, enabled)) {
+            renderer->setSortCulledKeys(enabled);
+            return 0;
+        }
+        if (0 == bx::strCmp(setting, "sortcheck") && parseSwitch(value, enabled)) {
+            renderer->setSortCheck(enabled);
+            return 0;
+        }
+        if (0 == bx::strCmp(setting, "dataset") && bx::fromString(&number, value)) {
+            // Selecting the dataset already shown keeps it, as the UI does
+            if (number == renderer->getSelectedHeightmap() || renderer->loadHeightmap(number)) {
+                return 0;
+            }
+            printf("No dataset %d, there are %d\n", number, renderer->getDatasetCount());
+            return 1;
+        }
+        printf("%s", kTerrainUsage);
+        return 1;
+    }
+} // namespace
 
 HeightmapRenderer::HeightmapRenderer()
     : m_dmap(nullptr)
@@ -19,6 +124,12 @@ HeightmapRenderer::HeightmapRenderer()
     , m_selectedDiffuse(0)
     , m_shading(types::PROGRAM_TERRAIN)
     , m_pingPong(0)
+    , m_maxSubTexelLevels(2)
+    , m_frameNumber(0)
+    , m_dmapStreamBudget(DmapStream::DEFAULT_BUDGET_MB)
+    , m_diffuseFormat(bimg::TextureFormat::BC1)
+    , m_time(0.0f)
+    , m_prefetchHorizon(DEFAULT_PREFETCH_SECONDS)
     , m_terrainAspectRatio(1.0f)
     , m_primitivePixelLengthTarget(1.0f)
     , m_fovy(60.0f)
@@ -26,14 +137,20 @@ HeightmapRenderer::HeightmapRenderer()
     , m_wireframe(false)
     , m_cull(true)
     , m_freeze(false)
+    , m_sortCulled(false)
+    , m_sortCheck(false)
     , m_useGpuSmap(true)
     , m_texturesNeedReload(false)
     , m_loadStartTime(0)
     , m_firstFrameRendered(false)
     , m_loadTime(0.0f)
+    , m_loadKind(types::LOAD_COLD)
     , m_cpuSmapGenTime(0.0f)
     , m_gpuSmapGenTime(0.0f)
-    , m_loadHistoryCount(0)
+    , m_texturesLoadedTime(0)
+    , m_gpuReloadPending(false)
+    , m_gpuBytesBeforeReload(0)
+    , m_gpuHandlesBeforeReload(0)
 {
     // Initialize invalid handles
     for (uint32_t i = 0; i < types::PROGRAM_COUNT; ++i) {
@@ -53,16 +170,36 @@ HeightmapRenderer::HeightmapRenderer()
     m_bufferSubd[1] = BGFX_INVALID_HANDLE;
     m_bufferCulledSubd = BGFX_INVALID_HANDLE;
     m_bufferCounter = BGFX_INVALID_HANDLE;
+    m_bufferSortedSubd = BGFX_INVALID_HANDLE;
+    m_bufferSortHistogram = BGFX_INVALID_HANDLE;
     m_geometryIndices = BGFX_INVALID_HANDLE;
     m_geometryVertices = BGFX_INVALID_HANDLE;
     m_instancedGeometryIndices = BGFX_INVALID_HANDLE;
     m_instancedGeometryVertices = BGFX_INVALID_HANDLE;
     m_dispatchIndirect = BGFX_INVALID_HANDLE;
     m_smapParamsHandle = BGFX_INVALID_HANDLE;
+    m_counterImage = BGFX_INVALID_HANDLE;
+    for (uint32_t i = 0; i < COUNTER_READBACKS; ++i) {
+        m_counterReadbacks[i].texture = BGFX_INVALID_HANDLE;
+        m_counterReadbacks[i].readyFrame = 0;
+    }
+    bx::memSet(&m_frameStats, 0, sizeof(m_frameStats));
+    m_sortCheckImage = BGFX_INVALID_HANDLE;
+    m_sortCheckReadback = BGFX_INVALID_HANDLE;
+    m_sortCheckData = nullptr;
+    m_sortCheckReadyFrame = 0;
+    m_sortCheckStats = { 0, 0, 0 };
+
+    m_gpuReloadDelta = { 0, 0, 0 };
+
+    for (uint32_t i = 0; i < types::LOAD_PHASE_COUNT; ++i) {
+        m_loadPhases[i] = 0.0f;
+    }
 
     // Initialize paths
     m_heightmapPath[0] = '\0';
     m_diffuseTexturePath[0] = '\0';
+    m_loadHistoryPath[0] = '\0';
 }
 
 HeightmapRenderer::~HeightmapRenderer() {
@@ -75,7 +212,12 @@ bool HeightmapRenderer::init(uint32_t width, uint32_t height) {
     m_loadStartTime = bx::getHPCounter();
     m_firstFrameRendered = false;
 
-    // Initialize texture options
+    // Initialize dataset catalog, compressing diffuse textures if supported
+    const bgfx::Caps* caps = bgfx::getCaps();
+    const bool blocksSupported = m_diffuseFormat != bimg::TextureFormat::Count
+        && 0 != (caps->formats[m_diffuseFormat] & BGFX_CAPS_FORMAT_TEXTURE_2D);
+    m_catalog.setDiffuseFormat(blocksSupported ? m_diffuseFormat : bimg::TextureFormat::Count);
+    m_catalog.init();
     initTextureOptions();
 
     // Set default selections
@@ -93,9 +235,17 @@ bool HeightmapRenderer::init(uint32_t width, uint32_t height) {
         loadTextures();
         loadBuffers();
         createAtomicCounters();
+        createCounterReadbacks();
+
+        for (uint32_t i = 0; i < types::VIEW_COUNT; ++i) {
+            bgfx::setViewName(bgfx::ViewId(i), kViewNames[i]);
+        }
+        bgfx::setViewClear(types::VIEW_RENDER, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x303030ff, 1.0f, 0);
 
-        m_dispatchIndirect = bgfx::createIndirectBuffer(2);
+        // [0] draw, [1] LOD dispatch, [2] per-culled-key dispatch
+        m_dispatchIndirect = gpuCreateIndirectBuffer("terrain", 3);
 
+        cmdAdd("terrain", cmdTerrain, this);
         return true;
     }
     catch (...) {
@@ -105,47 +255,64 @@ bool HeightmapRenderer::init(uint32_t width, uint32_t height) {
 }
 
 void HeightmapRenderer::shutdown() {
+    cmdRemove("terrain");
     m_uniforms.destroy();
 
     if (bgfx::isValid(m_bufferCounter)) {
-        bgfx::destroy(m_bufferCounter);
+        gpuDestroy(m_bufferCounter);
         m_bufferCounter = BGFX_INVALID_HANDLE;
     }
 
+    if (bgfx::isValid(m_counterImage)) {
+        gpuDestroy(m_counterImage);
+        m_counterImage = BGFX_INVALID_HANDLE;
+    }
+    for (uint32_t i = 0; i < COUNTER_READBACKS; ++i) {
+        if (bgfx::isValid(m_counterReadbacks[i].texture)) {
+            gpuDestroy(m_counterReadbacks[i].texture);
+            m_counterReadbacks[i].texture = BGFX_INVALID_HANDLE;
+        }
+        m_counterReadbacks[i].readyFrame = 0;
+    }
+    m_frameStats.countersValid = false;
+    destroySortCheck();
+
     if (bgfx::isValid(m_bufferCulledSubd)) {
-        bgfx::destroy(m_bufferCulledSubd);
+        gpuDestroy(m_bufferCulledSubd);
         m_bufferCulledSubd = BGFX_INVALID_HANDLE;
     }
 
+    destroySortBuffers();
+
     for (int i = 0; i < 2; ++i) {
         if (bgfx::isValid(m_bufferSubd[i])) {
-            bgfx::destroy(m_bufferSubd[i]);
+            gpuDestroy(m_bufferSubd[i]);
             m_bufferSubd[i] = BGFX_INVALID_HANDLE;
         }
     }
 
     if (bgfx::isValid(m_dispatchIndirect)) {
-        bgfx::destroy(m_dispatchIndirect);
+        gpuDestroy(m_dispatchIndirect);
         m_dispatchIndirect = BGFX_INVALID_HANDLE;
     }
 
     if (bgfx::isValid(m_geometryIndices)) {
-        bgfx::destroy(m_geometryIndices);
+        gpuDestroy(m_geometryIndices);
         m_geometryIndices = BGFX_INVALID_HANDLE;
     }
 
     if (bgfx::isValid(m_geometryVertices)) {
-        bgfx::destroy(m_geometryVertices);
+        gpuDestroy(m_geometryVertices);
         m_geometryVertices = BGFX_INVALID_HANDLE;
     }
 
     if (bgfx::isValid(m_instancedGeometryIndices)) {
-        bgfx::destroy(m_instancedGeometryIndices);
+        gpuDestroy(m_instancedGeometryIndices);
         m_instancedGeometryIndices = BGFX_INVALID_HANDLE;
     }
 
     if (bgfx::isValid(m_instancedGeometryVertices)) {
-        bgfx::destroy(m_instancedGeometryVertices);
+        gpuDestroy(m_instancedGeometryVertices);
         m_instancedGeometryVertices = BGFX_INVALID_HANDLE;
     }
 
@@ -177,49 +344,41 @@ void HeightmapRenderer::shutdown() {
 
     for (uint32_t i = 0; i < types::TEXTURE_COUNT; ++i) {
         if (bgfx::isValid(m_textures[i])) {
-            bgfx::destroy(m_textures[i]);
+            gpuDestroy(m_textures[i]);
             m_textures[i] = BGFX_INVALID_HANDLE;
         }
     }
 
-    if (m_dmap) {
-        bimg::imageFree(m_dmap);
-        m_dmap = nullptr;
-    }
+    m_vt.shutdown();
+    m_dmapStream.shutdown();
+    m_dmap = nullptr;
+    m_catalog.shutdown();
 }
 
 bool HeightmapRenderer::update(float deltaTime, const entry::MouseState& mouseState) {
+    PROFILER_SCOPE("HeightmapRenderer::update");
+
     // Calculate first frame loading time
     if (!m_firstFrameRendered) {
         int64_t now = bx::getHPCounter();
         m_loadTime = float((now - m_loadStartTime) / double(bx::getHPFrequency()) * 1000.0);
         m_firstFrameRendered = true;
-        printf("Loading time: %.2f ms\n", m_loadTime);
-        
-        // Add to load history
-        if (m_loadHistoryCount < MAX_LOAD_HISTORY) {
-            m_loadHistory[m_loadHistoryCount].loadTimeMs = m_loadTime;
-            m_loadHistory[m_loadHistoryCount].timestamp = now;
-            bx::strCopy(m_loadHistory[m_loadHistoryCount].heightmapName,
-                sizeof(m_loadHistory[m_loadHistoryCount].heightmapName),
-                m_heightmapOptions[m_selectedHeightmap].name);
-            bx::strCopy(m_loadHistory[m_loadHistoryCount].diffuseName,
-                sizeof(m_loadHistory[m_loadHistoryCount].diffuseName),
-                m_diffuseOptions[m_selectedDiffuse].name);
-            m_loadHistoryCount++;
-        } else {
-            // Shift array and add new record
-            for (int i = 0; i < MAX_LOAD_HISTORY - 1; i++) {
-                m_loadHistory[i] = m_loadHistory[i + 1];
-            }
-            m_loadHistory[MAX_LOAD_HISTORY - 1].loadTimeMs = m_loadTime;
-            m_loadHistory[MAX_LOAD_HISTORY - 1].timestamp = now;
-            bx::strCopy(m_loadHistory[MAX_LOAD_HISTORY - 1].heightmapName,
-                sizeof(m_loadHistory[MAX_LOAD_HISTORY - 1].heightmapName),
-                m_heightmapOptions[m_selectedHeightmap].name);
-            bx::strCopy(m_loadHistory[MAX_LOAD_HISTORY - 1].diffuseName,
-                sizeof(m_loadHistory[MAX_LOAD_HISTORY - 1].diffuseName),
-                m_diffuseOptions[m_selectedDiffuse].name);
+        m_loadPhases[types::LOAD_PHASE_FIRST_FRAME] = float((now - m_texturesLoadedTime) / double(bx::getHPFrequency()) * 1000.0);
+        printf("Loading time: %.2f ms (%s)\n", m_loadTime, getLoadKindName(m_loadKind));
+
+        LoadTimeRecord record;
+        record.loadTimeMs = m_loadTime;
+        for (uint32_t i = 0; i < types::LOAD_PHASE_COUNT; ++i) {
+            record.phaseMs[i] = m_loadPhases[i];
+        }
+        record.kind = m_loadKind;
+        record.timestamp = int64_t(time(nullptr));
+        bx::strCopy(record.heightmapName, sizeof(record.heightmapName), m_catalog.get(m_selectedHeightmap).name);
+        bx::strCopy(record.diffuseName, sizeof(record.diffuseName), m_catalog.get(m_selectedDiffuse).name);
+        m_loadHistory.push(record);
+
+        if (m_loadHistoryPath[0] != '\0' && !loadhistory::append(m_loadHistoryPath, record)) {
+            printf("Failed to append to load history %s\n", m_loadHistoryPath);
         }
     }
 
@@ -232,29 +391,28 @@ bool HeightmapRenderer::update(float deltaTime, const entry::MouseState& mouseSt
         // Update DMap path
         m_dmapConfig.pathToFile = bx::FilePath(m_heightmapPath);
 
+        const GpuLedgerStats before = gpuLedgerGetTotal();
+        m_gpuBytesBeforeReload = before.m_bytes;
+        m_gpuHandlesBeforeReload = countHandles(before);
+        m_gpuReloadPending = true;
+
         // Clean up old textures
         for (uint32_t i = 0; i < types::TEXTURE_COUNT; ++i) {
             if (bgfx::isValid(m_textures[i])) {
-                bgfx::destroy(m_textures[i]);
+                gpuDestroy(m_textures[i]);
                 m_textures[i] = BGFX_INVALID_HANDLE;
             }
         }
 
         // Reload textures
-        loadDmapTexture();
-        if (m_useGpuSmap) {
-            loadSmapTextureGPU();
-        } else {
-            loadSmapTexture();
-        }
-        loadDiffuseTexture();
+        loadTextures();
 
         // Update geometry
         if (bgfx::isValid(m_geometryVertices)) {
-            bgfx::destroy(m_geometryVertices);
+            gpuDestroy(m_geometryVertices);
         }
         if (bgfx::isValid(m_geometryIndices)) {
-            bgfx::destroy(m_geometryIndices);
+            gpuDestroy(m_geometryIndices);
         }
         loadGeometryBuffers();
 
@@ -271,13 +429,62 @@ bool HeightmapRenderer::update(float deltaTime, const entry::MouseState& mouseSt
     bx::mtxProj(projMtx, m_fovy, float(m_width) / float(m_height), 0.0001f, 2000.0f, bgfx::getCaps()->homogeneousDepth);
 
     // Set view transforms
-    bgfx::setViewTransform(0, viewMtx, projMtx);
-    bgfx::setViewRect(1, 0, 0, uint16_t(m_width), uint16_t(m_height));
-    bgfx::setViewTransform(1, viewMtx, projMtx);
+    bgfx::setViewTransform(types::VIEW_LOD, viewMtx, projMtx);
+    bgfx::setViewRect(types::VIEW_RENDER, 0, 0, uint16_t(m_width), uint16_t(m_height));
+    bgfx::setViewTransform(types::VIEW_RENDER, viewMtx, projMtx);
+
+    // Streamed tiles follow the camera and are prefetched where it is
+    // heading. The terrain quad is rotated into the xz plane, see
+    // renderTerrain(), so terrain space is (x, -z, y) of world space.
+    const bx::Vec3 eye = cameraGetPosition();
+    const bx::Vec3 at = cameraGetAt();
+    const float eyeWorld[3] = { eye.x, eye.y, eye.z };
+    const float atWorld[3] = { at.x, at.y, at.z };
+    m_time += deltaTime;
+    m_cameraPredictor.addSample(m_time, eyeWorld, atWorld);
+    if (m_dmapStream.isValid() || m_vt.isValid()) {
+        PROFILER_SCOPE("streaming");
+        CameraPredictor::Forecast forecasts[PREFETCH_FORECASTS];
+        const uint32_t numForecasts = m_cameraPredictor.forecast(m_prefetchHorizon, PREFETCH_FORECASTS, forecasts);
+        for (uint32_t i = 0; i < numForecasts; ++i) {
+            const CameraPredictor::Forecast world = forecasts[i];
+            forecasts[i].position[1] = -world.position[2];
+            forecasts[i].position[2] = world.position[1];
+            forecasts[i].direction[1] = -world.direction[2];
+            forecasts[i].direction[2] = world.direction[1];
+        }
+
+        const float camera[3] = { eye.x, -eye.z, eye.y };
+        vt::TerrainView view;
+        view.halfWidth = m_terrainAspectRatio;
+        view.halfHeight = 1.0f;
+        view.heightScale = m_dmapConfig.scale;
+        view.lodFactor = 2.0f * bx::tan(bx::toRad(m_fovy) / 2.0f) / float(m_height);
+        m_dmapStream.update(camera, forecasts, numForecasts, view, m_frameNumber);
+        m_vt.prefetch(forecasts, numForecasts, view);
+    }
+    m_dmapStream.getShaderParams(m_uniforms.dmapStreamParams);
+
+    // Virtual texture feedback and its readback blit have views of their own
+    if (m_vt.isValid()) {
+        m_vt.update(m_frameNumber);
+        m_vt.setupViews(types::VIEW_VT_FEEDBACK, types::VIEW_VT_READBACK, viewMtx, projMtx);
+    }
+    readCounters();
+    readSortCheck();
 
     // Render terrain
     renderTerrain(viewMtx, projMtx);
 
+    // Subdivision buffers are recreated by the first frame after a reload
+    if (m_gpuReloadPending) {
+        m_gpuReloadPending = false;
+        const GpuLedgerStats after = gpuLedgerGetTotal();
+        m_gpuReloadDelta.bytes = int64_t(after.m_bytes) - int64_t(m_gpuBytesBeforeReload);
+        m_gpuReloadDelta.handles = int32_t(countHandles(after)) - int32_t(m_gpuHandlesBeforeReload);
+        ++m_gpuReloadDelta.reloads;
+    }
+
     return true;
 }
 
@@ -288,8 +495,15 @@ void HeightmapRenderer::setGpuSubdivision(int level) {
     }
 }
 
+void HeightmapRenderer::setSortCulledKeys(bool enabled) {
+    if (enabled != m_sortCulled) {
+        m_sortCulled = enabled;
+        m_restart = true;
+    }
+}
+
 bool HeightmapRenderer::loadHeightmap(int index) {
-    if (index >= 0 && index < MAX_HEIGHTMAP_OPTIONS) {
+    if (index >= 0 && index < m_catalog.getCount()) {
         m_selectedHeightmap = index;
         m_selectedDiffuse = index; // Keep them in sync
         updateTexturePaths();
@@ -300,7 +514,7 @@ bool HeightmapRenderer::loadHeightmap(int index) {
 }
 
 bool HeightmapRenderer::loadDiffuseTexture(int index) {
-    if (index >= 0 && index < MAX_DIFFUSE_OPTIONS) {
+    if (index >= 0 && index < m_catalog.getCount()) {
         m_selectedDiffuse = index;
         updateTexturePaths();
         m_texturesNeedReload = true;
@@ -313,10 +527,20 @@ void HeightmapRenderer::reloadTextures() {
     m_texturesNeedReload = true;
 }
 
+const char* HeightmapRenderer::getLoadKindName(int kind) {
+    return loadhistory::getKindName(kind);
+}
+
+void HeightmapRenderer::setLoadHistoryPath(const char* path) {
+    bx::strCopy(m_loadHistoryPath, sizeof(m_loadHistoryPath), path ? path : "");
+}
+
 void HeightmapRenderer::loadPrograms() {
     m_samplers[types::TERRAIN_DMAP_SAMPLER] = bgfx::createUniform("u_DmapSampler", bgfx::UniformType::Sampler);
     m_samplers[types::TERRAIN_SMAP_SAMPLER] = bgfx::createUniform("u_SmapSampler", bgfx::UniformType::Sampler);
     m_samplers[types::TERRAIN_DIFFUSE_SAMPLER] = bgfx::createUniform("u_DiffuseSampler", bgfx::UniformType::Sampler);
+    m_samplers[types::TERRAIN_DMAP_INDIRECTION_SAMPLER] = bgfx::createUniform("u_DmapIndirectionSampler", bgfx::UniformType::Sampler);
+    m_samplers[types::TERRAIN_DMAP_CACHE_SAMPLER] = bgfx::createUniform("u_DmapCacheSampler", bgfx::UniformType::Sampler);
 
     m_uniforms.init();
 
@@ -328,11 +552,31 @@ void HeightmapRenderer::loadPrograms() {
     m_programsCompute[types::PROGRAM_UPDATE_DRAW] = bgfx::createProgram(loadShader("cs_terrain_update_draw"), true);
     m_programsCompute[types::PROGRAM_INIT_INDIRECT] = bgfx::createProgram(loadShader("cs_terrain_init"), true);
     m_programsCompute[types::PROGRAM_GENERATE_SMAP] = bgfx::createProgram(loadShader("cs_generate_smap"), true);
+    m_programsCompute[types::PROGRAM_SORT_HISTOGRAM] = bgfx::createProgram(loadShader("cs_terrain_sort_histogram"), true);
+    m_programsCompute[types::PROGRAM_SORT_SCAN] = bgfx::createProgram(loadShader("cs_terrain_sort_scan"), true);
+    m_programsCompute[types::PROGRAM_SORT_SCATTER] = bgfx::createProgram(loadShader("cs_terrain_sort_scatter"), true);
+    m_programsCompute[types::PROGRAM_COPY_COUNTERS] = bgfx::createProgram(loadShader("cs_terrain_counters"), true);
+    m_programsCompute[types::PROGRAM_SORT_CHECK] = bgfx::createProgram(loadShader("cs_terrain_sort_check"), true);
     
     m_smapParamsHandle = bgfx::createUniform("u_smapParams", bgfx::UniformType::Vec4);
 }
 
 void HeightmapRenderer::loadTextures() {
+    PROFILER_SCOPE("loadTextures");
+
+    // Pin the selection before acquiring so nothing it needs gets evicted
+    m_catalog.setActive(m_selectedHeightmap, m_selectedDiffuse);
+    m_catalog.setCacheSlopeMaps(!m_useGpuSmap);
+    const bool resident = m_catalog.isResident(m_selectedHeightmap)
+        && m_catalog.isResident(m_selectedDiffuse);
+
+    // The catalog times what it loads, the texture loads below time the
+    // uploads and the GPU slope map
+    m_catalog.takeLoadTimes();
+    for (uint32_t i = 0; i < types::LOAD_PHASE_COUNT; ++i) {
+        m_loadPhases[i] = 0.0f;
+    }
+
     loadDmapTexture();
     if (m_useGpuSmap) {
         loadSmapTextureGPU();
@@ -340,6 +584,26 @@ void HeightmapRenderer::loadTextures() {
         loadSmapTexture();
     }
     loadDiffuseTexture();
+
+    if (resident) {
+        m_loadKind = types::LOAD_RESIDENT;
+    } else if (m_catalog.isBaked(m_selectedHeightmap) && m_catalog.isBaked(m_selectedDiffuse)) {
+        m_loadKind = types::LOAD_WARM;
+    } else {
+        m_loadKind = types::LOAD_COLD;
+    }
+
+    const DatasetCatalog::LoadTimes times = m_catalog.takeLoadTimes();
+    m_loadPhases[types::LOAD_PHASE_IO] += times.ioMs;
+    m_loadPhases[types::LOAD_PHASE_DECODE] += times.decodeMs;
+    m_loadPhases[types::LOAD_PHASE_CONVERT] += times.convertMs;
+    m_loadPhases[types::LOAD_PHASE_SMAP] += times.smapMs;
+    m_texturesLoadedTime = bx::getHPCounter();
+
+    // Cycling through the list is the common case, decode the next one now
+    if (m_catalog.getCount() > 1) {
+        m_catalog.prefetch((m_selectedHeightmap + 1) % m_catalog.getCount());
+    }
 }
 
 void HeightmapRenderer::loadBuffers() {
@@ -349,33 +613,72 @@ void HeightmapRenderer::loadBuffers() {
 }
 
 void HeightmapRenderer::createAtomicCounters() {
-    m_bufferCounter = bgfx::createDynamicIndexBuffer(3, BGFX_BUFFER_INDEX32 | BGFX_BUFFER_COMPUTE_READ_WRITE);
+    m_bufferCounter = gpuCreateDynamicIndexBuffer("terrain", 3, BGFX_BUFFER_INDEX32 | BGFX_BUFFER_COMPUTE_READ_WRITE);
+}
+
+void HeightmapRenderer::createCounterReadbacks() {
+    // bgfx reads back textures only, the counters are copied into an image
+    // and blitted from there
+    const bgfx::Caps* caps = bgfx::getCaps();
+    if (0 == (caps->supported & BGFX_CAPS_TEXTURE_BLIT)
+        || 0 == (caps->supported & BGFX_CAPS_TEXTURE_READ_BACK)
+        || 0 == (caps->formats[bgfx::TextureFormat::R32U] & BGFX_CAPS_FORMAT_TEXTURE_IMAGE_WRITE)) {
+        return;
+    }
+
+    m_counterImage = gpuCreateTexture2D("terrain counters",
+        3, 1, false, 1, bgfx::TextureFormat::R32U, BGFX_TEXTURE_COMPUTE_WRITE);
+    for (uint32_t i = 0; i < COUNTER_READBACKS; ++i) {
+        m_counterReadbacks[i].texture = gpuCreateTexture2D("terrain counters",
+            3, 1, false, 1, bgfx::TextureFormat::R32U,
+            BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK | BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+        m_counterReadbacks[i].readyFrame = 0;
+    }
 }
 
 void HeightmapRenderer::initTextureOptions() {
-    m_heightmapOptions[0] = { "0049", "textures/0049_16bit.png" };
-    m_heightmapOptions[1] = { "1972", "textures/1972_16bit.png" };
+    if (m_catalog.loadManifest("textures/datasets.txt") > 0) {
+        return;
+    }
+
+    if (m_catalog.scanDirectory("textures/") > 0) {
+        return;
+    }
 
-    m_diffuseOptions[0] = { "0049", "textures/0049.jpg" };
-    m_diffuseOptions[1] = { "1972", "textures/1972.png" };
+    m_catalog.addDataset("0049", "textures/0049_16bit.png", "textures/0049.jpg");
+    m_catalog.addDataset("1972", "textures/1972_16bit.png", "textures/1972.png");
 }
 
 void HeightmapRenderer::loadDmapTexture() {
-    m_dmap = imageLoad(m_dmapConfig.pathToFile.getCPtr(), bgfx::TextureFormat::R16);
+    PROFILER_SCOPE("loadDmapTexture");
+
+    // A tile pyramid is streamed around the camera, the texture below is
+    // then only a placeholder for the unused sampler
+    m_dmapStream.shutdown();
+    if (vt::isPyramidPath(m_heightmapPath)) {
+        m_dmap = nullptr;
+        m_dmapStream.init(m_heightmapPath, m_dmapStreamBudget);
+    } else {
+        m_dmap = m_catalog.acquireHeightmap(m_selectedHeightmap);
+    }
 
     if (!m_dmap) {
-        printf("Failed to load heightmap: %s\n", m_dmapConfig.pathToFile.getCPtr());
+        if (!m_dmapStream.isValid()) {
+            printf("Failed to load heightmap: %s\n", m_dmapConfig.pathToFile.getCPtr());
+        }
 
         const bgfx::Memory* mem = bgfx::alloc(sizeof(uint16_t));
         uint16_t* defaultHeightData = (uint16_t*)mem->data;
         *defaultHeightData = 0;
 
-        m_textures[types::TEXTURE_DMAP] = bgfx::createTexture2D(
+        m_textures[types::TEXTURE_DMAP] = gpuCreateTexture2D("dmap",
             1, 1, false, 1, bgfx::TextureFormat::R16,
             BGFX_TEXTURE_NONE, mem
         );
 
-        m_terrainAspectRatio = 1.0f;
+        m_terrainAspectRatio = m_dmapStream.isValid()
+            ? float(m_dmapStream.getInfo().width) / float(m_dmapStream.getInfo().height)
+            : 1.0f;
         return;
     }
 
@@ -385,18 +688,23 @@ void HeightmapRenderer::loadDmapTexture() {
         m_terrainAspectRatio = 1.0f;
     }
 
-    m_textures[types::TEXTURE_DMAP] = bgfx::createTexture2D(
+    // Copied, the cached image may be evicted before the upload happens.
+    // bgfx uploads on its render thread, the copy is what the load pays.
+    const int64_t uploadStart = bx::getHPCounter();
+    m_textures[types::TEXTURE_DMAP] = gpuCreateTexture2D("dmap",
         (uint16_t)m_dmap->m_width,
         (uint16_t)m_dmap->m_height,
         false,
         1,
         bgfx::TextureFormat::R16,
         BGFX_TEXTURE_NONE,
-        bgfx::makeRef(m_dmap->m_data, m_dmap->m_size)
+        bgfx::copy(m_dmap->m_data, m_dmap->m_size)
     );
+    m_loadPhases[types::LOAD_PHASE_UPLOAD] += msSince(uploadStart);
 }
 
 void HeightmapRenderer::loadSmapTexture() {
+    PROFILER_SCOPE("loadSmapTexture");
     int64_t startTime = bx::getHPCounter();
     
     if (!m_dmap || m_dmap->m_width == 0 || m_dmap->m_height == 0) {
@@ -405,7 +713,7 @@ void HeightmapRenderer::loadSmapTexture() {
         defaultSlopeData[0] = 0.0f;
         defaultSlopeData[1] = 0.0f;
 
-        m_textures[types::TEXTURE_SMAP] = bgfx::createTexture2D(
+        m_textures[types::TEXTURE_SMAP] = gpuCreateTexture2D("smap",
             1, 1, false, 1, bgfx::TextureFormat::RG32F,
             BGFX_TEXTURE_NONE, mem
         );
@@ -415,38 +723,18 @@ void HeightmapRenderer::loadSmapTexture() {
 
     int w = m_dmap->m_width;
     int h = m_dmap->m_height;
-    const uint16_t* texels = (const uint16_t*)m_dmap->m_data;
     int mipcnt = m_dmap->m_numMips;
 
-    const bgfx::Memory* mem = bgfx::alloc(w * h * 2 * sizeof(float));
-    float* smap = (float*)mem->data;
-
-    for (int j = 0; j < h; ++j) {
-        for (int i = 0; i < w; ++i) {
-            int i1 = bx::max(0, i - 1);
-            int i2 = bx::min(w - 1, i + 1);
-            int j1 = bx::max(0, j - 1);
-            int j2 = bx::min(h - 1, j + 1);
-            uint16_t px_l = texels[i1 + w * j];
-            uint16_t px_r = texels[i2 + w * j];
-            uint16_t px_b = texels[i + w * j1];
-            uint16_t px_t = texels[i + w * j2];
-            float z_l = (float)px_l / 65535.0f;
-            float z_r = (float)px_r / 65535.0f;
-            float z_b = (float)px_b / 65535.0f;
-            float z_t = (float)px_t / 65535.0f;
-            float slope_x = (float)w * 0.5f * (z_r - z_l);
-            float slope_y = (float)h * 0.5f * (z_t - z_b);
+    // Generated on first use, then served from the catalog
+    const float* smap = m_catalog.acquireSlopeMap(m_selectedHeightmap);
+    const int64_t uploadStart = bx::getHPCounter();
+    const bgfx::Memory* mem = bgfx::copy(smap, w * h * 2 * sizeof(float));
 
-            smap[2 * (i + w * j)] = slope_x;
-            smap[1 + 2 * (i + w * j)] = slope_y;
-        }
-    }
-
-    m_textures[types::TEXTURE_SMAP] = bgfx::createTexture2D(
+    m_textures[types::TEXTURE_SMAP] = gpuCreateTexture2D("smap",
         (uint16_t)w, (uint16_t)h, mipcnt > 1, 1, bgfx::TextureFormat::RG32F,
         BGFX_TEXTURE_NONE, mem
     );
+    m_loadPhases[types::LOAD_PHASE_UPLOAD] += msSince(uploadStart);
 
     int64_t endTime = bx::getHPCounter();
     m_cpuSmapGenTime = float((endTime - startTime) / double(bx::getHPFrequency()) * 1000.0);
@@ -454,6 +742,7 @@ void HeightmapRenderer::loadSmapTexture() {
 }
 
 void HeightmapRenderer::loadSmapTextureGPU() {
+    PROFILER_SCOPE("loadSmapTextureGPU");
     int64_t startTime = bx::getHPCounter();
     
     if (!m_dmap || m_dmap->m_width == 0 || m_dmap->m_height == 0) {
@@ -462,7 +751,7 @@ void HeightmapRenderer::loadSmapTextureGPU() {
         defaultSlopeData[0] = 0.0f;
         defaultSlopeData[1] = 0.0f;
 
-        m_textures[types::TEXTURE_SMAP] = bgfx::createTexture2D(
+        m_textures[types::TEXTURE_SMAP] = gpuCreateTexture2D("smap",
             1, 1, false, 1, bgfx::TextureFormat::RG32F,
             BGFX_TEXTURE_NONE, mem
         );
@@ -474,7 +763,7 @@ void HeightmapRenderer::loadSmapTextureGPU() {
     uint16_t h = static_cast<uint16_t>(m_dmap->m_height);
     int mipcnt = m_dmap->m_numMips;
 
-    m_textures[types::TEXTURE_SMAP] = bgfx::createTexture2D(
+    m_textures[types::TEXTURE_SMAP] = gpuCreateTexture2D("smap",
         w, h, mipcnt > 1, 1, bgfx::TextureFormat::RG32F,
         BGFX_TEXTURE_COMPUTE_WRITE
     );
@@ -489,11 +778,12 @@ void HeightmapRenderer::loadSmapTextureGPU() {
 
     uint16_t groupsX = (w + 15) / 16;
     uint16_t groupsY = (h + 15) / 16;
-    bgfx::dispatch(0, m_programsCompute[types::PROGRAM_GENERATE_SMAP], groupsX, groupsY, 1);
+    bgfx::dispatch(types::VIEW_SMAP, m_programsCompute[types::PROGRAM_GENERATE_SMAP], groupsX, groupsY, 1);
     bgfx::frame();
 
     int64_t endTime = bx::getHPCounter();
     m_gpuSmapGenTime = float((endTime - startTime) / double(bx::getHPFrequency()) * 1000.0);
+    m_loadPhases[types::LOAD_PHASE_SMAP] += m_gpuSmapGenTime;
     printf("GPU SMap generation time: %.2f ms (for %dx%d heightmap)\n", m_gpuSmapGenTime, w, h);
 
     if (m_cpuSmapGenTime > 0.0f) {
@@ -503,11 +793,34 @@ void HeightmapRenderer::loadSmapTextureGPU() {
 }
 
 void HeightmapRenderer::loadDiffuseTexture() {
+    PROFILER_SCOPE("loadDiffuseTexture");
     const char* filePath = m_diffuseTexturePath;
     uint64_t textureFlags = BGFX_TEXTURE_NONE | BGFX_SAMPLER_UVW_BORDER
         | BGFX_SAMPLER_MIN_ANISOTROPIC | BGFX_SAMPLER_MAG_ANISOTROPIC | BGFX_SAMPLER_MIP_SHIFT;
 
-    m_textures[types::TEXTURE_DIFFUSE] = loadTexture(filePath, textureFlags);
+    // A tile pyramid streams through the virtual texture, the diffuse
+    // texture below is then only the placeholder for the normal shading
+    m_vt.shutdown();
+    if (vt::isPyramidPath(filePath)) {
+        m_vt.init(filePath, m_width, m_height);
+    }
+
+    const bimg::ImageContainer* image = m_vt.isValid() ? nullptr : m_catalog.acquireDiffuse(m_selectedDiffuse);
+    if (image && !image->m_cubeMap && image->m_depth <= 1
+        && bgfx::isTextureValid(0, false, image->m_numLayers, bgfx::TextureFormat::Enum(image->m_format), textureFlags)) {
+        const int64_t uploadStart = bx::getHPCounter();
+        m_textures[types::TEXTURE_DIFFUSE] = gpuCreateTexture2D("diffuse",
+            (uint16_t)image->m_width,
+            (uint16_t)image->m_height,
+            image->m_numMips > 1,
+            image->m_numLayers,
+            bgfx::TextureFormat::Enum(image->m_format),
+            textureFlags,
+            bgfx::copy(image->m_data, image->m_size)
+        );
+        bgfx::setName(m_textures[types::TEXTURE_DIFFUSE], filePath);
+        m_loadPhases[types::LOAD_PHASE_UPLOAD] += msSince(uploadStart);
+    }
 
     if (!bgfx::isValid(m_textures[types::TEXTURE_DIFFUSE])) {
         BX_TRACE("Failed to load diffuse texture: %s, using default texture", filePath);
@@ -517,7 +830,7 @@ void HeightmapRenderer::loadDiffuseTexture() {
         data[0] = data[1] = data[2] = 128;
         data[3] = 255;
 
-        m_textures[types::TEXTURE_DIFFUSE] = bgfx::createTexture2D(
+        m_textures[types::TEXTURE_DIFFUSE] = gpuCreateTexture2D("diffuse",
             1, 1, false, 1, bgfx::TextureFormat::RGBA8,
             BGFX_TEXTURE_NONE, mem
         );
@@ -541,13 +854,13 @@ void HeightmapRenderer::loadGeometryBuffers() {
 
     m_geometryLayout.begin().add(bgfx::Attrib::Position, 4, bgfx::AttribType::Float).end();
 
-    m_geometryVertices = bgfx::createVertexBuffer(
+    m_geometryVertices = gpuCreateVertexBuffer("terrain geometry",
         bgfx::copy(vertices, sizeof(vertices)),
         m_geometryLayout,
         BGFX_BUFFER_COMPUTE_READ
     );
     
-    m_geometryIndices = bgfx::createIndexBuffer(
+    m_geometryIndices = gpuCreateIndexBuffer("terrain geometry",
         bgfx::copy(indices, sizeof(indices)),
         BGFX_BUFFER_COMPUTE_READ | BGFX_BUFFER_INDEX32
     );
@@ -589,12 +902,12 @@ void HeightmapRenderer::loadInstancedGeometryBuffers() {
         .add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
         .end();
 
-    m_instancedGeometryVertices = bgfx::createVertexBuffer(
+    m_instancedGeometryVertices = gpuCreateVertexBuffer("terrain geometry",
         bgfx::makeRef(vertices, sizeof(float) * 2 * m_instancedMeshVertexCount),
         m_instancedGeometryLayout
     );
 
-    m_instancedGeometryIndices = bgfx::createIndexBuffer(
+    m_instancedGeometryIndices = gpuCreateIndexBuffer("terrain geometry",
         bgfx::makeRef(indexes, sizeof(uint32_t) * m_instancedMeshPrimitiveCount * 3),
         BGFX_BUFFER_INDEX32
     );
@@ -603,22 +916,50 @@ void HeightmapRenderer::loadInstancedGeometryBuffers() {
 void HeightmapRenderer::loadSubdivisionBuffers() {
     const uint32_t bufferCapacity = 1 << 27;
 
-    m_bufferSubd[types::BUFFER_SUBD] = bgfx::createDynamicIndexBuffer(
+    m_bufferSubd[types::BUFFER_SUBD] = gpuCreateDynamicIndexBuffer("subdivision",
         bufferCapacity,
         BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32
     );
 
-    m_bufferSubd[types::BUFFER_SUBD + 1] = bgfx::createDynamicIndexBuffer(
+    m_bufferSubd[types::BUFFER_SUBD + 1] = gpuCreateDynamicIndexBuffer("subdivision",
         bufferCapacity,
         BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32
     );
 
-    m_bufferCulledSubd = bgfx::createDynamicIndexBuffer(
+    m_bufferCulledSubd = gpuCreateDynamicIndexBuffer("subdivision",
         bufferCapacity,
         BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32
     );
 }
 
+void HeightmapRenderer::loadSortBuffers() {
+    const uint32_t bufferCapacity = 1 << 27;
+
+    m_bufferSortedSubd = gpuCreateDynamicIndexBuffer("key sort",
+        bufferCapacity,
+        BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32
+    );
+
+    // per tile counts of every bucket, bucket-major; the histogram pass
+    // writes all of them, the scan pass turns them into offsets in place
+    m_bufferSortHistogram = gpuCreateDynamicIndexBuffer("key sort",
+        lebsort::kBucketCount * lebsort::kSortTiles,
+        BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32
+    );
+}
+
+void HeightmapRenderer::destroySortBuffers() {
+    if (bgfx::isValid(m_bufferSortedSubd)) {
+        gpuDestroy(m_bufferSortedSubd);
+        m_bufferSortedSubd = BGFX_INVALID_HANDLE;
+    }
+
+    if (bgfx::isValid(m_bufferSortHistogram)) {
+        gpuDestroy(m_bufferSortHistogram);
+        m_bufferSortHistogram = BGFX_INVALID_HANDLE;
+    }
+}
+
 void HeightmapRenderer::configureUniforms() {
     float lodFactor = 2.0f * bx::tan(bx::toRad(m_fovy) / 2.0f)
         / m_width * (1 << int(m_uniforms.gpuSubd))
@@ -630,18 +971,45 @@ void HeightmapRenderer::configureUniforms() {
     m_uniforms.freeze = m_freeze ? 1.0f : 0.0f;
     m_uniforms.terrainHalfWidth = m_terrainAspectRatio;
     m_uniforms.terrainHalfHeight = 1.0f;
+    m_uniforms.maxKeyDepth = computeMaxKeyDepth();
+}
+
+float HeightmapRenderer::computeMaxKeyDepth() const {
+    // Each coarse triangle covers half of the 2a x 2 terrain quad (a being
+    // the aspect ratio), i.e. an area of 2a. One bisection halves the
+    // area, and a triangle covering half a texel of an h-texel-tall map
+    // has area 0.5 * (2/h)^2. Reaching it takes log2(a * h^2) bisections.
+    // Each sub-texel level halves the edge length, i.e. two bisections,
+    // and the instanced mesh adds two bisections per gpuSubd level.
+    //
+    // The bound is purely horizontal: u_DmapFactor only scales heights,
+    // which adds no new samples between texels.
+    const uint32_t height = m_dmapStream.isValid() ? m_dmapStream.getInfo().height
+        : m_dmap ? m_dmap->m_height : 0;
+    if (m_maxSubTexelLevels < 0 || height == 0) {
+        return 31.0f;
+    }
+
+    const float h = float(height);
+    const float texelDepth = bx::ceil(bx::log2(m_terrainAspectRatio * h * h));
+    const float depth = texelDepth
+        + 2.0f * float(m_maxSubTexelLevels)
+        - 2.0f * m_uniforms.gpuSubd;
+
+    return bx::clamp(depth, 0.0f, 31.0f);
 }
 
 void HeightmapRenderer::updateTexturePaths() {
     bx::strCopy(m_heightmapPath, sizeof(m_heightmapPath),
-        m_heightmapOptions[m_selectedHeightmap].path);
+        m_catalog.get(m_selectedHeightmap).heightmapPath);
     bx::strCopy(m_diffuseTexturePath, sizeof(m_diffuseTexturePath),
-        m_diffuseOptions[m_selectedDiffuse].path);
+        m_catalog.get(m_selectedDiffuse).diffusePath);
 }
 
 void HeightmapRenderer::renderTerrain(const float* viewMtx, const float* projMtx) {
-    bgfx::touch(0);
-    bgfx::touch(1);
+    PROFILER_SCOPE("renderTerrain");
+
+    bgfx::touch(types::VIEW_RENDER);
 
     float model[16];
     bx::mtxRotateX(model, bx::toRad(90));
@@ -653,38 +1021,44 @@ void HeightmapRenderer::renderTerrain(const float* viewMtx, const float* projMtx
         m_pingPong = 1;
 
         if (bgfx::isValid(m_instancedGeometryVertices)) {
-            bgfx::destroy(m_instancedGeometryVertices);
+            gpuDestroy(m_instancedGeometryVertices);
         }
         if (bgfx::isValid(m_instancedGeometryIndices)) {
-            bgfx::destroy(m_instancedGeometryIndices);
+            gpuDestroy(m_instancedGeometryIndices);
         }
         if (bgfx::isValid(m_bufferSubd[types::BUFFER_SUBD])) {
-            bgfx::destroy(m_bufferSubd[types::BUFFER_SUBD]);
+            gpuDestroy(m_bufferSubd[types::BUFFER_SUBD]);
         }
         if (bgfx::isValid(m_bufferSubd[types::BUFFER_SUBD + 1])) {
-            bgfx::destroy(m_bufferSubd[types::BUFFER_SUBD + 1]);
+            gpuDestroy(m_bufferSubd[types::BUFFER_SUBD + 1]);
         }
         if (bgfx::isValid(m_bufferCulledSubd)) {
-            bgfx::destroy(m_bufferCulledSubd);
+            gpuDestroy(m_bufferCulledSubd);
         }
 
+        destroySortBuffers();
+
         loadInstancedGeometryBuffers();
         loadSubdivisionBuffers();
 
+        if (m_sortCulled) {
+            loadSortBuffers();
+        }
+
         // Initialize indirect
         bgfx::setBuffer(1, m_bufferSubd[m_pingPong], bgfx::Access::ReadWrite);
         bgfx::setBuffer(2, m_bufferCulledSubd, bgfx::Access::ReadWrite);
         bgfx::setBuffer(3, m_dispatchIndirect, bgfx::Access::ReadWrite);
         bgfx::setBuffer(4, m_bufferCounter, bgfx::Access::ReadWrite);
         bgfx::setBuffer(8, m_bufferSubd[1 - m_pingPong], bgfx::Access::ReadWrite);
-        bgfx::dispatch(0, m_programsCompute[types::PROGRAM_INIT_INDIRECT], 1, 1, 1);
+        bgfx::dispatch(types::VIEW_LOD, m_programsCompute[types::PROGRAM_INIT_INDIRECT], 1, 1, 1);
 
         m_restart = false;
     } else {
         // Update batch
         bgfx::setBuffer(3, m_dispatchIndirect, bgfx::Access::ReadWrite);
         bgfx::setBuffer(4, m_bufferCounter, bgfx::Access::ReadWrite);
-        bgfx::dispatch(0, m_programsCompute[types::PROGRAM_UPDATE_INDIRECT], 1, 1, 1);
+        bgfx::dispatch(types::VIEW_LOD, m_programsCompute[types::PROGRAM_UPDATE_INDIRECT], 1, 1, 1);
     }
 
     // Subdivision LOD computation
@@ -695,22 +1069,26 @@ void HeightmapRenderer::renderTerrain(const float* viewMtx, const float* projMtx
     bgfx::setBuffer(7, m_geometryIndices, bgfx::Access::Read);
     bgfx::setBuffer(8, m_bufferSubd[1 - m_pingPong], bgfx::Access::Read);
     bgfx::setTransform(model);
-
-    bgfx::setTexture(0, m_samplers[types::TERRAIN_DMAP_SAMPLER], m_textures[types::TEXTURE_DMAP], 
-        BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
+    bindDmapTextures();
 
     m_uniforms.submit();
-    bgfx::dispatch(0, m_programsCompute[types::PROGRAM_SUBD_CS_LOD], m_dispatchIndirect, 1);
+    bgfx::dispatch(types::VIEW_LOD, m_programsCompute[types::PROGRAM_SUBD_CS_LOD], m_dispatchIndirect, 1);
 
     // Update draw
     bgfx::setBuffer(3, m_dispatchIndirect, bgfx::Access::ReadWrite);
     bgfx::setBuffer(4, m_bufferCounter, bgfx::Access::ReadWrite);
     m_uniforms.submit();
-    bgfx::dispatch(1, m_programsCompute[types::PROGRAM_UPDATE_DRAW], 1, 1, 1);
+    bgfx::dispatch(types::VIEW_UPDATE_DRAW, m_programsCompute[types::PROGRAM_UPDATE_DRAW], 1, 1, 1);
+
+    // Optional ordering of the culled keys
+    bgfx::DynamicIndexBufferHandle drawKeys = m_bufferCulledSubd;
+    if (m_sortCulled) {
+        sortCulledKeys();
+        drawKeys = m_bufferSortedSubd;
+    }
 
     // Render terrain
-    bgfx::setTexture(0, m_samplers[types::TERRAIN_DMAP_SAMPLER], m_textures[types::TEXTURE_DMAP], 
-        BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
+    bindDmapTextures();
     bgfx::setTexture(1, m_samplers[types::TERRAIN_SMAP_SAMPLER], m_textures[types::TEXTURE_SMAP], 
         BGFX_SAMPLER_MIN_ANISOTROPIC | BGFX_SAMPLER_MAG_ANISOTROPIC);
 
@@ -724,16 +1102,286 @@ void HeightmapRenderer::renderTerrain(const float* viewMtx, const float* projMtx
             diffuseSamplerFlags);
     }
 
+    bgfx::ProgramHandle program = m_programsDraw[m_shading];
+    if (m_vt.isValid() && m_shading == types::PROGRAM_TERRAIN) {
+        m_vt.setDrawState();
+        program = m_vt.getDrawProgram();
+    }
+
     bgfx::setTransform(model);
     bgfx::setVertexBuffer(0, m_instancedGeometryVertices);
     bgfx::setIndexBuffer(m_instancedGeometryIndices);
-    bgfx::setBuffer(2, m_bufferCulledSubd, bgfx::Access::Read);
+    bgfx::setBuffer(2, drawKeys, bgfx::Access::Read);
     bgfx::setBuffer(3, m_geometryVertices, bgfx::Access::Read);
     bgfx::setBuffer(4, m_geometryIndices, bgfx::Access::Read);
     bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS);
 
     m_uniforms.submit();
-    bgfx::submit(1, m_programsDraw[m_shading], m_dispatchIndirect);
+    bgfx::submit(types::VIEW_RENDER, program, m_dispatchIndirect);
+
+    // Same draw at feedback resolution, writing the tile id each pixel wants
+    if (m_vt.isValid() && m_vt.wantsFeedback()) {
+        bindDmapTextures();
+        m_vt.setFeedbackState();
+
+        bgfx::setTransform(model);
+        bgfx::setVertexBuffer(0, m_instancedGeometryVertices);
+        bgfx::setIndexBuffer(m_instancedGeometryIndices);
+        bgfx::setBuffer(2, drawKeys, bgfx::Access::Read);
+        bgfx::setBuffer(3, m_geometryVertices, bgfx::Access::Read);
+        bgfx::setBuffer(4, m_geometryIndices, bgfx::Access::Read);
+        bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS);
+
+        m_uniforms.submit();
+        bgfx::submit(types::VIEW_VT_FEEDBACK, m_vt.getFeedbackProgram(), m_dispatchIndirect);
+        m_vt.readFeedback(types::VIEW_VT_READBACK);
+    }
 
+    copyCounters();
+    if (m_sortCheck && m_sortCulled) {
+        copySortCheck();
+    }
     m_pingPong = 1 - m_pingPong;
 }
+
+void HeightmapRenderer::bindDmapTextures() {
+    bgfx::setTexture(0, m_samplers[types::TERRAIN_DMAP_SAMPLER], m_textures[types::TEXTURE_DMAP],
+        BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
+
+    // The streaming samplers are declared by every terrain shader, the
+    // placeholder keeps them bound when nothing streams
+    const bool streamed = m_dmapStream.isValid();
+    bgfx::setTexture(9, m_samplers[types::TERRAIN_DMAP_INDIRECTION_SAMPLER],
+        streamed ? m_dmapStream.getIndirection() : m_textures[types::TEXTURE_DMAP]);
+    bgfx::setTexture(10, m_samplers[types::TERRAIN_DMAP_CACHE_SAMPLER],
+        streamed ? m_dmapStream.getCache() : m_textures[types::TEXTURE_DMAP]);
+}
+
+void HeightmapRenderer::sortCulledKeys() {
+    PROFILER_SCOPE("sortCulledKeys");
+
+    // Stable bucket sort of u_CulledSubdBuffer by keyToSortBucket() so
+    // that neighbouring instances sample neighbouring texels of the dmap.
+    // The keys are split into kSortTiles tiles, one workgroup each. See
+    // lebsort::sortReference() for the CPU equivalent.
+    bgfx::setBuffer(2, m_bufferCulledSubd, bgfx::Access::Read);
+    bgfx::setBuffer(4, m_bufferCounter, bgfx::Access::ReadWrite);
+    bgfx::setBuffer(5, m_bufferSortHistogram, bgfx::Access::ReadWrite);
+    bgfx::dispatch(types::VIEW_SORT, m_programsCompute[types::PROGRAM_SORT_HISTOGRAM], lebsort::kSortTiles, 1, 1);
+
+    bgfx::setBuffer(5, m_bufferSortHistogram, bgfx::Access::ReadWrite);
+    bgfx::dispatch(types::VIEW_SORT, m_programsCompute[types::PROGRAM_SORT_SCAN], 1, 1, 1);
+
+    bgfx::setBuffer(1, m_bufferSortedSubd, bgfx::Access::ReadWrite);
+    bgfx::setBuffer(2, m_bufferCulledSubd, bgfx::Access::Read);
+    bgfx::setBuffer(4, m_bufferCounter, bgfx::Access::ReadWrite);
+    bgfx::setBuffer(5, m_bufferSortHistogram, bgfx::Access::Read);
+    bgfx::dispatch(types::VIEW_SORT, m_programsCompute[types::PROGRAM_SORT_SCATTER], lebsort::kSortTiles, 1, 1);
+}
+
+void HeightmapRenderer::copyCounters() {
+    if (!bgfx::isValid(m_counterImage)) {
+        return;
+    }
+
+    CounterReadback* readback = nullptr;
+    for (uint32_t i = 0; i < COUNTER_READBACKS && readback == nullptr; ++i) {
+        if (m_counterReadbacks[i].readyFrame == 0) {
+            readback = &m_counterReadbacks[i];
+        }
+    }
+    if (readback == nullptr) {
+        return;
+    }
+
+    // After update draw has the frame's final counts
+    bgfx::setBuffer(4, m_bufferCounter, bgfx::Access::Read);
+    bgfx::setImage(0, m_counterImage, 0, bgfx::Access::Write, bgfx::TextureFormat::R32U);
+    bgfx::dispatch(types::VIEW_COUNTERS, m_programsCompute[types::PROGRAM_COPY_COUNTERS], 1, 1, 1);
+
+    bgfx::blit(types::VIEW_COUNTER_READBACK, readback->texture, 0, 0, m_counterImage);
+    readback->readyFrame = bgfx::readTexture(readback->texture, readback->counters);
+    readback->copyFrame = m_frameNumber + 1;
+    readback->trianglesPerInstance = m_instancedMeshPrimitiveCount;
+}
+
+void HeightmapRenderer::readCounters() {
+    // Several can land together after a hitch, the newest wins
+    const CounterReadback* latest = nullptr;
+    for (uint32_t i = 0; i < COUNTER_READBACKS; ++i) {
+        CounterReadback& readback = m_counterReadbacks[i];
+        if (readback.readyFrame != 0 && m_frameNumber >= readback.readyFrame) {
+            if (latest == nullptr || readback.copyFrame > latest->copyFrame) {
+                latest = &readback;
+            }
+            readback.readyFrame = 0;
+        }
+    }
+    if (latest == nullptr) {
+        return;
+    }
+
+    // A key is two uints, primitive and key, and the counters count uints.
+    // See writeKey() in terrain_common.sh.
+    m_frameStats.countersValid = true;
+    m_frameStats.latency = m_frameNumber - latest->copyFrame;
+    m_frameStats.keys = latest->counters[0] / 2;
+    m_frameStats.culledKeys = latest->counters[1] / 2;
+    m_frameStats.instances = m_frameStats.culledKeys;
+    m_frameStats.triangles = uint64_t(m_frameStats.instances) * latest->trianglesPerInstance;
+}
+
+bool HeightmapRenderer::createSortCheck() {
+    // Same route as the counters, through an image and a blit
+    const bgfx::Caps* caps = bgfx::getCaps();
+    if (0 == (caps->supported & BGFX_CAPS_TEXTURE_BLIT)
+        || 0 == (caps->supported & BGFX_CAPS_TEXTURE_READ_BACK)
+        || 0 == (caps->formats[bgfx::TextureFormat::R32U] & BGFX_CAPS_FORMAT_TEXTURE_IMAGE_WRITE)) {
+        return false;
+    }
+
+    m_sortCheckImage = gpuCreateTexture2D("key sort check",
+        lebsort::kCheckWidth, lebsort::kCheckHeight, false, 1, bgfx::TextureFormat::R32U, BGFX_TEXTURE_COMPUTE_WRITE);
+    m_sortCheckReadback = gpuCreateTexture2D("key sort check",
+        lebsort::kCheckWidth, lebsort::kCheckHeight, false, 1, bgfx::TextureFormat::R32U,
+        BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK | BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+    m_sortCheckData = (uint32_t*)BX_ALLOC(entry::getAllocator(),
+        lebsort::kCheckWidth * lebsort::kCheckHeight * sizeof(uint32_t));
+    m_sortCheckReadyFrame = 0;
+    return true;
+}
+
+void HeightmapRenderer::destroySortCheck() {
+    if (!bgfx::isValid(m_sortCheckImage)) {
+        return;
+    }
+
+    // bgfx writes a pending read when it runs the frame, the storage has
+    // to outlive it
+    while (m_sortCheckReadyFrame != 0 && m_frameNumber < m_sortCheckReadyFrame) {
+        m_frameNumber = bgfx::frame();
+    }
+    m_sortCheckReadyFrame = 0;
+
+    gpuDestroy(m_sortCheckImage);
+    gpuDestroy(m_sortCheckReadback);
+    m_sortCheckImage = BGFX_INVALID_HANDLE;
+    m_sortCheckReadback = BGFX_INVALID_HANDLE;
+    BX_FREE(entry::getAllocator(), m_sortCheckData);
+    m_sortCheckData = nullptr;
+}
+
+void HeightmapRenderer::copySortCheck() {
+    if (!bgfx::isValid(m_sortCheckImage) && !createSortCheck()) {
+        printf("Key sort check needs texture blits, read back and R32U image writes\n");
+        m_sortCheck = false;
+        return;
+    }
+    if (m_sortCheckReadyFrame != 0) {
+        return;
+    }
+
+    // After the counters, the render pass only reads both buffers
+    bgfx::setBuffer(1, m_bufferSortedSubd, bgfx::Access::Read);
+    bgfx::setBuffer(2, m_bufferCulledSubd, bgfx::Access::Read);
+    bgfx::setBuffer(4, m_bufferCounter, bgfx::Access::Read);
+    bgfx::setImage(0, m_sortCheckImage, 0, bgfx::Access::Write, bgfx::TextureFormat::R32U);
+    bgfx::dispatch(types::VIEW_COUNTERS, m_programsCompute[types::PROGRAM_SORT_CHECK],
+        lebsort::kCheckWidth / 64, lebsort::kCheckHeight, 1);
+
+    bgfx::blit(types::VIEW_COUNTER_READBACK, m_sortCheckReadback, 0, 0, m_sortCheckImage);
+    m_sortCheckReadyFrame = bgfx::readTexture(m_sortCheckReadback, m_sortCheckData);
+}
+
+void HeightmapRenderer::readSortCheck() {
+    if (m_sortCheckReadyFrame == 0 || m_frameNumber < m_sortCheckReadyFrame) {
+        return;
+    }
+    m_sortCheckReadyFrame = 0;
+
+    const uint32_t keys = lebsort::getCheckKeys(m_sortCheckData);
+    if (keys > lebsort::kCheckMaxKeys) {
+        ++m_sortCheckStats.skipped;
+        return;
+    }
+
+    if (lebsort::checkImage(m_sortCheckData)) {
+        ++m_sortCheckStats.passed;
+    } else {
+        ++m_sortCheckStats.failed;
+        printf("Key sort check failed on %u keys\n", keys);
+    }
+}
+
+HeightmapRenderer::FrameStats HeightmapRenderer::getFrameStats() const {
+    FrameStats stats = m_frameStats;
+    stats.passTimes = false;
+    for (uint32_t i = 0; i < types::VIEW_COUNT; ++i) {
+        stats.cpuMs[i] = 0.0f;
+        stats.gpuMs[i] = 0.0f;
+    }
+
+    const bgfx::Stats* bgfxStats = bgfx::getStats();
+    const double toCpuMs = 1000.0 / double(bgfxStats->cpuTimerFreq);
+    const double toGpuMs = bgfxStats->gpuTimerFreq > 0 ? 1000.0 / double(bgfxStats->gpuTimerFreq) : 0.0;
+    for (uint16_t i = 0; i < bgfxStats->numViews; ++i) {
+        const bgfx::ViewStats& view = bgfxStats->viewStats[i];
+        if (view.view < types::VIEW_COUNT) {
+            stats.passTimes = true;
+            stats.cpuMs[view.view] = float(double(view.cpuTimeEnd - view.cpuTimeBegin) * toCpuMs);
+            stats.gpuMs[view.view] = float(double(view.gpuTimeEnd - view.gpuTimeBegin) * toGpuMs);
+        }
+    }
+    return stats;
+}
+
+const char* HeightmapRenderer::getViewName(int view) {
+    return view >= 0 && view < types::VIEW_COUNT ? kViewNames[view] : "";
+}
+
+void HeightmapRenderer::publishMetrics(MetricsSnapshot& snapshot) const {
+    snapshot.add("heightmap_load_time_ms", MetricType::Gauge, m_loadTime,
+        "dataset", m_catalog.get(m_selectedHeightmap).name, "kind", getLoadKindName(m_loadKind));
+    for (uint32_t i = 0; i < types::LOAD_PHASE_COUNT; ++i) {
+        snapshot.add("heightmap_load_phase_ms", MetricType::Gauge, m_loadPhases[i],
+            "dataset", m_catalog.get(m_selectedHeightmap).name, "phase", loadhistory::getPhaseName(i));
+    }
+    snapshot.add("heightmap_smap_time_ms", MetricType::Gauge, m_cpuSmapGenTime, "device", "cpu");
+    snapshot.add("heightmap_smap_time_ms", MetricType::Gauge, m_gpuSmapGenTime, "device", "gpu");
+    snapshot.add("heightmap_reloads_total", MetricType::Counter, m_gpuReloadDelta.reloads);
+    snapshot.add("heightmap_max_key_depth", MetricType::Gauge, getMaxKeyDepth());
+
+    const FrameStats stats = getFrameStats();
+    if (stats.countersValid) {
+        snapshot.add("heightmap_terrain_keys", MetricType::Gauge, stats.keys);
+        snapshot.add("heightmap_terrain_culled_keys", MetricType::Gauge, stats.culledKeys);
+        snapshot.add("heightmap_terrain_instances", MetricType::Gauge, stats.instances);
+        snapshot.add("heightmap_terrain_triangles", MetricType::Gauge, double(stats.triangles));
+        snapshot.add("heightmap_terrain_counter_latency_frames", MetricType::Gauge, stats.latency);
+    }
+    if (stats.passTimes) {
+        for (uint32_t i = 0; i < types::VIEW_COUNT; ++i) {
+            snapshot.add("heightmap_pass_cpu_ms", MetricType::Gauge, stats.cpuMs[i], "pass", kViewNames[i]);
+        }
+        for (uint32_t i = 0; i < types::VIEW_COUNT; ++i) {
+            snapshot.add("heightmap_pass_gpu_ms", MetricType::Gauge, stats.gpuMs[i], "pass", kViewNames[i]);
+        }
+    }
+
+    const DatasetCatalog::Stats cache = m_catalog.getStats();
+    snapshot.add("heightmap_dataset_cache_bytes", MetricType::Gauge, double(cache.residentBytes));
+    snapshot.add("heightmap_dataset_cache_hits_total", MetricType::Counter, cache.hits);
+    snapshot.add("heightmap_dataset_cache_misses_total", MetricType::Counter, cache.misses);
+
+    // Owners go together per metric
+    const uint32_t numOwners = gpuLedgerGetNumOwners();
+    snapshot.add("heightmap_gpu_bytes", MetricType::Gauge, double(gpuLedgerGetTotal().m_bytes));
+    for (uint32_t i = 0; i < numOwners; ++i) {
+        const GpuLedgerStats owner = gpuLedgerGetOwner(i);
+        snapshot.add("heightmap_gpu_owner_bytes", MetricType::Gauge, double(owner.m_bytes), "owner", owner.m_name);
+    }
+    for (uint32_t i = 0; i < numOwners; ++i) {
+        const GpuLedgerStats owner = gpuLedgerGetOwner(i);
+        snapshot.add("heightmap_gpu_owner_handles", MetricType::Gauge, countHandles(owner), "owner", owner.m_name);
+    }
+}
@@ -2,23 +2,18 @@
 
 #include "uniforms.h"
 #include "types.h"
+#include "dataset_catalog.h"
+#include "vt_texture.h"
+#include "dmap_stream.h"
+#include "camera_predictor.h"
+#include "load_history.h"
 
 #include <bgfx/bgfx.h>
 #include <bimg/bimg.h>
 #include <bx/file.h>
 #include <entry/entry.h>
 
-struct TextureOption {
-    const char* name;
-    const char* path;
-};
-
-struct LoadTimeRecord {
-    float loadTimeMs;
-    char heightmapName[64];
-    char diffuseName[64];
-    int64_t timestamp;
-};
+struct MetricsSnapshot;
 
 struct DMap {
     bx::FilePath pathToFile;
@@ -27,9 +22,42 @@ struct DMap {
 
 class HeightmapRenderer {
 public:
-    static constexpr int MAX_HEIGHTMAP_OPTIONS = 2;
-    static constexpr int MAX_DIFFUSE_OPTIONS = 2;
-    static constexpr int MAX_LOAD_HISTORY = 5;
+    // Camera forecasts streamed tiles are prefetched for, spread over the
+    // prefetch horizon
+    static constexpr uint32_t PREFETCH_FORECASTS = 4;
+    static constexpr float DEFAULT_PREFETCH_SECONDS = 1.0f;
+    // Counter readbacks in flight at most, a frame whose counters find
+    // none free skips its copy instead of waiting for the GPU
+    static constexpr uint32_t COUNTER_READBACKS = 3;
+
+    // What the last texture reload changed the GPU ledger by, from before
+    // the old textures are destroyed to after the first frame with new ones
+    struct GpuReloadDelta {
+        int64_t bytes;
+        int32_t handles;
+        uint32_t reloads;
+    };
+
+    // Terrain counters of a recent frame and the time of each pass' view.
+    // The counters are copied every frame and land a few frames late.
+    struct FrameStats {
+        bool countersValid;             // false before the first readback or without read back support
+        uint32_t latency;               // frames from the counter copy to its readback
+        uint32_t keys;                  // subdivision keys the LOD pass wrote
+        uint32_t culledKeys;            // of those, the keys the frustum cull kept
+        uint32_t instances;             // instanced meshes drawn, one per culled key
+        uint64_t triangles;
+        bool passTimes;                 // false until bgfx profiles views, see BGFX_DEBUG_PROFILER
+        float cpuMs[types::VIEW_COUNT];
+        float gpuMs[types::VIEW_COUNT]; // 0 without timer queries
+    };
+
+    // Key sort checks that landed, see setSortCheck()
+    struct SortCheckStats {
+        uint32_t passed;
+        uint32_t failed;
+        uint32_t skipped;               // more culled keys than the check image holds
+    };
 
     HeightmapRenderer();
     ~HeightmapRenderer();
@@ -45,16 +73,63 @@ public:
     void setPrimitivePixelLength(float length) { m_primitivePixelLengthTarget = length; }
     void setShading(int shading) { m_shading = shading; }
     void setGpuSubdivision(int level);
+    void setSortCulledKeys(bool enabled);
+    // Reads back the culled keys before and after the sort of one frame at
+    // a time and checks them against lebsort::sortReference(). Debug only,
+    // it costs a 1 MB readback per check.
+    void setSortCheck(bool enabled) { m_sortCheck = enabled; }
+    // False again once the sort check found no read back support
+    bool getSortCheck() const { return m_sortCheck; }
+    // Subdivision stops this many bisection pairs below one heightmap texel,
+    // negative for no bound. "terrain subtexel <levels>" on the console.
+    void setMaxSubTexelLevels(int levels) { m_maxSubTexelLevels = levels; }
+    // BC1, BC7 or Count for uncompressed diffuse textures, set before init()
+    void setDiffuseFormat(bimg::TextureFormat::Enum format) { m_diffuseFormat = format; }
+    // Value returned by the last bgfx::frame(), for readbacks
+    void setFrameNumber(uint32_t frameNumber) { m_frameNumber = frameNumber; }
+    // Tile cache size for heightmaps streamed from a pyramid
+    void setDmapStreamBudget(uint32_t megabytes) { m_dmapStreamBudget = megabytes; }
+    // How far ahead streamed tiles are prefetched along the camera's
+    // predicted path, 0 disables prefetching
+    void setPrefetchHorizon(float seconds) { m_prefetchHorizon = seconds; }
 
     // Texture management
     bool loadHeightmap(int index);
     bool loadDiffuseTexture(int index);
     void reloadTextures();
+    int bakeAllDatasets() { return m_catalog.bakeAll(); }
+    int buildVirtualTextures() { return m_catalog.buildVirtualTextures(); }
+    int getDatasetCount() const { return m_catalog.getCount(); }
+    const char* getDatasetName(int index) const { return m_catalog.get(index).name; }
+    int getSelectedHeightmap() const { return m_selectedHeightmap; }
+    // True from a dataset change until its textures are in and the catalog
+    // is done prefetching behind them
+    bool isLoading() const { return m_texturesNeedReload || !m_catalog.isIdle(); }
+    DatasetCatalog::Stats getDatasetCacheStats() const { return m_catalog.getStats(); }
 
     // Performance stats
     float getLoadTime() const { return m_loadTime; }
+    int getLoadKind() const { return m_loadKind; }
+    static const char* getLoadKindName(int kind);
+    // Phase times of the last load, types::LOAD_PHASE_*
+    const float* getLoadPhases() const { return m_loadPhases; }
+    const LoadHistory& getLoadHistory() const { return m_loadHistory; }
+    // Every load is appended to this CSV file, none when empty
+    void setLoadHistoryPath(const char* path);
     float getCpuSmapTime() const { return m_cpuSmapGenTime; }
     float getGpuSmapTime() const { return m_gpuSmapGenTime; }
+    int getMaxKeyDepth() const { return int(m_uniforms.maxKeyDepth); }
+    bool isVirtualTextureActive() const { return m_vt.isValid(); }
+    vt::VirtualTexture::Stats getVirtualTextureStats() const { return m_vt.getStats(); }
+    bool isDmapStreamActive() const { return m_dmapStream.isValid(); }
+    DmapStream::Stats getDmapStreamStats() const { return m_dmapStream.getStats(); }
+    GpuReloadDelta getGpuReloadDelta() const { return m_gpuReloadDelta; }
+    FrameStats getFrameStats() const;
+    SortCheckStats getSortCheckStats() const { return m_sortCheckStats; }
+    static const char* getViewName(int view);
+    // Load, terrain counters, pass times, caches and the GPU ledger, for
+    // the metrics server
+    void publishMetrics(MetricsSnapshot& snapshot) const;
 
 private:
     // Initialization methods
@@ -62,6 +137,7 @@ private:
     void loadTextures();
     void loadBuffers();
     void createAtomicCounters();
+    void createCounterReadbacks();
     void initTextureOptions();
 
     // Texture loading methods
@@ -74,11 +150,30 @@ private:
     void loadGeometryBuffers();
     void loadInstancedGeometryBuffers();
     void loadSubdivisionBuffers();
+    void loadSortBuffers();
+    void destroySortBuffers();
 
     // Rendering
     void configureUniforms();
+    float computeMaxKeyDepth() const;
     void updateTexturePaths();
     void renderTerrain(const float* viewMtx, const float* projMtx);
+    void bindDmapTextures();
+    void sortCulledKeys();
+    void copyCounters();
+    void readCounters();
+    bool createSortCheck();
+    void destroySortCheck();
+    void copySortCheck();
+    void readSortCheck();
+
+    struct CounterReadback {
+        bgfx::TextureHandle texture;
+        uint32_t counters[3];
+        uint32_t copyFrame;
+        uint32_t readyFrame;            // 0 when free
+        uint32_t trianglesPerInstance;  // when copied, subdivision can change since
+    };
 
     // Resources
     Uniforms m_uniforms;
@@ -93,6 +188,8 @@ private:
     bgfx::DynamicIndexBufferHandle m_bufferSubd[2];
     bgfx::DynamicIndexBufferHandle m_bufferCulledSubd;
     bgfx::DynamicIndexBufferHandle m_bufferCounter;
+    bgfx::DynamicIndexBufferHandle m_bufferSortedSubd;
+    bgfx::DynamicIndexBufferHandle m_bufferSortHistogram;
     bgfx::IndexBufferHandle m_geometryIndices;
     bgfx::VertexBufferHandle m_geometryVertices;
     bgfx::VertexLayout m_geometryLayout;
@@ -101,13 +198,31 @@ private:
     bgfx::VertexLayout m_instancedGeometryLayout;
     bgfx::IndirectBufferHandle m_dispatchIndirect;
 
-    // Image data
-    bimg::ImageContainer* m_dmap;
+    // Counters copied for readback, invalid without read back support
+    bgfx::TextureHandle m_counterImage;
+    CounterReadback m_counterReadbacks[COUNTER_READBACKS];
+    FrameStats m_frameStats;
+
+    // Keys copied for the sort check, one check in flight at most
+    bgfx::TextureHandle m_sortCheckImage;
+    bgfx::TextureHandle m_sortCheckReadback;
+    uint32_t* m_sortCheckData;
+    uint32_t m_sortCheckReadyFrame;     // 0 when none is in flight
+    SortCheckStats m_sortCheckStats;
+
+    // Image data, owned by the catalog
+    DatasetCatalog m_catalog;
+    const bimg::ImageContainer* m_dmap;
+
+    // Streams the diffuse image when the dataset points at a tile pyramid
+    vt::VirtualTexture m_vt;
+    // Streams the heightmap when the dataset points at an R16 tile pyramid
+    DmapStream m_dmapStream;
+    // Feeds both streams with where the camera is heading
+    CameraPredictor m_cameraPredictor;
 
     // Configuration
     DMap m_dmapConfig;
-    TextureOption m_heightmapOptions[MAX_HEIGHTMAP_OPTIONS];
-    TextureOption m_diffuseOptions[MAX_DIFFUSE_OPTIONS];
     
     // State
     uint32_t m_width;
@@ -119,7 +234,13 @@ private:
     int m_selectedDiffuse;
     int m_shading;
     int m_pingPong;
+    int m_maxSubTexelLevels;
+    uint32_t m_frameNumber;
+    uint32_t m_dmapStreamBudget;
+    bimg::TextureFormat::Enum m_diffuseFormat;
     
+    float m_time;
+    float m_prefetchHorizon;
     float m_terrainAspectRatio;
     float m_primitivePixelLengthTarget;
     float m_fovy;
@@ -128,6 +249,8 @@ private:
     bool m_wireframe;
     bool m_cull;
     bool m_freeze;
+    bool m_sortCulled;
+    bool m_sortCheck;
     bool m_useGpuSmap;
     bool m_texturesNeedReload;
 
@@ -135,11 +258,20 @@ private:
     int64_t m_loadStartTime;
     bool m_firstFrameRendered;
     float m_loadTime;
+    int m_loadKind;
     float m_cpuSmapGenTime;
     float m_gpuSmapGenTime;
-    
-    LoadTimeRecord m_loadHistory[MAX_LOAD_HISTORY];
-    int m_loadHistoryCount;
+    float m_loadPhases[types::LOAD_PHASE_COUNT];
+    int64_t m_texturesLoadedTime;
+
+    LoadHistory m_loadHistory;
+    char m_loadHistoryPath[256];
+
+    // GPU ledger totals when the pending reload started
+    bool m_gpuReloadPending;
+    uint64_t m_gpuBytesBeforeReload;
+    uint32_t m_gpuHandlesBeforeReload;
+    GpuReloadDelta m_gpuReloadDelta;
 
     // Paths
     char m_heightmapPath[256];
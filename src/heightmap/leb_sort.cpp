@@ -0,0 +1,64 @@
+#include "leb_sort.h"
+
+#include <bx/allocator.h>
+#include <bx/uint32_t.h>
+#include <entry/entry.h>
+
+namespace lebsort {
+    uint32_t findMSB(uint32_t x) {
+        return 0 == x ? ~0u : 31u - bx::uint32_cntlz(x);
+    }
+
+    uint32_t sortBucket(uint32_t primID, uint32_t key) {
+        const uint32_t bits = kBucketBits - 1;
+        const uint32_t depth = findMSB(key);
+        const uint32_t path = key ^ (1u << depth);
+        const uint32_t aligned = depth >= bits
+            ? (path >> (depth - bits))
+            : (path << (bits - depth));
+
+        return ((primID << bits) | aligned) & (kBucketCount - 1);
+    }
+
+    void sortReference(const uint32_t* pairs, uint32_t count, uint32_t* outPairs) {
+        uint32_t offsets[kBucketCount] = {};
+
+        for (uint32_t i = 0; i < count; ++i) {
+            ++offsets[sortBucket(pairs[i * 2], pairs[i * 2 + 1])];
+        }
+
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < kBucketCount; ++i) {
+            const uint32_t bucketCount = offsets[i];
+            offsets[i] = sum;
+            sum += bucketCount;
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint32_t slot = offsets[sortBucket(pairs[i * 2], pairs[i * 2 + 1])]++;
+            outPairs[slot * 2] = pairs[i * 2];
+            outPairs[slot * 2 + 1] = pairs[i * 2 + 1];
+        }
+    }
+
+    uint32_t getCheckKeys(const uint32_t* image) {
+        return image[2 * kCheckRows * kCheckWidth] / 2;
+    }
+
+    bool checkImage(const uint32_t* image) {
+        const uint32_t count = getCheckKeys(image);
+        BX_ASSERT(count <= kCheckMaxKeys, "%u keys don't fit the sort check image.", count);
+
+        const uint32_t* culled = image;
+        const uint32_t* sorted = image + kCheckRows * kCheckWidth;
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        uint32_t* reference = (uint32_t*)BX_ALLOC(allocator, 2 * count * sizeof(uint32_t) + 1);
+
+        sortReference(culled, count, reference);
+        const bool same = 0 == bx::memCmp(sorted, reference, 2 * count * sizeof(uint32_t));
+
+        BX_FREE(allocator, reference);
+        return same;
+    }
+} // namespace lebsort
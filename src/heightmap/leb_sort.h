@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+
+// CPU reference for the culled key ordering pass (cs_terrain_sort_*.sc).
+// Keys are stored as (primID, key) pairs, exactly as in u_CulledSubdBuffer.
+namespace lebsort {
+    constexpr uint32_t kBucketBits = 10;
+    constexpr uint32_t kBucketCount = 1u << kBucketBits;
+
+    // Workgroups of the histogram and scatter passes (SORT_TILE_COUNT),
+    // each of which sorts a contiguous tile of the keys.
+    constexpr uint32_t kSortTiles = 128;
+
+    // Layout of the sort check image (cs_terrain_sort_check.sc): culled
+    // pairs in the first kCheckRows rows, sorted pairs in the next ones,
+    // the culled count of uints in the last row.
+    constexpr uint32_t kCheckWidth = 1024;
+    constexpr uint32_t kCheckRows = 128;
+    constexpr uint32_t kCheckHeight = 2 * kCheckRows + 1;
+    constexpr uint32_t kCheckMaxKeys = kCheckWidth * kCheckRows / 2;
+
+    // Index of the most significant set bit, ~0u for zero (matches findMSB_).
+    uint32_t findMSB(uint32_t x);
+
+    // Mirror of keyToSortBucket() in keysort.sh.
+    uint32_t sortBucket(uint32_t primID, uint32_t key);
+
+    // Stable counting sort of `count` pairs by bucket.
+    void sortReference(const uint32_t* pairs, uint32_t count, uint32_t* outPairs);
+
+    // Culled keys of a sort check image read back from the GPU. Only the
+    // first kCheckMaxKeys are in the image.
+    uint32_t getCheckKeys(const uint32_t* image);
+
+    // Returns true if the GPU's output in a sort check image matches the
+    // CPU reference of its input pair for pair. A stable sort has a single
+    // result, so any reordering within a bucket fails. The keys must fit
+    // the image.
+    bool checkImage(const uint32_t* image);
+} // namespace lebsort
@@ -0,0 +1,185 @@
+// Compares two load history files, as the app and heightmap_bench
+// --load-history write them:
+//
+//   heightmap_load_compare --baseline base.csv --current loads.csv
+//       [--threshold 0.1] [--min-ms 1] [--last N]
+//
+// Loads are grouped by dataset and load kind, and the median of every
+// group's total and phase times is compared, the last N loads of each
+// group only with --last. A phase regresses when its current median is
+// more than --threshold above the baseline and by at least --min-ms, so
+// phases of a few milliseconds don't flag on noise. Groups missing from
+// either file are listed but never fail.
+//
+// Prints a table and exits 1 when anything regressed, 2 when a file can't
+// be read, 0 otherwise, to gate a CI job on.
+#include "load_history.h"
+#include "../common/tool_support.h"
+
+#include <bx/allocator.h>
+#include <bx/commandline.h>
+#include <bx/string.h>
+#include <entry/entry.h>
+#include <cstdio>
+
+namespace {
+    constexpr uint32_t kMaxGroups = 256;
+    constexpr uint32_t kNumValues = 1 + types::LOAD_PHASE_COUNT;   // total, then the phases
+
+    struct Records {
+        LoadTimeRecord* records;
+        uint32_t count;
+        uint32_t capacity;
+    };
+
+    struct Group {
+        char dataset[64];
+        int kind;
+        float baseline[kNumValues];
+        float current[kNumValues];
+        uint32_t numBaseline;
+        uint32_t numCurrent;
+    };
+
+    void appendRecord(const LoadTimeRecord& record, void* userData) {
+        Records& records = *static_cast<Records*>(userData);
+        if (records.count == records.capacity) {
+            records.capacity = bx::max(records.capacity * 2, 64u);
+            records.records = (LoadTimeRecord*)BX_REALLOC(entry::getAllocator(), records.records,
+                records.capacity * sizeof(LoadTimeRecord));
+        }
+        records.records[records.count++] = record;
+    }
+
+    float getValue(const LoadTimeRecord& record, uint32_t value) {
+        return value == 0 ? record.loadTimeMs : record.phaseMs[value - 1];
+    }
+
+    const char* getValueName(uint32_t value) {
+        return value == 0 ? "total" : loadhistory::getPhaseName(int(value - 1));
+    }
+
+    Group* findGroup(Group* groups, uint32_t& numGroups, const LoadTimeRecord& record) {
+        for (uint32_t i = 0; i < numGroups; ++i) {
+            if (groups[i].kind == record.kind && 0 == bx::strCmp(groups[i].dataset, record.heightmapName)) {
+                return &groups[i];
+            }
+        }
+        if (numGroups == kMaxGroups) {
+            return nullptr;
+        }
+
+        Group& group = groups[numGroups++];
+        bx::memSet(&group, 0, sizeof(group));
+        bx::strCopy(group.dataset, sizeof(group.dataset), record.heightmapName);
+        group.kind = record.kind;
+        return &group;
+    }
+
+    // Medians of the group's last `last` loads in the file, 0 for all.
+    // Returns the number of loads they cover.
+    uint32_t computeMedians(const Records& records, const Group& group, uint32_t last,
+            float* scratch, float* medians) {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < records.count; ++i) {
+            const LoadTimeRecord& record = records.records[i];
+            count += record.kind == group.kind && 0 == bx::strCmp(record.heightmapName, group.dataset);
+        }
+        const uint32_t skip = last > 0 && count > last ? count - last : 0;
+
+        for (uint32_t value = 0; value < kNumValues; ++value) {
+            uint32_t num = 0;
+            uint32_t seen = 0;
+            for (uint32_t i = 0; i < records.count; ++i) {
+                const LoadTimeRecord& record = records.records[i];
+                if (record.kind == group.kind && 0 == bx::strCmp(record.heightmapName, group.dataset)
+                    && seen++ >= skip) {
+                    scratch[num++] = getValue(record, value);
+                }
+            }
+
+            medians[value] = 0.0f;
+            if (num > 0) {
+                sortFloats(scratch, num);
+                medians[value] = num & 1 ? scratch[num / 2] : 0.5f * (scratch[num / 2 - 1] + scratch[num / 2]);
+            }
+        }
+        return count - skip;
+    }
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    bx::CommandLine cmdLine(argc, argv);
+
+    const char* baselinePath = cmdLine.findOption("baseline");
+    const char* currentPath = cmdLine.findOption("current");
+    if (baselinePath == nullptr || currentPath == nullptr) {
+        printf("Usage: heightmap_load_compare --baseline base.csv --current loads.csv"
+            " [--threshold 0.1] [--min-ms 1] [--last N]\n");
+        return 2;
+    }
+    const float threshold = bx::max(floatOption(cmdLine, "threshold", 0.1f), 0.0f);
+    const float minMs = bx::max(floatOption(cmdLine, "min-ms", 1.0f), 0.0f);
+    const uint32_t last = uintOption(cmdLine, "last", 0);
+
+    bx::AllocatorI* allocator = entry::getAllocator();
+    Records baseline = { nullptr, 0, 0 };
+    Records current = { nullptr, 0, 0 };
+    if (loadhistory::read(baselinePath, appendRecord, &baseline) < 0) {
+        printf("Failed to read %s\n", baselinePath);
+        return 2;
+    }
+    if (loadhistory::read(currentPath, appendRecord, &current) < 0) {
+        printf("Failed to read %s\n", currentPath);
+        BX_FREE(allocator, baseline.records);
+        return 2;
+    }
+
+    // Groups in the order they first show up, baseline first
+    Group* groups = (Group*)BX_ALLOC(allocator, kMaxGroups * sizeof(Group));
+    uint32_t numGroups = 0;
+    const Records* files[] = { &baseline, &current };
+    for (const Records* records : files) {
+        for (uint32_t i = 0; i < records->count; ++i) {
+            if (!findGroup(groups, numGroups, records->records[i])) {
+                printf("More than %u dataset and kind pairs, the rest are ignored\n", kMaxGroups);
+                break;
+            }
+        }
+    }
+
+    float* scratch = (float*)BX_ALLOC(allocator, (bx::max(baseline.count, current.count) + 1) * sizeof(float));
+    for (uint32_t i = 0; i < numGroups; ++i) {
+        Group& group = groups[i];
+        group.numBaseline = computeMedians(baseline, group, last, scratch, group.baseline);
+        group.numCurrent = computeMedians(current, group, last, scratch, group.current);
+    }
+    BX_FREE(allocator, scratch);
+
+    printf("Median load times, regression above +%.0f%% and +%.2f ms\n\n", threshold * 100.0f, minMs);
+    printf("%-24s %-8s %-11s %10s %10s %8s\n", "dataset", "kind", "phase", "baseline", "current", "change");
+    uint32_t numRegressions = 0;
+    for (uint32_t i = 0; i < numGroups; ++i) {
+        const Group& group = groups[i];
+        const char* kind = loadhistory::getKindName(group.kind);
+        if (group.numBaseline == 0 || group.numCurrent == 0) {
+            printf("%-24s %-8s only in the %s\n", group.dataset, kind, group.numBaseline == 0 ? "current" : "baseline");
+            continue;
+        }
+
+        for (uint32_t value = 0; value < kNumValues; ++value) {
+            const float base = group.baseline[value];
+            const float cur = group.current[value];
+            const bool regressed = cur > base * (1.0f + threshold) && cur - base >= minMs;
+            numRegressions += regressed;
+            printf("%-24s %-8s %-11s %10.2f %10.2f %+7.1f%%%s\n", group.dataset, kind, getValueName(value),
+                base, cur, base > 0.0f ? (cur - base) / base * 100.0f : 0.0f, regressed ? "  REGRESSION" : "");
+        }
+    }
+    printf("\n%u baseline loads, %u current loads, %u regressions\n", baseline.count, current.count, numRegressions);
+
+    BX_FREE(allocator, groups);
+    BX_FREE(allocator, baseline.records);
+    BX_FREE(allocator, current.records);
+    return numRegressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+#include "load_history.h"
+#include "../common/format_writer.h"
+
+#include <bx/file.h>
+#include <bx/string.h>
+#include <entry/entry.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace {
+    constexpr uint32_t kNumFields = 5 + types::LOAD_PHASE_COUNT;
+
+    const char* const kHeader =
+        "timestamp,dataset,diffuse,kind,total_ms,io_ms,decode_ms,convert_ms,smap_ms,upload_ms,first_frame_ms\n";
+
+    bool isEmptyFile(const char* path) {
+        struct stat st;
+        return stat(path, &st) != 0 || st.st_size == 0;
+    }
+
+    // Commas would split the field, the name is only for matching records
+    void copyName(char* dst, int32_t dstSize, const char* src) {
+        bx::strCopy(dst, dstSize, src);
+        for (char* ptr = dst; *ptr != '\0'; ++ptr) {
+            if (*ptr == ',' || *ptr == '\r' || *ptr == '\n') {
+                *ptr = ';';
+            }
+        }
+    }
+
+    // Splits the line in place, returns the number of fields
+    uint32_t splitFields(char* line, char** fields, uint32_t maxFields) {
+        uint32_t num = 0;
+        fields[num++] = line;
+        for (char* ptr = line; *ptr != '\0'; ++ptr) {
+            if (*ptr == ',') {
+                *ptr = '\0';
+                if (num == maxFields) {
+                    return maxFields + 1;
+                }
+                fields[num++] = ptr + 1;
+            }
+        }
+        return num;
+    }
+
+    bool parseFloat(const char* str, float& value) {
+        char* end;
+        value = float(strtod(str, &end));
+        return end != str;
+    }
+
+    bool parseRecord(char* line, LoadTimeRecord& record) {
+        char* fields[kNumFields];
+        if (splitFields(line, fields, kNumFields) != kNumFields) {
+            return false;
+        }
+
+        char* end;
+        record.timestamp = int64_t(strtoll(fields[0], &end, 10));
+        if (end == fields[0]) {
+            return false;
+        }
+
+        bx::strCopy(record.heightmapName, sizeof(record.heightmapName), fields[1]);
+        bx::strCopy(record.diffuseName, sizeof(record.diffuseName), fields[2]);
+
+        record.kind = -1;
+        for (int i = 0; i < types::LOAD_KIND_COUNT; ++i) {
+            if (0 == bx::strCmp(fields[3], loadhistory::getKindName(i))) {
+                record.kind = i;
+            }
+        }
+        if (record.kind < 0 || !parseFloat(fields[4], record.loadTimeMs)) {
+            return false;
+        }
+
+        for (int i = 0; i < types::LOAD_PHASE_COUNT; ++i) {
+            if (!parseFloat(fields[5 + i], record.phaseMs[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+} // namespace
+
+LoadHistory::LoadHistory()
+    : m_head(0)
+    , m_count(0)
+{
+    bx::memSet(m_records, 0, sizeof(m_records));
+}
+
+void LoadHistory::push(const LoadTimeRecord& record) {
+    m_records[m_head] = record;
+    m_head = (m_head + 1) % CAPACITY;
+    if (m_count < CAPACITY) {
+        ++m_count;
+    }
+}
+
+const LoadTimeRecord& LoadHistory::get(uint32_t index) const {
+    BX_ASSERT(index < m_count, "Load history index %u out of %u", index, m_count);
+    return m_records[(m_head + CAPACITY - m_count + index) % CAPACITY];
+}
+
+namespace loadhistory {
+    const char* getKindName(int kind) {
+        static const char* names[types::LOAD_KIND_COUNT] = { "cold", "warm", "resident" };
+        return kind >= 0 && kind < types::LOAD_KIND_COUNT ? names[kind] : "unknown";
+    }
+
+    const char* getPhaseName(int phase) {
+        static const char* names[types::LOAD_PHASE_COUNT] = {
+            "io", "decode", "convert", "smap", "upload", "first_frame"
+        };
+        return phase >= 0 && phase < types::LOAD_PHASE_COUNT ? names[phase] : "unknown";
+    }
+
+    bool append(const char* path, const LoadTimeRecord& record) {
+        const bool header = isEmptyFile(path);
+
+        bx::FileWriter writer;
+        bx::Error err;
+        if (!bx::open(&writer, path, true, &err)) {
+            return false;
+        }
+
+        char heightmapName[64];
+        char diffuseName[64];
+        copyName(heightmapName, sizeof(heightmapName), record.heightmapName);
+        copyName(diffuseName, sizeof(diffuseName), record.diffuseName);
+
+        if (header) {
+            bx::write(&writer, kHeader, bx::strLen(kHeader), &err);
+        }
+        writef(&writer, &err, "%lld,%s,%s,%s,%.3f"
+            , (long long)record.timestamp
+            , heightmapName
+            , diffuseName
+            , getKindName(record.kind)
+            , record.loadTimeMs
+            );
+        for (int i = 0; i < types::LOAD_PHASE_COUNT; ++i) {
+            writef(&writer, &err, ",%.3f", record.phaseMs[i]);
+        }
+        bx::write(&writer, "\n", 1, &err);
+
+        bx::close(&writer);
+        return err.isOk();
+    }
+
+    int read(const char* path, RecordFn fn, void* userData) {
+        bx::FileReader reader;
+        if (!bx::open(&reader, path)) {
+            return -1;
+        }
+
+        const uint32_t size = uint32_t(bx::getSize(&reader));
+        bx::AllocatorI* allocator = entry::getAllocator();
+        char* text = (char*)BX_ALLOC(allocator, size + 1);
+        bx::Error err;
+        bx::read(&reader, text, int32_t(size), &err);
+        bx::close(&reader);
+        text[size] = '\0';
+
+        // The header and anything else that doesn't parse is skipped
+        int numRecords = 0;
+        for (char* line = text; *line != '\0'; ) {
+            char* end = line;
+            while (*end != '\0' && *end != '\n') {
+                ++end;
+            }
+            const bool last = *end == '\0';
+            *end = '\0';
+            if (end > line && end[-1] == '\r') {
+                end[-1] = '\0';
+            }
+
+            LoadTimeRecord record;
+            if (parseRecord(line, record)) {
+                fn(record, userData);
+                ++numRecords;
+            }
+            line = last ? end : end + 1;
+        }
+        BX_FREE(allocator, text);
+        return numRecords;
+    }
+} // namespace loadhistory
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstdint>
+
+// One load of a dataset, from reloadTextures() or init() to its first frame
+struct LoadTimeRecord {
+    float loadTimeMs;
+    float phaseMs[types::LOAD_PHASE_COUNT];
+    int kind;                   // types::LOAD_*
+    char heightmapName[64];
+    char diffuseName[64];
+    int64_t timestamp;          // seconds since the epoch
+};
+
+// The last loads, the oldest overwritten first
+class LoadHistory {
+public:
+    static constexpr uint32_t CAPACITY = 16;
+
+    LoadHistory();
+
+    void push(const LoadTimeRecord& record);
+    uint32_t getCount() const { return m_count; }
+    // 0 is the oldest still kept
+    const LoadTimeRecord& get(uint32_t index) const;
+    // nullptr before the first load
+    const LoadTimeRecord* getLatest() const { return m_count > 0 ? &get(m_count - 1) : nullptr; }
+
+private:
+    LoadTimeRecord m_records[CAPACITY];
+    uint32_t m_head;            // next to write
+    uint32_t m_count;
+};
+
+// History files are CSV, one load per line under a header:
+//
+//   timestamp,dataset,diffuse,kind,total_ms,io_ms,decode_ms,convert_ms,
+//   smap_ms,upload_ms,first_frame_ms
+//
+// Commas in dataset names are written as ';'.
+namespace loadhistory {
+    const char* getKindName(int kind);
+    const char* getPhaseName(int phase);
+
+    // Appends the record, with the header first when the file is new
+    bool append(const char* path, const LoadTimeRecord& record);
+
+    typedef void (*RecordFn)(const LoadTimeRecord& record, void* userData);
+
+    // Calls fn for every record of the file, lines that don't parse are
+    // skipped. Returns the number of records, -1 when the file can't be read.
+    int read(const char* path, RecordFn fn, void* userData);
+}
@@ -0,0 +1,274 @@
+#include "param_sweep.h"
+#include "../common/entry/cmd.h"
+#include "../common/format_writer.h"
+#include "../common/tool_support.h"
+
+#include <bx/file.h>
+#include <bx/math.h>
+#include <bx/string.h>
+#include <entry/entry.h>
+
+namespace {
+    // Beyond this a sweep takes hours at any useful frame count
+    constexpr uint32_t kMaxCombinations = 4096;
+
+    void writeTiming(bx::WriterI* writer, bx::Error* err, const char* name, const ParamSweep::Timing& t, const char* separator) {
+        writef(writer, err
+            , "\"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s"
+            , name, t.mean, t.p50, t.p95, t.p99, t.max, separator);
+    }
+} // namespace
+
+ParamSweep::ParamSweep()
+    : m_numAxes(0)
+    , m_results(nullptr)
+    , m_frameMs(nullptr)
+    , m_gpuMs(nullptr)
+    , m_warmupFrames(0)
+    , m_frames(0)
+    , m_current(0)
+    , m_frame(0)
+    , m_running(false)
+{
+}
+
+ParamSweep::~ParamSweep() {
+    clear();
+}
+
+bool ParamSweep::addAxis(const char* spec) {
+    if (m_numAxes == MAX_AXES) {
+        return false;
+    }
+
+    const bx::StringView equals = bx::strFind(spec, '=');
+    if (equals.isEmpty() || equals.getPtr() == spec) {
+        return false;
+    }
+
+    Axis& axis = m_axes[m_numAxes];
+    const int32_t nameLength = int32_t(equals.getPtr() - spec);
+    if (nameLength >= int32_t(sizeof(axis.name))) {
+        return false;
+    }
+    bx::strCopy(axis.name, sizeof(axis.name), spec, nameLength);
+
+    axis.numValues = 0;
+    const char* value = equals.getPtr() + 1;
+    while (*value != '\0') {
+        const bx::StringView comma = bx::strFind(value, ',');
+        const char* end = comma.isEmpty() ? value + bx::strLen(value) : comma.getPtr();
+        const int32_t length = int32_t(end - value);
+        if (length == 0 || length >= int32_t(sizeof(axis.values[0])) || axis.numValues == MAX_VALUES) {
+            return false;
+        }
+        bx::strCopy(axis.values[axis.numValues++], sizeof(axis.values[0]), value, length);
+        value = comma.isEmpty() ? end : end + 1;
+    }
+
+    if (axis.numValues == 0) {
+        return false;
+    }
+    ++m_numAxes;
+    return true;
+}
+
+bool ParamSweep::parse(const char* spec) {
+    char buffer[512];
+    bx::strCopy(buffer, sizeof(buffer), spec);
+
+    char* token = buffer;
+    for (char* ch = buffer;; ++ch) {
+        const char c = *ch;
+        if (c == ';' || c == ' ' || c == '\0') {
+            *ch = '\0';
+            if (ch != token && !addAxis(token)) {
+                return false;
+            }
+            if (c == '\0') {
+                break;
+            }
+            token = ch + 1;
+        }
+    }
+    return m_numAxes > 0;
+}
+
+void ParamSweep::clear() {
+    bx::AllocatorI* allocator = entry::getAllocator();
+    BX_FREE(allocator, m_results);
+    BX_FREE(allocator, m_frameMs);
+    BX_FREE(allocator, m_gpuMs);
+    m_results = nullptr;
+    m_frameMs = nullptr;
+    m_gpuMs = nullptr;
+    m_numAxes = 0;
+    m_current = 0;
+    m_running = false;
+}
+
+uint32_t ParamSweep::getNumCombinations() const {
+    if (m_numAxes == 0) {
+        return 0;
+    }
+
+    uint32_t count = 1;
+    for (uint32_t i = 0; i < m_numAxes; ++i) {
+        count *= m_axes[i].numValues;
+    }
+    return count;
+}
+
+bool ParamSweep::start(uint32_t warmupFrames, uint32_t frames) {
+    const uint32_t count = getNumCombinations();
+    if (count == 0 || count > kMaxCombinations) {
+        return false;
+    }
+
+    m_warmupFrames = warmupFrames;
+    m_frames = bx::clamp<uint32_t>(frames, 1, MAX_FRAMES);
+
+    bx::AllocatorI* allocator = entry::getAllocator();
+    m_results = (Result*)BX_REALLOC(allocator, m_results, count * sizeof(Result));
+    m_frameMs = (float*)BX_REALLOC(allocator, m_frameMs, m_frames * sizeof(float));
+    m_gpuMs = (float*)BX_REALLOC(allocator, m_gpuMs, m_frames * sizeof(float));
+    bx::memSet(m_results, 0, count * sizeof(Result));
+
+    m_current = 0;
+    m_frame = 0;
+    m_running = true;
+    apply(0, true);
+    return true;
+}
+
+bool ParamSweep::frame(float frameMs, float gpuMs, bool loading) {
+    if (!m_running) {
+        return false;
+    }
+
+    // A load behind the frames would be measured along with the settings
+    if (loading) {
+        m_frame = 0;
+        return false;
+    }
+
+    // Frames before the warmup is over still run the previous settings or
+    // the restart they caused
+    ++m_frame;
+    if (m_frame <= m_warmupFrames) {
+        return false;
+    }
+
+    const uint32_t index = m_frame - m_warmupFrames - 1;
+    m_frameMs[index] = frameMs;
+    m_gpuMs[index] = gpuMs;
+    if (index + 1 < m_frames) {
+        return false;
+    }
+
+    Result& result = m_results[m_current];
+    for (uint32_t i = 0; i < m_numAxes; ++i) {
+        result.values[i] = uint8_t(getValue(m_current, i));
+    }
+    result.frame = summarize(m_frameMs);
+    result.gpu = summarize(m_gpuMs);
+
+    if (++m_current == getNumCombinations()) {
+        m_running = false;
+        return true;
+    }
+
+    m_frame = 0;
+    apply(m_current, false);
+    return false;
+}
+
+void ParamSweep::apply(uint32_t combination, bool all) {
+    for (uint32_t i = 0; i < m_numAxes; ++i) {
+        const uint32_t value = getValue(combination, i);
+        if (all || value != getValue(combination - 1, i)) {
+            cmdExec("terrain %s %s", m_axes[i].name, m_axes[i].values[value]);
+        }
+    }
+}
+
+uint32_t ParamSweep::getValue(uint32_t combination, uint32_t axis) const {
+    for (uint32_t i = m_numAxes - 1; i > axis; --i) {
+        combination /= m_axes[i].numValues;
+    }
+    return combination % m_axes[axis].numValues;
+}
+
+// Nearest rank, sorts the samples in place
+ParamSweep::Timing ParamSweep::summarize(float* samples) const {
+    double sum = 0.0;
+    for (uint32_t i = 0; i < m_frames; ++i) {
+        sum += samples[i];
+    }
+    sortFloats(samples, m_frames);
+
+    Timing timing;
+    timing.mean = float(sum / m_frames);
+    timing.p50 = nearestRank(samples, m_frames, 0.50f);
+    timing.p95 = nearestRank(samples, m_frames, 0.95f);
+    timing.p99 = nearestRank(samples, m_frames, 0.99f);
+    timing.max = samples[m_frames - 1];
+    return timing;
+}
+
+bool ParamSweep::write(const char* path) const {
+    const bx::StringView extension = bx::FilePath(path).getExt();
+    return 0 == bx::strCmpI(extension, ".csv") ? writeCsv(path) : writeJson(path);
+}
+
+bool ParamSweep::writeCsv(const char* path) const {
+    bx::FileWriter writer;
+    bx::Error err;
+    if (!bx::open(&writer, path, false, &err)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < m_numAxes; ++i) {
+        writef(&writer, &err, "%s,", m_axes[i].name);
+    }
+    writef(&writer, &err
+        , "frame_mean_ms,frame_p50_ms,frame_p95_ms,frame_p99_ms,frame_max_ms"
+          ",gpu_mean_ms,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms,gpu_max_ms\n");
+
+    for (uint32_t r = 0; r < m_current; ++r) {
+        const Result& result = m_results[r];
+        for (uint32_t i = 0; i < m_numAxes; ++i) {
+            writef(&writer, &err, "%s,", m_axes[i].values[result.values[i]]);
+        }
+        writef(&writer, &err, "%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n"
+            , result.frame.mean, result.frame.p50, result.frame.p95, result.frame.p99, result.frame.max
+            , result.gpu.mean, result.gpu.p50, result.gpu.p95, result.gpu.p99, result.gpu.max);
+    }
+
+    bx::close(&writer);
+    return err.isOk();
+}
+
+bool ParamSweep::writeJson(const char* path) const {
+    bx::FileWriter writer;
+    bx::Error err;
+    if (!bx::open(&writer, path, false, &err)) {
+        return false;
+    }
+
+    writef(&writer, &err, "{\n  \"warmup\": %u,\n  \"frames\": %u,\n  \"results\": [\n", m_warmupFrames, m_frames);
+    for (uint32_t r = 0; r < m_current; ++r) {
+        const Result& result = m_results[r];
+        writef(&writer, &err, "    { \"settings\": {");
+        for (uint32_t i = 0; i < m_numAxes; ++i) {
+            writef(&writer, &err, "%s \"%s\": \"%s\"", i == 0 ? "" : ",", m_axes[i].name, m_axes[i].values[result.values[i]]);
+        }
+        writef(&writer, &err, " },\n      ");
+        writeTiming(&writer, &err, "frame_ms", result.frame, ",\n      ");
+        writeTiming(&writer, &err, "gpu_ms", result.gpu, r + 1 < m_current ? " },\n" : " }\n");
+    }
+    writef(&writer, &err, "  ]\n}\n");
+
+    bx::close(&writer);
+    return err.isOk();
+}
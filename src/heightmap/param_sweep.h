@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+// Runs every combination of a set of renderer settings for a number of
+// frames each and tabulates the frame times, to pick defaults per machine
+// from data. Settings are applied through the console as
+// "terrain <name> <value>", so an axis is anything the terrain command
+// takes: subdivision, pixel, cull, freeze or dataset.
+//
+// The first axis changes slowest, and a setting is only applied again when
+// its value changes, so put dataset first to load each dataset once.
+// Settings stay as the last combination left them.
+class ParamSweep {
+public:
+    static constexpr uint32_t MAX_AXES = 6;
+    static constexpr uint32_t MAX_VALUES = 16;
+    static constexpr uint32_t MAX_FRAMES = 10000;
+
+    struct Timing {
+        float mean;
+        float p50;
+        float p95;
+        float p99;
+        float max;
+    };
+
+    struct Result {
+        uint8_t values[MAX_AXES];   // value index per axis
+        Timing frame;               // wall time between frames
+        Timing gpu;                 // GPU time bgfx reports, 0 without timer queries
+    };
+
+    ParamSweep();
+    ~ParamSweep();
+
+    // "name=v1,v2,...", false when malformed or out of room
+    bool addAxis(const char* spec);
+    // Axes separated by ';' or spaces
+    bool parse(const char* spec);
+    void clear();
+
+    // Applies the first combination, false without axes
+    bool start(uint32_t warmupFrames, uint32_t frames);
+    bool isRunning() const { return m_running; }
+    uint32_t getNumCombinations() const;
+    uint32_t getCurrent() const { return m_current; }
+
+    // Takes the frame just finished, returns true once the last combination
+    // has all its frames. While `loading` is set, a dataset change still
+    // loading or prefetching, frames aren't counted and the warmup starts
+    // over once it is done.
+    bool frame(float frameMs, float gpuMs, bool loading);
+
+    // CSV when the path ends in .csv, JSON otherwise
+    bool write(const char* path) const;
+
+private:
+    struct Axis {
+        char name[32];
+        char values[MAX_VALUES][16];
+        uint32_t numValues;
+    };
+
+    void apply(uint32_t combination, bool all);
+    uint32_t getValue(uint32_t combination, uint32_t axis) const;
+    Timing summarize(float* samples) const;
+    bool writeCsv(const char* path) const;
+    bool writeJson(const char* path) const;
+
+    Axis m_axes[MAX_AXES];
+    uint32_t m_numAxes;
+
+    Result* m_results;
+    float* m_frameMs;
+    float* m_gpuMs;
+
+    uint32_t m_warmupFrames;
+    uint32_t m_frames;
+    uint32_t m_current;
+    uint32_t m_frame;           // of the current combination, warmup included
+    bool m_running;
+};
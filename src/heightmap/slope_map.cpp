@@ -0,0 +1,52 @@
+#include "slope_map.h"
+#include "../common/job_system.h"
+
+#include <bx/math.h>
+
+namespace smap {
+    namespace {
+        // A few hundred kilobytes of output per job at common map widths
+        constexpr uint32_t kGrainRows = 64;
+
+        struct GenerateContext {
+            const uint16_t* texels;
+            int w;
+            int h;
+            float* out;
+        };
+
+        void generateRange(uint32_t begin, uint32_t end, void* userData) {
+            const GenerateContext& ctx = *static_cast<const GenerateContext*>(userData);
+            generateRows(ctx.texels, ctx.w, ctx.h, int(begin), int(end), ctx.out);
+        }
+    } // namespace
+
+    void generate(const uint16_t* texels, int w, int h, float* out) {
+        GenerateContext ctx = { texels, w, h, out };
+        jobParallelFor(0, uint32_t(h), kGrainRows, generateRange, &ctx);
+    }
+
+    void generateRows(const uint16_t* texels, int w, int h, int rowBegin, int rowEnd, float* out) {
+        for (int j = rowBegin; j < rowEnd; ++j) {
+            for (int i = 0; i < w; ++i) {
+                int i1 = bx::max(0, i - 1);
+                int i2 = bx::min(w - 1, i + 1);
+                int j1 = bx::max(0, j - 1);
+                int j2 = bx::min(h - 1, j + 1);
+                uint16_t px_l = texels[i1 + w * j];
+                uint16_t px_r = texels[i2 + w * j];
+                uint16_t px_b = texels[i + w * j1];
+                uint16_t px_t = texels[i + w * j2];
+                float z_l = (float)px_l / 65535.0f;
+                float z_r = (float)px_r / 65535.0f;
+                float z_b = (float)px_b / 65535.0f;
+                float z_t = (float)px_t / 65535.0f;
+                float slope_x = (float)w * 0.5f * (z_r - z_l);
+                float slope_y = (float)h * 0.5f * (z_t - z_b);
+
+                out[2 * (i + w * j)] = slope_x;
+                out[1 + 2 * (i + w * j)] = slope_y;
+            }
+        }
+    }
+} // namespace smap
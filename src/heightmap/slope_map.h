@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+// CPU slope map generation, mirrors cs_generate_smap.sc.
+namespace smap {
+    // Writes w * h RG32F texels: central differences of the normalized
+    // R16 heights, scaled by half the map size. Rows are spread over the
+    // job system.
+    void generate(const uint16_t* texels, int w, int h, float* out);
+
+    // Same as generate() for rows [rowBegin, rowEnd) only.
+    void generateRows(const uint16_t* texels, int w, int h, int rowBegin, int rowEnd, float* out);
+} // namespace smap
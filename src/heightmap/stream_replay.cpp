@@ -0,0 +1,510 @@
+// Offline tool for streamed heightmaps, no GPU involved:
+//
+//   heightmap_stream_replay --build out.vtp --raw in.r16 --width W --height H
+//   heightmap_stream_replay --build out.vtp --synthetic --width W --height H
+//   heightmap_stream_replay --replay in.vtp [--path flight.txt] [--budget MB]
+//       [--threads N] [--speed X] [--fovy deg] [--viewport px] [--scale s]
+//       [--prefetch seconds] [--compare]
+//
+// --build converts a raw little-endian 16-bit heightmap of any size into an
+// R16 tile pyramid, row by row. --replay flies a camera path over a
+// pyramid with the same prediction, selection, residency and loader the
+// renderer uses, paced in real time (times --speed) once the first view
+// has loaded. It reports the hit rate, the I/O issued and the worst time a
+// wanted tile stayed missing; --compare runs the path without prefetching
+// first, for reference.
+//
+// Path files hold one "t x y z [ax ay az]" line per key, seconds and world
+// space as cameraGetPosition() and cameraGetAt() return them; the camera
+// looks along its path where the target is left out. Without a path file
+// the camera flies a low pass along the terrain diagonal.
+#include "camera_predictor.h"
+#include "vt_loader.h"
+#include "vt_prefetch.h"
+#include "vt_residency.h"
+#include "../common/tool_support.h"
+
+#include <bx/allocator.h>
+#include <bx/commandline.h>
+#include <bx/file.h>
+#include <bx/math.h>
+#include <bx/os.h>
+#include <bx/sort.h>
+#include <bx/string.h>
+#include <bx/timer.h>
+#include <entry/entry.h>
+#include <cstdio>
+
+namespace {
+    constexpr uint32_t kMaxKeys = 4096;
+    constexpr uint32_t kForecasts = 4;     // as HeightmapRenderer::PREFETCH_FORECASTS
+    constexpr float kFrameTime = 1.0f / 60.0f;
+
+    struct PathKey {
+        float time;
+        float pos[3];
+        float at[3];
+    };
+
+    struct Path {
+        PathKey keys[kMaxKeys];
+        uint32_t numKeys;
+    };
+
+    struct ReplayConfig {
+        const char* pyramidPath;
+        uint32_t budgetMB;
+        uint32_t numThreads;
+        float speed;
+        float fovy;
+        float viewport;
+        float scale;
+        float prefetchSeconds;
+    };
+
+    // Tile wanted but not resident, and since when
+    struct Missing {
+        uint32_t id;
+        int64_t since;
+    };
+
+    bool buildFromRaw(const char* rawPath, uint32_t width, uint32_t height, const char* outPath) {
+        bx::FileReader reader;
+        if (!bx::open(&reader, rawPath)) {
+            printf("Failed to open %s\n", rawPath);
+            return false;
+        }
+        if (uint64_t(bx::getSize(&reader)) != uint64_t(width) * height * sizeof(uint16_t)) {
+            printf("%s is not %ux%u 16-bit texels\n", rawPath, width, height);
+            bx::close(&reader);
+            return false;
+        }
+
+        vt::PyramidBuilder builder;
+        if (!builder.begin(outPath, width, height, vt::Format::R16)) {
+            bx::close(&reader);
+            return false;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        uint16_t* row = (uint16_t*)BX_ALLOC(allocator, width * sizeof(uint16_t));
+        bx::Error err;
+        for (uint32_t y = 0; y < height && err.isOk(); ++y) {
+            bx::read(&reader, row, int32_t(width * sizeof(uint16_t)), &err);
+            builder.addRow(row);
+        }
+        BX_FREE(allocator, row);
+        bx::close(&reader);
+        return builder.end() && err.isOk();
+    }
+
+    // A few octaves of ridges, enough structure for every level to differ
+    bool buildSynthetic(uint32_t width, uint32_t height, const char* outPath) {
+        vt::PyramidBuilder builder;
+        if (!builder.begin(outPath, width, height, vt::Format::R16)) {
+            return false;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        uint16_t* row = (uint16_t*)BX_ALLOC(allocator, width * sizeof(uint16_t));
+        for (uint32_t y = 0; y < height; ++y) {
+            const float v = float(y) / float(height);
+            for (uint32_t x = 0; x < width; ++x) {
+                const float u = float(x) / float(width);
+                float h = 0.5f;
+                float amplitude = 0.25f;
+                float frequency = 3.0f;
+                for (uint32_t octave = 0; octave < 6; ++octave) {
+                    h += amplitude * bx::sin(u * frequency * bx::kPi2 + float(octave)) * bx::cos(v * frequency * bx::kPi2);
+                    amplitude *= 0.5f;
+                    frequency *= 2.3f;
+                }
+                row[x] = uint16_t(bx::clamp(h, 0.0f, 1.0f) * 65535.0f);
+            }
+            builder.addRow(row);
+        }
+        BX_FREE(allocator, row);
+        return builder.end();
+    }
+
+    // Keys without a target look along the path
+    void lookAlongPath(Path& path, const bool* hasAt) {
+        for (uint32_t i = 0; i < path.numKeys; ++i) {
+            if (hasAt[i]) {
+                continue;
+            }
+            const PathKey& from = path.keys[i + 1 < path.numKeys ? i : i - 1];
+            const PathKey& to = path.keys[i + 1 < path.numKeys ? i + 1 : i];
+            const float direction[3] = {
+                to.pos[0] - from.pos[0], to.pos[1] - from.pos[1], to.pos[2] - from.pos[2],
+            };
+            const float length = bx::max(bx::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]), 1e-6f);
+            for (uint32_t c = 0; c < 3; ++c) {
+                path.keys[i].at[c] = path.keys[i].pos[c] + direction[c] / length;
+            }
+        }
+    }
+
+    bool loadPath(const char* path, Path& out) {
+        bx::FileReader reader;
+        if (!bx::open(&reader, path)) {
+            printf("Failed to open camera path %s\n", path);
+            return false;
+        }
+
+        const uint32_t size = uint32_t(bx::getSize(&reader));
+        bx::AllocatorI* allocator = entry::getAllocator();
+        char* text = (char*)BX_ALLOC(allocator, size + 1);
+        bool* hasAt = (bool*)BX_ALLOC(allocator, kMaxKeys * sizeof(bool));
+        bx::Error err;
+        bx::read(&reader, text, int32_t(size), &err);
+        bx::close(&reader);
+        text[size] = '\0';
+
+        out.numKeys = 0;
+        for (char* line = text; *line != '\0' && out.numKeys < kMaxKeys; ) {
+            char* end = line;
+            while (*end != '\0' && *end != '\n') {
+                ++end;
+            }
+            const bool last = *end == '\0';
+            *end = '\0';
+
+            PathKey key;
+            const int32_t num = line[0] == '#' ? 0 : sscanf(line, "%f %f %f %f %f %f %f",
+                &key.time, &key.pos[0], &key.pos[1], &key.pos[2], &key.at[0], &key.at[1], &key.at[2]);
+            if ((num == 4 || num == 7)
+                && (out.numKeys == 0 || key.time > out.keys[out.numKeys - 1].time)) {
+                hasAt[out.numKeys] = num == 7;
+                out.keys[out.numKeys++] = key;
+            }
+            line = last ? end : end + 1;
+        }
+        BX_FREE(allocator, text);
+
+        const bool valid = out.numKeys >= 2;
+        if (valid) {
+            lookAlongPath(out, hasAt);
+        } else {
+            printf("Camera path %s needs at least two keys\n", path);
+        }
+        BX_FREE(allocator, hasAt);
+        return valid;
+    }
+
+    // 20 seconds along the diagonal, just above the highest point
+    void defaultPath(float halfWidth, float scale, Path& out) {
+        const bool hasAt[2] = { false, false };
+        out.numKeys = 2;
+        out.keys[0] = { 0.0f, { -0.9f * halfWidth, scale * 1.1f, 0.9f }, { 0.0f, 0.0f, 0.0f } };
+        out.keys[1] = { 20.0f, { 0.9f * halfWidth, scale * 1.1f, -0.9f }, { 0.0f, 0.0f, 0.0f } };
+        lookAlongPath(out, hasAt);
+    }
+
+    void samplePath(const Path& path, float time, float* pos, float* at) {
+        uint32_t i = 1;
+        while (i + 1 < path.numKeys && path.keys[i].time < time) {
+            ++i;
+        }
+        const PathKey& a = path.keys[i - 1];
+        const PathKey& b = path.keys[i];
+        const float t = bx::clamp((time - a.time) / (b.time - a.time), 0.0f, 1.0f);
+        for (uint32_t c = 0; c < 3; ++c) {
+            pos[c] = bx::lerp(a.pos[c], b.pos[c], t);
+            at[c] = bx::lerp(a.at[c], b.at[c], t);
+        }
+    }
+
+    // World to terrain space as in HeightmapRenderer::update()
+    void toTerrainSpace(float* v) {
+        const float y = v[1];
+        v[1] = -v[2];
+        v[2] = y;
+    }
+
+    const Missing* findMissing(const Missing* missing, uint32_t count, uint32_t id) {
+        uint32_t lo = 0;
+        uint32_t hi = count;
+        while (lo < hi) {
+            const uint32_t mid = (lo + hi) / 2;
+            if (missing[mid].id < id) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo < count && missing[lo].id == id ? &missing[lo] : nullptr;
+    }
+
+    int replay(const Path& path, const ReplayConfig& config) {
+        vt::TileLoader loader;
+        if (!loader.init(config.pyramidPath, config.numThreads)) {
+            printf("Failed to open tile pyramid %s\n", config.pyramidPath);
+            return 1;
+        }
+
+        // Same cache layout as DmapStream, minus the texture size limit
+        const vt::PyramidInfo& info = loader.getInfo();
+        const uint32_t numSlots = bx::max<uint32_t>(uint32_t((uint64_t(config.budgetMB) << 20) / info.tileBytes()), 1);
+        const uint32_t slotsX = bx::clamp<uint32_t>(uint32_t(bx::ceil(bx::sqrt(float(numSlots)))), 1, 256);
+        const uint32_t slotsY = bx::clamp<uint32_t>(numSlots / slotsX, 1, 256);
+        const uint32_t maxTiles = slotsX * slotsY;
+
+        vt::Residency residency;
+        residency.init(info, slotsX, slotsY);
+        vt::DistanceSelector selector;
+        selector.init(maxTiles);
+        vt::PrefetchPlanner planner;
+        planner.init(maxTiles);
+        CameraPredictor predictor;
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        uint32_t* sorted = (uint32_t*)BX_ALLOC(allocator, maxTiles * sizeof(uint32_t));
+        uint32_t* sortTemp = (uint32_t*)BX_ALLOC(allocator, maxTiles * sizeof(uint32_t));
+        Missing* missing = (Missing*)BX_ALLOC(allocator, maxTiles * sizeof(Missing));
+        Missing* nextMissing = (Missing*)BX_ALLOC(allocator, maxTiles * sizeof(Missing));
+        uint32_t numMissing = 0;
+
+        vt::TerrainView view;
+        view.halfWidth = float(info.width) / float(info.height);
+        view.halfHeight = 1.0f;
+        view.heightScale = config.scale;
+        view.lodFactor = 2.0f * bx::tan(bx::toRad(config.fovy) / 2.0f) / config.viewport;
+        const float duration = path.keys[path.numKeys - 1].time;
+        const double freq = double(bx::getHPFrequency());
+
+        uint64_t wantedFrames = 0;
+        uint64_t hitFrames = 0;
+        uint32_t wantedRequests = 0;
+        uint32_t prefetchRequests = 0;
+        uint32_t cancelled = 0;
+        uint32_t tilesRead = 0;
+        uint32_t latencySamples = 0;
+        double latencySum = 0.0;
+        double worstLatency = 0.0;
+        uint32_t worstTile = vt::kInvalidTile;
+        uint32_t frames = 0;
+
+        // The first view loads before the clock starts, as it would behind a
+        // loading screen, so the numbers are about streaming while moving
+        bool settling = true;
+        uint32_t settleFrames = 0;
+        int64_t start = bx::getHPCounter();
+        for (float time = 0.0f; time <= duration; ) {
+            // Keep to the path's clock, scaled by `speed`
+            const int64_t due = start + int64_t(double(time) / config.speed * freq);
+            int64_t now = bx::getHPCounter();
+            if (now < due) {
+                bx::sleep(uint32_t((due - now) * 1000 / int64_t(freq)));
+                now = bx::getHPCounter();
+            }
+
+            // The same steps as DmapStream::update() and TileCache::update()
+            float eye[3];
+            float at[3];
+            samplePath(path, time, eye, at);
+            predictor.addSample(time, eye, at);
+            CameraPredictor::Forecast forecasts[kForecasts];
+            const uint32_t numForecasts = predictor.forecast(config.prefetchSeconds, kForecasts, forecasts);
+            for (uint32_t i = 0; i < numForecasts; ++i) {
+                toTerrainSpace(forecasts[i].position);
+                toTerrainSpace(forecasts[i].direction);
+            }
+            toTerrainSpace(eye);
+
+            const uint32_t numSelected = selector.select(info, vt::terrainSelectParams(info, view, eye));
+            residency.processFeedback(selector.getTiles(), numSelected, settleFrames + frames + 1);
+            const vt::Residency::Stats& current = residency.getStats();
+            const uint32_t numPrefetch = planner.plan(info, view, forecasts, numForecasts,
+                selector.getTiles(), numSelected, current.numSlots > current.wanted ? current.numSlots - current.wanted : 0);
+            residency.setPrefetch(planner.getTiles(), numPrefetch);
+
+            uint32_t stale[vt::Residency::MAX_LOADING];
+            const uint32_t numStale = residency.collectStale(stale, vt::Residency::MAX_LOADING);
+            for (uint32_t i = 0; i < numStale; ++i) {
+                if (loader.cancel(stale[i])) {
+                    residency.cancel(stale[i]);
+                    ++cancelled;
+                }
+            }
+
+            uint32_t ids[32];
+            uint32_t priorities[32];
+            const uint32_t numRequests = residency.collectRequests(ids, BX_COUNTOF(ids), priorities);
+            for (uint32_t i = 0; i < numRequests; ++i) {
+                if (!loader.request(ids[i], priorities[i])) {
+                    residency.cancel(ids[i]);
+                } else if (priorities[i] >= vt::Residency::PREFETCH_PRIORITY) {
+                    ++prefetchRequests;
+                } else {
+                    ++wantedRequests;
+                }
+            }
+
+            vt::TileLoader::Tile tiles[16];
+            const uint32_t numTiles = loader.poll(tiles, BX_COUNTOF(tiles));
+            for (uint32_t i = 0; i < numTiles; ++i) {
+                tilesRead += tiles[i].data ? 1 : 0;
+                if (!tiles[i].data || residency.commit(tiles[i].id) < 0) {
+                    residency.cancel(tiles[i].id);
+                }
+                loader.freeTile(tiles[i]);
+            }
+            residency.clearDirty();
+
+            if (settling) {
+                ++settleFrames;
+                settling = residency.getStats().missing > 0 || residency.getStats().loading > 0;
+                if (!settling) {
+                    start = bx::getHPCounter();
+                } else {
+                    bx::sleep(1);
+                }
+                continue;
+            }
+
+            // Missing tiles that arrived give a latency sample
+            for (uint32_t i = 0; i < numMissing; ++i) {
+                if (residency.isResident(missing[i].id)) {
+                    const double latency = double(now - missing[i].since) / freq * 1000.0 * config.speed;
+                    latencySum += latency;
+                    ++latencySamples;
+                    if (latency > worstLatency) {
+                        worstLatency = latency;
+                        worstTile = missing[i].id;
+                    }
+                }
+            }
+
+            bx::memCopy(sorted, selector.getTiles(), numSelected * sizeof(uint32_t));
+            bx::radixSort(sorted, sortTemp, numSelected);
+            uint32_t numNextMissing = 0;
+            for (uint32_t i = 0; i < numSelected; ++i) {
+                ++wantedFrames;
+                if (residency.isResident(sorted[i])) {
+                    ++hitFrames;
+                    continue;
+                }
+                const Missing* previous = findMissing(missing, numMissing, sorted[i]);
+                nextMissing[numNextMissing].id = sorted[i];
+                nextMissing[numNextMissing].since = previous ? previous->since : now;
+                ++numNextMissing;
+            }
+
+            Missing* swap = missing;
+            missing = nextMissing;
+            nextMissing = swap;
+            numMissing = numNextMissing;
+            time += kFrameTime;
+            ++frames;
+        }
+        const double elapsed = double(bx::getHPCounter() - start) / freq;
+
+        // Tiles still missing at the end count as late as they are
+        const int64_t end = bx::getHPCounter();
+        for (uint32_t i = 0; i < numMissing; ++i) {
+            const double latency = double(end - missing[i].since) / freq * 1000.0 * config.speed;
+            if (latency > worstLatency) {
+                worstLatency = latency;
+                worstTile = missing[i].id;
+            }
+        }
+
+        const vt::Residency::Stats& stats = residency.getStats();
+        const double tileMB = double(info.tileBytes()) / (1024.0 * 1024.0);
+        printf("Pyramid:        %s, %ux%u, %u levels\n", config.pyramidPath, info.width, info.height, info.numLevels);
+        printf("Cache:          %u slots, %.1f MB, %u loader threads\n", maxTiles,
+            double(maxTiles) * tileMB, loader.getNumThreads());
+        if (config.prefetchSeconds > 0.0f) {
+            printf("Prefetch:       %.2f s ahead, %u forecasts\n", double(config.prefetchSeconds), kForecasts);
+        } else {
+            printf("Prefetch:       off\n");
+        }
+        printf("Replay:         %u frames, %.1f s path in %.1f s, first view settled in %u frames\n",
+            frames, double(duration), elapsed, settleFrames);
+        printf("Hit rate:       %.2f%% of %llu wanted tile-frames\n",
+            wantedFrames > 0 ? 100.0 * double(hitFrames) / double(wantedFrames) : 100.0,
+            (unsigned long long)wantedFrames);
+        printf("I/O issued:     %u requests (%u wanted, %u prefetch), %u cancelled unread\n",
+            wantedRequests + prefetchRequests, wantedRequests, prefetchRequests, cancelled);
+        printf("I/O read:       %u tiles, %.1f MB\n", tilesRead, double(tilesRead) * tileMB);
+        printf("Evicted:        %u, dropped %u\n", stats.evicted, stats.dropped);
+        printf("Missing tiles:  %u filled, mean %.1f ms, worst %.1f ms", latencySamples,
+            latencySamples > 0 ? latencySum / latencySamples : 0.0, worstLatency);
+        if (worstTile != vt::kInvalidTile) {
+            printf(" (level %u tile %u,%u)", vt::tileLevel(worstTile), vt::tileX(worstTile), vt::tileY(worstTile));
+        }
+        printf("\n");
+
+        BX_FREE(allocator, sorted);
+        BX_FREE(allocator, sortTemp);
+        BX_FREE(allocator, missing);
+        BX_FREE(allocator, nextMissing);
+        planner.shutdown();
+        selector.shutdown();
+        residency.shutdown();
+        loader.shutdown();
+        return 0;
+    }
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    bx::CommandLine cmdLine(argc, argv);
+
+    const char* build = cmdLine.findOption("build");
+    if (build != nullptr) {
+        const uint32_t width = uintOption(cmdLine, "width", 0);
+        const uint32_t height = uintOption(cmdLine, "height", 0);
+        const char* raw = cmdLine.findOption("raw");
+        const bool built = raw != nullptr ? buildFromRaw(raw, width, height, build)
+            : cmdLine.hasArg("synthetic") ? buildSynthetic(width, height, build)
+            : false;
+        printf(built ? "Built %s (%ux%u)\n" : "Failed to build %s (%ux%u)\n", build, width, height);
+        return built ? 0 : 1;
+    }
+
+    const char* pyramid = cmdLine.findOption("replay");
+    if (pyramid != nullptr) {
+        ReplayConfig config;
+        config.pyramidPath = pyramid;
+        config.budgetMB = uintOption(cmdLine, "budget", 64);
+        config.numThreads = uintOption(cmdLine, "threads", 0);
+        config.speed = bx::max(floatOption(cmdLine, "speed", 1.0f), 0.01f);
+        config.fovy = floatOption(cmdLine, "fovy", 60.0f);
+        config.viewport = floatOption(cmdLine, "viewport", 1080.0f);
+        config.scale = floatOption(cmdLine, "scale", 0.8f);
+        config.prefetchSeconds = bx::max(floatOption(cmdLine, "prefetch", 1.0f), 0.0f);
+
+        Path* path = (Path*)BX_ALLOC(entry::getAllocator(), sizeof(Path));
+        const char* pathFile = cmdLine.findOption("path");
+        bool valid = true;
+        if (pathFile != nullptr) {
+            valid = loadPath(pathFile, *path);
+        } else {
+            vt::PyramidReader reader;
+            valid = reader.open(pyramid);
+            if (valid) {
+                defaultPath(float(reader.getInfo().width) / float(reader.getInfo().height), config.scale, *path);
+            }
+        }
+
+        int result = valid ? 0 : 1;
+        if (valid && cmdLine.hasArg("compare") && config.prefetchSeconds > 0.0f) {
+            ReplayConfig baseline = config;
+            baseline.prefetchSeconds = 0.0f;
+            result = replay(*path, baseline);
+            printf("\n");
+        }
+        if (result == 0) {
+            result = replay(*path, config);
+        }
+        BX_FREE(entry::getAllocator(), path);
+        return result;
+    }
+
+    printf("Usage: heightmap_stream_replay --build out.vtp (--raw in.r16 | --synthetic) --width W --height H\n"
+           "       heightmap_stream_replay --replay in.vtp [--path flight.txt] [--budget MB] [--threads N]\n"
+           "                               [--speed X] [--fovy deg] [--viewport px] [--scale s]\n"
+           "                               [--prefetch seconds] [--compare]\n");
+    return 1;
+}
@@ -0,0 +1,541 @@
+// Micro-benchmarks of the terrain CPU kernels, no GPU involved:
+//
+//   terrain_microbench [--sizes 512,1024,2048,4096] [--threads 1,2,4]
+//       [--keys 65536,1048576] [--pyramids 4096,16384,65536]
+//       [--meshes 65536,1048576] [--bc-sizes 512,1024]
+//       [--png textures/0049_16bit.png] [--warmup N] [--reps N]
+//       [--filter name] [--json out.json]
+//
+// Every kernel runs --warmup times unmeasured, then --reps times measured
+// one by one; the results keep the mean, percentiles and extremes of the
+// repetitions and the items (texels, keys, tiles) one repetition handles.
+// Inputs are synthetic and seeded, so two builds measure the same work and
+// their JSON files can be diffed.
+//
+//   slope_map        smap::generate() of a --sizes heightmap, per --threads;
+//                    the CPU work of loadSmapTexture()
+//   png_r16_decode   pngR16Decode() of --png, the loader's fast path
+//   r16_convert      bimg::imageParse() of --png to R16, the generic path
+//   pyramid_build    vt::buildPyramid() of a --sizes heightmap into memory
+//   leb_sort_bucket  lebsort::sortBucket() of --keys (primID, key) pairs
+//   leb_sort         lebsort::sortReference() of the same pairs
+//   tile_select      vt::DistanceSelector::select() on a --pyramids sized
+//                    pyramid, for 16 camera positions along the diagonal
+//   mesh_decode      meshDecode() of --meshes vertices and their grid
+//                    indices, in 16384 vertex groups, per --threads; the
+//                    decode of Mesh::load()
+//   bc_compress      bcenc::compress() of a --bc-sizes RGBA8 image to BC1
+//                    with its mip chain, per --threads
+//
+// Threads count the calling thread, --threads 1 runs without job workers.
+#include "block_compress.h"
+#include "leb_sort.h"
+#include "slope_map.h"
+#include "vt_pyramid.h"
+#include "vt_select.h"
+#include "../common/job_system.h"
+#include "../common/mesh_decode.h"
+#include "../common/png_r16.h"
+#include "../common/tool_support.h"
+
+#include <bimg/decode.h>
+#include <bx/allocator.h>
+#include <bx/commandline.h>
+#include <bx/file.h>
+#include <bx/math.h>
+#include <bx/sort.h>
+#include <bx/string.h>
+#include <bx/timer.h>
+#include <entry/entry.h>
+#include <cstdio>
+#include <meshoptimizer/src/meshoptimizer.h>
+
+namespace {
+    constexpr uint32_t kMaxList = 16;
+    constexpr uint32_t kMaxResults = 256;
+    constexpr uint32_t kSelectPositions = 16;
+    constexpr uint32_t kSelectMaxTiles = 4096;
+    constexpr uint32_t kMeshGroupSide = 128;
+    constexpr uint32_t kMeshGroupVertices = kMeshGroupSide * kMeshGroupSide;
+
+    struct Options {
+        uint32_t warmup;
+        uint32_t reps;
+        const char* filter;
+    };
+
+    struct Result {
+        const char* name;
+        uint32_t size;
+        uint32_t threads;
+        uint64_t items;     // per repetition
+        float mean;         // milliseconds
+        float p50;
+        float p90;
+        float p99;
+        float min;
+        float max;
+    };
+
+    Result s_results[kMaxResults];
+    uint32_t s_numResults = 0;
+
+    // Results of the measured work end up here so none of it is optimized out
+    volatile uint32_t s_sink = 0;
+
+    struct Random {
+        uint32_t state;
+        uint32_t next() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+    };
+
+    bool isEnabled(const Options& options, const char* name) {
+        return options.filter == nullptr || !bx::strFind(name, options.filter).isEmpty();
+    }
+
+    template<typename Fn>
+    void measure(const Options& options, const char* name, uint32_t size, uint32_t threads, uint64_t items, Fn&& fn) {
+        for (uint32_t i = 0; i < options.warmup; ++i) {
+            fn();
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        float* samples = (float*)BX_ALLOC(allocator, options.reps * sizeof(float));
+        const double toMs = 1000.0 / double(bx::getHPFrequency());
+        double sum = 0.0;
+        for (uint32_t i = 0; i < options.reps; ++i) {
+            const int64_t start = bx::getHPCounter();
+            fn();
+            samples[i] = float(double(bx::getHPCounter() - start) * toMs);
+            sum += samples[i];
+        }
+        sortFloats(samples, options.reps);
+        Result result;
+        result.name = name;
+        result.size = size;
+        result.threads = threads;
+        result.items = items;
+        result.mean = float(sum / options.reps);
+        result.p50 = nearestRank(samples, options.reps, 0.50f);
+        result.p90 = nearestRank(samples, options.reps, 0.90f);
+        result.p99 = nearestRank(samples, options.reps, 0.99f);
+        result.min = samples[0];
+        result.max = samples[options.reps - 1];
+        BX_FREE(allocator, samples);
+
+        printf("%-16s %6u %3u thr %10.3f ms p50 %10.3f ms p99 %9.3f Mitems/s\n", name, size, threads,
+            result.p50, result.p99, result.p50 > 0.0f ? double(items) / (double(result.p50) * 1000.0) : 0.0);
+        if (s_numResults < kMaxResults) {
+            s_results[s_numResults++] = result;
+        }
+    }
+
+    // Same octaves as heightmap_stream_replay --synthetic
+    uint16_t* createHeightmap(uint32_t size) {
+        uint16_t* texels = (uint16_t*)BX_ALLOC(entry::getAllocator(), size_t(size) * size * sizeof(uint16_t));
+        for (uint32_t y = 0; y < size; ++y) {
+            const float v = float(y) / float(size);
+            for (uint32_t x = 0; x < size; ++x) {
+                const float u = float(x) / float(size);
+                float h = 0.5f;
+                float amplitude = 0.25f;
+                float frequency = 3.0f;
+                for (uint32_t octave = 0; octave < 6; ++octave) {
+                    h += amplitude * bx::sin(u * frequency * bx::kPi2 + float(octave)) * bx::cos(v * frequency * bx::kPi2);
+                    amplitude *= 0.5f;
+                    frequency *= 2.3f;
+                }
+                texels[size_t(y) * size + x] = uint16_t(bx::clamp(h, 0.0f, 1.0f) * 65535.0f);
+            }
+        }
+        return texels;
+    }
+
+    void setThreads(uint32_t threads) {
+        jobShutdown();
+        if (threads > 1) {
+            jobInit(threads - 1);
+        }
+    }
+
+    void benchSlopeMap(const Options& options, const uint32_t* sizes, uint32_t numSizes, const uint32_t* threads, uint32_t numThreads) {
+        if (!isEnabled(options, "slope_map")) {
+            return;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        for (uint32_t i = 0; i < numSizes; ++i) {
+            const uint32_t size = sizes[i];
+            uint16_t* texels = createHeightmap(size);
+            float* slopes = (float*)BX_ALLOC(allocator, size_t(size) * size * 2 * sizeof(float));
+            for (uint32_t t = 0; t < numThreads; ++t) {
+                setThreads(threads[t]);
+                measure(options, "slope_map", size, threads[t], uint64_t(size) * size, [&]() {
+                    smap::generate(texels, int(size), int(size), slopes);
+                    s_sink += uint32_t(slopes[0]);
+                });
+            }
+            setThreads(1);
+            BX_FREE(allocator, slopes);
+            BX_FREE(allocator, texels);
+        }
+    }
+
+    void benchPngDecode(const Options& options, const char* path) {
+        if (!isEnabled(options, "png_r16_decode") && !isEnabled(options, "r16_convert")) {
+            return;
+        }
+
+        bx::FileReader reader;
+        if (!bx::open(&reader, path)) {
+            printf("%-16s skipped, no %s\n", "png_r16_decode", path);
+            return;
+        }
+        bx::AllocatorI* allocator = entry::getAllocator();
+        const uint32_t size = uint32_t(bx::getSize(&reader));
+        uint8_t* data = (uint8_t*)BX_ALLOC(allocator, size);
+        bx::Error err;
+        bx::read(&reader, data, int32_t(size), &err);
+        bx::close(&reader);
+
+        uint32_t width;
+        uint32_t height;
+        if (!err.isOk() || !pngR16Probe(data, size, &width, &height)) {
+            printf("%-16s skipped, %s is not a 16-bit grayscale PNG\n", "png_r16_decode", path);
+            BX_FREE(allocator, data);
+            return;
+        }
+
+        if (isEnabled(options, "png_r16_decode")) {
+            uint16_t* texels = (uint16_t*)BX_ALLOC(allocator, size_t(width) * height * sizeof(uint16_t));
+            measure(options, "png_r16_decode", width, 1, uint64_t(width) * height, [&]() {
+                s_sink += pngR16Decode(allocator, data, size, texels) ? texels[0] : 0;
+            });
+            BX_FREE(allocator, texels);
+        }
+
+        if (isEnabled(options, "r16_convert")) {
+            measure(options, "r16_convert", width, 1, uint64_t(width) * height, [&]() {
+                bimg::ImageContainer* image = bimg::imageParse(allocator, data, size, bimg::TextureFormat::R16);
+                if (image != nullptr) {
+                    s_sink += image->m_width;
+                    bimg::imageFree(image);
+                }
+            });
+        }
+        BX_FREE(allocator, data);
+    }
+
+    void benchPyramidBuild(const Options& options, const uint32_t* sizes, uint32_t numSizes) {
+        if (!isEnabled(options, "pyramid_build")) {
+            return;
+        }
+
+        // Into memory, so the disk does not take part in the timing
+        bx::AllocatorI* allocator = entry::getAllocator();
+        for (uint32_t i = 0; i < numSizes; ++i) {
+            const uint32_t size = sizes[i];
+            vt::PyramidInfo info;
+            if (!vt::computePyramidInfo(size, size, vt::Format::R16, info)) {
+                printf("%-16s skipped, %u texels do not fit a pyramid\n", "pyramid_build", size);
+                continue;
+            }
+
+            const uint64_t pyramidSize = vt::getPyramidSize(info);
+            uint8_t* pyramid = (uint8_t*)BX_ALLOC(allocator, size_t(pyramidSize));
+            uint16_t* texels = createHeightmap(size);
+            measure(options, "pyramid_build", size, 1, uint64_t(size) * size, [&]() {
+                s_sink += vt::buildPyramid(texels, size, size, vt::Format::R16, pyramid, pyramidSize) ? pyramid[pyramidSize - 1] : 0;
+            });
+            BX_FREE(allocator, texels);
+            BX_FREE(allocator, pyramid);
+        }
+    }
+
+    void benchLebKeys(const Options& options, const uint32_t* counts, uint32_t numCounts) {
+        if (!isEnabled(options, "leb_sort") && !isEnabled(options, "leb_sort_bucket")) {
+            return;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        for (uint32_t i = 0; i < numCounts; ++i) {
+            const uint32_t count = counts[i];
+            uint32_t* pairs = (uint32_t*)BX_ALLOC(allocator, size_t(count) * 2 * sizeof(uint32_t));
+            uint32_t* sorted = (uint32_t*)BX_ALLOC(allocator, size_t(count) * 2 * sizeof(uint32_t));
+
+            // Keys of any depth the subdivision reaches, on either triangle
+            Random random = { 0x2545f491u + count };
+            for (uint32_t k = 0; k < count; ++k) {
+                const uint32_t depth = 1 + random.next() % 30;
+                pairs[k * 2] = random.next() & 1;
+                pairs[k * 2 + 1] = (1u << depth) | (random.next() & ((1u << depth) - 1));
+            }
+
+            if (isEnabled(options, "leb_sort_bucket")) {
+                measure(options, "leb_sort_bucket", count, 1, count, [&]() {
+                    uint32_t sum = 0;
+                    for (uint32_t k = 0; k < count; ++k) {
+                        sum += lebsort::sortBucket(pairs[k * 2], pairs[k * 2 + 1]);
+                    }
+                    s_sink += sum;
+                });
+            }
+            if (isEnabled(options, "leb_sort")) {
+                measure(options, "leb_sort", count, 1, count, [&]() {
+                    lebsort::sortReference(pairs, count, sorted);
+                    s_sink += sorted[0];
+                });
+            }
+
+            BX_FREE(allocator, sorted);
+            BX_FREE(allocator, pairs);
+        }
+    }
+
+    void benchTileSelect(const Options& options, const uint32_t* sizes, uint32_t numSizes) {
+        if (!isEnabled(options, "tile_select")) {
+            return;
+        }
+
+        vt::DistanceSelector selector;
+        selector.init(kSelectMaxTiles);
+        for (uint32_t i = 0; i < numSizes; ++i) {
+            vt::PyramidInfo info;
+            if (!vt::computePyramidInfo(sizes[i], sizes[i], vt::Format::R16, info)) {
+                printf("%-16s skipped, %u texels do not fit a pyramid\n", "tile_select", sizes[i]);
+                continue;
+            }
+
+            // As the renderer sets it up for a 60 degree, 1080 pixel view
+            vt::TerrainView view;
+            view.halfWidth = 1.0f;
+            view.halfHeight = 1.0f;
+            view.heightScale = 0.8f;
+            view.lodFactor = 2.0f * bx::tan(bx::toRad(60.0f) / 2.0f) / 1080.0f;
+
+            vt::SelectParams params[kSelectPositions];
+            for (uint32_t p = 0; p < kSelectPositions; ++p) {
+                const float t = float(p) / float(kSelectPositions - 1);
+                const float position[3] = { bx::lerp(-0.9f, 0.9f, t), bx::lerp(-0.9f, 0.9f, t), 0.9f };
+                params[p] = vt::terrainSelectParams(info, view, position);
+            }
+
+            measure(options, "tile_select", sizes[i], 1, kSelectPositions, [&]() {
+                uint32_t sum = 0;
+                for (uint32_t p = 0; p < kSelectPositions; ++p) {
+                    sum += selector.select(info, params[p]);
+                }
+                s_sink += sum;
+            });
+        }
+        selector.shutdown();
+    }
+
+    // Position, packed normal and texture coordinate, as the example meshes
+    struct MeshVertex {
+        float x;
+        float y;
+        float z;
+        uint32_t normal;
+        float u;
+        float v;
+    };
+
+    void benchMeshDecode(const Options& options, const uint32_t* counts, uint32_t numCounts, const uint32_t* threads, uint32_t numThreads) {
+        if (!isEnabled(options, "mesh_decode")) {
+            return;
+        }
+
+        // One grid encoded once; every group decodes the same bytes
+        constexpr uint32_t numIndices = (kMeshGroupSide - 1) * (kMeshGroupSide - 1) * 6;
+        bx::AllocatorI* allocator = entry::getAllocator();
+        MeshVertex* vertices = (MeshVertex*)BX_ALLOC(allocator, kMeshGroupVertices * sizeof(MeshVertex));
+        unsigned int* indices = (unsigned int*)BX_ALLOC(allocator, numIndices * sizeof(unsigned int));
+        Random random = { 0x6b43a9b5u };
+        for (uint32_t y = 0; y < kMeshGroupSide; ++y) {
+            for (uint32_t x = 0; x < kMeshGroupSide; ++x) {
+                MeshVertex& vertex = vertices[y * kMeshGroupSide + x];
+                vertex.u = float(x) / float(kMeshGroupSide - 1);
+                vertex.v = float(y) / float(kMeshGroupSide - 1);
+                vertex.x = vertex.u * 2.0f - 1.0f;
+                vertex.y = 0.25f * bx::sin(vertex.u * 7.0f) * bx::cos(vertex.v * 5.0f);
+                vertex.z = vertex.v * 2.0f - 1.0f;
+                vertex.normal = 0x7f7fff7fu ^ (random.next() & 0x00070007u);
+            }
+        }
+        uint32_t numWritten = 0;
+        for (uint32_t y = 0; y + 1 < kMeshGroupSide; ++y) {
+            for (uint32_t x = 0; x + 1 < kMeshGroupSide; ++x) {
+                const unsigned int corner = y * kMeshGroupSide + x;
+                const unsigned int quad[6] = { corner, corner + kMeshGroupSide, corner + 1,
+                    corner + 1, corner + kMeshGroupSide, corner + kMeshGroupSide + 1 };
+                for (uint32_t k = 0; k < 6; ++k) {
+                    indices[numWritten++] = quad[k];
+                }
+            }
+        }
+
+        const size_t vertexBound = meshopt_encodeVertexBufferBound(kMeshGroupVertices, sizeof(MeshVertex));
+        const size_t indexBound = meshopt_encodeIndexBufferBound(numIndices, kMeshGroupVertices);
+        uint8_t* encodedVertices = (uint8_t*)BX_ALLOC(allocator, vertexBound);
+        uint8_t* encodedIndices = (uint8_t*)BX_ALLOC(allocator, indexBound);
+        const uint32_t vertexSize = uint32_t(meshopt_encodeVertexBuffer(encodedVertices, vertexBound,
+            vertices, kMeshGroupVertices, sizeof(MeshVertex)));
+        const uint32_t indexSize = uint32_t(meshopt_encodeIndexBuffer(encodedIndices, indexBound, indices, numIndices));
+
+        for (uint32_t i = 0; i < numCounts; ++i) {
+            const uint32_t numGroups = bx::max(counts[i] / kMeshGroupVertices, 1u);
+            const uint32_t numDecodes = numGroups * 2;
+            const size_t groupSize = kMeshGroupVertices * sizeof(MeshVertex) + numIndices * sizeof(uint16_t);
+            uint8_t* decoded = (uint8_t*)BX_ALLOC(allocator, groupSize * numGroups);
+            MeshDecode* decodes = (MeshDecode*)BX_ALLOC(allocator, numDecodes * sizeof(MeshDecode));
+            for (uint32_t g = 0; g < numGroups; ++g) {
+                MeshDecode& vertexDecode = decodes[g * 2];
+                vertexDecode.m_dst = decoded + groupSize * g;
+                vertexDecode.m_compressed = encodedVertices;
+                vertexDecode.m_compressedSize = vertexSize;
+                vertexDecode.m_count = kMeshGroupVertices;
+                vertexDecode.m_stride = sizeof(MeshVertex);
+                vertexDecode.m_index = false;
+
+                MeshDecode& indexDecode = decodes[g * 2 + 1];
+                indexDecode.m_dst = decoded + groupSize * g + kMeshGroupVertices * sizeof(MeshVertex);
+                indexDecode.m_compressed = encodedIndices;
+                indexDecode.m_compressedSize = indexSize;
+                indexDecode.m_count = numIndices;
+                indexDecode.m_stride = sizeof(uint16_t);
+                indexDecode.m_index = true;
+            }
+
+            for (uint32_t t = 0; t < numThreads; ++t) {
+                setThreads(threads[t]);
+                measure(options, "mesh_decode", numGroups * kMeshGroupVertices, threads[t],
+                    uint64_t(numGroups) * kMeshGroupVertices, [&]() {
+                    meshDecode(decodes, numDecodes);
+                    s_sink += decoded[groupSize * numGroups - 1];
+                });
+            }
+            setThreads(1);
+            BX_FREE(allocator, decodes);
+            BX_FREE(allocator, decoded);
+        }
+
+        BX_FREE(allocator, encodedIndices);
+        BX_FREE(allocator, encodedVertices);
+        BX_FREE(allocator, indices);
+        BX_FREE(allocator, vertices);
+    }
+
+    void benchBlockCompress(const Options& options, const uint32_t* sizes, uint32_t numSizes, const uint32_t* threads, uint32_t numThreads) {
+        if (!isEnabled(options, "bc_compress")) {
+            return;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        for (uint32_t i = 0; i < numSizes; ++i) {
+            const uint32_t size = sizes[i];
+            bimg::ImageContainer* image = bimg::imageAlloc(allocator, bimg::TextureFormat::RGBA8,
+                uint16_t(size), uint16_t(size), 1, 1, false, false);
+
+            // Smooth colour gradients with a little noise, like a diffuse map
+            Random random = { 0x1b873593u + size };
+            uint8_t* texels = (uint8_t*)image->m_data;
+            for (uint32_t y = 0; y < size; ++y) {
+                for (uint32_t x = 0; x < size; ++x) {
+                    uint8_t* texel = texels + (size_t(y) * size + x) * 4;
+                    const uint32_t noise = random.next() & 15;
+                    texel[0] = uint8_t(x * 223 / size + noise);
+                    texel[1] = uint8_t(y * 223 / size + noise);
+                    texel[2] = uint8_t((x + y) * 111 / size + noise);
+                    texel[3] = 255;
+                }
+            }
+
+            for (uint32_t t = 0; t < numThreads; ++t) {
+                setThreads(threads[t]);
+                measure(options, "bc_compress", size, threads[t], uint64_t(size) * size, [&]() {
+                    bimg::ImageContainer* blocks = bcenc::compress(allocator, *image, bimg::TextureFormat::BC1,
+                        threads[t], nullptr);
+                    if (blocks != nullptr) {
+                        s_sink += blocks->m_size;
+                        bimg::imageFree(blocks);
+                    }
+                });
+            }
+            setThreads(1);
+            bimg::imageFree(image);
+        }
+    }
+
+    bool writeJson(const char* path, const Options& options) {
+        bx::FileWriter writer;
+        bx::Error err;
+        if (!bx::open(&writer, path, false, &err)) {
+            return false;
+        }
+
+        bx::writePrintf(&writer, "{\n  \"warmup\": %u,\n  \"reps\": %u,\n  \"results\": [\n",
+            options.warmup, options.reps);
+        for (uint32_t i = 0; i < s_numResults; ++i) {
+            const Result& result = s_results[i];
+            bx::writePrintf(&writer
+                , "    { \"name\": \"%s\", \"size\": %u, \"threads\": %u, \"items\": %llu"
+                  ", \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f"
+                  ", \"min_ms\": %.4f, \"max_ms\": %.4f }%s\n"
+                , result.name, result.size, result.threads, (unsigned long long)result.items
+                , result.mean, result.p50, result.p90, result.p99, result.min, result.max
+                , i + 1 < s_numResults ? "," : "");
+        }
+        bx::writePrintf(&writer, "  ]\n}\n");
+
+        bx::close(&writer);
+        return err.isOk();
+    }
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    bx::CommandLine cmdLine(argc, argv);
+
+    Options options;
+    options.warmup = uintOption(cmdLine, "warmup", 3);
+    options.reps = uintOption(cmdLine, "reps", 20);
+    if (options.reps == 0) {
+        printf("--reps must be at least 1\n");
+        return 1;
+    }
+    options.filter = cmdLine.findOption("filter");
+
+    uint32_t sizes[kMaxList];
+    uint32_t threads[kMaxList];
+    uint32_t keys[kMaxList];
+    uint32_t pyramids[kMaxList];
+    uint32_t meshes[kMaxList];
+    uint32_t bcSizes[kMaxList];
+    const uint32_t numSizes = parseUintList(cmdLine.findOption("sizes", "512,1024,2048,4096"), sizes, kMaxList);
+    const uint32_t numThreads = parseUintList(cmdLine.findOption("threads", "1,2,4"), threads, kMaxList);
+    const uint32_t numKeys = parseUintList(cmdLine.findOption("keys", "65536,1048576"), keys, kMaxList);
+    const uint32_t numPyramids = parseUintList(cmdLine.findOption("pyramids", "4096,16384,65536"), pyramids, kMaxList);
+    const uint32_t numMeshes = parseUintList(cmdLine.findOption("meshes", "65536,1048576"), meshes, kMaxList);
+    const uint32_t numBcSizes = parseUintList(cmdLine.findOption("bc-sizes", "512,1024"), bcSizes, kMaxList);
+
+    benchSlopeMap(options, sizes, numSizes, threads, numThreads);
+    benchPngDecode(options, cmdLine.findOption("png", "textures/0049_16bit.png"));
+    benchPyramidBuild(options, sizes, numSizes);
+    benchLebKeys(options, keys, numKeys);
+    benchTileSelect(options, pyramids, numPyramids);
+    benchMeshDecode(options, meshes, numMeshes, threads, numThreads);
+    benchBlockCompress(options, bcSizes, numBcSizes, threads, numThreads);
+    jobShutdown();
+
+    const char* json = cmdLine.findOption("json", "terrain_microbench.json");
+    if (!writeJson(json, options)) {
+        printf("Failed to write %s\n", json);
+        return 1;
+    }
+    printf("%u results written to %s\n", s_numResults, json);
+    return 0;
+}
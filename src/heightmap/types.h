@@ -21,15 +21,39 @@ namespace types {
         PROGRAM_INIT_INDIRECT,
         PROGRAM_UPDATE_DRAW,
         PROGRAM_GENERATE_SMAP,
+        PROGRAM_SORT_HISTOGRAM,
+        PROGRAM_SORT_SCAN,
+        PROGRAM_SORT_SCATTER,
+        PROGRAM_COPY_COUNTERS,
+        PROGRAM_SORT_CHECK,
 
         PROGRAM_COUNT
     };
 
+    // One view per pass, in the order they run, so that
+    // bgfx::Stats::viewStats times each of them on its own
+    enum
+    {
+        VIEW_LOD,           // indirect update and LOD subdivision
+        VIEW_UPDATE_DRAW,
+        VIEW_SORT,          // optional, see setSortCulledKeys()
+        VIEW_RENDER,
+        VIEW_VT_FEEDBACK,
+        VIEW_VT_READBACK,
+        VIEW_COUNTERS,      // counter copy, blits run before a view's dispatches
+        VIEW_COUNTER_READBACK,
+        VIEW_SMAP,          // slope map generation, at load only
+
+        VIEW_COUNT
+    };
+
     enum
     {
         TERRAIN_DMAP_SAMPLER,
         TERRAIN_SMAP_SAMPLER,
         TERRAIN_DIFFUSE_SAMPLER,
+        TERRAIN_DMAP_INDIRECTION_SAMPLER,
+        TERRAIN_DMAP_CACHE_SAMPLER,
 
         SAMPLER_COUNT
     };
@@ -42,4 +66,28 @@ namespace types {
 
         TEXTURE_COUNT
     };
-}
\ No newline at end of file
+
+    enum
+    {
+        LOAD_COLD,      // decoded from the source images
+        LOAD_WARM,      // read from the on-disk bake cache
+        LOAD_RESIDENT,  // already decoded in memory
+
+        LOAD_KIND_COUNT
+    };
+
+    // Where a load's time goes. Images decode on job workers next to the
+    // main thread, so the phases are thread time and can add up to more
+    // than the load took.
+    enum
+    {
+        LOAD_PHASE_IO,          // source images and bake cache files
+        LOAD_PHASE_DECODE,
+        LOAD_PHASE_CONVERT,     // to R16, and diffuse block compression
+        LOAD_PHASE_SMAP,        // slope map, on the CPU or the GPU
+        LOAD_PHASE_UPLOAD,      // texture creation and the copies for bgfx
+        LOAD_PHASE_FIRST_FRAME, // from the textures to the first frame
+
+        LOAD_PHASE_COUNT
+    };
+}
\ No newline at end of file
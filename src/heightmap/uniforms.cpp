@@ -3,12 +3,15 @@
 void Uniforms::init() {
     m_paramsHandle = bgfx::createUniform("u_params", bgfx::UniformType::Vec4, tables::kNumVec4);
     m_aspectParamsHandle = bgfx::createUniform("u_aspectParams", bgfx::UniformType::Vec4);
+    m_dmapStreamParamsHandle = bgfx::createUniform("u_dmapStreamParams", bgfx::UniformType::Vec4, 2);
 
     cull = 1.0f;
     freeze = 0.0f;
     gpuSubd = 3.0f;
+    maxKeyDepth = 31.0f;
     terrainHalfWidth = 1.0f;
     terrainHalfHeight = 1.0f;
+    bx::memSet(dmapStreamParams, 0, sizeof(dmapStreamParams));
 }
 
 void Uniforms::submit() {
@@ -16,9 +19,11 @@ void Uniforms::submit() {
     
     float aspectParams[4] = { terrainHalfWidth, terrainHalfHeight, 0.0f, 0.0f };
     bgfx::setUniform(m_aspectParamsHandle, aspectParams);
+    bgfx::setUniform(m_dmapStreamParamsHandle, dmapStreamParams, 2);
 }
 
 void Uniforms::destroy() {
     bgfx::destroy(m_paramsHandle);
     bgfx::destroy(m_aspectParamsHandle);
+    bgfx::destroy(m_dmapStreamParamsHandle);
 }
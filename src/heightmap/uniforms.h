@@ -18,7 +18,7 @@ public:
             float freeze;
 
             float gpuSubd;
-            float padding0;
+            float maxKeyDepth;
             float padding1;
             float padding2;
 
@@ -28,7 +28,11 @@ public:
         float params[tables::kNumVec4 * 4];
     };
 
+    // u_dmapStreamParams, see DmapStream::getShaderParams()
+    float dmapStreamParams[8];
+
 private:
     bgfx::UniformHandle m_paramsHandle;
     bgfx::UniformHandle m_aspectParamsHandle;
+    bgfx::UniformHandle m_dmapStreamParamsHandle;
 };
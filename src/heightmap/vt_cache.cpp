@@ -0,0 +1,174 @@
+#include "vt_cache.h"
+#include "../common/gpu_ledger.h"
+
+#include <bx/allocator.h>
+#include <entry/entry.h>
+#include <cstdio>
+
+namespace {
+    void releaseTile(void* ptr, void* userData) {
+        BX_UNUSED(userData);
+        BX_FREE(entry::getAllocator(), ptr);
+    }
+} // namespace
+
+namespace vt {
+    TileCache::TileCache()
+        : m_indirection(BGFX_INVALID_HANDLE)
+        , m_cache(BGFX_INVALID_HANDLE)
+        , m_uploads(0)
+        , m_cancelled(0)
+        , m_bytesLoaded(0)
+    {
+    }
+
+    TileCache::~TileCache() {
+        shutdown();
+    }
+
+    bool TileCache::init(const char* path, uint32_t slotsX, uint32_t slotsY, const char* name) {
+        shutdown();
+
+        const uint32_t maxSize = bgfx::getCaps()->limits.maxTextureSize;
+        if (slotsX * kTileStride > maxSize || slotsY * kTileStride > maxSize) {
+            printf("Tile cache of %ux%u slots exceeds the texture size limit\n", slotsX, slotsY);
+            return false;
+        }
+
+        if (!m_loader.init(path)) {
+            printf("Failed to open tile pyramid: %s\n", path);
+            return false;
+        }
+
+        const PyramidInfo& info = m_loader.getInfo();
+        if (!m_residency.init(info, slotsX, slotsY)) {
+            m_loader.shutdown();
+            return false;
+        }
+
+        const bgfx::TextureFormat::Enum format = info.format == Format::R16
+            ? bgfx::TextureFormat::R16
+            : bgfx::TextureFormat::RGBA8;
+        m_indirection = gpuCreateTexture2D(name,
+            uint16_t(info.tiles), uint16_t(info.tiles), info.numLevels > 1, 1,
+            bgfx::TextureFormat::RGBA8,
+            BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP
+        );
+        m_cache = gpuCreateTexture2D(name,
+            uint16_t(slotsX * kTileStride), uint16_t(slotsY * kTileStride), false, 1,
+            format,
+            BGFX_SAMPLER_UVW_CLAMP
+        );
+        bgfx::setName(m_cache, name);
+
+        m_uploads = 0;
+        m_cancelled = 0;
+        m_bytesLoaded = 0;
+        return true;
+    }
+
+    void TileCache::shutdown() {
+        m_loader.shutdown();
+        m_residency.shutdown();
+
+        if (bgfx::isValid(m_indirection)) {
+            gpuDestroy(m_indirection);
+            m_indirection = BGFX_INVALID_HANDLE;
+        }
+        if (bgfx::isValid(m_cache)) {
+            gpuDestroy(m_cache);
+            m_cache = BGFX_INVALID_HANDLE;
+        }
+    }
+
+    void TileCache::setWanted(const uint32_t* ids, uint32_t count, uint32_t frame) {
+        if (isValid()) {
+            m_residency.processFeedback(ids, count, frame);
+        }
+    }
+
+    void TileCache::setPrefetch(const uint32_t* ids, uint32_t count) {
+        if (isValid()) {
+            m_residency.setPrefetch(ids, count);
+        }
+    }
+
+    uint32_t TileCache::getPrefetchCapacity() const {
+        const Residency::Stats& stats = m_residency.getStats();
+        return stats.numSlots > stats.wanted ? stats.numSlots - stats.wanted : 0;
+    }
+
+    void TileCache::update() {
+        if (!isValid()) {
+            return;
+        }
+
+        // Tiles already being read are kept, they may be wanted again soon
+        uint32_t stale[Residency::MAX_LOADING];
+        const uint32_t numStale = m_residency.collectStale(stale, Residency::MAX_LOADING);
+        for (uint32_t i = 0; i < numStale; ++i) {
+            if (m_loader.cancel(stale[i])) {
+                m_residency.cancel(stale[i]);
+                ++m_cancelled;
+            }
+        }
+
+        uint32_t ids[MAX_REQUESTS_PER_FRAME];
+        uint32_t priorities[MAX_REQUESTS_PER_FRAME];
+        const uint32_t numRequests = m_residency.collectRequests(ids, MAX_REQUESTS_PER_FRAME, priorities);
+        for (uint32_t i = 0; i < numRequests; ++i) {
+            if (!m_loader.request(ids[i], priorities[i])) {
+                m_residency.cancel(ids[i]);
+            }
+        }
+
+        // Tiles go up by reference and are freed once bgfx is done with them
+        const PyramidInfo& info = m_residency.getInfo();
+        const uint32_t tileBytes = info.tileBytes();
+        const uint32_t slotsX = m_residency.getSlotsX();
+        TileLoader::Tile tiles[MAX_UPLOADS_PER_FRAME];
+        const uint32_t numTiles = m_loader.poll(tiles, MAX_UPLOADS_PER_FRAME);
+        for (uint32_t i = 0; i < numTiles; ++i) {
+            const int32_t slot = tiles[i].data ? m_residency.commit(tiles[i].id) : -1;
+            if (slot < 0) {
+                m_residency.cancel(tiles[i].id);
+                m_loader.freeTile(tiles[i]);
+                continue;
+            }
+
+            bgfx::updateTexture2D(m_cache, 0, 0,
+                uint16_t((uint32_t(slot) % slotsX) * kTileStride),
+                uint16_t((uint32_t(slot) / slotsX) * kTileStride),
+                uint16_t(kTileStride), uint16_t(kTileStride),
+                bgfx::makeRef(tiles[i].data, tileBytes, releaseTile));
+            ++m_uploads;
+            m_bytesLoaded += tileBytes;
+        }
+
+        for (uint32_t level = 0; level < info.numLevels; ++level) {
+            uint32_t x, y, width, height;
+            if (!m_residency.getDirtyRect(level, x, y, width, height)) {
+                continue;
+            }
+
+            const uint32_t pitch = info.levelTiles(level);
+            const uint32_t* src = m_residency.getIndirection(level) + y * pitch + x;
+            const bgfx::Memory* mem = bgfx::alloc(width * height * sizeof(uint32_t));
+            for (uint32_t row = 0; row < height; ++row) {
+                bx::memCopy(mem->data + row * width * sizeof(uint32_t), src + row * pitch, width * sizeof(uint32_t));
+            }
+            bgfx::updateTexture2D(m_indirection, 0, uint8_t(level),
+                uint16_t(x), uint16_t(y), uint16_t(width), uint16_t(height), mem);
+        }
+        m_residency.clearDirty();
+    }
+
+    TileCache::Stats TileCache::getStats() const {
+        Stats stats;
+        stats.residency = m_residency.getStats();
+        stats.uploads = m_uploads;
+        stats.cancelled = m_cancelled;
+        stats.bytesLoaded = m_bytesLoaded;
+        return stats;
+    }
+} // namespace vt
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "vt_loader.h"
+#include "vt_residency.h"
+
+#include <bgfx/bgfx.h>
+
+// GPU side of a streamed tile pyramid: the physical cache texture loaded
+// tiles are copied into and the indirection texture that maps every
+// virtual tile to its cache slot. What is wanted comes from the owner,
+// GPU feedback for the virtual texture and camera distance for the
+// streamed heightmap.
+namespace vt {
+    class TileCache {
+    public:
+        static constexpr uint32_t MAX_REQUESTS_PER_FRAME = 32;
+        static constexpr uint32_t MAX_UPLOADS_PER_FRAME = 16;
+
+        struct Stats {
+            Residency::Stats residency;
+            uint32_t uploads;       // tiles uploaded since init
+            uint32_t cancelled;     // loads taken back before they were read
+            uint64_t bytesLoaded;
+        };
+
+        TileCache();
+        ~TileCache();
+
+        // The cache holds slotsX * slotsY tiles of the pyramid's format,
+        // `name` labels its textures in graphics debuggers and owns them in
+        // the GPU ledger, it must outlive the cache
+        bool init(const char* path, uint32_t slotsX, uint32_t slotsY, const char* name);
+        void shutdown();
+        bool isValid() const { return m_loader.isOpen(); }
+
+        const PyramidInfo& getInfo() const { return m_residency.getInfo(); }
+        uint32_t getSlotsX() const { return m_residency.getSlotsX(); }
+        uint32_t getSlotsY() const { return m_residency.getSlotsY(); }
+
+        // See Residency::processFeedback()
+        void setWanted(const uint32_t* ids, uint32_t count, uint32_t frame);
+        // See Residency::setPrefetch()
+        void setPrefetch(const uint32_t* ids, uint32_t count);
+        // Slots not taken by the wanted tiles, what prefetch can fill
+        // without evicting its own tiles
+        uint32_t getPrefetchCapacity() const;
+
+        // Cancels loads nobody wants any more, queues new ones and uploads
+        // the tiles and indirection texels that changed
+        void update();
+
+        // Point sampled, one texel per tile and one mip per level
+        bgfx::TextureHandle getIndirection() const { return m_indirection; }
+        bgfx::TextureHandle getCache() const { return m_cache; }
+
+        Stats getStats() const;
+
+    private:
+        TileLoader m_loader;
+        Residency m_residency;
+
+        bgfx::TextureHandle m_indirection;
+        bgfx::TextureHandle m_cache;
+
+        uint32_t m_uploads;
+        uint32_t m_cancelled;
+        uint64_t m_bytesLoaded;
+    };
+} // namespace vt
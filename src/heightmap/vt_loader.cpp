@@ -0,0 +1,184 @@
+#include "vt_loader.h"
+#include "../common/job_system.h"
+#include "../common/profiler.h"
+
+#include <bx/allocator.h>
+#include <entry/entry.h>
+
+namespace vt {
+    TileLoader::TileLoader()
+        : m_numThreads(0)
+        , m_numRequests(0)
+        , m_sequence(0)
+        , m_numDone(0)
+        , m_numInFlight(0)
+        , m_quit(false)
+    {
+        bx::memSet(&m_info, 0, sizeof(m_info));
+    }
+
+    TileLoader::~TileLoader() {
+        shutdown();
+    }
+
+    bool TileLoader::init(const char* path, uint32_t numThreads) {
+        shutdown();
+
+        if (numThreads == 0) {
+            numThreads = jobGetNumCores();
+        }
+        numThreads = bx::clamp<uint32_t>(numThreads, 1, MAX_THREADS);
+
+        for (uint32_t i = 0; i < numThreads; ++i) {
+            if (!m_workers[i].reader.open(path)) {
+                for (uint32_t j = 0; j < i; ++j) {
+                    m_workers[j].reader.close();
+                }
+                return false;
+            }
+        }
+
+        m_info = m_workers[0].reader.getInfo();
+        m_quit = false;
+        m_numRequests = 0;
+        m_sequence = 0;
+        m_numDone = 0;
+        m_numInFlight = 0;
+        m_numThreads = numThreads;
+        for (uint32_t i = 0; i < numThreads; ++i) {
+            m_workers[i].loader = this;
+            m_workers[i].thread.init(workerFn, &m_workers[i], 0, "vt loader");
+        }
+        return true;
+    }
+
+    void TileLoader::shutdown() {
+        if (m_numThreads == 0) {
+            return;
+        }
+
+        {
+            bx::MutexScope lock(m_mutex);
+            m_quit = true;
+        }
+        m_requestSem.post(m_numThreads);
+        for (uint32_t i = 0; i < m_numThreads; ++i) {
+            m_workers[i].thread.shutdown();
+            m_workers[i].reader.close();
+        }
+        m_numThreads = 0;
+
+        // Tiles nobody polled
+        for (uint32_t i = 0; i < m_numDone; ++i) {
+            freeTile(m_done[i]);
+        }
+        m_numDone = 0;
+        m_numRequests = 0;
+        m_numInFlight = 0;
+    }
+
+    bool TileLoader::request(uint32_t id, uint32_t priority) {
+        if (m_numThreads == 0) {
+            return false;
+        }
+
+        {
+            // Every queued or in-flight tile needs a place in m_done
+            bx::MutexScope lock(m_mutex);
+            if (m_numRequests + m_numInFlight + m_numDone >= QUEUE_SIZE) {
+                return false;
+            }
+            Request& request = m_requests[m_numRequests++];
+            request.id = id;
+            request.priority = priority;
+            request.sequence = m_sequence++;
+        }
+        m_requestSem.post();
+        return true;
+    }
+
+    bool TileLoader::cancel(uint32_t id) {
+        // The semaphore keeps its count, a worker woken for nothing waits again
+        bx::MutexScope lock(m_mutex);
+        for (uint32_t i = 0; i < m_numRequests; ++i) {
+            if (m_requests[i].id == id) {
+                m_requests[i] = m_requests[--m_numRequests];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t TileLoader::poll(Tile* tiles, uint32_t max) {
+        bx::MutexScope lock(m_mutex);
+        const uint32_t num = bx::min(max, m_numDone);
+        for (uint32_t i = 0; i < num; ++i) {
+            tiles[i] = m_done[i];
+        }
+        for (uint32_t i = num; i < m_numDone; ++i) {
+            m_done[i - num] = m_done[i];
+        }
+        m_numDone -= num;
+        return num;
+    }
+
+    void TileLoader::freeTile(Tile& tile) {
+        if (tile.data) {
+            BX_FREE(entry::getAllocator(), tile.data);
+            tile.data = nullptr;
+        }
+    }
+
+    int32_t TileLoader::workerFn(bx::Thread* self, void* userData) {
+        BX_UNUSED(self);
+        Worker* worker = static_cast<Worker*>(userData);
+        return worker->loader->worker(worker->reader);
+    }
+
+    int32_t TileLoader::worker(PyramidReader& reader) {
+        profilerSetThreadName("vt loader");
+        bx::AllocatorI* allocator = entry::getAllocator();
+        for (;;) {
+            m_requestSem.wait();
+
+            uint32_t id;
+            {
+                bx::MutexScope lock(m_mutex);
+                if (m_quit) {
+                    break;
+                }
+                if (m_numRequests == 0) {
+                    continue;
+                }
+                // Sequence numbers wrap, compare them as a distance
+                uint32_t best = 0;
+                for (uint32_t i = 1; i < m_numRequests; ++i) {
+                    const Request& request = m_requests[i];
+                    if (request.priority < m_requests[best].priority
+                        || (request.priority == m_requests[best].priority
+                            && int32_t(request.sequence - m_requests[best].sequence) < 0)) {
+                        best = i;
+                    }
+                }
+                id = m_requests[best].id;
+                m_requests[best] = m_requests[--m_numRequests];
+                ++m_numInFlight;
+            }
+
+            PROFILER_SCOPE("vt tile read");
+            Tile tile;
+            tile.id = id;
+            tile.data = (uint8_t*)BX_ALLOC(allocator, m_info.tileBytes());
+            if (!reader.readTile(id, tile.data)) {
+                BX_FREE(allocator, tile.data);
+                tile.data = nullptr;
+            }
+
+            bx::MutexScope lock(m_mutex);
+            m_done[m_numDone++] = tile;
+            --m_numInFlight;
+        }
+
+        return 0;
+    }
+} // namespace vt
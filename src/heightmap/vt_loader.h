@@ -0,0 +1,75 @@
+#pragma once
+
+#include "vt_pyramid.h"
+
+#include <bx/mutex.h>
+#include <bx/semaphore.h>
+#include <bx/thread.h>
+
+// Reads pyramid tiles on worker threads. The main thread queues
+// tile ids and polls for finished tiles once per frame; each worker has its
+// own file handle so reads do not serialize on a seek. Workers take the
+// queued tile with the lowest priority value first, and tiles no longer
+// wanted can be taken back out of the queue until a worker picks them up.
+namespace vt {
+    class TileLoader {
+    public:
+        static constexpr uint32_t MAX_THREADS = 8;
+        static constexpr uint32_t QUEUE_SIZE = 128;
+
+        struct Tile {
+            uint32_t id;
+            uint8_t* data;  // PyramidInfo::tileBytes(), nullptr if the read failed
+        };
+
+        TileLoader();
+        ~TileLoader();
+
+        // 0 threads picks one per core, capped at MAX_THREADS
+        bool init(const char* path, uint32_t numThreads = 0);
+        void shutdown();
+        bool isOpen() const { return m_numThreads > 0; }
+
+        const PyramidInfo& getInfo() const { return m_info; }
+        uint32_t getNumThreads() const { return m_numThreads; }
+
+        // Returns false when the queue is full, the tile can be asked again.
+        // Equal priorities are read in request order.
+        bool request(uint32_t id, uint32_t priority = 0);
+        // Removes a queued tile, false if it is already being read or done
+        bool cancel(uint32_t id);
+        // Finished tiles, release each with freeTile()
+        uint32_t poll(Tile* tiles, uint32_t max);
+        void freeTile(Tile& tile);
+
+    private:
+        struct Request {
+            uint32_t id;
+            uint32_t priority;
+            uint32_t sequence;
+        };
+
+        struct Worker {
+            TileLoader* loader;
+            PyramidReader reader;
+            bx::Thread thread;
+        };
+
+        static int32_t workerFn(bx::Thread* self, void* userData);
+        int32_t worker(PyramidReader& reader);
+
+        PyramidInfo m_info;
+        Worker m_workers[MAX_THREADS];
+        uint32_t m_numThreads;
+
+        bx::Mutex m_mutex;
+        bx::Semaphore m_requestSem;
+        Request m_requests[QUEUE_SIZE];    // unordered
+        uint32_t m_numRequests;
+        uint32_t m_sequence;
+        Tile m_done[QUEUE_SIZE];
+        uint32_t m_numDone;
+        uint32_t m_numInFlight;
+        bool m_quit;
+    };
+} // namespace vt
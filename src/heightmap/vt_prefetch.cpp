@@ -0,0 +1,149 @@
+#include "vt_prefetch.h"
+
+#include <bx/allocator.h>
+#include <bx/math.h>
+#include <bx/sort.h>
+#include <entry/entry.h>
+
+namespace {
+    // Tiles straight behind the camera still count a little, it may turn
+    constexpr float kBehindWeight = 0.25f;
+    // A tile this close covers the screen, the score saturates
+    constexpr float kMaxTilePixels = 4096.0f;
+
+    // Edge of the tile in pixels, squared, for a camera looking its way
+    float projectedCoverage(uint32_t id, const vt::SelectParams& params) {
+        const float size = float(vt::kTileSize << vt::tileLevel(id));
+        const float distance = vt::tileDistance(id, params);
+        const float pixels = bx::min(size / bx::max(distance * params.lodFactor, 1e-6f), kMaxTilePixels);
+        return pixels * pixels;
+    }
+
+    float facing(uint32_t id, const vt::SelectParams& params, const float* direction) {
+        const float size = float(vt::kTileSize << vt::tileLevel(id));
+        float toTile[3] = {
+            (float(vt::tileX(id)) + 0.5f) * size - params.cameraX,
+            (float(vt::tileY(id)) + 0.5f) * size - params.cameraY,
+            -params.cameraZ,
+        };
+        const float length = bx::sqrt(toTile[0] * toTile[0] + toTile[1] * toTile[1] + toTile[2] * toTile[2]);
+        if (length < 1e-6f) {
+            return 1.0f;
+        }
+        const float cosine = (toTile[0] * direction[0] + toTile[1] * direction[1] + toTile[2] * direction[2]) / length;
+        return kBehindWeight + (1.0f - kBehindWeight) * bx::max(cosine, 0.0f);
+    }
+} // namespace
+
+namespace vt {
+    PrefetchPlanner::PrefetchPlanner()
+        : m_candidates(nullptr)
+        , m_temp(nullptr)
+        , m_current(nullptr)
+        , m_currentTemp(nullptr)
+        , m_tiles(nullptr)
+        , m_maxTiles(0)
+    {
+    }
+
+    PrefetchPlanner::~PrefetchPlanner() {
+        shutdown();
+    }
+
+    void PrefetchPlanner::init(uint32_t maxTiles) {
+        shutdown();
+        bx::AllocatorI* allocator = entry::getAllocator();
+        m_maxTiles = bx::max<uint32_t>(maxTiles, 1);
+        m_selector.init(m_maxTiles);
+        m_candidates = (uint64_t*)BX_ALLOC(allocator, MAX_FORECASTS * m_maxTiles * sizeof(uint64_t));
+        m_temp = (uint64_t*)BX_ALLOC(allocator, MAX_FORECASTS * m_maxTiles * sizeof(uint64_t));
+        m_current = (uint32_t*)BX_ALLOC(allocator, m_maxTiles * sizeof(uint32_t));
+        m_currentTemp = (uint32_t*)BX_ALLOC(allocator, m_maxTiles * sizeof(uint32_t));
+        m_tiles = (uint32_t*)BX_ALLOC(allocator, MAX_FORECASTS * m_maxTiles * sizeof(uint32_t));
+    }
+
+    void PrefetchPlanner::shutdown() {
+        if (m_maxTiles == 0) {
+            return;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        m_selector.shutdown();
+        BX_FREE(allocator, m_candidates);
+        BX_FREE(allocator, m_temp);
+        BX_FREE(allocator, m_current);
+        BX_FREE(allocator, m_currentTemp);
+        BX_FREE(allocator, m_tiles);
+        m_candidates = nullptr;
+        m_temp = nullptr;
+        m_current = nullptr;
+        m_currentTemp = nullptr;
+        m_tiles = nullptr;
+        m_maxTiles = 0;
+    }
+
+    uint32_t PrefetchPlanner::plan(const PyramidInfo& info, const TerrainView& view,
+        const CameraPredictor::Forecast* forecasts, uint32_t numForecasts,
+        const uint32_t* current, uint32_t numCurrent, uint32_t max) {
+        if (m_maxTiles == 0 || max == 0) {
+            return 0;
+        }
+
+        numCurrent = current != nullptr ? bx::min(numCurrent, m_maxTiles) : 0;
+        if (numCurrent > 0) {
+            bx::memCopy(m_current, current, numCurrent * sizeof(uint32_t));
+            bx::radixSort(m_current, m_currentTemp, numCurrent);
+        }
+
+        // Keyed by id with the inverted score below, so sorting puts each
+        // tile's best score first. Higher scores have larger float bits.
+        uint32_t num = 0;
+        numForecasts = bx::min<uint32_t>(numForecasts, MAX_FORECASTS);
+        for (uint32_t f = 0; f < numForecasts; ++f) {
+            const CameraPredictor::Forecast& forecast = forecasts[f];
+            const SelectParams params = terrainSelectParams(info, view, forecast.position);
+            const float weight = 1.0f / (1.0f + forecast.ahead);
+
+            const uint32_t numSelected = m_selector.select(info, params);
+            const uint32_t* tiles = m_selector.getTiles();
+            for (uint32_t i = 0; i < numSelected; ++i) {
+                if (isCurrent(tiles[i], numCurrent)) {
+                    continue;
+                }
+                const float score = projectedCoverage(tiles[i], params) * facing(tiles[i], params, forecast.direction) * weight;
+                m_candidates[num++] = (uint64_t(tiles[i]) << 32) | (UINT32_MAX - bx::floatToBits(score));
+            }
+        }
+        bx::radixSort(m_candidates, m_temp, num);
+
+        uint32_t numUnique = 0;
+        for (uint32_t i = 0; i < num; ++i) {
+            const uint32_t id = uint32_t(m_candidates[i] >> 32);
+            if (i > 0 && uint32_t(m_candidates[i - 1] >> 32) == id) {
+                continue;
+            }
+            m_candidates[numUnique++] = (m_candidates[i] << 32) | id;
+        }
+        bx::radixSort(m_candidates, m_temp, numUnique);
+
+        const uint32_t count = bx::min(numUnique, max);
+        for (uint32_t i = 0; i < count; ++i) {
+            m_tiles[i] = uint32_t(m_candidates[i]);
+        }
+        return count;
+    }
+
+    bool PrefetchPlanner::isCurrent(uint32_t id, uint32_t numCurrent) const {
+        uint32_t lo = 0;
+        uint32_t hi = numCurrent;
+        while (lo < hi) {
+            const uint32_t mid = (lo + hi) / 2;
+            if (m_current[mid] < id) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo < numCurrent && m_current[lo] == id;
+    }
+} // namespace vt
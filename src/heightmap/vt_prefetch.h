@@ -0,0 +1,42 @@
+#pragma once
+
+#include "camera_predictor.h"
+#include "vt_select.h"
+
+// Ranks the tiles a moving camera is about to want, so they can be loaded
+// before they are on screen. Every forecast camera gets a DistanceSelector
+// pass and each tile it selects is scored by its projected screen
+// coverage, less when it lies behind the forecast view direction and less
+// the further ahead the forecast is. A tile keeps its best score.
+namespace vt {
+    class PrefetchPlanner {
+    public:
+        static constexpr uint32_t MAX_FORECASTS = 8;
+
+        PrefetchPlanner();
+        ~PrefetchPlanner();
+
+        // `maxTiles` bounds the selection of each forecast, see
+        // DistanceSelector::init()
+        void init(uint32_t maxTiles);
+        void shutdown();
+
+        // Up to `max` tiles selected for any of the forecasts, which are in
+        // terrain space, best first. Tiles in `current` are left out.
+        uint32_t plan(const PyramidInfo& info, const TerrainView& view,
+            const CameraPredictor::Forecast* forecasts, uint32_t numForecasts,
+            const uint32_t* current, uint32_t numCurrent, uint32_t max);
+        const uint32_t* getTiles() const { return m_tiles; }
+
+    private:
+        bool isCurrent(uint32_t id, uint32_t numCurrent) const;
+
+        DistanceSelector m_selector;
+        uint64_t* m_candidates;
+        uint64_t* m_temp;
+        uint32_t* m_current;
+        uint32_t* m_currentTemp;
+        uint32_t* m_tiles;
+        uint32_t m_maxTiles;
+    };
+} // namespace vt
@@ -0,0 +1,385 @@
+#include "vt_pyramid.h"
+
+#include <bx/allocator.h>
+#include <bx/string.h>
+#include <entry/entry.h>
+#include <cstdio>
+
+namespace {
+    constexpr uint32_t kMagic = BX_MAKEFOURCC('V', 'T', 'P', '1');
+    constexpr uint32_t kVersion = 2;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t tiles;
+        uint32_t numLevels;
+        uint32_t tileSize;
+        uint32_t tileBorder;
+        uint32_t format;
+    };
+
+    // Box filter of two rows to ceil(width / 2) texels, the odd column is
+    // clamped so every level keeps covering the whole image
+    template <typename T, uint32_t Channels>
+    void downsampleRows(const uint8_t* src0, const uint8_t* src1, uint32_t width, uint8_t* dst) {
+        const T* row0 = (const T*)src0;
+        const T* row1 = (const T*)src1;
+        T* out = (T*)dst;
+        const uint32_t dstWidth = (width + 1) / 2;
+        for (uint32_t x = 0; x < dstWidth; ++x) {
+            const uint32_t x0 = 2 * x * Channels;
+            const uint32_t x1 = bx::min(2 * x + 1, width - 1) * Channels;
+            for (uint32_t c = 0; c < Channels; ++c) {
+                const uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                out[x * Channels + c] = T((sum + 2) / 4);
+            }
+        }
+    }
+} // namespace
+
+namespace vt {
+    bool computePyramidInfo(uint32_t width, uint32_t height, Format::Enum format, PyramidInfo& info) {
+        if (width == 0 || height == 0 || format >= Format::Count) {
+            return false;
+        }
+
+        const uint32_t tilesNeeded = bx::max((width + kTileSize - 1) / kTileSize, (height + kTileSize - 1) / kTileSize);
+        uint32_t tiles = 1;
+        uint32_t numLevels = 1;
+        while (tiles < tilesNeeded) {
+            tiles <<= 1;
+            ++numLevels;
+        }
+
+        info.width = width;
+        info.height = height;
+        info.tiles = tiles;
+        info.numLevels = numLevels;
+        info.format = format;
+        return numLevels <= kMaxLevels;
+    }
+
+    uint64_t getPyramidSize(const PyramidInfo& info) {
+        uint64_t size = sizeof(Header);
+        for (uint32_t l = 0; l < info.numLevels; ++l) {
+            size += uint64_t(info.storedTilesX(l)) * info.storedTilesY(l) * info.tileBytes();
+        }
+        return size;
+    }
+
+    bool isPyramidPath(const char* path) {
+        const int32_t len = bx::strLen(path);
+        return len > 4 && 0 == bx::strCmpI(path + len - 4, ".vtp");
+    }
+
+    PyramidBuilder::PyramidBuilder()
+        : m_tile(nullptr)
+        , m_downsampled(nullptr)
+        , m_memory(nullptr)
+        , m_open(false)
+    {
+        bx::memSet(&m_info, 0, sizeof(m_info));
+        bx::memSet(m_levels, 0, sizeof(m_levels));
+    }
+
+    PyramidBuilder::~PyramidBuilder() {
+        if (m_open) {
+            end();
+        }
+    }
+
+    bool PyramidBuilder::begin(const char* path, uint32_t width, uint32_t height, Format::Enum format) {
+        if (m_open) {
+            end();
+        }
+
+        if (!computePyramidInfo(width, height, format, m_info)) {
+            printf("Cannot build a tile pyramid of %ux%u\n", width, height);
+            return false;
+        }
+
+        bx::strCopy(m_path, sizeof(m_path), path);
+        bx::snprintf(m_tmpPath, sizeof(m_tmpPath), "%s.tmp", path);
+        m_err.reset();
+        m_memory = nullptr;
+        if (!bx::open(&m_writer, m_tmpPath, false, &m_err)) {
+            return false;
+        }
+        return beginLevels(width, height, format);
+    }
+
+    bool PyramidBuilder::begin(void* dst, uint64_t dstSize, uint32_t width, uint32_t height, Format::Enum format) {
+        if (m_open) {
+            end();
+        }
+
+        if (!computePyramidInfo(width, height, format, m_info)) {
+            printf("Cannot build a tile pyramid of %ux%u\n", width, height);
+            return false;
+        }
+        if (dstSize < getPyramidSize(m_info)) {
+            return false;
+        }
+
+        m_err.reset();
+        m_memory = (uint8_t*)dst;
+        return beginLevels(width, height, format);
+    }
+
+    bool PyramidBuilder::beginLevels(uint32_t width, uint32_t height, Format::Enum format) {
+        Header header;
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.width = width;
+        header.height = height;
+        header.tiles = m_info.tiles;
+        header.numLevels = m_info.numLevels;
+        header.tileSize = kTileSize;
+        header.tileBorder = kTileBorder;
+        header.format = format;
+        writeAt(0, &header, uint32_t(sizeof(header)));
+
+        // Tiles are written in place as soon as their rows are in, the
+        // levels finish out of order
+        bx::AllocatorI* allocator = entry::getAllocator();
+        const uint32_t texelBytes = getTexelBytes(format);
+        uint64_t offset = sizeof(Header);
+        for (uint32_t l = 0; l < m_info.numLevels; ++l) {
+            Level& level = m_levels[l];
+            level.rows = (uint8_t*)BX_ALLOC(allocator, kTileStride * m_info.levelWidth(l) * texelBytes);
+            level.numRows = 0;
+            level.nextTileRow = 0;
+            level.offset = offset;
+            offset += uint64_t(m_info.storedTilesX(l)) * m_info.storedTilesY(l) * m_info.tileBytes();
+        }
+        m_tile = (uint8_t*)BX_ALLOC(allocator, m_info.tileBytes());
+        m_downsampled = (uint8_t*)BX_ALLOC(allocator, m_info.levelWidth(1) * texelBytes);
+        m_open = true;
+        return true;
+    }
+
+    void PyramidBuilder::addRow(const void* texels) {
+        if (m_open && m_levels[0].numRows < m_info.height) {
+            pushRow(0, (const uint8_t*)texels);
+        }
+    }
+
+    bool PyramidBuilder::end() {
+        if (!m_open) {
+            return false;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        for (uint32_t l = 0; l < m_info.numLevels; ++l) {
+            BX_FREE(allocator, m_levels[l].rows);
+            m_levels[l].rows = nullptr;
+        }
+        BX_FREE(allocator, m_tile);
+        BX_FREE(allocator, m_downsampled);
+        m_tile = nullptr;
+        m_downsampled = nullptr;
+        m_open = false;
+
+        const bool complete = m_levels[m_info.numLevels - 1].numRows == m_info.levelHeight(m_info.numLevels - 1);
+        if (m_memory != nullptr) {
+            m_memory = nullptr;
+            return complete;
+        }
+
+        bx::close(&m_writer);
+        if (!complete || !m_err.isOk()) {
+            remove(m_tmpPath);
+            return false;
+        }
+
+        remove(m_path);
+        if (rename(m_tmpPath, m_path) != 0) {
+            remove(m_tmpPath);
+            return false;
+        }
+        return true;
+    }
+
+    void PyramidBuilder::writeAt(uint64_t offset, const void* data, uint32_t size) {
+        if (m_memory != nullptr) {
+            bx::memCopy(m_memory + offset, data, size);
+        } else {
+            bx::seek(&m_writer, int64_t(offset), bx::Whence::Begin);
+            bx::write(&m_writer, data, int32_t(size), &m_err);
+        }
+    }
+
+    void PyramidBuilder::pushRow(uint32_t l, const uint8_t* texels) {
+        Level& level = m_levels[l];
+        const uint32_t texelBytes = getTexelBytes(m_info.format);
+        const uint32_t rowBytes = m_info.levelWidth(l) * texelBytes;
+        const uint32_t row = level.numRows++;
+        bx::memCopy(level.rows + (row % kTileStride) * rowBytes, texels, rowBytes);
+
+        // Every pair of rows makes a row of the next level
+        if (l + 1 < m_info.numLevels && (row & 1) == 1) {
+            const uint8_t* above = getRow(l, int32_t(row) - 1);
+            const uint8_t* below = getRow(l, int32_t(row));
+            if (m_info.format == Format::R16) {
+                downsampleRows<uint16_t, 1>(above, below, m_info.levelWidth(l), m_downsampled);
+            } else {
+                downsampleRows<uint8_t, 4>(above, below, m_info.levelWidth(l), m_downsampled);
+            }
+            pushRow(l + 1, m_downsampled);
+        }
+
+        // A tile row is complete once its bottom border is in
+        if (row == level.nextTileRow * kTileSize + kTileSize + kTileBorder - 1) {
+            writeTileRow(l, level.nextTileRow++);
+        }
+
+        if (level.numRows == m_info.levelHeight(l)) {
+            finishLevel(l);
+        }
+    }
+
+    void PyramidBuilder::finishLevel(uint32_t l) {
+        Level& level = m_levels[l];
+        const uint32_t height = m_info.levelHeight(l);
+
+        // The odd last row is paired with itself
+        if (l + 1 < m_info.numLevels && (height & 1) == 1) {
+            const uint8_t* last = getRow(l, int32_t(height) - 1);
+            if (m_info.format == Format::R16) {
+                downsampleRows<uint16_t, 1>(last, last, m_info.levelWidth(l), m_downsampled);
+            } else {
+                downsampleRows<uint8_t, 4>(last, last, m_info.levelWidth(l), m_downsampled);
+            }
+            pushRow(l + 1, m_downsampled);
+        }
+
+        // Rows past the end clamp to the last one
+        while (level.nextTileRow < m_info.storedTilesY(l)) {
+            writeTileRow(l, level.nextTileRow++);
+        }
+    }
+
+    void PyramidBuilder::writeTileRow(uint32_t l, uint32_t tileRow) {
+        const Level& level = m_levels[l];
+        const uint32_t width = m_info.levelWidth(l);
+        const uint32_t texelBytes = getTexelBytes(m_info.format);
+        const uint32_t tileBytes = m_info.tileBytes();
+        const uint32_t storedX = m_info.storedTilesX(l);
+        const int32_t originY = int32_t(tileRow * kTileSize) - int32_t(kTileBorder);
+
+        for (uint32_t tx = 0; tx < storedX; ++tx) {
+            const int32_t originX = int32_t(tx * kTileSize) - int32_t(kTileBorder);
+            for (uint32_t y = 0; y < kTileStride; ++y) {
+                const uint8_t* row = getRow(l, originY + int32_t(y));
+                uint8_t* out = m_tile + y * kTileStride * texelBytes;
+                for (uint32_t x = 0; x < kTileStride; ++x) {
+                    const uint32_t sx = uint32_t(bx::clamp(originX + int32_t(x), 0, int32_t(width) - 1));
+                    bx::memCopy(out + x * texelBytes, row + sx * texelBytes, texelBytes);
+                }
+            }
+
+            const uint64_t index = uint64_t(tileRow) * storedX + tx;
+            writeAt(level.offset + index * tileBytes, m_tile, tileBytes);
+        }
+    }
+
+    const uint8_t* PyramidBuilder::getRow(uint32_t l, int32_t row) const {
+        // The ring always holds the kTileStride rows a pending tile row needs
+        const uint32_t clamped = uint32_t(bx::clamp(row, 0, int32_t(m_info.levelHeight(l)) - 1));
+        const uint32_t rowBytes = m_info.levelWidth(l) * getTexelBytes(m_info.format);
+        return m_levels[l].rows + (clamped % kTileStride) * rowBytes;
+    }
+
+    bool buildPyramid(const void* texels, uint32_t width, uint32_t height, Format::Enum format, const char* path) {
+        PyramidBuilder builder;
+        if (!builder.begin(path, width, height, format)) {
+            return false;
+        }
+
+        const uint32_t rowBytes = width * getTexelBytes(format);
+        for (uint32_t y = 0; y < height; ++y) {
+            builder.addRow((const uint8_t*)texels + size_t(y) * rowBytes);
+        }
+        return builder.end();
+    }
+
+    bool buildPyramid(const void* texels, uint32_t width, uint32_t height, Format::Enum format, void* dst, uint64_t dstSize) {
+        PyramidBuilder builder;
+        if (!builder.begin(dst, dstSize, width, height, format)) {
+            return false;
+        }
+
+        const uint32_t rowBytes = width * getTexelBytes(format);
+        for (uint32_t y = 0; y < height; ++y) {
+            builder.addRow((const uint8_t*)texels + size_t(y) * rowBytes);
+        }
+        return builder.end();
+    }
+
+    PyramidReader::PyramidReader()
+        : m_open(false)
+    {
+        bx::memSet(&m_info, 0, sizeof(m_info));
+    }
+
+    PyramidReader::~PyramidReader() {
+        close();
+    }
+
+    bool PyramidReader::open(const char* path) {
+        close();
+        if (!bx::open(&m_reader, path)) {
+            return false;
+        }
+
+        Header header;
+        bx::Error err;
+        bool valid = bx::read(&m_reader, &header, int32_t(sizeof(header)), &err) == int32_t(sizeof(header))
+            && header.magic == kMagic
+            && header.version == kVersion
+            && header.tileSize == kTileSize
+            && header.tileBorder == kTileBorder
+            && computePyramidInfo(header.width, header.height, Format::Enum(header.format), m_info)
+            && m_info.tiles == header.tiles
+            && m_info.numLevels == header.numLevels;
+
+        uint64_t offset = sizeof(Header);
+        for (uint32_t l = 0; valid && l < m_info.numLevels; ++l) {
+            m_levelOffsets[l] = offset;
+            offset += uint64_t(m_info.storedTilesX(l)) * m_info.storedTilesY(l) * m_info.tileBytes();
+        }
+        valid = valid && uint64_t(bx::getSize(&m_reader)) == offset;
+
+        if (!valid) {
+            printf("Invalid tile pyramid %s\n", path);
+            bx::close(&m_reader);
+            return false;
+        }
+        m_open = true;
+        return true;
+    }
+
+    void PyramidReader::close() {
+        if (m_open) {
+            bx::close(&m_reader);
+            m_open = false;
+        }
+    }
+
+    bool PyramidReader::readTile(uint32_t id, uint8_t* dst) {
+        if (!m_open || !m_info.isValid(id)) {
+            return false;
+        }
+
+        const uint32_t level = tileLevel(id);
+        const uint64_t index = uint64_t(tileY(id)) * m_info.storedTilesX(level) + tileX(id);
+        const uint32_t tileBytes = m_info.tileBytes();
+        bx::seek(&m_reader, int64_t(m_levelOffsets[level] + index * tileBytes), bx::Whence::Begin);
+
+        bx::Error err;
+        return bx::read(&m_reader, dst, int32_t(tileBytes), &err) == int32_t(tileBytes);
+    }
+} // namespace vt
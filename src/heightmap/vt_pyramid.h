@@ -0,0 +1,140 @@
+#pragma once
+
+#include <bx/file.h>
+#include <cstdint>
+
+// Tile pyramid shared by the virtual texture and the streamed heightmap.
+// The virtual image is a square power-of-two grid of tiles with the source
+// image in its top left corner; every level halves the grid until it is a
+// single tile. Only tiles that overlap the image are stored. Tiles carry a
+// border of kTileBorder texels copied from their neighbours so the physical
+// cache can be sampled bilinearly.
+namespace vt {
+    constexpr uint32_t kTileSize = 128;
+    constexpr uint32_t kTileBorder = 4;
+    constexpr uint32_t kTileStride = kTileSize + 2 * kTileBorder;
+    // 2048 tiles per axis (256k texels) keeps the indirection texture at 2048^2
+    constexpr uint32_t kMaxLevels = 12;
+    constexpr uint32_t kInvalidTile = UINT32_MAX;
+
+    struct Format {
+        enum Enum {
+            RGBA8,  // diffuse imagery
+            R16,    // heightmaps
+            Count
+        };
+    };
+
+    inline uint32_t getTexelBytes(Format::Enum format) { return format == Format::R16 ? 2 : 4; }
+
+    // Tile ids match the feedback shader: level in the top 4 bits, then
+    // 14 bits each of y and x.
+    inline uint32_t packTileId(uint32_t level, uint32_t x, uint32_t y) { return (level << 28) | (y << 14) | x; }
+    inline uint32_t tileLevel(uint32_t id) { return id >> 28; }
+    inline uint32_t tileX(uint32_t id) { return id & 0x3fff; }
+    inline uint32_t tileY(uint32_t id) { return (id >> 14) & 0x3fff; }
+    inline uint32_t parentTile(uint32_t id) { return packTileId(tileLevel(id) + 1, tileX(id) >> 1, tileY(id) >> 1); }
+
+    struct PyramidInfo {
+        uint32_t width;     // source texels
+        uint32_t height;
+        uint32_t tiles;     // virtual grid per axis at level 0, power of two
+        uint32_t numLevels;
+        Format::Enum format;
+
+        uint32_t tileBytes() const { return kTileStride * kTileStride * getTexelBytes(format); }
+        uint32_t levelTiles(uint32_t level) const { return tiles >> level; }
+        uint32_t levelWidth(uint32_t level) const { return (width + (1u << level) - 1) >> level; }
+        uint32_t levelHeight(uint32_t level) const { return (height + (1u << level) - 1) >> level; }
+        // Tiles overlapping the image, the ones stored in the file
+        uint32_t storedTilesX(uint32_t level) const { return (levelWidth(level) + kTileSize - 1) / kTileSize; }
+        uint32_t storedTilesY(uint32_t level) const { return (levelHeight(level) + kTileSize - 1) / kTileSize; }
+        bool isValid(uint32_t id) const {
+            return id != kInvalidTile
+                && tileLevel(id) < numLevels
+                && tileX(id) < storedTilesX(tileLevel(id))
+                && tileY(id) < storedTilesY(tileLevel(id));
+        }
+    };
+
+    // Grid and level count for a source of `width` x `height` texels, false
+    // if it does not fit in the tile id.
+    bool computePyramidInfo(uint32_t width, uint32_t height, Format::Enum format, PyramidInfo& info);
+
+    // Bytes of the pyramid file of `info`, header included
+    uint64_t getPyramidSize(const PyramidInfo& info);
+
+    bool isPyramidPath(const char* path);
+
+    // Writes a pyramid file from rows fed top to bottom, so sources larger
+    // than memory (or than a texture) can be converted. Every level keeps
+    // one tile row plus borders, kTileStride rows, of its own width.
+    class PyramidBuilder {
+    public:
+        PyramidBuilder();
+        ~PyramidBuilder();
+
+        bool begin(const char* path, uint32_t width, uint32_t height, Format::Enum format);
+        // Writes the file into `dst` instead, false if `dstSize` is less
+        // than getPyramidSize()
+        bool begin(void* dst, uint64_t dstSize, uint32_t width, uint32_t height, Format::Enum format);
+        // `width` texels of the pyramid's format
+        void addRow(const void* texels);
+        // Renames the file into place once every row was added, false if
+        // any write failed or a row is missing
+        bool end();
+
+        const PyramidInfo& getInfo() const { return m_info; }
+
+    private:
+        struct Level {
+            uint8_t* rows;      // ring of kTileStride rows
+            uint32_t numRows;   // rows added so far
+            uint32_t nextTileRow;
+            uint64_t offset;    // of the level's first tile in the file
+        };
+
+        bool beginLevels(uint32_t width, uint32_t height, Format::Enum format);
+        void writeAt(uint64_t offset, const void* data, uint32_t size);
+        void pushRow(uint32_t level, const uint8_t* texels);
+        void finishLevel(uint32_t level);
+        void writeTileRow(uint32_t level, uint32_t tileRow);
+        const uint8_t* getRow(uint32_t level, int32_t row) const;
+
+        PyramidInfo m_info;
+        Level m_levels[kMaxLevels];
+        uint8_t* m_tile;
+        uint8_t* m_downsampled;
+        bx::FileWriter m_writer;
+        bx::Error m_err;
+        uint8_t* m_memory;      // written instead of the file when set
+        char m_path[512];
+        char m_tmpPath[512];
+        bool m_open;
+    };
+
+    // Builds a pyramid file from an image held in memory.
+    bool buildPyramid(const void* texels, uint32_t width, uint32_t height, Format::Enum format, const char* path);
+    bool buildPyramid(const void* texels, uint32_t width, uint32_t height, Format::Enum format, void* dst, uint64_t dstSize);
+
+    // Reads tiles from a pyramid file. Not thread-safe, use one per thread.
+    class PyramidReader {
+    public:
+        PyramidReader();
+        ~PyramidReader();
+
+        bool open(const char* path);
+        void close();
+
+        const PyramidInfo& getInfo() const { return m_info; }
+
+        // Writes getInfo().tileBytes() to `dst`.
+        bool readTile(uint32_t id, uint8_t* dst);
+
+    private:
+        bx::FileReader m_reader;
+        PyramidInfo m_info;
+        uint64_t m_levelOffsets[kMaxLevels];
+        bool m_open;
+    };
+} // namespace vt
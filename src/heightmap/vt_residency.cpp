@@ -0,0 +1,480 @@
+#include "vt_residency.h"
+
+#include <bx/allocator.h>
+#include <bx/sort.h>
+#include <entry/entry.h>
+
+namespace {
+    constexpr uint32_t kEmptyKey = vt::kInvalidTile;
+
+    uint32_t encodeEntry(uint32_t slotX, uint32_t slotY, uint32_t level) {
+        return slotX | (slotY << 8) | (level << 16) | 0xff000000;
+    }
+} // namespace
+
+namespace vt {
+    Residency::Residency()
+        : m_slotsX(0)
+        , m_slotsY(0)
+        , m_numSlots(0)
+        , m_slotTile(nullptr)
+        , m_slotLastUse(nullptr)
+        , m_mapCapacity(0)
+        , m_mapShift(0)
+        , m_mapKeys(nullptr)
+        , m_mapValues(nullptr)
+        , m_numLoading(0)
+        , m_wanted(nullptr)
+        , m_wantedTemp(nullptr)
+        , m_wantedCapacity(0)
+        , m_numMissing(0)
+        , m_frame(0)
+        , m_prefetch(nullptr)
+        , m_prefetchCapacity(0)
+        , m_numPrefetch(0)
+    {
+        bx::memSet(&m_info, 0, sizeof(m_info));
+        bx::memSet(m_indirection, 0, sizeof(m_indirection));
+        bx::memSet(m_residentPerLevel, 0, sizeof(m_residentPerLevel));
+        bx::memSet(&m_stats, 0, sizeof(m_stats));
+    }
+
+    Residency::~Residency() {
+        shutdown();
+    }
+
+    bool Residency::init(const PyramidInfo& info, uint32_t slotsX, uint32_t slotsY) {
+        shutdown();
+        if (info.numLevels == 0 || info.numLevels > kMaxLevels
+            || slotsX == 0 || slotsX > 256 || slotsY == 0 || slotsY > 256) {
+            return false;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        m_info = info;
+        m_slotsX = slotsX;
+        m_slotsY = slotsY;
+        m_numSlots = slotsX * slotsY;
+        m_slotTile = (uint32_t*)BX_ALLOC(allocator, m_numSlots * sizeof(uint32_t));
+        m_slotLastUse = (uint32_t*)BX_ALLOC(allocator, m_numSlots * sizeof(uint32_t));
+        bx::memSet(m_slotTile, 0xff, m_numSlots * sizeof(uint32_t));
+        bx::memSet(m_slotLastUse, 0, m_numSlots * sizeof(uint32_t));
+
+        // At most half full keeps probe chains short
+        m_mapCapacity = 16;
+        m_mapShift = 28;
+        while (m_mapCapacity < m_numSlots * 2) {
+            m_mapCapacity <<= 1;
+            --m_mapShift;
+        }
+        m_mapKeys = (uint32_t*)BX_ALLOC(allocator, m_mapCapacity * sizeof(uint32_t));
+        m_mapValues = (uint16_t*)BX_ALLOC(allocator, m_mapCapacity * sizeof(uint16_t));
+        bx::memSet(m_mapKeys, 0xff, m_mapCapacity * sizeof(uint32_t));
+
+        for (uint32_t level = 0; level < m_info.numLevels; ++level) {
+            const uint32_t tiles = m_info.levelTiles(level);
+            m_indirection[level] = (uint32_t*)BX_ALLOC(allocator, tiles * tiles * sizeof(uint32_t));
+            bx::memSet(m_indirection[level], 0, tiles * tiles * sizeof(uint32_t));
+            m_dirty[level] = { 0, 0, tiles, tiles };
+        }
+
+        m_stats.numSlots = m_numSlots;
+        return true;
+    }
+
+    void Residency::shutdown() {
+        bx::AllocatorI* allocator = entry::getAllocator();
+        for (uint32_t level = 0; level < kMaxLevels; ++level) {
+            if (m_indirection[level]) {
+                BX_FREE(allocator, m_indirection[level]);
+                m_indirection[level] = nullptr;
+            }
+        }
+        if (m_slotTile) {
+            BX_FREE(allocator, m_slotTile);
+            BX_FREE(allocator, m_slotLastUse);
+            BX_FREE(allocator, m_mapKeys);
+            BX_FREE(allocator, m_mapValues);
+            m_slotTile = nullptr;
+            m_slotLastUse = nullptr;
+            m_mapKeys = nullptr;
+            m_mapValues = nullptr;
+        }
+        if (m_wanted) {
+            BX_FREE(allocator, m_wanted);
+            BX_FREE(allocator, m_wantedTemp);
+            m_wanted = nullptr;
+            m_wantedTemp = nullptr;
+        }
+        if (m_prefetch) {
+            BX_FREE(allocator, m_prefetch);
+            m_prefetch = nullptr;
+        }
+        m_numSlots = 0;
+        m_wantedCapacity = 0;
+        m_numMissing = 0;
+        m_prefetchCapacity = 0;
+        m_numPrefetch = 0;
+        m_numLoading = 0;
+        m_frame = 0;
+        bx::memSet(m_residentPerLevel, 0, sizeof(m_residentPerLevel));
+        bx::memSet(&m_stats, 0, sizeof(m_stats));
+    }
+
+    void Residency::reserveWanted(uint32_t count) {
+        if (count <= m_wantedCapacity) {
+            return;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        const uint32_t capacity = bx::max<uint32_t>(count, bx::max<uint32_t>(m_wantedCapacity * 2, 1024));
+        m_wanted = (uint64_t*)BX_REALLOC(allocator, m_wanted, capacity * sizeof(uint64_t));
+        m_wantedTemp = (uint64_t*)BX_REALLOC(allocator, m_wantedTemp, capacity * sizeof(uint64_t));
+        m_wantedCapacity = capacity;
+    }
+
+    void Residency::processFeedback(const uint32_t* ids, uint32_t count, uint32_t frame) {
+        m_frame = frame;
+        reserveWanted(count);
+
+        // Visible tiles with the number of feedback texels that want them
+        uint32_t num = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (m_info.isValid(ids[i])) {
+                m_wanted[num++] = ids[i];
+            }
+        }
+        bx::radixSort(m_wanted, m_wantedTemp, num);
+
+        uint32_t numUnique = 0;
+        for (uint32_t i = 0; i < num;) {
+            const uint64_t id = m_wanted[i];
+            uint32_t run = 1;
+            while (i + run < num && m_wanted[i + run] == id) {
+                ++run;
+            }
+            m_wanted[numUnique++] = (id << 32) | run;
+            i += run;
+        }
+
+        // Add the ancestors and merge them with tiles already in the list
+        reserveWanted(numUnique * m_info.numLevels);
+        num = numUnique;
+        for (uint32_t i = 0; i < numUnique; ++i) {
+            uint32_t id = uint32_t(m_wanted[i] >> 32);
+            for (uint32_t level = tileLevel(id) + 1; level < m_info.numLevels; ++level) {
+                id = parentTile(id);
+                m_wanted[num++] = uint64_t(id) << 32;
+            }
+        }
+        bx::radixSort(m_wanted, m_wantedTemp, num);
+
+        for (uint32_t i = 0; i < m_numLoading; ++i) {
+            m_loadingFlags[i] &= ~LOADING_WANTED;
+        }
+
+        uint32_t numWanted = 0;
+        m_numMissing = 0;
+        for (uint32_t i = 0; i < num;) {
+            const uint32_t id = uint32_t(m_wanted[i] >> 32);
+            uint32_t texels = 0;
+            for (; i < num && uint32_t(m_wanted[i] >> 32) == id; ++i) {
+                texels += uint32_t(m_wanted[i]);
+            }
+            ++numWanted;
+
+            const uint32_t slot = mapFind(id);
+            const int32_t loading = slot == UINT32_MAX ? findLoading(id) : -1;
+            if (slot != UINT32_MAX) {
+                m_slotLastUse[slot] = frame;
+            } else if (loading >= 0) {
+                m_loadingFlags[loading] |= LOADING_WANTED;
+            } else {
+                // Coarsest level first, then the most covered tiles
+                const uint64_t order = uint64_t(kMaxLevels - 1 - tileLevel(id)) << 56
+                    | uint64_t(0xffffff - bx::min<uint32_t>(texels, 0xffffff)) << 32;
+                m_wanted[m_numMissing++] = order | id;
+            }
+        }
+        bx::radixSort(m_wanted, m_wantedTemp, m_numMissing);
+
+        m_stats.wanted = numWanted;
+        m_stats.missing = m_numMissing;
+    }
+
+    void Residency::setPrefetch(const uint32_t* ids, uint32_t count) {
+        if (count > m_prefetchCapacity) {
+            m_prefetchCapacity = bx::max<uint32_t>(count, m_prefetchCapacity * 2);
+            m_prefetch = (uint32_t*)BX_REALLOC(entry::getAllocator(), m_prefetch, m_prefetchCapacity * sizeof(uint32_t));
+        }
+
+        for (uint32_t i = 0; i < m_numLoading; ++i) {
+            m_loadingFlags[i] &= ~LOADING_PREFETCH;
+        }
+
+        // Resident prefetch tiles look used just before the current frame:
+        // evicted after every other tile not wanted now
+        const uint32_t lastUse = m_frame > 0 ? m_frame - 1 : 0;
+        m_numPrefetch = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!m_info.isValid(ids[i])) {
+                continue;
+            }
+            const uint32_t slot = mapFind(ids[i]);
+            const int32_t loading = slot == UINT32_MAX ? findLoading(ids[i]) : -1;
+            if (slot != UINT32_MAX) {
+                m_slotLastUse[slot] = bx::max(m_slotLastUse[slot], lastUse);
+            } else if (loading >= 0) {
+                m_loadingFlags[loading] |= LOADING_PREFETCH;
+            } else {
+                m_prefetch[m_numPrefetch++] = ids[i];
+            }
+        }
+        m_stats.prefetch = m_numPrefetch;
+    }
+
+    uint32_t Residency::collectRequests(uint32_t* ids, uint32_t max, uint32_t* priorities) {
+        uint32_t num = 0;
+        for (uint32_t i = 0; i < m_numMissing && num < max && m_numLoading < MAX_LOADING; ++i) {
+            const uint32_t id = uint32_t(m_wanted[i]);
+            if (mapFind(id) == UINT32_MAX && !isLoading(id)) {
+                m_loading[m_numLoading] = id;
+                m_loadingFlags[m_numLoading++] = LOADING_WANTED;
+                if (priorities) {
+                    priorities[num] = bx::min(i, PREFETCH_PRIORITY - 1);
+                }
+                ids[num++] = id;
+            }
+        }
+
+        uint32_t numPrefetchLoading = 0;
+        for (uint32_t i = 0; i < m_numLoading; ++i) {
+            numPrefetchLoading += m_loadingFlags[i] == LOADING_PREFETCH ? 1 : 0;
+        }
+        for (uint32_t i = 0; i < m_numPrefetch && num < max && m_numLoading < MAX_LOADING
+            && numPrefetchLoading < MAX_PREFETCH_LOADING; ++i) {
+            const uint32_t id = m_prefetch[i];
+            if (mapFind(id) == UINT32_MAX && !isLoading(id)) {
+                m_loading[m_numLoading] = id;
+                m_loadingFlags[m_numLoading++] = LOADING_PREFETCH;
+                if (priorities) {
+                    priorities[num] = PREFETCH_PRIORITY + i;
+                }
+                ids[num++] = id;
+                ++numPrefetchLoading;
+                ++m_stats.prefetchRequests;
+            }
+        }
+        m_stats.loading = m_numLoading;
+        return num;
+    }
+
+    uint32_t Residency::collectStale(uint32_t* ids, uint32_t max) const {
+        uint32_t num = 0;
+        for (uint32_t i = 0; i < m_numLoading && num < max; ++i) {
+            if (m_loadingFlags[i] == 0) {
+                ids[num++] = m_loading[i];
+            }
+        }
+        return num;
+    }
+
+    int32_t Residency::commit(uint32_t id, uint32_t* evicted) {
+        if (evicted) {
+            *evicted = kInvalidTile;
+        }
+        const int32_t loading = findLoading(id);
+        const bool prefetchOnly = loading >= 0 && m_loadingFlags[loading] == LOADING_PREFETCH;
+        cancel(id);
+        if (!m_info.isValid(id)) {
+            return -1;
+        }
+
+        uint32_t slot = mapFind(id);
+        if (slot != UINT32_MAX) {
+            return int32_t(slot);
+        }
+
+        // A free slot, or else the least recently wanted tile that is not
+        // wanted now. The top level is never evicted, it is the fallback.
+        const uint32_t topLevel = m_info.numLevels - 1;
+        uint32_t oldest = UINT32_MAX;
+        for (uint32_t i = 0; i < m_numSlots; ++i) {
+            if (m_slotTile[i] == kInvalidTile) {
+                slot = i;
+                break;
+            }
+            if (m_slotLastUse[i] < m_frame && m_slotLastUse[i] < oldest && tileLevel(m_slotTile[i]) != topLevel) {
+                oldest = m_slotLastUse[i];
+                slot = i;
+            }
+        }
+        if (slot == UINT32_MAX) {
+            ++m_stats.dropped;
+            return -1;
+        }
+
+        const uint32_t previous = m_slotTile[slot];
+        if (previous != kInvalidTile) {
+            mapRemove(previous);
+            --m_residentPerLevel[tileLevel(previous)];
+            --m_stats.resident;
+            ++m_stats.evicted;
+            refreshIndirection(previous);
+            if (evicted) {
+                *evicted = previous;
+            }
+        }
+
+        m_slotTile[slot] = id;
+        m_slotLastUse[slot] = prefetchOnly && m_frame > 0 ? m_frame - 1 : m_frame;
+        mapInsert(id, uint16_t(slot));
+        ++m_residentPerLevel[tileLevel(id)];
+        ++m_stats.resident;
+        ++m_stats.committed;
+        refreshIndirection(id);
+        return int32_t(slot);
+    }
+
+    void Residency::cancel(uint32_t id) {
+        const int32_t loading = findLoading(id);
+        if (loading >= 0) {
+            --m_numLoading;
+            m_loading[loading] = m_loading[m_numLoading];
+            m_loadingFlags[loading] = m_loadingFlags[m_numLoading];
+        }
+        m_stats.loading = m_numLoading;
+    }
+
+    int32_t Residency::findSlot(uint32_t id) const {
+        const uint32_t slot = mapFind(id);
+        return slot == UINT32_MAX ? -1 : int32_t(slot);
+    }
+
+    bool Residency::isLoading(uint32_t id) const {
+        return findLoading(id) >= 0;
+    }
+
+    int32_t Residency::findLoading(uint32_t id) const {
+        for (uint32_t i = 0; i < m_numLoading; ++i) {
+            if (m_loading[i] == id) {
+                return int32_t(i);
+            }
+        }
+        return -1;
+    }
+
+    uint32_t Residency::getIndirectionEntry(uint32_t id) const {
+        const uint32_t level = tileLevel(id);
+        if (level >= m_info.numLevels || tileX(id) >= m_info.levelTiles(level) || tileY(id) >= m_info.levelTiles(level)) {
+            return 0;
+        }
+        return m_indirection[level][tileY(id) * m_info.levelTiles(level) + tileX(id)];
+    }
+
+    bool Residency::getDirtyRect(uint32_t level, uint32_t& x, uint32_t& y, uint32_t& width, uint32_t& height) const {
+        if (level >= m_info.numLevels || m_dirty[level].minX >= m_dirty[level].maxX) {
+            return false;
+        }
+        const DirtyRect& rect = m_dirty[level];
+        x = rect.minX;
+        y = rect.minY;
+        width = rect.maxX - rect.minX;
+        height = rect.maxY - rect.minY;
+        return true;
+    }
+
+    void Residency::clearDirty() {
+        for (uint32_t level = 0; level < m_info.numLevels; ++level) {
+            m_dirty[level] = { UINT32_MAX, UINT32_MAX, 0, 0 };
+        }
+    }
+
+    uint32_t Residency::mapFind(uint32_t id) const {
+        if (m_mapCapacity == 0) {
+            return UINT32_MAX;
+        }
+        const uint32_t mask = m_mapCapacity - 1;
+        for (uint32_t index = (id * 0x9e3779b1u) >> m_mapShift;; index = (index + 1) & mask) {
+            if (m_mapKeys[index] == id) {
+                return m_mapValues[index];
+            }
+            if (m_mapKeys[index] == kEmptyKey) {
+                return UINT32_MAX;
+            }
+        }
+    }
+
+    void Residency::mapInsert(uint32_t id, uint16_t slot) {
+        const uint32_t mask = m_mapCapacity - 1;
+        uint32_t index = (id * 0x9e3779b1u) >> m_mapShift;
+        while (m_mapKeys[index] != kEmptyKey && m_mapKeys[index] != id) {
+            index = (index + 1) & mask;
+        }
+        m_mapKeys[index] = id;
+        m_mapValues[index] = slot;
+    }
+
+    void Residency::mapRemove(uint32_t id) {
+        const uint32_t mask = m_mapCapacity - 1;
+        uint32_t index = (id * 0x9e3779b1u) >> m_mapShift;
+        while (m_mapKeys[index] != id) {
+            if (m_mapKeys[index] == kEmptyKey) {
+                return;
+            }
+            index = (index + 1) & mask;
+        }
+
+        // Backward shift, keys after the hole move up if their home allows
+        for (uint32_t next = (index + 1) & mask; m_mapKeys[next] != kEmptyKey; next = (next + 1) & mask) {
+            const uint32_t home = (m_mapKeys[next] * 0x9e3779b1u) >> m_mapShift;
+            if (((next - home) & mask) >= ((next - index) & mask)) {
+                m_mapKeys[index] = m_mapKeys[next];
+                m_mapValues[index] = m_mapValues[next];
+                index = next;
+            }
+        }
+        m_mapKeys[index] = kEmptyKey;
+    }
+
+    void Residency::refreshIndirection(uint32_t id) {
+        // Every virtual tile under `id`, at every finer level, may now fall
+        // back to a different tile. Levels are refreshed coarse to fine so
+        // each can copy its parent's entry.
+        const uint32_t tileLevelId = tileLevel(id);
+        for (int32_t level = int32_t(tileLevelId); level >= 0; --level) {
+            const uint32_t shift = tileLevelId - uint32_t(level);
+            const uint32_t tiles = m_info.levelTiles(level);
+            const uint32_t minX = tileX(id) << shift;
+            const uint32_t minY = tileY(id) << shift;
+            const uint32_t maxX = bx::min(minX + (1u << shift), tiles);
+            const uint32_t maxY = bx::min(minY + (1u << shift), tiles);
+            const uint32_t storedX = m_info.storedTilesX(level);
+            const uint32_t storedY = m_info.storedTilesY(level);
+            const bool hasResident = m_residentPerLevel[level] > 0;
+            const uint32_t* parent = uint32_t(level) + 1 < m_info.numLevels ? m_indirection[level + 1] : nullptr;
+            const uint32_t parentTiles = parent ? m_info.levelTiles(level + 1) : 0;
+
+            for (uint32_t y = minY; y < maxY; ++y) {
+                uint32_t* row = m_indirection[level] + y * tiles;
+                for (uint32_t x = minX; x < maxX; ++x) {
+                    uint32_t slot = UINT32_MAX;
+                    if (hasResident && x < storedX && y < storedY) {
+                        slot = mapFind(packTileId(uint32_t(level), x, y));
+                    }
+                    if (slot != UINT32_MAX) {
+                        row[x] = encodeEntry(slot % m_slotsX, slot / m_slotsX, uint32_t(level));
+                    } else {
+                        row[x] = parent ? parent[(y >> 1) * parentTiles + (x >> 1)] : 0;
+                    }
+                }
+            }
+
+            DirtyRect& rect = m_dirty[level];
+            rect.minX = bx::min(rect.minX, minX);
+            rect.minY = bx::min(rect.minY, minY);
+            rect.maxX = bx::max(rect.maxX, maxX);
+            rect.maxY = bx::max(rect.maxY, maxY);
+        }
+    }
+} // namespace vt
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "vt_pyramid.h"
+
+// CPU side of a streamed tile pyramid: which tiles are wanted, which live in
+// the physical cache and where, and the indirection table that maps every
+// virtual tile to the best resident tile covering it. No GPU calls, the
+// renderer uploads the results, so the whole policy can run on synthetic
+// feedback.
+//
+// Each frame:
+//   processFeedback()  tile ids rendered by the feedback pass, or selected
+//   setPrefetch()      tiles expected to be wanted soon, optional
+//   collectStale()     loads nobody wants any more, to cancel
+//   collectRequests()  missing tiles to hand to the loader
+//   commit()           loaded tiles, returns the cache slot to upload to
+//   getDirtyRect()     indirection texels to upload per level
+namespace vt {
+    class Residency {
+    public:
+        struct Stats {
+            uint32_t numSlots;
+            uint32_t resident;
+            uint32_t loading;
+            uint32_t wanted;        // tiles and ancestors in the last feedback
+            uint32_t missing;       // of those, neither resident nor loading
+            uint32_t prefetch;      // prefetch tiles neither resident nor loading
+            uint32_t committed;     // totals since init
+            uint32_t prefetchRequests;
+            uint32_t evicted;
+            uint32_t dropped;       // loaded but no slot free of current tiles
+        };
+
+        static constexpr uint32_t MAX_LOADING = 64;
+        // Prefetch never holds more loads than this, wanted tiles get the rest
+        static constexpr uint32_t MAX_PREFETCH_LOADING = MAX_LOADING / 2;
+        // Request priorities of prefetch tiles start here, below every
+        // wanted tile
+        static constexpr uint32_t PREFETCH_PRIORITY = 0x10000;
+
+        Residency();
+        ~Residency();
+
+        // The cache holds slotsX * slotsY tiles, both at most 256
+        bool init(const PyramidInfo& info, uint32_t slotsX, uint32_t slotsY);
+        void shutdown();
+
+        const PyramidInfo& getInfo() const { return m_info; }
+        uint32_t getSlotsX() const { return m_slotsX; }
+        uint32_t getSlotsY() const { return m_slotsY; }
+
+        // Ids equal to kInvalidTile or outside the pyramid are ignored.
+        // Ancestors of every visible tile are wanted too, so a coarser
+        // fallback is always on its way.
+        void processFeedback(const uint32_t* ids, uint32_t count, uint32_t frame);
+
+        // Tiles likely wanted soon, most important first. They are loaded
+        // after every wanted tile and, once resident, are the last to be
+        // evicted for wanted ones. Replaces the previous list.
+        void setPrefetch(const uint32_t* ids, uint32_t count);
+
+        // Up to `max` wanted tiles that are neither resident nor loading,
+        // coarsest first and then by screen coverage, followed by prefetch
+        // tiles. They are marked as loading until commit() or cancel().
+        // `priorities`, if given, receives the loader priority of each.
+        uint32_t collectRequests(uint32_t* ids, uint32_t max, uint32_t* priorities = nullptr);
+
+        // Loading tiles that are neither wanted nor prefetched any more.
+        // They stay loading, cancel() those the loader gave back.
+        uint32_t collectStale(uint32_t* ids, uint32_t max) const;
+
+        // Places a loaded tile and returns its slot, or -1 if every slot
+        // holds a tile seen in the last feedback. `evicted` receives the
+        // tile that was replaced, kInvalidTile if none.
+        int32_t commit(uint32_t id, uint32_t* evicted = nullptr);
+        void cancel(uint32_t id);
+
+        int32_t findSlot(uint32_t id) const;
+        bool isResident(uint32_t id) const { return findSlot(id) >= 0; }
+        bool isLoading(uint32_t id) const;
+
+        // RGBA8 per virtual tile: slot x, slot y, level of the resident
+        // tile used, 255. Alpha is 0 until the top level is resident.
+        const uint32_t* getIndirection(uint32_t level) const { return m_indirection[level]; }
+        uint32_t getIndirectionEntry(uint32_t id) const;
+        // Returns false when nothing changed at `level` since clearDirty()
+        bool getDirtyRect(uint32_t level, uint32_t& x, uint32_t& y, uint32_t& width, uint32_t& height) const;
+        void clearDirty();
+
+        const Stats& getStats() const { return m_stats; }
+
+    private:
+        struct DirtyRect {
+            uint32_t minX, minY, maxX, maxY;
+        };
+
+        // Why a tile is loading, cleared when the respective list is replaced
+        enum LoadingFlags {
+            LOADING_WANTED = 1,
+            LOADING_PREFETCH = 2,
+        };
+
+        // Open addressing from tile id to slot, linear probing
+        uint32_t mapFind(uint32_t id) const;
+        void mapInsert(uint32_t id, uint16_t slot);
+        void mapRemove(uint32_t id);
+
+        void reserveWanted(uint32_t count);
+        int32_t findLoading(uint32_t id) const;
+        void refreshIndirection(uint32_t id);
+
+        PyramidInfo m_info;
+        uint32_t m_slotsX;
+        uint32_t m_slotsY;
+        uint32_t m_numSlots;
+        uint32_t* m_slotTile;
+        uint32_t* m_slotLastUse;
+
+        uint32_t m_mapCapacity;
+        uint32_t m_mapShift;
+        uint32_t* m_mapKeys;
+        uint16_t* m_mapValues;
+
+        uint32_t m_loading[MAX_LOADING];
+        uint8_t m_loadingFlags[MAX_LOADING];
+        uint32_t m_numLoading;
+
+        // Sorted missing tiles of the last feedback, and scratch for sorting
+        uint64_t* m_wanted;
+        uint64_t* m_wantedTemp;
+        uint32_t m_wantedCapacity;
+        uint32_t m_numMissing;
+        uint32_t m_frame;
+
+        // Prefetch tiles neither resident nor loading when set, in order
+        uint32_t* m_prefetch;
+        uint32_t m_prefetchCapacity;
+        uint32_t m_numPrefetch;
+
+        uint32_t* m_indirection[kMaxLevels];
+        DirtyRect m_dirty[kMaxLevels];
+        uint32_t m_residentPerLevel[kMaxLevels];
+
+        Stats m_stats;
+    };
+} // namespace vt
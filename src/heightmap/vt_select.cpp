@@ -0,0 +1,132 @@
+#include "vt_select.h"
+
+#include <bx/allocator.h>
+#include <bx/math.h>
+#include <bx/sort.h>
+#include <entry/entry.h>
+
+namespace {
+    // Non-negative floats order like their bits
+    uint64_t sortKey(uint32_t id, float distance) {
+        return (uint64_t(bx::floatToBits(distance)) << 32) | id;
+    }
+} // namespace
+
+namespace vt {
+    SelectParams terrainSelectParams(const PyramidInfo& info, const TerrainView& view, const float* position) {
+        const float texelsPerUnit = float(info.height) / (2.0f * view.halfHeight);
+        SelectParams params;
+        params.cameraX = (position[0] + view.halfWidth) * texelsPerUnit;
+        params.cameraY = (position[1] + view.halfHeight) * texelsPerUnit;
+        params.cameraZ = bx::max(position[2] - view.heightScale, 0.0f) * texelsPerUnit;
+        params.lodFactor = view.lodFactor;
+        return params;
+    }
+
+    float tileDistance(uint32_t id, const SelectParams& params) {
+        const float size = float(kTileSize << tileLevel(id));
+        const float x0 = float(tileX(id)) * size;
+        const float y0 = float(tileY(id)) * size;
+        const float dx = bx::max(bx::max(x0 - params.cameraX, params.cameraX - (x0 + size)), 0.0f);
+        const float dy = bx::max(bx::max(y0 - params.cameraY, params.cameraY - (y0 + size)), 0.0f);
+        return bx::sqrt(dx * dx + dy * dy + params.cameraZ * params.cameraZ);
+    }
+
+    DistanceSelector::DistanceSelector()
+        : m_tiles(nullptr)
+        , m_frontier(nullptr)
+        , m_next(nullptr)
+        , m_temp(nullptr)
+        , m_maxTiles(0)
+    {
+    }
+
+    DistanceSelector::~DistanceSelector() {
+        shutdown();
+    }
+
+    void DistanceSelector::init(uint32_t maxTiles) {
+        shutdown();
+        bx::AllocatorI* allocator = entry::getAllocator();
+        m_maxTiles = bx::max<uint32_t>(maxTiles, 1);
+        m_tiles = (uint32_t*)BX_ALLOC(allocator, m_maxTiles * sizeof(uint32_t));
+        m_frontier = (uint64_t*)BX_ALLOC(allocator, m_maxTiles * sizeof(uint64_t));
+        m_next = (uint64_t*)BX_ALLOC(allocator, m_maxTiles * sizeof(uint64_t));
+        m_temp = (uint64_t*)BX_ALLOC(allocator, m_maxTiles * sizeof(uint64_t));
+    }
+
+    void DistanceSelector::shutdown() {
+        if (m_maxTiles == 0) {
+            return;
+        }
+
+        bx::AllocatorI* allocator = entry::getAllocator();
+        BX_FREE(allocator, m_tiles);
+        BX_FREE(allocator, m_frontier);
+        BX_FREE(allocator, m_next);
+        BX_FREE(allocator, m_temp);
+        m_tiles = nullptr;
+        m_frontier = nullptr;
+        m_next = nullptr;
+        m_temp = nullptr;
+        m_maxTiles = 0;
+    }
+
+    uint32_t DistanceSelector::select(const PyramidInfo& info, const SelectParams& params) {
+        if (m_maxTiles == 0 || info.numLevels == 0) {
+            return 0;
+        }
+
+        // Every tile counts once, refined ones stay wanted as ancestors
+        uint32_t numTiles = 0;
+        uint32_t numRefined = 0;
+        const uint32_t root = packTileId(info.numLevels - 1, 0, 0);
+        m_frontier[0] = sortKey(root, tileDistance(root, params));
+        uint32_t numFrontier = 1;
+
+        for (uint32_t level = info.numLevels - 1; numFrontier > 0; --level) {
+            bx::radixSort(m_frontier, m_temp, numFrontier);
+
+            // A texel of this level covers 2^level pixels at distance 1/lodFactor
+            const float refineDistance = float(1u << level) / bx::max(params.lodFactor, 1e-8f);
+            const uint32_t childWidth = level > 0 ? info.storedTilesX(level - 1) : 0;
+            const uint32_t childHeight = level > 0 ? info.storedTilesY(level - 1) : 0;
+            uint32_t numNext = 0;
+
+            for (uint32_t i = 0; i < numFrontier; ++i) {
+                const uint32_t id = uint32_t(m_frontier[i]);
+                const float distance = bx::bitsToFloat(uint32_t(m_frontier[i] >> 32));
+
+                uint32_t children[4];
+                uint32_t numChildren = 0;
+                if (level > 0 && distance < refineDistance) {
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        const uint32_t x = tileX(id) * 2 + (c & 1);
+                        const uint32_t y = tileY(id) * 2 + (c >> 1);
+                        if (x < childWidth && y < childHeight) {
+                            children[numChildren++] = packTileId(level - 1, x, y);
+                        }
+                    }
+                }
+
+                // Everything still pending must fit after the split
+                const uint32_t pending = numTiles + numRefined + numNext + (numFrontier - i);
+                if (numChildren > 0 && pending + numChildren <= m_maxTiles) {
+                    for (uint32_t c = 0; c < numChildren; ++c) {
+                        m_next[numNext++] = sortKey(children[c], tileDistance(children[c], params));
+                    }
+                    ++numRefined;
+                } else {
+                    m_tiles[numTiles++] = id;
+                }
+            }
+
+            uint64_t* swap = m_frontier;
+            m_frontier = m_next;
+            m_next = swap;
+            numFrontier = numNext;
+        }
+
+        return numTiles;
+    }
+} // namespace vt
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "vt_pyramid.h"
+
+// Camera driven tile selection for pyramids that have no feedback pass,
+// i.e. the heightmap, which is sampled by compute and vertex shaders. A
+// quadtree walk from the top level refines every tile closer than the
+// distance at which its texels shrink below the pixel target, so each
+// level ends up as a ring around the camera, much like a clipmap. No
+// frustum test: the set survives fast camera turns.
+namespace vt {
+    struct SelectParams {
+        // Camera in level 0 texels, z is its height above the highest
+        // terrain point (0 when below it)
+        float cameraX;
+        float cameraY;
+        float cameraZ;
+        // Level 0 texels per pixel at a distance of one texel, i.e.
+        // 2 tan(fovy / 2) / viewport height times the pixels per texel
+        // wanted
+        float lodFactor;
+    };
+
+    // How the pyramid lies in terrain space: the quad spans
+    // [-halfWidth, halfWidth] x [-halfHeight, halfHeight] with z up and
+    // heights in [0, heightScale]; texels are square. `lodFactor` is
+    // 2 tan(fovy / 2) divided by the viewport height.
+    struct TerrainView {
+        float halfWidth;
+        float halfHeight;
+        float heightScale;
+        float lodFactor;
+    };
+
+    // Params for a camera at `position`, in terrain space
+    SelectParams terrainSelectParams(const PyramidInfo& info, const TerrainView& view, const float* position);
+
+    // Distance from the camera to the tile's footprint, in level 0 texels
+    float tileDistance(uint32_t id, const SelectParams& params);
+
+    class DistanceSelector {
+    public:
+        DistanceSelector();
+        ~DistanceSelector();
+
+        // `maxTiles` bounds the selected tiles plus their ancestors, size it
+        // to the cache so the wanted set always fits
+        void init(uint32_t maxTiles);
+        void shutdown();
+
+        // Tiles are listed coarsest first, nearest first within a level.
+        // When the budget runs short the nearest tiles are refined first.
+        uint32_t select(const PyramidInfo& info, const SelectParams& params);
+        const uint32_t* getTiles() const { return m_tiles; }
+
+    private:
+        uint32_t* m_tiles;
+        uint64_t* m_frontier;
+        uint64_t* m_next;
+        uint64_t* m_temp;
+        uint32_t m_maxTiles;
+    };
+} // namespace vt
@@ -0,0 +1,223 @@
+#include "vt_texture.h"
+#include "../common/bgfx_utils.h"
+#include "../common/gpu_ledger.h"
+#include "../common/tracking_allocator.h"
+
+#include <bx/allocator.h>
+#include <bx/math.h>
+#include <entry/entry.h>
+
+namespace {
+    template <typename Handle>
+    void destroyHandle(Handle& handle) {
+        if (bgfx::isValid(handle)) {
+            bgfx::destroy(handle);
+            handle = BGFX_INVALID_HANDLE;
+        }
+    }
+
+    void destroyTexture(bgfx::TextureHandle& handle) {
+        if (bgfx::isValid(handle)) {
+            gpuDestroy(handle);
+            handle = BGFX_INVALID_HANDLE;
+        }
+    }
+} // namespace
+
+namespace vt {
+    VirtualTexture::VirtualTexture()
+        : m_feedbackColor(BGFX_INVALID_HANDLE)
+        , m_feedbackDepth(BGFX_INVALID_HANDLE)
+        , m_readback(BGFX_INVALID_HANDLE)
+        , m_feedbackFrameBuffer(BGFX_INVALID_HANDLE)
+        , m_paramsHandle(BGFX_INVALID_HANDLE)
+        , m_indirectionSampler(BGFX_INVALID_HANDLE)
+        , m_cacheSampler(BGFX_INVALID_HANDLE)
+        , m_programDraw(BGFX_INVALID_HANDLE)
+        , m_programFeedback(BGFX_INVALID_HANDLE)
+        , m_feedbackData(nullptr)
+        , m_retiredData(nullptr)
+        , m_feedbackCapacity(0)
+        , m_feedbackWidth(0)
+        , m_feedbackHeight(0)
+        , m_readbackFrame(0)
+        , m_feedbacks(0)
+        , m_prefetched(0)
+    {
+    }
+
+    VirtualTexture::~VirtualTexture() {
+        shutdown();
+        // bgfx::shutdown() has finished any readback by now
+        if (m_feedbackData) {
+            BX_FREE(entry::getAllocator(), m_feedbackData);
+        }
+        if (m_retiredData) {
+            BX_FREE(entry::getAllocator(), m_retiredData);
+        }
+    }
+
+    bool VirtualTexture::isSupported() {
+        const bgfx::Caps* caps = bgfx::getCaps();
+        return 0 != (caps->supported & BGFX_CAPS_TEXTURE_BLIT)
+            && 0 != (caps->supported & BGFX_CAPS_TEXTURE_READ_BACK)
+            && 0 != (caps->formats[bgfx::TextureFormat::RGBA8] & BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER);
+    }
+
+    bool VirtualTexture::init(const char* path, uint32_t width, uint32_t height) {
+        MEMORY_TAG_SCOPE("virtual texture");
+        shutdown();
+        if (!isSupported()) {
+            printf("Virtual texturing needs texture blit and read back\n");
+            return false;
+        }
+
+        if (!m_cache.init(path, CACHE_SLOTS, CACHE_SLOTS, "vt cache")) {
+            return false;
+        }
+        const PyramidInfo& info = m_cache.getInfo();
+        if (info.format != Format::RGBA8) {
+            printf("Virtual texture %s is not RGBA8\n", path);
+            m_cache.shutdown();
+            return false;
+        }
+
+        m_feedbackWidth = bx::max<uint32_t>(width / FEEDBACK_DIVISOR, 1);
+        m_feedbackHeight = bx::max<uint32_t>(height / FEEDBACK_DIVISOR, 1);
+        m_feedbackColor = gpuCreateTexture2D("vt feedback",
+            uint16_t(m_feedbackWidth), uint16_t(m_feedbackHeight), false, 1,
+            bgfx::TextureFormat::RGBA8,
+            BGFX_TEXTURE_RT | BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP
+        );
+        m_feedbackDepth = gpuCreateTexture2D("vt feedback",
+            uint16_t(m_feedbackWidth), uint16_t(m_feedbackHeight), false, 1,
+            bgfx::TextureFormat::D24S8,
+            BGFX_TEXTURE_RT_WRITE_ONLY
+        );
+        bgfx::TextureHandle attachments[] = { m_feedbackColor, m_feedbackDepth };
+        m_feedbackFrameBuffer = bgfx::createFrameBuffer(BX_COUNTOF(attachments), attachments, false);
+        m_readback = gpuCreateTexture2D("vt feedback",
+            uint16_t(m_feedbackWidth), uint16_t(m_feedbackHeight), false, 1,
+            bgfx::TextureFormat::RGBA8,
+            BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK | BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP
+        );
+
+        const uint32_t texels = m_feedbackWidth * m_feedbackHeight;
+        if (texels > m_feedbackCapacity) {
+            m_feedbackData = (uint32_t*)BX_REALLOC(entry::getAllocator(), m_feedbackData, texels * sizeof(uint32_t));
+            m_feedbackCapacity = texels;
+        }
+
+        m_paramsHandle = bgfx::createUniform("u_vtParams", bgfx::UniformType::Vec4, 2);
+        m_indirectionSampler = bgfx::createUniform("u_VtIndirectionSampler", bgfx::UniformType::Sampler);
+        m_cacheSampler = bgfx::createUniform("u_VtCacheSampler", bgfx::UniformType::Sampler);
+        m_programDraw = loadProgram("vs_terrain_render", "fs_terrain_render_vt");
+        m_programFeedback = loadProgram("vs_terrain_render", "fs_terrain_vt_feedback");
+
+        m_planner.init(CACHE_SLOTS * CACHE_SLOTS);
+        m_feedbacks = 0;
+        m_prefetched = 0;
+        printf("Virtual texture %s: %ux%u, %u levels, %u cache slots\n",
+            path, info.width, info.height, info.numLevels, CACHE_SLOTS * CACHE_SLOTS);
+        return true;
+    }
+
+    void VirtualTexture::shutdown() {
+        m_cache.shutdown();
+        m_planner.shutdown();
+
+        destroyHandle(m_feedbackFrameBuffer);
+        destroyTexture(m_feedbackColor);
+        destroyTexture(m_feedbackDepth);
+        destroyTexture(m_readback);
+        destroyHandle(m_paramsHandle);
+        destroyHandle(m_indirectionSampler);
+        destroyHandle(m_cacheSampler);
+        destroyHandle(m_programDraw);
+        destroyHandle(m_programFeedback);
+
+        // bgfx still copies a pending readback into the buffer, init() must
+        // not move or free it before then
+        if (m_readbackFrame != 0 && m_retiredData == nullptr) {
+            m_retiredData = m_feedbackData;
+            m_feedbackData = nullptr;
+            m_feedbackCapacity = 0;
+        }
+    }
+
+    void VirtualTexture::prefetch(const CameraPredictor::Forecast* forecasts, uint32_t numForecasts, const TerrainView& view) {
+        MEMORY_TAG_SCOPE("virtual texture");
+        if (!isValid()) {
+            return;
+        }
+
+        m_prefetched = m_planner.plan(m_cache.getInfo(), view, forecasts, numForecasts,
+            nullptr, 0, m_cache.getPrefetchCapacity());
+        m_cache.setPrefetch(m_planner.getTiles(), m_prefetched);
+    }
+
+    void VirtualTexture::update(uint32_t frameNumber) {
+        MEMORY_TAG_SCOPE("virtual texture");
+        if (!isValid()) {
+            return;
+        }
+
+        if (m_readbackFrame != 0 && frameNumber >= m_readbackFrame) {
+            if (m_retiredData) {
+                // Feedback of the texture before init(), of no use now
+                BX_FREE(entry::getAllocator(), m_retiredData);
+                m_retiredData = nullptr;
+            } else {
+                m_cache.setWanted(m_feedbackData, m_feedbackWidth * m_feedbackHeight, frameNumber);
+                ++m_feedbacks;
+            }
+            m_readbackFrame = 0;
+        }
+
+        m_cache.update();
+    }
+
+    void VirtualTexture::setupViews(bgfx::ViewId feedbackView, bgfx::ViewId blitView, const float* viewMtx, const float* projMtx) {
+        // Cleared to kInvalidTile where no terrain is drawn
+        bgfx::setViewName(feedbackView, "vt feedback");
+        bgfx::setViewFrameBuffer(feedbackView, m_feedbackFrameBuffer);
+        bgfx::setViewRect(feedbackView, 0, 0, uint16_t(m_feedbackWidth), uint16_t(m_feedbackHeight));
+        bgfx::setViewClear(feedbackView, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0xffffffff, 1.0f, 0);
+        bgfx::setViewTransform(feedbackView, viewMtx, projMtx);
+        bgfx::setViewName(blitView, "vt readback");
+    }
+
+    void VirtualTexture::readFeedback(bgfx::ViewId blitView) {
+        bgfx::blit(blitView, m_readback, 0, 0, m_feedbackColor);
+        m_readbackFrame = bgfx::readTexture(m_readback, m_feedbackData);
+    }
+
+    void VirtualTexture::setDrawState() {
+        setUniforms(0.0f);
+    }
+
+    void VirtualTexture::setFeedbackState() {
+        // Derivatives are FEEDBACK_DIVISOR times larger at the lower resolution
+        setUniforms(-bx::log2(float(FEEDBACK_DIVISOR)));
+    }
+
+    VirtualTexture::Stats VirtualTexture::getStats() const {
+        Stats stats;
+        stats.cache = m_cache.getStats();
+        stats.feedbacks = m_feedbacks;
+        stats.prefetched = m_prefetched;
+        return stats;
+    }
+
+    void VirtualTexture::setUniforms(float lodBias) {
+        const PyramidInfo& info = m_cache.getInfo();
+        const float virtualSize = float(info.tiles * kTileSize);
+        const float params[8] = {
+            float(info.tiles), float(info.numLevels), lodBias, 0.0f,
+            float(info.width) / virtualSize, float(info.height) / virtualSize, float(CACHE_SLOTS), 0.0f,
+        };
+        bgfx::setUniform(m_paramsHandle, params, 2);
+        bgfx::setTexture(6, m_indirectionSampler, m_cache.getIndirection());
+        bgfx::setTexture(7, m_cacheSampler, m_cache.getCache());
+    }
+} // namespace vt
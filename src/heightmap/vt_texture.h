@@ -0,0 +1,91 @@
+#pragma once
+
+#include "vt_cache.h"
+#include "vt_prefetch.h"
+
+#include <bgfx/bgfx.h>
+
+// Virtual texture for the diffuse image: a TileCache fed by a feedback
+// render target and its readback. The
+// terrain is drawn twice, once with the program from getDrawProgram() and
+// once, at reduced resolution, with getFeedbackProgram(); the feedback
+// image read back a few frames later drives the residency. Feedback only
+// sees what is on screen, so tiles near the forecast cameras are
+// prefetched into the slots it leaves free.
+namespace vt {
+    class VirtualTexture {
+    public:
+        static constexpr uint32_t CACHE_SLOTS = 16;       // per axis
+        static constexpr uint32_t FEEDBACK_DIVISOR = 8;   // per axis
+
+        struct Stats {
+            TileCache::Stats cache;
+            uint32_t feedbacks;     // feedback images processed
+            uint32_t prefetched;    // tiles the last forecasts want
+        };
+
+        VirtualTexture();
+        ~VirtualTexture();
+
+        // Needs texture blit and read back support
+        static bool isSupported();
+
+        // `width` x `height` is the back buffer size
+        bool init(const char* path, uint32_t width, uint32_t height);
+        void shutdown();
+        bool isValid() const { return m_cache.isValid(); }
+
+        // Tiles the camera is expected to want, call before update().
+        // `forecasts` are in terrain space, see vt::TerrainView.
+        void prefetch(const CameraPredictor::Forecast* forecasts, uint32_t numForecasts, const TerrainView& view);
+
+        // Consumes finished feedback, queues tile loads and uploads the
+        // tiles and indirection texels that changed. `frameNumber` is the
+        // value returned by the last bgfx::frame().
+        void update(uint32_t frameNumber);
+
+        // The feedback view renders into the feedback target, the blit view
+        // copies it to the readback texture
+        void setupViews(bgfx::ViewId feedbackView, bgfx::ViewId blitView, const float* viewMtx, const float* projMtx);
+        // False while the previous readback is pending, skip the feedback draw.
+        // A readback pending at shutdown() still counts, so a new one waits
+        // until the stale one has landed.
+        bool wantsFeedback() const { return m_readbackFrame == 0; }
+        void readFeedback(bgfx::ViewId blitView);
+
+        // Bind before submitting the respective draw
+        void setDrawState();
+        void setFeedbackState();
+        bgfx::ProgramHandle getDrawProgram() const { return m_programDraw; }
+        bgfx::ProgramHandle getFeedbackProgram() const { return m_programFeedback; }
+
+        Stats getStats() const;
+
+    private:
+        void setUniforms(float lodBias);
+
+        TileCache m_cache;
+        PrefetchPlanner m_planner;
+
+        bgfx::TextureHandle m_feedbackColor;
+        bgfx::TextureHandle m_feedbackDepth;
+        bgfx::TextureHandle m_readback;
+        bgfx::FrameBufferHandle m_feedbackFrameBuffer;
+        bgfx::UniformHandle m_paramsHandle;
+        bgfx::UniformHandle m_indirectionSampler;
+        bgfx::UniformHandle m_cacheSampler;
+        bgfx::ProgramHandle m_programDraw;
+        bgfx::ProgramHandle m_programFeedback;
+
+        // Kept across shutdown() unless a readback is pending, then it moves
+        // to m_retiredData until that lands and init() allocates anew
+        uint32_t* m_feedbackData;
+        uint32_t* m_retiredData;
+        uint32_t m_feedbackCapacity;
+        uint32_t m_feedbackWidth;
+        uint32_t m_feedbackHeight;
+        uint32_t m_readbackFrame;
+        uint32_t m_feedbacks;
+        uint32_t m_prefetched;
+    };
+} // namespace vt
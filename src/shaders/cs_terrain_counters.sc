@@ -0,0 +1,13 @@
+#include "bgfx_compute.sh"
+
+BUFFER_RO(atomicCounterBuffer, uint, 4);
+UIMAGE2D_WR(u_CounterImage, r32ui, 0);
+
+// Buffers can't be read back, the counters go through a 3x1 image
+NUM_THREADS(3u, 1u, 1u)
+void main()
+{
+	uint id = gl_LocalInvocationID.x;
+
+	imageStore(u_CounterImage, ivec2(id, 0), uvec4(atomicCounterBuffer[id], 0u, 0u, 0u));
+}
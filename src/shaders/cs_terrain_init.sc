@@ -19,6 +19,7 @@ void main()
 
 	drawIndexedIndirect(indirectBuffer, 0u, subd, 0u, 0u, 0u, 0u);
 	dispatchIndirect(indirectBuffer, 1u, 2u / UPDATE_INDIRECT_VALUE_DIVIDE + 1u, 1u, 1u);
+	dispatchIndirect(indirectBuffer, 2u, 2u / UPDATE_INDIRECT_VALUE_DIVIDE + 1u, 1u, 1u);
 
 	u_SubdBufferOut[0] = 0;
 	u_SubdBufferOut[1] = 1;
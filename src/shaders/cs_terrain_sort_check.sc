@@ -0,0 +1,48 @@
+#include "bgfx_compute.sh"
+#include "uniforms.sh"
+
+BUFFER_RO(u_SortedSubdBuffer, uint, 1);
+BUFFER_RO(u_CulledSubdBuffer, uint, 2);
+BUFFER_RO(atomicCounterBuffer, uint, 4);
+UIMAGE2D_WR(u_SortCheckImage, r32ui, 0);
+
+/**
+ * Sort Check Copy Shader
+ *
+ * Buffers can't be read back, so the culled keys go to the first
+ * SORT_CHECK_ROWS rows of the image, the sorted keys to the next ones and
+ * the culled count to the last row. The CPU checks the sort against
+ * lebsort::sortReference(); frames with more keys than fit are skipped.
+ */
+
+NUM_THREADS(64u, 1u, 1u)
+void main()
+{
+	uint x = gl_GlobalInvocationID.x;
+	uint y = gl_GlobalInvocationID.y;
+	uint count = atomicCounterBuffer[1];
+	uint value = 0u;
+
+	if (y < SORT_CHECK_ROWS)
+	{
+		uint id = y*SORT_CHECK_WIDTH + x;
+		if (id < count)
+		{
+			value = u_CulledSubdBuffer[id];
+		}
+	}
+	else if (y < 2u*SORT_CHECK_ROWS)
+	{
+		uint id = (y - SORT_CHECK_ROWS)*SORT_CHECK_WIDTH + x;
+		if (id < count)
+		{
+			value = u_SortedSubdBuffer[id];
+		}
+	}
+	else if (x == 0u)
+	{
+		value = count;
+	}
+
+	imageStore(u_SortCheckImage, ivec2(x, y), uvec4(value, 0u, 0u, 0u));
+}
@@ -0,0 +1,52 @@
+#include "bgfx_compute.sh"
+#include "uniforms.sh"
+#include "isubd.sh"
+#include "keysort.sh"
+
+BUFFER_RO(u_CulledSubdBuffer, uint, 2);
+BUFFER_RW(atomicCounterBuffer, uint, 4);
+BUFFER_RW(u_SortHistogram, uint, 5);
+
+SHARED uint s_counts[SORT_BUCKET_COUNT];
+
+/**
+ * Sort Histogram Shader
+ *
+ * The culled keys are split into SORT_TILE_COUNT contiguous tiles, one
+ * workgroup each. Every workgroup counts the keys of its tile that fall
+ * in each sort bucket and writes the counts bucket-major, at
+ * bucket*SORT_TILE_COUNT + tile, so that scanning the buffer in order
+ * visits the tiles of a bucket in input order.
+ */
+
+NUM_THREADS(SORT_TILE_THREADS, 1u, 1u)
+void main()
+{
+	uint tile  = gl_WorkGroupID.x;
+	uint local = gl_LocalInvocationID.x;
+
+	for (uint i = local; i < SORT_BUCKET_COUNT; i += SORT_TILE_THREADS)
+	{
+		s_counts[i] = 0u;
+	}
+	barrier();
+
+	uint count   = atomicCounterBuffer[1] / 2u;
+	uint perTile = (count + SORT_TILE_COUNT - 1u) / SORT_TILE_COUNT;
+	uint begin   = min(tile*perTile, count);
+	uint end     = min(begin + perTile, count);
+
+	for (uint id = begin + local; id < end; id += SORT_TILE_THREADS)
+	{
+		uint primID = u_CulledSubdBuffer[id*2u];
+		uint key    = u_CulledSubdBuffer[id*2u+1u];
+
+		atomicAdd(s_counts[keyToSortBucket(primID, key)], 1u);
+	}
+	barrier();
+
+	for (uint i = local; i < SORT_BUCKET_COUNT; i += SORT_TILE_THREADS)
+	{
+		u_SortHistogram[i*SORT_TILE_COUNT + tile] = s_counts[i];
+	}
+}
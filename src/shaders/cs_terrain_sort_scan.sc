@@ -0,0 +1,49 @@
+#include "bgfx_compute.sh"
+#include "uniforms.sh"
+
+BUFFER_RW(u_SortHistogram, uint, 5);
+
+SHARED uint s_sums[SORT_SCAN_THREADS];
+
+#define SORT_SCAN_RANGE (SORT_BUCKET_COUNT*SORT_TILE_COUNT/SORT_SCAN_THREADS)
+
+/**
+ * Sort Prefix-Sum Shader
+ *
+ * Turns the per-tile bucket counts into exclusive offsets in place. The
+ * counts are bucket-major, so the offset of a tile's keys in a bucket
+ * follows every key of the lower buckets and of the earlier tiles in the
+ * same bucket, which is what keeps the sort stable. Every thread sums a
+ * contiguous range, the ranges are scanned, then every thread writes the
+ * offsets of its range.
+ */
+
+NUM_THREADS(SORT_SCAN_THREADS, 1u, 1u)
+void main()
+{
+	uint local = gl_LocalInvocationID.x;
+	uint begin = local*SORT_SCAN_RANGE;
+
+	uint sum = 0u;
+	for (uint i = 0u; i < SORT_SCAN_RANGE; ++i)
+	{
+		sum += u_SortHistogram[begin + i];
+	}
+	s_sums[local] = sum;
+	barrier();
+
+	uint offset = 0u;
+	for (uint i = 0u; i < local; ++i)
+	{
+		offset += s_sums[i];
+	}
+
+	for (uint i = 0u; i < SORT_SCAN_RANGE; ++i)
+	{
+		uint count = u_SortHistogram[begin + i];
+
+		u_SortHistogram[begin + i] = offset;
+
+		offset += count;
+	}
+}
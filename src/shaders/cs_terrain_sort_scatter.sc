@@ -0,0 +1,90 @@
+#include "bgfx_compute.sh"
+#include "uniforms.sh"
+#include "isubd.sh"
+#include "keysort.sh"
+
+BUFFER_RW(u_SortedSubdBuffer, uint, 1);
+BUFFER_RO(u_CulledSubdBuffer, uint, 2);
+BUFFER_RW(atomicCounterBuffer, uint, 4);
+BUFFER_RO(u_SortHistogram, uint, 5);
+
+SHARED uint s_offsets[SORT_BUCKET_COUNT];
+SHARED uint s_buckets[SORT_TILE_THREADS];
+
+/**
+ * Sort Scatter Shader
+ *
+ * Writes every culled key to its slot in the sorted buffer, so that the
+ * instances of the indirect draw are grouped by terrain region. Every
+ * workgroup walks its tile SORT_TILE_THREADS keys at a time, in order.
+ * A key's slot is its tile's offset for the bucket, advanced by the keys
+ * of the bucket in the earlier steps, plus its rank among the threads of
+ * the step before it with the same bucket. Keys of a bucket keep their
+ * input order, the sort is stable.
+ */
+
+NUM_THREADS(SORT_TILE_THREADS, 1u, 1u)
+void main()
+{
+	uint tile  = gl_WorkGroupID.x;
+	uint local = gl_LocalInvocationID.x;
+
+	for (uint i = local; i < SORT_BUCKET_COUNT; i += SORT_TILE_THREADS)
+	{
+		s_offsets[i] = u_SortHistogram[i*SORT_TILE_COUNT + tile];
+	}
+	barrier();
+
+	uint count   = atomicCounterBuffer[1] / 2u;
+	uint perTile = (count + SORT_TILE_COUNT - 1u) / SORT_TILE_COUNT;
+	uint begin   = min(tile*perTile, count);
+	uint end     = min(begin + perTile, count);
+
+	// The bounds are the same for the whole workgroup, every thread runs
+	// every step and reaches the barriers
+	for (uint first = begin; first < end; first += SORT_TILE_THREADS)
+	{
+		uint id     = first + local;
+		bool valid  = id < end;
+		uint primID = 0u;
+		uint key    = 0u;
+		uint bucket = SORT_BUCKET_COUNT;
+
+		if (valid)
+		{
+			primID = u_CulledSubdBuffer[id*2u];
+			key    = u_CulledSubdBuffer[id*2u+1u];
+			bucket = keyToSortBucket(primID, key);
+		}
+
+		s_buckets[local] = bucket;
+		barrier();
+
+		uint rank = 0u;
+		bool last = true;
+		for (uint j = 0u; j < SORT_TILE_THREADS; ++j)
+		{
+			if (s_buckets[j] == bucket)
+			{
+				rank += j < local ? 1u : 0u;
+				last  = last && j <= local;
+			}
+		}
+
+		if (valid)
+		{
+			uint slot = s_offsets[bucket] + rank;
+
+			u_SortedSubdBuffer[slot*2u]    = primID;
+			u_SortedSubdBuffer[slot*2u+1u] = key;
+		}
+		barrier();
+
+		// The last thread of a bucket moves it past the step's keys
+		if (valid && last)
+		{
+			s_offsets[bucket] += rank + 1u;
+		}
+		barrier();
+	}
+}
@@ -16,4 +16,7 @@ void main()
 	}
 
 	drawIndexedIndirect(indirectBuffer, 0, subd, counter / 2, 0u, 0u, 0u);
+
+	// one thread per culled key for the optional sort passes
+	dispatchIndirect(indirectBuffer, 2u, (counter / 2u) / UPDATE_INDIRECT_VALUE_DIVIDE + 1u, 1u, 1u);
 }
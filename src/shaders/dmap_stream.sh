@@ -0,0 +1,53 @@
+/**
+ * Streamed Heightmap Sampling
+ *
+ * Heightmaps beyond the texture size limit are streamed from an R16 tile
+ * pyramid (see vt_pyramid.h and dmap_stream.h). The CPU keeps the tiles
+ * around the camera resident, so the finest resident level is the one to
+ * use: level 0 of the indirection texture already points every tile at
+ * the best resident tile covering it, which is then read from the
+ * physical cache with the same border layout as the virtual texture.
+ */
+uniform vec4 u_dmapStreamParams[2];
+#define u_dmapStreamed u_dmapStreamParams[0].x
+#define u_dmapStreamTiles u_dmapStreamParams[0].y
+#define u_dmapStreamSize u_dmapStreamParams[0].zw
+#define u_dmapStreamUvScale u_dmapStreamParams[1].xy
+#define u_dmapStreamSlots u_dmapStreamParams[1].zw
+
+SAMPLER2D(u_DmapIndirectionSampler, 9);
+SAMPLER2D(u_DmapCacheSampler, 10);
+
+// must match vt_pyramid.h
+#define DMAP_TILE_SIZE 128.0
+#define DMAP_TILE_BORDER 4.0
+#define DMAP_TILE_STRIDE 136.0
+
+float dmapStreamSample(vec2 uv)
+{
+	// the far edge would land on the first tile past the image
+	vec2 vuv = clamp(uv, vec2_splat(0.0), vec2_splat(0.99999)) * u_dmapStreamUvScale;
+	vec4 entry = floor(texture2DLod(u_DmapIndirectionSampler, vuv, 0.0) * 255.0 + 0.5);
+
+	// nothing resident yet
+	if (entry.w < 128.0)
+		return 0.0;
+
+	vec2 tileCoord = vuv * (u_dmapStreamTiles / exp2(entry.z));
+	vec2 inTile = tileCoord - floor(tileCoord);
+	vec2 texel = entry.xy * DMAP_TILE_STRIDE + DMAP_TILE_BORDER + inTile * DMAP_TILE_SIZE;
+
+	return texture2DLod(u_DmapCacheSampler, texel / (u_dmapStreamSlots * DMAP_TILE_STRIDE), 0.0).x;
+}
+
+// Central differences one level 0 texel apart, in the slope map's units
+vec2 dmapStreamSlope(vec2 uv)
+{
+	vec2 e = 1.0 / u_dmapStreamSize;
+	float z_l = dmapStreamSample(uv - vec2(e.x, 0.0));
+	float z_r = dmapStreamSample(uv + vec2(e.x, 0.0));
+	float z_b = dmapStreamSample(uv - vec2(0.0, e.y));
+	float z_t = dmapStreamSample(uv + vec2(0.0, e.y));
+
+	return vec2(z_r - z_l, z_t - z_b) * 0.5 * u_dmapStreamSize;
+}
@@ -5,7 +5,7 @@ $input v_texcoord0 // 这个是从顶点着色器传来的 UV 坐标，正好用
 void main()
 {
     // 1. 计算法线 (来自坡度图)
-    vec2 s = texture2D(u_SmapSampler, v_texcoord0).rg * u_DmapFactor;
+    vec2 s = terrainSlope(v_texcoord0) * u_DmapFactor;
     vec3 n = normalize(vec3(-s, 1.0)); // 得到表面法线
 
     // 2. 计算一个简单的光照因子 (例如，模拟来自上方的定向光 NdotL)
@@ -4,7 +4,7 @@ $input v_texcoord0
 
 void main()
 {
-	vec2 s = texture2D(u_SmapSampler, v_texcoord0).rg * u_DmapFactor;
+	vec2 s = terrainSlope(v_texcoord0) * u_DmapFactor;
 	vec3 n = normalize(vec3(-s, 1));
 	gl_FragColor = vec4(abs(n), 1);
 }
@@ -0,0 +1,15 @@
+$input v_texcoord0
+
+#include "terrain_common.sh"
+#include "vt.sh"
+
+void main()
+{
+	vec2 s = terrainSlope(v_texcoord0) * u_DmapFactor;
+	vec3 n = normalize(vec3(-s, 1.0));
+	float lightFactor = clamp(n.z, 0.1, 1.0);
+
+	vec4 diffuseTexColor = vtSample(v_texcoord0);
+
+	gl_FragColor = vec4(diffuseTexColor.rgb * lightFactor, 1.0);
+}
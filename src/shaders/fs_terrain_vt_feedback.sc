@@ -0,0 +1,24 @@
+$input v_texcoord0
+
+#include "terrain_common.sh"
+#include "vt.sh"
+
+/**
+ * Writes the id of the tile this pixel wants, as vt::packTileId() builds
+ * it (level << 28 | y << 14 | x), one byte per channel with the lowest in
+ * red. The target is cleared to 0xffffffff, vt::kInvalidTile.
+ */
+void main()
+{
+	vec2 vuv = vtVirtualUv(v_texcoord0);
+	float level = vtMipLevel(vuv);
+	float tiles = u_vtTiles / exp2(level);
+	vec2 tile = clamp(floor(vuv * tiles), vec2_splat(0.0), vec2_splat(tiles - 1.0));
+
+	float b0 = mod(tile.x, 256.0);
+	float b1 = floor(tile.x / 256.0) + mod(tile.y, 4.0) * 64.0;
+	float b2 = mod(floor(tile.y / 4.0), 256.0);
+	float b3 = floor(tile.y / 1024.0) + level * 16.0;
+
+	gl_FragColor = vec4(b0, b1, b2, b3) / 255.0;
+}
@@ -0,0 +1,20 @@
+/**
+ * Culled Key Bucketing
+ *
+ * Maps a (primID, key) pair to one of SORT_BUCKET_COUNT buckets such that
+ * bucket order follows the bisection order of the keys. The path bits
+ * below the key's leading one are left-aligned so that keys of different
+ * depths that cover the same region of the terrain land in the same
+ * bucket. The top bit selects the coarse triangle (there are two).
+ */
+uint keyToSortBucket(uint primID, uint key)
+{
+	uint bits  = SORT_BUCKET_BITS - 1u;
+	uint depth = findMSB_(key);
+	uint path  = key ^ (1u << depth);
+	uint aligned = depth >= bits
+		? (path >> (depth - bits))
+		: (path << (bits - depth));
+
+	return ((primID << bits) | aligned) & (SORT_BUCKET_COUNT - 1u);
+}
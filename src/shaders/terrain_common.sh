@@ -2,6 +2,7 @@
 #include "matrices.sh"
 #include "isubd.sh"
 #include "uniforms.sh"
+#include "dmap_stream.sh"
 
 BUFFER_RW(u_AtomicCounterBuffer, uint, 4);
 BUFFER_RW(u_SubdBufferOut, uint, 1);
@@ -22,10 +23,22 @@ float dmap(vec2 pos)
     // Map pos.y to [0, 1]
     uv.y = (pos.y + u_terrainHalfHeight) / (2.0 * u_terrainHalfHeight);
 
+    if (u_dmapStreamed != 0.0)
+        return dmapStreamSample(uv) * u_DmapFactor;
+
     // Use calculated uv for sampling
     return (texture2DLod(u_DmapSampler, uv, 0.0).x) * u_DmapFactor;
 }
 
+// slope map, or its streamed equivalent
+vec2 terrainSlope(vec2 uv)
+{
+    if (u_dmapStreamed != 0.0)
+        return dmapStreamSlope(uv);
+
+    return texture2D(u_SmapSampler, uv).rg;
+}
+
 float distanceToLod(float z, float lodFactor)
 {
 	// Note that we multiply the result by two because the triangles
@@ -77,6 +90,11 @@ void updateSubdBuffer(
 	// extract subdivision level associated to the key
 	uint keyLod = findMSB_(key);
 
+	// never go deeper than the heightmap resolution supports; keys that
+	// are already past the bound get merged back
+	targetLod = min(targetLod, u_maxKeyDepth);
+	parentLod = min(parentLod, u_maxKeyDepth);
+
 	// update the key accordingly
 	if (/* subdivide ? */ keyLod < targetLod && !isLeafKey(key) && isVisible)
 	{
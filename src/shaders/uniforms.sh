@@ -10,7 +10,16 @@ uniform vec4 u_aspectParams;
 #define u_cull u_params[0].z
 #define u_freeze u_params[0].w
 #define u_gpu_subd  int(u_params[1].x)
+#define u_maxKeyDepth uint(u_params[1].y)
 
 
 #define COMPUTE_THREAD_COUNT 32u
 #define UPDATE_INDIRECT_VALUE_DIVIDE 32u
+
+#define SORT_BUCKET_BITS 10u
+#define SORT_BUCKET_COUNT (1u << SORT_BUCKET_BITS)
+#define SORT_TILE_COUNT 128u
+#define SORT_TILE_THREADS 64u
+#define SORT_SCAN_THREADS 256u
+#define SORT_CHECK_WIDTH 1024u
+#define SORT_CHECK_ROWS 128u
@@ -0,0 +1,57 @@
+/**
+ * Virtual Texture Sampling
+ *
+ * The diffuse image lives in a tile pyramid (see vt_pyramid.h). A point
+ * sampled indirection texture with one texel per virtual tile and one mip
+ * per pyramid level gives the cache slot and level of the best resident
+ * tile; the texel is then fetched from the physical cache, whose tiles
+ * carry a VT_TILE_BORDER texel border for bilinear filtering.
+ */
+uniform vec4 u_vtParams[2];
+#define u_vtTiles u_vtParams[0].x
+#define u_vtNumLevels u_vtParams[0].y
+#define u_vtLodBias u_vtParams[0].z
+#define u_vtUvScale u_vtParams[1].xy
+#define u_vtCacheSlots u_vtParams[1].z
+
+SAMPLER2D(u_VtIndirectionSampler, 6);
+SAMPLER2D(u_VtCacheSampler, 7);
+
+// must match vt_pyramid.h
+#define VT_TILE_SIZE 128.0
+#define VT_TILE_BORDER 4.0
+#define VT_TILE_STRIDE 136.0
+
+// The image fills the top left corner of the power-of-two virtual texture
+vec2 vtVirtualUv(vec2 uv)
+{
+	return uv * u_vtUvScale;
+}
+
+// Pyramid level wanted at this pixel, from level 0 texel derivatives
+float vtMipLevel(vec2 vuv)
+{
+	vec2 texels = vuv * (u_vtTiles * VT_TILE_SIZE);
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + u_vtLodBias;
+
+	return clamp(floor(lod), 0.0, u_vtNumLevels - 1.0);
+}
+
+vec4 vtSample(vec2 uv)
+{
+	vec2 vuv = vtVirtualUv(uv);
+	float level = vtMipLevel(vuv);
+	vec4 entry = floor(texture2DLod(u_VtIndirectionSampler, vuv, level) * 255.0 + 0.5);
+
+	// nothing resident yet
+	if (entry.w < 128.0)
+		return vec4(0.5, 0.5, 0.5, 1.0);
+
+	vec2 tileCoord = vuv * (u_vtTiles / exp2(entry.z));
+	vec2 inTile = tileCoord - floor(tileCoord);
+	vec2 texel = entry.xy * VT_TILE_STRIDE + VT_TILE_BORDER + inTile * VT_TILE_SIZE;
+
+	return texture2DLod(u_VtCacheSampler, texel / (u_vtCacheSlots * VT_TILE_STRIDE), 0.0);
+}